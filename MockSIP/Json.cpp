@@ -0,0 +1,671 @@
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "Json.h"
+
+namespace
+{
+	class Parser
+	{
+	public:
+
+		Parser(const std::string& text) : m_text(text), m_pos(0) {}
+
+		bool parseDocument(JsonValue* value, std::string* error)
+		{
+			if (!parseValue(value, 0))
+			{
+				*error = m_error + " at character " + std::to_string(m_pos);
+				return false;
+			}
+			skipSpace();
+			if (m_pos != m_text.size())
+			{
+				*error = "unexpected text after the value at character " + std::to_string(m_pos);
+				return false;
+			}
+			return true;
+		}
+
+	private:
+
+		bool fail(const std::string& error)
+		{
+			m_error = error;
+			return false;
+		}
+
+		void skipSpace()
+		{
+			while (m_pos < m_text.size() && (m_text[m_pos] == ' ' || m_text[m_pos] == '\t' || m_text[m_pos] == '\r' || m_text[m_pos] == '\n'))
+			{
+				m_pos++;
+			}
+		}
+
+		bool consume(const char* word)
+		{
+			size_t length = strlen(word);
+			if (m_text.compare(m_pos, length, word) != 0)
+			{
+				return false;
+			}
+			m_pos += length;
+			return true;
+		}
+
+		bool parseValue(JsonValue* value, int depth)
+		{
+			//schemas don't nest anywhere near this deep, it just stops a bad message blowing the stack
+			if (depth > MAX_DEPTH)
+			{
+				return fail("nested too deeply");
+			}
+
+			skipSpace();
+			if (m_pos >= m_text.size())
+			{
+				return fail("unexpected end of text");
+			}
+
+			char c = m_text[m_pos];
+			if (c == '{')
+			{
+				return parseObject(value, depth);
+			}
+			if (c == '[')
+			{
+				return parseArray(value, depth);
+			}
+			if (c == '"')
+			{
+				std::string text;
+				if (!parseString(&text))
+				{
+					return false;
+				}
+				*value = JsonValue(text);
+				return true;
+			}
+			if (consume("true"))
+			{
+				*value = JsonValue(true);
+				return true;
+			}
+			if (consume("false"))
+			{
+				*value = JsonValue(false);
+				return true;
+			}
+			if (consume("null"))
+			{
+				*value = JsonValue();
+				return true;
+			}
+			return parseNumber(value);
+		}
+
+		bool parseObject(JsonValue* value, int depth)
+		{
+			*value = JsonValue::makeObject();
+			m_pos++;
+			while (true)
+			{
+				skipSpace();
+				if (m_pos < m_text.size() && m_text[m_pos] == '}')
+				{
+					m_pos++;
+					return true;
+				}
+
+				std::string name;
+				if (m_pos >= m_text.size() || m_text[m_pos] != '"')
+				{
+					return fail("expected a member name");
+				}
+				if (!parseString(&name))
+				{
+					return false;
+				}
+				skipSpace();
+				if (m_pos >= m_text.size() || m_text[m_pos] != ':')
+				{
+					return fail("expected ':'");
+				}
+				m_pos++;
+
+				JsonValue member;
+				if (!parseValue(&member, depth + 1))
+				{
+					return false;
+				}
+				value->set(name, member);
+
+				skipSpace();
+				if (m_pos < m_text.size() && m_text[m_pos] == ',')
+				{
+					m_pos++;
+				}
+				else if (m_pos >= m_text.size() || m_text[m_pos] != '}')
+				{
+					return fail("expected ',' or '}'");
+				}
+			}
+		}
+
+		bool parseArray(JsonValue* value, int depth)
+		{
+			*value = JsonValue::makeArray();
+			m_pos++;
+			while (true)
+			{
+				skipSpace();
+				if (m_pos < m_text.size() && m_text[m_pos] == ']')
+				{
+					m_pos++;
+					return true;
+				}
+
+				JsonValue element;
+				if (!parseValue(&element, depth + 1))
+				{
+					return false;
+				}
+				value->append(element);
+
+				skipSpace();
+				if (m_pos < m_text.size() && m_text[m_pos] == ',')
+				{
+					m_pos++;
+				}
+				else if (m_pos >= m_text.size() || m_text[m_pos] != ']')
+				{
+					return fail("expected ',' or ']'");
+				}
+			}
+		}
+
+		bool parseString(std::string* text)
+		{
+			m_pos++;
+			while (m_pos < m_text.size())
+			{
+				char c = m_text[m_pos++];
+				if (c == '"')
+				{
+					return true;
+				}
+				if (c != '\\')
+				{
+					*text += c;
+					continue;
+				}
+
+				if (m_pos >= m_text.size())
+				{
+					break;
+				}
+				char escape = m_text[m_pos++];
+				switch (escape)
+				{
+				case '"': *text += '"'; break;
+				case '\\': *text += '\\'; break;
+				case '/': *text += '/'; break;
+				case 'b': *text += '\b'; break;
+				case 'f': *text += '\f'; break;
+				case 'n': *text += '\n'; break;
+				case 'r': *text += '\r'; break;
+				case 't': *text += '\t'; break;
+				case 'u':
+				{
+					//written out as UTF-8, surrogate pairs aren't joined (none of the messages need them)
+					if (m_pos + 4 > m_text.size() || m_text.substr(m_pos, 4).find_first_not_of("0123456789abcdefABCDEF") != std::string::npos)
+					{
+						return fail("bad \\u escape");
+					}
+					unsigned long code = strtoul(m_text.substr(m_pos, 4).c_str(), nullptr, 16);
+					m_pos += 4;
+					if (code < 0x80)
+					{
+						*text += (char)code;
+					}
+					else if (code < 0x800)
+					{
+						*text += (char)(0xC0 | (code >> 6));
+						*text += (char)(0x80 | (code & 0x3F));
+					}
+					else
+					{
+						*text += (char)(0xE0 | (code >> 12));
+						*text += (char)(0x80 | ((code >> 6) & 0x3F));
+						*text += (char)(0x80 | (code & 0x3F));
+					}
+					break;
+				}
+				default:
+					return fail("bad escape");
+				}
+			}
+			return fail("unterminated string");
+		}
+
+		bool parseNumber(JsonValue* value)
+		{
+			size_t start = m_pos;
+			if (m_pos < m_text.size() && m_text[m_pos] == '-')
+			{
+				m_pos++;
+			}
+			size_t digits = m_pos;
+			while (m_pos < m_text.size() && strchr("0123456789.eE+-", m_text[m_pos]) != nullptr)
+			{
+				m_pos++;
+			}
+			if (m_pos == digits || !isdigit((unsigned char)m_text[digits]))
+			{
+				m_pos = start;
+				return fail("unexpected character");
+			}
+
+			std::string number = m_text.substr(start, m_pos - start);
+			char* end;
+			double parsed = strtod(number.c_str(), &end);
+			if (*end != '\0')
+			{
+				m_pos = start;
+				return fail("bad number");
+			}
+			*value = JsonValue(parsed);
+			return true;
+		}
+
+		const std::string& m_text;
+		size_t m_pos;
+		std::string m_error;
+
+		static const int MAX_DEPTH = 64;
+	};
+
+	class Validator
+	{
+	public:
+
+		Validator(const JsonValue& root) : m_root(root), m_depth(0) {}
+
+		bool validate(const JsonValue& instance, const JsonValue& schema, const std::string& path, std::string* error)
+		{
+			if (!schema.isObject())
+			{
+				return true;
+			}
+
+			//a $ref that loops back on itself without going into the instance would never end
+			if (m_depth > MAX_REF_DEPTH)
+			{
+				*error = path + ": schema $refs nested too deeply";
+				return false;
+			}
+
+			if (schema.has("$ref"))
+			{
+				const JsonValue* target = resolve(schema.get("$ref").getString());
+				if (target == nullptr)
+				{
+					*error = path + ": can't resolve $ref " + schema.get("$ref").getString();
+					return false;
+				}
+				m_depth++;
+				bool valid = validate(instance, *target, path, error);
+				m_depth--;
+				if (!valid)
+				{
+					return false;
+				}
+			}
+
+			if (schema.has("type") && !matchesType(instance, schema.get("type")))
+			{
+				*error = path + ": wrong type, expected " + schema.get("type").toString();
+				return false;
+			}
+
+			if (schema.has("const") && instance != schema.get("const"))
+			{
+				*error = path + ": should be " + schema.get("const").toString();
+				return false;
+			}
+
+			if (schema.has("enum"))
+			{
+				const JsonValue& options = schema.get("enum");
+				bool found = false;
+				for (size_t i = 0; i < options.size() && !found; i++)
+				{
+					found = instance == options[i];
+				}
+				if (!found)
+				{
+					*error = path + ": should be one of " + options.toString();
+					return false;
+				}
+			}
+
+			if (instance.isNumber())
+			{
+				if (schema.get("minimum").isNumber() && instance.getNumber() < schema.get("minimum").getNumber())
+				{
+					*error = path + ": less than the minimum " + schema.get("minimum").toString();
+					return false;
+				}
+				if (schema.get("maximum").isNumber() && instance.getNumber() > schema.get("maximum").getNumber())
+				{
+					*error = path + ": more than the maximum " + schema.get("maximum").toString();
+					return false;
+				}
+			}
+
+			if (instance.isObject())
+			{
+				const JsonValue& required = schema.get("required");
+				for (size_t i = 0; i < required.size(); i++)
+				{
+					if (!instance.has(required[i].getString()))
+					{
+						*error = path + ": missing " + required[i].getString();
+						return false;
+					}
+				}
+
+				const JsonValue& properties = schema.get("properties");
+				for (const auto& property : properties.getMembers())
+				{
+					if (instance.has(property.first)
+						&& !validate(instance.get(property.first), property.second, path + "/" + property.first, error))
+					{
+						return false;
+					}
+				}
+			}
+
+			if (instance.isArray())
+			{
+				if (schema.get("minItems").isNumber() && instance.size() < schema.get("minItems").getNumber())
+				{
+					*error = path + ": fewer than " + schema.get("minItems").toString() + " items";
+					return false;
+				}
+				if (schema.get("maxItems").isNumber() && instance.size() > schema.get("maxItems").getNumber())
+				{
+					*error = path + ": more than " + schema.get("maxItems").toString() + " items";
+					return false;
+				}
+
+				//one schema for every item, or (the tuple form) one per position
+				const JsonValue& items = schema.get("items");
+				for (size_t i = 0; i < instance.size(); i++)
+				{
+					const JsonValue& itemSchema = items.isArray() ? (i < items.size() ? items[i] : JsonValue()) : items;
+					if (!validate(instance[i], itemSchema, path + "/" + std::to_string(i), error))
+					{
+						return false;
+					}
+				}
+			}
+
+			const JsonValue& allOf = schema.get("allOf");
+			for (size_t i = 0; i < allOf.size(); i++)
+			{
+				if (!validate(instance, allOf[i], path, error))
+				{
+					return false;
+				}
+			}
+
+			if (schema.has("anyOf") || schema.has("oneOf"))
+			{
+				bool oneOf = schema.has("oneOf");
+				const JsonValue& options = oneOf ? schema.get("oneOf") : schema.get("anyOf");
+				int nValid = 0;
+				std::string ignored;
+				for (size_t i = 0; i < options.size(); i++)
+				{
+					nValid += validate(instance, options[i], path, &ignored) ? 1 : 0;
+				}
+				if (oneOf ? nValid != 1 : nValid == 0)
+				{
+					*error = path + (oneOf ? ": doesn't match exactly one of oneOf" : ": doesn't match any of anyOf");
+					return false;
+				}
+			}
+
+			std::string ignored;
+			if (schema.has("not") && validate(instance, schema.get("not"), path, &ignored))
+			{
+				*error = path + ": matches a schema under not";
+				return false;
+			}
+
+			if (schema.has("if"))
+			{
+				const char* branch = validate(instance, schema.get("if"), path, &ignored) ? "then" : "else";
+				if (schema.has(branch) && !validate(instance, schema.get(branch), path, error))
+				{
+					return false;
+				}
+			}
+
+			return true;
+		}
+
+	private:
+
+		static bool matchesType(const JsonValue& instance, const JsonValue& type)
+		{
+			if (type.isArray())
+			{
+				for (size_t i = 0; i < type.size(); i++)
+				{
+					if (matchesType(instance, type[i]))
+					{
+						return true;
+					}
+				}
+				return false;
+			}
+
+			const std::string& name = type.getString();
+			return (name == "null" && instance.isNull()) || (name == "boolean" && instance.isBool()) || (name == "number" && instance.isNumber())
+				|| (name == "integer" && instance.isInteger()) || (name == "string" && instance.isString())
+				|| (name == "array" && instance.isArray()) || (name == "object" && instance.isObject());
+		}
+
+		//only JSON pointers into this schema, which is all OCD_Schema.json has
+		const JsonValue* resolve(const std::string& ref) const
+		{
+			if (ref.compare(0, 1, "#") != 0)
+			{
+				return nullptr;
+			}
+
+			const JsonValue* node = &m_root;
+			size_t pos = 1;
+			while (pos < ref.size())
+			{
+				if (ref[pos] != '/')
+				{
+					return nullptr;
+				}
+				size_t next = ref.find('/', pos + 1);
+				std::string name = ref.substr(pos + 1, next == std::string::npos ? std::string::npos : next - pos - 1);
+				if (!node->has(name))
+				{
+					return nullptr;
+				}
+				node = &node->get(name);
+				pos = next == std::string::npos ? ref.size() : next;
+			}
+			return node;
+		}
+
+		const JsonValue& m_root;
+		int m_depth;
+
+		static const int MAX_REF_DEPTH = 32;
+	};
+}
+
+JsonValue JsonValue::makeArray()
+{
+	JsonValue value;
+	value.m_type = JSON_ARRAY;
+	return value;
+}
+
+JsonValue JsonValue::makeObject()
+{
+	JsonValue value;
+	value.m_type = JSON_OBJECT;
+	return value;
+}
+
+bool JsonValue::parse(const std::string& text, JsonValue* value, std::string* error)
+{
+	Parser parser(text);
+	return parser.parseDocument(value, error);
+}
+
+bool JsonValue::isInteger() const
+{
+	return m_type == JSON_NUMBER && std::floor(m_number) == m_number;
+}
+
+const JsonValue& JsonValue::get(const std::string& name) const
+{
+	static const JsonValue missing;
+	std::map<std::string, JsonValue>::const_iterator member = m_object.find(name);
+	return member == m_object.end() ? missing : member->second;
+}
+
+bool JsonValue::operator==(const JsonValue& other) const
+{
+	if (m_type != other.m_type)
+	{
+		return false;
+	}
+
+	switch (m_type)
+	{
+	case JSON_BOOL:
+		return m_bool == other.m_bool;
+	case JSON_NUMBER:
+		return m_number == other.m_number;
+	case JSON_STRING:
+		return m_string == other.m_string;
+	case JSON_ARRAY:
+		return m_array == other.m_array;
+	case JSON_OBJECT:
+		return m_object == other.m_object;
+	default:
+		return true;
+	}
+}
+
+std::string JsonValue::toString() const
+{
+	std::string text;
+	write(&text);
+	return text;
+}
+
+void JsonValue::write(std::string* text) const
+{
+	switch (m_type)
+	{
+	case JSON_NULL:
+		*text += "null";
+		break;
+	case JSON_BOOL:
+		*text += m_bool ? "true" : "false";
+		break;
+	case JSON_NUMBER:
+	{
+		//integers without a decimal point, so they still validate as "integer" on the other end
+		char number[32];
+		if (isInteger() && std::fabs(m_number) < 1e15)
+		{
+			snprintf(number, sizeof(number), "%lld", (long long)m_number);
+		}
+		else
+		{
+			snprintf(number, sizeof(number), "%.17g", m_number);
+		}
+		*text += number;
+		break;
+	}
+	case JSON_STRING:
+		*text += '"';
+		for (size_t i = 0; i < m_string.size(); i++)
+		{
+			char c = m_string[i];
+			switch (c)
+			{
+			case '"': *text += "\\\""; break;
+			case '\\': *text += "\\\\"; break;
+			case '\n': *text += "\\n"; break;
+			case '\r': *text += "\\r"; break;
+			case '\t': *text += "\\t"; break;
+			default:
+				if ((unsigned char)c < 0x20)
+				{
+					char escape[8];
+					snprintf(escape, sizeof(escape), "\\u%04x", (unsigned char)c);
+					*text += escape;
+				}
+				else
+				{
+					*text += c;
+				}
+			}
+		}
+		*text += '"';
+		break;
+	case JSON_ARRAY:
+		*text += '[';
+		for (size_t i = 0; i < m_array.size(); i++)
+		{
+			if (i > 0)
+			{
+				*text += ',';
+			}
+			m_array[i].write(text);
+		}
+		*text += ']';
+		break;
+	case JSON_OBJECT:
+	{
+		*text += '{';
+		bool first = true;
+		for (const auto& member : m_object)
+		{
+			if (!first)
+			{
+				*text += ',';
+			}
+			first = false;
+			JsonValue(member.first).write(text);
+			*text += ':';
+			member.second.write(text);
+		}
+		*text += '}';
+		break;
+	}
+	}
+}
+
+bool validateJson(const JsonValue& instance, const JsonValue& schema, std::string* error)
+{
+	Validator validator(schema);
+	return validator.validate(instance, schema, "#", error);
+}
@@ -0,0 +1,95 @@
+#ifndef MOCKSIP_JSON_H_INCLUDED
+#define MOCKSIP_JSON_H_INCLUDED
+
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+
+  Just enough JSON for the MyRC+S messages: a value type, a parser, a
+  compact writer, and a validator for the parts of JSON Schema (draft 7)
+  that OCD_Schema.json uses:
+
+      type, enum, const, properties, required, items, minItems, maxItems,
+      minimum, maximum, allOf, anyOf, oneOf, not, if/then/else, and $ref
+      to somewhere in the same schema ("#/definitions/...")
+
+  Anything else in a schema is ignored. The parser lets through trailing
+  commas, like Json.NET does, since OCD_Schema.json has a few.
+
+*/
+
+class JsonValue
+{
+public:
+
+	enum Type
+	{
+		JSON_NULL,
+		JSON_BOOL,
+		JSON_NUMBER,
+		JSON_STRING,
+		JSON_ARRAY,
+		JSON_OBJECT
+	};
+
+	JsonValue() : m_type(JSON_NULL), m_bool(false), m_number(0) {}
+	JsonValue(bool value) : m_type(JSON_BOOL), m_bool(value), m_number(0) {}
+	JsonValue(double value) : m_type(JSON_NUMBER), m_bool(false), m_number(value) {}
+	JsonValue(int value) : m_type(JSON_NUMBER), m_bool(false), m_number(value) {}
+	JsonValue(const std::string& value) : m_type(JSON_STRING), m_bool(false), m_number(0), m_string(value) {}
+	JsonValue(const char* value) : m_type(JSON_STRING), m_bool(false), m_number(0), m_string(value) {}
+
+	static JsonValue makeArray();
+	static JsonValue makeObject();
+
+	/** Parses text into value. Returns false (with where it went wrong in error) if it isn't valid JSON */
+	static bool parse(const std::string& text, JsonValue* value, std::string* error);
+
+	/** Compact JSON text, object members in name order */
+	std::string toString() const;
+
+	Type getType() const { return m_type; }
+	bool isNull() const { return m_type == JSON_NULL; }
+	bool isBool() const { return m_type == JSON_BOOL; }
+	bool isNumber() const { return m_type == JSON_NUMBER; }
+	bool isInteger() const;
+	bool isString() const { return m_type == JSON_STRING; }
+	bool isArray() const { return m_type == JSON_ARRAY; }
+	bool isObject() const { return m_type == JSON_OBJECT; }
+
+	bool getBool() const { return m_bool; }
+	double getNumber() const { return m_number; }
+	const std::string& getString() const { return m_string; }
+
+	/** Array elements */
+	size_t size() const { return m_array.size(); }
+	const JsonValue& operator[](size_t index) const { return m_array[index]; }
+	void append(const JsonValue& value) { m_array.push_back(value); }
+
+	/** Object members, get() gives a null value for a missing member */
+	bool has(const std::string& name) const { return m_object.count(name) > 0; }
+	const JsonValue& get(const std::string& name) const;
+	void set(const std::string& name, const JsonValue& value) { m_object[name] = value; }
+	const std::map<std::string, JsonValue>& getMembers() const { return m_object; }
+
+	bool operator==(const JsonValue& other) const;
+	bool operator!=(const JsonValue& other) const { return !(*this == other); }
+
+private:
+
+	void write(std::string* text) const;
+
+	Type m_type;
+	bool m_bool;
+	double m_number;
+	std::string m_string;
+	std::vector<JsonValue> m_array;
+	std::map<std::string, JsonValue> m_object;
+};
+
+/** Whether instance conforms to schema. If not, error says where (as a path into the instance) and why */
+bool validateJson(const JsonValue& instance, const JsonValue& schema, std::string* error);
+
+#endif  // MOCKSIP_JSON_H_INCLUDED
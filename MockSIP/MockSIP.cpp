@@ -0,0 +1,829 @@
+/*
+
+  Mock SIP: stands in for the Summit Interface Program (and the INS behind
+  it) so the Open-Ephys plugins can be run and benchmarked without a CTM or
+  the Windows-only Summit API. Replays a session the SIP saved (a
+  "*-Data.txt" file) with the timing the INS sent its packets at, or N
+  times faster, and speaks the same three protocols as the SIP:
+
+    - sense data to the Summit Source: "InitTD" hand-shakes, "TD" requests
+      (also from a sequence number), "FB" flushes, and the side stream
+      requests (always empty here), or pushing TD in push mode
+      (StreamingThread.SendSense())
+    - stim commands from the Summit Stim Sink, on a SUB socket bound to port
+      12345, either binary StimCommands or the class as text. Each one is
+      logged with how long it took from the sink, and how long after the
+      last TD data it came, which is the closed-loop latency through
+      Open-Ephys
+    - MyRC+S JSON requests on port 5556, checked against OCD_Schema.json,
+      with canned replies (StreamingThread.MyRCpS())
+
+  Stops at the end of the recording (unless looping), on a "quit" message,
+  or on Ctrl-C.
+
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "zmq.hpp"
+#include "StimCommand.h"
+#include "Json.h"
+#include "Recording.h"
+#include "TDBuffer.h"
+
+namespace
+{
+	typedef std::chrono::steady_clock Clock;
+
+	struct Options
+	{
+		std::string recordingPath;
+		double speed; //0 for as fast as Open-Ephys takes the data
+		bool loop;
+		bool keepInterpolated;
+		std::string host;
+		int sensePort;
+		bool push;
+		bool tdV1;
+		bool int16;
+		int bufferSize;
+		int stimPort;
+		std::string stimLogPath;
+		bool stimConflate;
+		int rcsPort;
+		std::string schemaPath;
+		int batteryLevel;
+	};
+
+	const int TD_HISTORY_BUFFERS = 4; //same as SummitProgram, how many buffers worth of TD data Open-Ephys can re-request
+	const int IDLE_POLL_MS = 100; //how often threads with nothing to do check whether they should stop
+	const double END_GRACE_SECONDS = 2; //how long to keep answering after the last packet, so Open-Ephys can get the rest
+
+	std::atomic<bool> g_stop(false);
+	std::atomic<bool> g_senseOn(true);
+	std::atomic<bool> g_beepsDisabled(false);
+	std::atomic<long long> g_lastTDSentUs(-1); //when the last message with TD data went out, from g_startTime
+	std::atomic<bool> g_bindFailed(false);
+	Clock::time_point g_startTime;
+	std::mutex g_logMutex;
+
+	void log(const std::string& text)
+	{
+		std::lock_guard<std::mutex> lock(g_logMutex);
+		std::cout << text << std::endl;
+	}
+
+	long long getMicroseconds(Clock::time_point time)
+	{
+		return std::chrono::duration_cast<std::chrono::microseconds>(time - g_startTime).count();
+	}
+
+	void onSignal(int)
+	{
+		g_stop = true;
+	}
+
+	std::string getEndpoint(const Options& options, int port)
+	{
+		return "tcp://" + options.host + ":" + std::to_string(port);
+	}
+
+	//stops everything if the port is already taken (e.g. by a real SIP)
+	bool bindSocket(zmq::socket_t& socket, const std::string& endpoint)
+	{
+		try
+		{
+			socket.bind(endpoint);
+			return true;
+		}
+		catch (const zmq::error_t& e)
+		{
+			log("Error: couldn't bind to " + endpoint + ": " + e.what());
+			g_bindFailed = true;
+			g_stop = true;
+			return false;
+		}
+	}
+
+	void printUsage()
+	{
+		std::cout <<
+			"Usage: mock_sip [options] <recording-Data.txt>\n"
+			"\n"
+			"  --speed N        replay N times faster than it was recorded (default 1), 0 for as\n"
+			"                   fast as Open-Ephys takes the data\n"
+			"  --loop           start over at the end of the recording instead of stopping\n"
+			"  --interpolated   also replay the packets the SIP filled in, and tell Open-Ephys\n"
+			"                   the gaps are already filled\n"
+			"  --host NAME      interface to bind to (default localhost)\n"
+			"  --port N         sense port, like Sense.ZMQPort (default 5555), push mode also\n"
+			"                   uses N+1\n"
+			"  --push           push TD data as it comes instead of waiting for requests\n"
+			"  --v1             old TD format, every value a double\n"
+			"  --int16          int16 channel data in the v2 TD format\n"
+			"  --buffer N       TD buffer size in time points, like Sense.BufferSize (default 1000)\n"
+			"  --stim-port N    port the Summit Stim Sink sends stim classes to (default 12345)\n"
+			"  --stim-log FILE  write every stim class received, with its latency, to FILE\n"
+			"  --stim-conflate  only keep the newest stim command we haven't read yet\n"
+			"  --rcs-port N     MyRC+S port (default 5556)\n"
+			"  --schema FILE    MyRC+S message schema (default JSONFiles/OCD_Schema.json)\n"
+			"  --battery N      battery level to report, 0 to 100 (default 80)\n";
+	}
+
+	bool parseOptions(int argc, char* argv[], Options* options)
+	{
+		options->speed = 1;
+		options->loop = false;
+		options->keepInterpolated = false;
+		options->host = "localhost";
+		options->sensePort = 5555;
+		options->push = false;
+		options->tdV1 = false;
+		options->int16 = false;
+		options->bufferSize = 1000;
+		options->stimPort = 12345;
+		options->stimConflate = false;
+		options->rcsPort = 5556;
+		options->schemaPath = "JSONFiles/OCD_Schema.json";
+		options->batteryLevel = 80;
+
+		for (int iArg = 1; iArg < argc; iArg++)
+		{
+			std::string arg = argv[iArg];
+			bool hasValue = iArg + 1 < argc;
+			if (arg == "--loop")
+			{
+				options->loop = true;
+			}
+			else if (arg == "--interpolated")
+			{
+				options->keepInterpolated = true;
+			}
+			else if (arg == "--push")
+			{
+				options->push = true;
+			}
+			else if (arg == "--v1")
+			{
+				options->tdV1 = true;
+			}
+			else if (arg == "--int16")
+			{
+				options->int16 = true;
+			}
+			else if (arg == "--stim-conflate")
+			{
+				options->stimConflate = true;
+			}
+			else if (arg == "--speed" && hasValue)
+			{
+				options->speed = atof(argv[++iArg]);
+			}
+			else if (arg == "--host" && hasValue)
+			{
+				options->host = argv[++iArg];
+			}
+			else if (arg == "--port" && hasValue)
+			{
+				options->sensePort = atoi(argv[++iArg]);
+			}
+			else if (arg == "--buffer" && hasValue)
+			{
+				options->bufferSize = atoi(argv[++iArg]);
+			}
+			else if (arg == "--stim-port" && hasValue)
+			{
+				options->stimPort = atoi(argv[++iArg]);
+			}
+			else if (arg == "--stim-log" && hasValue)
+			{
+				options->stimLogPath = argv[++iArg];
+			}
+			else if (arg == "--rcs-port" && hasValue)
+			{
+				options->rcsPort = atoi(argv[++iArg]);
+			}
+			else if (arg == "--schema" && hasValue)
+			{
+				options->schemaPath = argv[++iArg];
+			}
+			else if (arg == "--battery" && hasValue)
+			{
+				options->batteryLevel = atoi(argv[++iArg]);
+			}
+			else if (arg.compare(0, 2, "--") != 0 && options->recordingPath.empty())
+			{
+				options->recordingPath = arg;
+			}
+			else
+			{
+				std::cerr << "Unknown option or missing value: " << arg << std::endl;
+				return false;
+			}
+		}
+
+		if (options->recordingPath.empty())
+		{
+			std::cerr << "No recording given" << std::endl;
+			return false;
+		}
+		if (options->speed < 0 || options->bufferSize < 1 || options->batteryLevel < 0 || options->batteryLevel > 100)
+		{
+			std::cerr << "--speed can't be negative, --buffer has to be at least 1 and --battery 0 to 100" << std::endl;
+			return false;
+		}
+		return true;
+	}
+
+	void appendInt(std::vector<char>* message, int32_t value)
+	{
+		const char* bytes = reinterpret_cast<const char*>(&value);
+		message->insert(message->end(), bytes, bytes + sizeof(int32_t));
+	}
+
+	//same layout as StreamingThread.getHandshakeMessage()
+	std::vector<char> getHandshake(const Options& options, const Recording& recording)
+	{
+		std::string labels;
+		for (int iChan = 0; iChan < recording.getNumChans(); iChan++)
+		{
+			labels += (iChan > 0 ? "\n" : "") + std::string("SenseChannel") + std::to_string(iChan + 1);
+		}
+
+		std::vector<char> message;
+		appendInt(&message, recording.getNumChans());
+		appendInt(&message, options.bufferSize);
+		appendInt(&message, options.push ? 1 : 0);
+		appendInt(&message, options.sensePort + 1);
+		appendInt(&message, options.tdV1 ? 1 : 2);
+		appendInt(&message, 0); //no delta bit-packing
+		appendInt(&message, 1); //answers "TD since sequence N"
+		appendInt(&message, recording.getSampleRate());
+		appendInt(&message, recording.getPacketPeriodMs());
+		appendInt(&message, (int32_t)labels.size());
+		message.insert(message.end(), labels.begin(), labels.end());
+		appendInt(&message, options.keepInterpolated ? 0 : 1); //who fills in dropped packets
+		appendInt(&message, 0); //no FFT, band power or accelerometer streams
+		return message;
+	}
+
+	bool sendBytes(zmq::socket_t& socket, const std::vector<char>& bytes, int flags = 0)
+	{
+		zmq::message_t message(bytes.size());
+		if (!bytes.empty())
+		{
+			memcpy(message.data(), &bytes[0], bytes.size());
+		}
+		return socket.send(message, flags);
+	}
+
+	//whether a TD message has any time points in it, for the stim latency
+	bool hasSamples(const std::vector<char>& message, bool tdV1)
+	{
+		return tdV1 ? message.size() > sizeof(int32_t) : message.size() > (size_t)TDBuffer::TDV2_HEADER_BYTES;
+	}
+
+	void noteTDSent(const std::vector<char>& message, bool tdV1)
+	{
+		if (hasSamples(message, tdV1))
+		{
+			g_lastTDSentUs = getMicroseconds(Clock::now());
+		}
+	}
+
+	//replays the recording into a TD buffer and serves it to the Summit Source
+	void serveSense(zmq::context_t& context, const Options& options, const Recording& recording)
+	{
+		TDBuffer buffer(recording.getNumChans(), options.bufferSize, TD_HISTORY_BUFFERS * options.bufferSize);
+		const std::vector<Recording::Packet>& packets = recording.getPackets();
+
+		int linger = 0;
+		zmq::socket_t senseSocket(context, ZMQ_REP);
+		senseSocket.setsockopt(ZMQ_LINGER, &linger, sizeof(linger));
+		if (!bindSocket(senseSocket, getEndpoint(options, options.sensePort)))
+		{
+			return;
+		}
+
+		std::unique_ptr<zmq::socket_t> pushSocket;
+		if (options.push)
+		{
+			pushSocket.reset(new zmq::socket_t(context, ZMQ_PUSH));
+			pushSocket->setsockopt(ZMQ_LINGER, &linger, sizeof(linger));
+			if (!bindSocket(*pushSocket, getEndpoint(options, options.sensePort + 1)))
+			{
+				return;
+			}
+		}
+
+		log("Serving " + std::to_string(recording.getNumChans()) + " TD channels at " + std::to_string(recording.getSampleRate()) + " Hz on "
+			+ getEndpoint(options, options.sensePort) + (options.push ? " (pushing on port " + std::to_string(options.sensePort + 1) + ")" : ""));
+
+		//each pass over the recording carries on the packet numbers and SystemTicks from the last, like the INS would
+		size_t nextPacket = 0;
+		double passSeconds = 0; //where this pass starts on the INS timeline
+		int passPacketNumOffset = 0;
+		bool finished = false;
+		Clock::time_point finishTime;
+		Clock::time_point replayStart = Clock::now();
+
+		long long nPacketsSent = 0;
+		long long nSamplesSent = 0;
+		long long nRequests = 0;
+		bool pushBlocked = false;
+
+		while (!g_stop)
+		{
+			Clock::time_point now = Clock::now();
+
+			//move every packet that's due into the buffer (as fast as possible, only as much as fits in the buffer)
+			while (!finished)
+			{
+				const Recording::Packet& packet = packets[nextPacket];
+				double insSeconds = passSeconds + packet.seconds;
+				if (options.speed > 0)
+				{
+					if (replayStart + std::chrono::duration<double>(insSeconds / options.speed) > now)
+					{
+						break;
+					}
+				}
+				else if (pushBlocked || (!buffer.isEmpty() && buffer.getNumBufferSamples() + packet.nSamples > buffer.getBufferSize()))
+				{
+					break;
+				}
+
+				//with sensing off the INS doesn't send anything, but time goes on
+				if (g_senseOn)
+				{
+					int packetNum = (packet.packetNum + passPacketNumOffset) % Recording::PACKET_NUM_WRAP;
+					double systemTick = std::fmod(packets[0].systemTick + insSeconds * Recording::SYSTEM_TICKS_PER_SECOND,
+						(double)Recording::SYSTEM_TICK_WRAP);
+					buffer.addPacket(&packet.data[0], packet.nSamples, packetNum, systemTick);
+					nPacketsSent++;
+					nSamplesSent += packet.nSamples;
+				}
+
+				if (++nextPacket == packets.size())
+				{
+					if (!options.loop)
+					{
+						finished = true;
+						finishTime = now;
+						break;
+					}
+					nextPacket = 0;
+					passSeconds += recording.getDuration() + recording.getPacketPeriodMs() / 1000.0;
+					passPacketNumOffset = (passPacketNumOffset + packets.back().packetNum - packets[0].packetNum + 1 + Recording::PACKET_NUM_WRAP)
+						% Recording::PACKET_NUM_WRAP;
+				}
+			}
+
+			//push everything that came in, if Open-Ephys can take it
+			if (options.push && !buffer.isEmpty())
+			{
+				std::vector<char> message = options.tdV1 ? buffer.getMessageV1(false) : buffer.getMessageV2(false, options.int16);
+				pushBlocked = !sendBytes(*pushSocket, message, ZMQ_DONTWAIT);
+				if (!pushBlocked)
+				{
+					buffer.flush();
+					noteTDSent(message, options.tdV1);
+				}
+			}
+
+			//give Open-Ephys a little while to get the end of the recording
+			if (finished && ((options.push && buffer.isEmpty())
+				|| now - finishTime > std::chrono::duration<double>(END_GRACE_SECONDS)))
+			{
+				break;
+			}
+
+			//wait for a request, or until the next packet is due
+			long timeoutMs = IDLE_POLL_MS;
+			if (!finished && options.speed > 0)
+			{
+				double dueSeconds = (passSeconds + packets[nextPacket].seconds) / options.speed;
+				double waitSeconds = dueSeconds - std::chrono::duration<double>(now - replayStart).count();
+				timeoutMs = std::min(timeoutMs, std::max((long)std::ceil(waitSeconds * 1000), 0L));
+			}
+			else if (!finished && !pushBlocked
+				&& (buffer.isEmpty() || buffer.getNumBufferSamples() + packets[nextPacket].nSamples <= buffer.getBufferSize()))
+			{
+				timeoutMs = 0;
+			}
+
+			zmq::pollitem_t items[2] = {
+				{ static_cast<void*>(senseSocket), 0, ZMQ_POLLIN, 0 },
+				{ pushSocket ? static_cast<void*>(*pushSocket) : nullptr, 0, (short)(pushBlocked ? ZMQ_POLLOUT : 0), 0 }
+			};
+			try
+			{
+				zmq::poll(items, pushSocket ? 2 : 1, timeoutMs);
+			}
+			catch (const zmq::error_t&)
+			{
+				//interrupted, e.g. by Ctrl-C
+				continue;
+			}
+			if (pushSocket && (items[1].revents & ZMQ_POLLOUT))
+			{
+				pushBlocked = false;
+			}
+			if (!(items[0].revents & ZMQ_POLLIN))
+			{
+				continue;
+			}
+
+			zmq::message_t request;
+			if (!senseSocket.recv(&request, ZMQ_DONTWAIT))
+			{
+				continue;
+			}
+			nRequests++;
+
+			//a 2 character command (or "InitTD" or "FFT"), "TD" can be followed by the int64 sequence number Open-Ephys wants next
+			std::string command(static_cast<const char*>(request.data()), request.size());
+			if (command != "InitTD" && command != "FFT")
+			{
+				command = command.substr(0, 2);
+			}
+
+			std::vector<char> reply;
+			if (command == "InitTD")
+			{
+				reply = getHandshake(options, recording);
+				log("Hand-shake with Open-Ephys");
+			}
+			else if (command == "TD")
+			{
+				if (request.size() >= 2 + sizeof(int64_t) && !options.tdV1)
+				{
+					int64_t cursor;
+					memcpy(&cursor, static_cast<const char*>(request.data()) + 2, sizeof(int64_t));
+					reply = buffer.getMessageV2Since(cursor, buffer.getBufferSize(), options.int16);
+				}
+				else
+				{
+					reply = options.tdV1 ? buffer.getMessageV1(true) : buffer.getMessageV2(true, options.int16);
+				}
+				noteTDSent(reply, options.tdV1);
+			}
+			else if (command == "FB")
+			{
+				buffer.flush();
+			}
+			else if (command != "FFT" && command != "PW" && command != "AC")
+			{
+				log("Unknown request from Open-Ephys: " + command);
+			}
+
+			//have to answer every request or the socket gets stuck
+			sendBytes(senseSocket, reply);
+		}
+
+		double elapsed = std::chrono::duration<double>(Clock::now() - replayStart).count();
+		log("Replayed " + std::to_string(nPacketsSent) + " packets (" + std::to_string(nSamplesSent) + " time points) in "
+			+ std::to_string(elapsed) + " s, answered " + std::to_string(nRequests) + " requests");
+
+		g_stop = true;
+	}
+
+	//latencies in us, leaving out ones we couldn't measure (-1)
+	class LatencyStats
+	{
+	public:
+
+		LatencyStats() : m_count(0), m_total(0), m_max(0) {}
+
+		void add(long long us)
+		{
+			if (us >= 0)
+			{
+				m_count++;
+				m_total += us;
+				m_max = std::max(m_max, us);
+			}
+		}
+
+		std::string toString(const std::string& what) const
+		{
+			if (m_count == 0)
+			{
+				return "";
+			}
+			return ", " + std::to_string((long long)(m_total / m_count)) + " us" + what + " on average (most " + std::to_string(m_max) + " us)";
+		}
+
+	private:
+
+		long long m_count;
+		double m_total;
+		long long m_max;
+	};
+
+	//takes stim classes from the Summit Stim Sink, the same as the SIP would
+	void serveStim(zmq::context_t& context, const Options& options)
+	{
+		int linger = 0;
+		int timeoutMs = IDLE_POLL_MS;
+		int conflate = options.stimConflate ? 1 : 0;
+		zmq::socket_t stimSocket(context, ZMQ_SUB);
+		stimSocket.setsockopt(ZMQ_LINGER, &linger, sizeof(linger));
+		stimSocket.setsockopt(ZMQ_CONFLATE, &conflate, sizeof(conflate));
+		stimSocket.setsockopt(ZMQ_RCVTIMEO, &timeoutMs, sizeof(timeoutMs));
+		stimSocket.setsockopt(ZMQ_SUBSCRIBE, "", 0);
+		if (!bindSocket(stimSocket, getEndpoint(options, options.stimPort)))
+		{
+			return;
+		}
+
+		std::ofstream stimLog;
+		if (!options.stimLogPath.empty())
+		{
+			stimLog.open(options.stimLogPath.c_str());
+			stimLog << "ReceivedUs Sequence Class Heartbeat SourceTimestamp TransitUs SinceLastTDUs" << std::endl;
+		}
+
+		long long nCommands = 0;
+		long long nLost = 0;
+		long long nHeartbeats = 0;
+		bool haveSequence = false;
+		uint32_t nextSequence = 0;
+		LatencyStats transit;
+		LatencyStats sinceTD;
+		std::string lastClass;
+
+		while (!g_stop)
+		{
+			zmq::message_t message;
+			try
+			{
+				if (!stimSocket.recv(&message))
+				{
+					continue;
+				}
+			}
+			catch (const zmq::error_t&)
+			{
+				continue;
+			}
+
+			long long receivedUs = getMicroseconds(Clock::now());
+			long long lastTDSentUs = g_lastTDSentUs;
+			long long sinceTDUs = lastTDSentUs >= 0 ? receivedUs - lastTDSentUs : -1;
+
+			//binary StimCommands, or just the class as text from a sink set to the old protocol
+			StimCommand command;
+			std::string stimClass;
+			long long sequence = -1;
+			long long sourceTimestamp = -1;
+			long long transitUs = -1;
+			bool heartbeat = false;
+			if (StimCommand::read(message.data(), message.size(), &command))
+			{
+				stimClass = command.type == StimCommand::TYPE_CLASS ? std::to_string(command.stimClass)
+					: "parameter " + std::to_string((int)command.parameter) + " = " + std::to_string(command.value);
+				sequence = command.sequence;
+				sourceTimestamp = command.sourceTimestamp;
+				transitUs = StimCommand::getHostTimeUs() - command.hostSendTimeUs;
+				heartbeat = (command.flags & StimCommand::FLAG_HEARTBEAT) != 0;
+
+				//a restarted acquisition starts over at 0
+				if (haveSequence && command.sequence != nextSequence && command.sequence != 0)
+				{
+					nLost += (uint32_t)(command.sequence - nextSequence);
+				}
+				haveSequence = true;
+				nextSequence = command.sequence + 1;
+			}
+			else
+			{
+				stimClass.assign(static_cast<const char*>(message.data()), message.size());
+			}
+
+			nCommands++;
+			nHeartbeats += heartbeat ? 1 : 0;
+			transit.add(transitUs);
+			sinceTD.add(sinceTDUs);
+			if (stimLog.is_open())
+			{
+				stimLog << receivedUs << " " << sequence << " " << stimClass << " " << (heartbeat ? 1 : 0) << " " << sourceTimestamp << " " << transitUs << " " << sinceTDUs
+					<< std::endl;
+			}
+			//a heartbeat with a class we didn't have means we missed the change
+			if (stimClass != lastClass)
+			{
+				log("Stim class " + stimClass + (heartbeat ? " (from a heartbeat)" : ""));
+				lastClass = stimClass;
+			}
+		}
+
+		log("Received " + std::to_string(nCommands) + " stim commands (" + std::to_string(nHeartbeats) + " heartbeats, "
+			+ std::to_string(nLost) + " lost)"
+			+ transit.toString(" from the sink") + sinceTD.toString(" after the last TD data"));
+	}
+
+	//the first example reply in the schema for this message that isn't an error, for the parts of the reply we don't make up
+	JsonValue getExamplePayload(const JsonValue& schema, const std::string& message)
+	{
+		const JsonValue& examples = schema.get("examples");
+		for (size_t iExample = 0; iExample < examples.size(); iExample++)
+		{
+			const JsonValue& example = examples[iExample];
+			if (example.get("message_type").getString() == "result" && example.get("message").getString() == message
+				&& example.get("payload").isObject() && example.get("payload").get("success") != JsonValue(false))
+			{
+				return example.get("payload");
+			}
+		}
+
+		JsonValue payload = JsonValue::makeObject();
+		payload.set("success", true);
+		return payload;
+	}
+
+	JsonValue getErrorReply(int errorCode, const std::string& errorMessage)
+	{
+		//the SIP says errors are about device_info, whatever was asked
+		JsonValue payload = JsonValue::makeObject();
+		payload.set("success", false);
+		payload.set("error_code", errorCode);
+		payload.set("error_message", errorMessage);
+
+		JsonValue reply = JsonValue::makeObject();
+		reply.set("message_type", "result");
+		reply.set("message", "device_info");
+		reply.set("payload", payload);
+		return reply;
+	}
+
+	//answers MyRC+S requests, like the SIP does when it's connected to an INS
+	void serveMyRCpS(zmq::context_t& context, const Options& options, const JsonValue& schema)
+	{
+		int linger = 0;
+		int timeoutMs = IDLE_POLL_MS;
+		zmq::socket_t rcsSocket(context, ZMQ_REP);
+		rcsSocket.setsockopt(ZMQ_LINGER, &linger, sizeof(linger));
+		rcsSocket.setsockopt(ZMQ_RCVTIMEO, &timeoutMs, sizeof(timeoutMs));
+		if (!bindSocket(rcsSocket, getEndpoint(options, options.rcsPort)))
+		{
+			return;
+		}
+
+		while (!g_stop)
+		{
+			zmq::message_t request;
+			try
+			{
+				if (!rcsSocket.recv(&request))
+				{
+					continue;
+				}
+			}
+			catch (const zmq::error_t&)
+			{
+				continue;
+			}
+
+			std::string requestText(static_cast<const char*>(request.data()), request.size());
+			JsonValue requestMsg;
+			JsonValue reply;
+			std::string error;
+			bool quit = false;
+			if (!JsonValue::parse(requestText, &requestMsg, &error))
+			{
+				log("Received a msg from MyRCpS program, but was unable to parse JSON: " + error);
+				reply = getErrorReply(1, "Unable to parse JSON message");
+			}
+			else if (!validateJson(requestMsg, schema, &error))
+			{
+				log("Error: received JSON message from MyRC+S that doesn't conform to schema! " + error);
+				reply = getErrorReply(2, "received JSON message does not conform to schema");
+			}
+			else
+			{
+				std::string message = requestMsg.get("message").getString();
+				const JsonValue& requestPayload = requestMsg.get("payload");
+				JsonValue payload = getExamplePayload(schema, message);
+
+				if (message == "battery" || message == "device_info")
+				{
+					payload.set("battery_level", options.batteryLevel);
+				}
+				if (message == "device_info")
+				{
+					payload.set("sense_on", (bool)g_senseOn);
+					payload.set("beeps_disabled", (bool)g_beepsDisabled);
+				}
+				else if (message == "sense_on" || message == "sense_off")
+				{
+					g_senseOn = message == "sense_on";
+				}
+				else if (message == "beep_change")
+				{
+					//the SIP restarts to reconnect to the CTM, nothing to do here
+					g_beepsDisabled = requestPayload.get("disable_beeps").getBool();
+				}
+				else if (message == "quit")
+				{
+					quit = true;
+				}
+
+				reply = JsonValue::makeObject();
+				reply.set("message_type", "result");
+				reply.set("message", message);
+				reply.set("payload", payload);
+				log("MyRC+S: " + message);
+			}
+
+			//the SIP drops replies that don't conform, but then its socket is stuck, so send them anyway
+			if (!validateJson(reply, schema, &error))
+			{
+				log("Error: response message does not conform to the schema: " + error);
+			}
+			std::string replyText = reply.toString();
+			zmq::message_t replyMessage(replyText.size());
+			memcpy(replyMessage.data(), replyText.data(), replyText.size());
+			rcsSocket.send(replyMessage);
+
+			if (quit)
+			{
+				g_stop = true;
+			}
+		}
+	}
+
+	bool loadSchema(const std::string& path, JsonValue* schema)
+	{
+		std::ifstream file(path.c_str());
+		if (!file)
+		{
+			std::cerr << "Error: unable to read schema file " << path << std::endl;
+			return false;
+		}
+
+		std::stringstream text;
+		text << file.rdbuf();
+		std::string error;
+		if (!JsonValue::parse(text.str(), schema, &error))
+		{
+			std::cerr << "Error: " << path << " isn't valid JSON: " << error << std::endl;
+			return false;
+		}
+		return true;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	Options options;
+	if (!parseOptions(argc, argv, &options))
+	{
+		printUsage();
+		return 1;
+	}
+
+	Recording recording;
+	std::string error;
+	if (!recording.load(options.recordingPath, options.keepInterpolated, &error))
+	{
+		std::cerr << "Error: " << error << std::endl;
+		return 1;
+	}
+
+	JsonValue schema;
+	if (!loadSchema(options.schemaPath, &schema))
+	{
+		return 1;
+	}
+
+	std::cout << "Loaded " << recording.getPackets().size() << " packets (" << recording.getDuration() << " s, "
+		<< recording.getPacketPeriodMs() << " ms packets) from " << options.recordingPath << std::endl;
+
+	signal(SIGINT, onSignal);
+	signal(SIGTERM, onSignal);
+	g_startTime = Clock::now();
+
+	zmq::context_t context(1);
+	std::thread stimThread(serveStim, std::ref(context), std::cref(options));
+	std::thread rcsThread(serveMyRCpS, std::ref(context), std::cref(options), std::cref(schema));
+	serveSense(context, options, recording);
+	stimThread.join();
+	rcsThread.join();
+
+	return g_bindFailed ? 1 : 0;
+}
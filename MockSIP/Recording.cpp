@@ -0,0 +1,183 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include "Recording.h"
+
+Recording::Recording()
+	: m_nChans(0), m_sampleRate(0), m_packetPeriodMs(0)
+{
+}
+
+bool Recording::load(const std::string& path, bool keepInterpolated, std::string* error)
+{
+	m_nChans = 0;
+	m_sampleRate = 0;
+	m_packetPeriodMs = 0;
+	m_packets.clear();
+
+	std::ifstream file(path.c_str());
+	if (!file)
+	{
+		*error = "can't open " + path;
+		return false;
+	}
+
+	std::string line;
+	int lineNumber = 0;
+	std::vector<double> values;
+	while (std::getline(file, line))
+	{
+		lineNumber++;
+		if (!line.empty() && line[line.size() - 1] == '\r')
+		{
+			line.erase(line.size() - 1);
+		}
+		if (line.empty())
+		{
+			continue;
+		}
+
+		//header lines, only the sampling rate is needed
+		if (line.compare(0, 14, "Sampling rate:") == 0)
+		{
+			m_sampleRate = atoi(line.c_str() + 14);
+			continue;
+		}
+
+		values.clear();
+		std::istringstream fields(line);
+		std::string field;
+		bool numeric = true;
+		while (std::getline(fields, field, '\t'))
+		{
+			char* end;
+			double value = strtod(field.c_str(), &end);
+			while (*end == ' ')
+			{
+				end++;
+			}
+			if (end == field.c_str() || *end != '\0')
+			{
+				numeric = false;
+				break;
+			}
+			values.push_back(value);
+		}
+		if (!numeric)
+		{
+			if (m_nChans > 0)
+			{
+				*error = path + " line " + std::to_string(lineNumber) + ": not a row of numbers";
+				return false;
+			}
+			continue;
+		}
+
+		//sample number, the channels, then stim class, packet number, SystemTick and dropped flag
+		int nChans = (int)values.size() - 5;
+		if (m_nChans == 0)
+		{
+			if (nChans < 1)
+			{
+				*error = path + " line " + std::to_string(lineNumber) + ": too few columns";
+				return false;
+			}
+			m_nChans = nChans;
+		}
+		else if (nChans != m_nChans)
+		{
+			*error = path + " line " + std::to_string(lineNumber) + ": expected " + std::to_string(m_nChans + 5) + " columns";
+			return false;
+		}
+
+		int packetNum = (int)values[m_nChans + 2];
+		double systemTick = values[m_nChans + 3];
+		bool interpolated = values[m_nChans + 4] != 0;
+
+		if (m_packets.empty() || m_packets.back().packetNum != packetNum || m_packets.back().systemTick != systemTick
+			|| m_packets.back().interpolated != interpolated)
+		{
+			Packet packet;
+			packet.packetNum = packetNum;
+			packet.systemTick = systemTick;
+			packet.interpolated = interpolated;
+			packet.nSamples = 0;
+			packet.seconds = 0;
+			m_packets.push_back(packet);
+		}
+
+		Packet& packet = m_packets.back();
+		for (int iChan = 0; iChan < m_nChans; iChan++)
+		{
+			packet.data.push_back((float)values[1 + iChan]);
+		}
+		packet.nSamples++;
+	}
+
+	if (m_sampleRate <= 0)
+	{
+		*error = path + ": no \"Sampling rate:\" header line";
+		return false;
+	}
+
+	unwrapTicks();
+
+	if (!keepInterpolated)
+	{
+		m_packets.erase(std::remove_if(m_packets.begin(), m_packets.end(), [](const Packet& packet) { return packet.interpolated; }),
+			m_packets.end());
+	}
+	if (m_packets.empty())
+	{
+		*error = path + ": no packets to replay";
+		return false;
+	}
+
+	//put the first packet we replay at 0
+	double firstSeconds = m_packets.front().seconds;
+	std::map<int, int> lengthCounts;
+	for (size_t iPacket = 0; iPacket < m_packets.size(); iPacket++)
+	{
+		m_packets[iPacket].seconds -= firstSeconds;
+		lengthCounts[m_packets[iPacket].nSamples]++;
+	}
+
+	int commonLength = 0;
+	int commonCount = 0;
+	for (const auto& length : lengthCounts)
+	{
+		if (length.second > commonCount)
+		{
+			commonLength = length.first;
+			commonCount = length.second;
+		}
+	}
+	m_packetPeriodMs = (int)std::lround(commonLength * 1000.0 / m_sampleRate);
+
+	return true;
+}
+
+void Recording::unwrapTicks()
+{
+	//every packet moves the SystemTick on by about its length, more if packets were lost in between. Count as many wraps as
+	//gets closest to that, so long gaps (longer than a wrap) still come out right as long as the packet numbers are right
+	double ticksPerSample = (double)SYSTEM_TICKS_PER_SECOND / m_sampleRate;
+	double unwrapped = 0;
+	for (size_t iPacket = 0; iPacket < m_packets.size(); iPacket++)
+	{
+		Packet& packet = m_packets[iPacket];
+		if (iPacket > 0)
+		{
+			const Packet& previous = m_packets[iPacket - 1];
+			int packetStep = ((packet.packetNum - previous.packetNum) % PACKET_NUM_WRAP + PACKET_NUM_WRAP) % PACKET_NUM_WRAP;
+			double expected = std::max(packetStep, 1) * packet.nSamples * ticksPerSample;
+			double step = std::fmod(packet.systemTick - previous.systemTick + SYSTEM_TICK_WRAP, (double)SYSTEM_TICK_WRAP);
+			double wraps = std::max(std::floor((expected - step) / SYSTEM_TICK_WRAP + 0.5), 0.0);
+			unwrapped += step + wraps * SYSTEM_TICK_WRAP;
+		}
+		packet.seconds = unwrapped / SYSTEM_TICKS_PER_SECOND;
+	}
+}
@@ -0,0 +1,72 @@
+#ifndef MOCKSIP_RECORDING_H_INCLUDED
+#define MOCKSIP_RECORDING_H_INCLUDED
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+
+  A session saved by the SIP's SaveData thread (a "*-Data.txt" file), split
+  back into the CTM packets it came in, so it can be replayed.
+
+  The file has a few header lines (start time, "Sampling rate: 500 Hz" and
+  the column labels), then one tab separated line per time point:
+
+      SampleNumber, one value per sense channel, StimulationClass,
+      PacketNumber, Timestamp (SystemTick), IsDroppedPacket
+
+  Consecutive time points with the same packet number, SystemTick and
+  dropped flag make one packet. The INS stamps a packet with the SystemTick
+  of its last time point, in 100 us, wrapping every 6.5536 s; the wraps are
+  counted back in from the packet numbers and sizes to put every packet on
+  one INS timeline.
+
+*/
+
+class Recording
+{
+public:
+
+	struct Packet
+	{
+		int packetNum; //CTM packet number, 0 to 255
+		double systemTick; //of the last time point, the SIP's interpolated packets can have fractional ones
+		bool interpolated; //made up by the SIP to fill in a dropped packet
+		int nSamples;
+		std::vector<float> data; //[time point][channel]
+		double seconds; //when the last time point was sampled on the INS clock, the first packet is at 0
+	};
+
+	Recording();
+
+	/** Reads a recording. Packets the SIP interpolated are left out unless keepInterpolated is set, since the INS never
+	    sent them. Returns false (and why in error) if the file can't be read or has no packets */
+	bool load(const std::string& path, bool keepInterpolated, std::string* error);
+
+	int getNumChans() const { return m_nChans; }
+	int getSampleRate() const { return m_sampleRate; }
+
+	/** The most common packet length in ms, what the INS was set to */
+	int getPacketPeriodMs() const { return m_packetPeriodMs; }
+
+	const std::vector<Packet>& getPackets() const { return m_packets; }
+
+	/** From the first packet's last time point to the last packet's */
+	double getDuration() const { return m_packets.empty() ? 0 : m_packets.back().seconds; }
+
+	static const int SYSTEM_TICKS_PER_SECOND = 10000;
+	static const int SYSTEM_TICK_WRAP = 65536;
+	static const int PACKET_NUM_WRAP = 256;
+
+private:
+
+	void unwrapTicks();
+
+	int m_nChans;
+	int m_sampleRate; //Hz
+	int m_packetPeriodMs;
+	std::vector<Packet> m_packets;
+};
+
+#endif  // MOCKSIP_RECORDING_H_INCLUDED
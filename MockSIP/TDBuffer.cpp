@@ -0,0 +1,180 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "TDBuffer.h"
+
+TDBuffer::TDBuffer(int nChans, int bufferSize, int historySize)
+	: m_nChans(nChans), m_bufferSize(bufferSize), m_historySize(historySize), m_total(0), m_flushed(0)
+{
+	m_capacity = std::max(std::max(bufferSize, historySize), 1);
+	m_data.resize((size_t)m_capacity * m_nChans);
+	m_packetNums.resize(m_capacity);
+	m_systemTicks.resize(m_capacity);
+}
+
+void TDBuffer::addPacket(const float* data, int nSamples, int packetNum, double systemTick)
+{
+	for (int iSample = 0; iSample < nSamples; iSample++)
+	{
+		int ringIndex = getRingIndex(m_total);
+		memcpy(&m_data[(size_t)ringIndex * m_nChans], data + (size_t)iSample * m_nChans, m_nChans * sizeof(float));
+		m_packetNums[ringIndex] = packetNum;
+		m_systemTicks[ringIndex] = systemTick;
+		m_total++;
+	}
+}
+
+int TDBuffer::getNumBufferSamples() const
+{
+	//like the SIP's ring, only the newest bufferSize time points are kept if nobody flushes
+	return (int)std::min(m_total - m_flushed, (int64_t)m_bufferSize);
+}
+
+std::vector<char> TDBuffer::getMessageV1(bool flush)
+{
+	int nSamples = getNumBufferSamples();
+	int64_t firstSequence = m_total - nSamples;
+
+	std::vector<char> message(sizeof(int32_t) + (size_t)nSamples * (m_nChans + 1) * sizeof(double));
+	int32_t count = nSamples;
+	memcpy(&message[0], &count, sizeof(int32_t));
+
+	char* write = &message[sizeof(int32_t)];
+	for (int64_t sequence = firstSequence; sequence < m_total; sequence++)
+	{
+		int ringIndex = getRingIndex(sequence);
+		for (int iChan = 0; iChan < m_nChans; iChan++)
+		{
+			double value = m_data[(size_t)ringIndex * m_nChans + iChan];
+			memcpy(write, &value, sizeof(double));
+			write += sizeof(double);
+		}
+		double packetNum = m_packetNums[ringIndex];
+		memcpy(write, &packetNum, sizeof(double));
+		write += sizeof(double);
+	}
+
+	if (flush)
+	{
+		this->flush();
+	}
+	return message;
+}
+
+std::vector<char> TDBuffer::getMessageV2(bool flush, bool int16Samples)
+{
+	int nSamples = getNumBufferSamples();
+	std::vector<char> message = encodeV2(m_total - nSamples, nSamples, int16Samples);
+	if (flush)
+	{
+		this->flush();
+	}
+	return message;
+}
+
+std::vector<char> TDBuffer::getMessageV2Since(int64_t cursor, int maxSamples, bool int16Samples) const
+{
+	int64_t oldestSequence = std::max((int64_t)0, m_total - m_historySize);
+	int64_t firstSequence = (cursor < oldestSequence || cursor > m_total) ? oldestSequence : cursor;
+	int nSamples = (int)std::min(m_total - firstSequence, (int64_t)maxSamples);
+	return encodeV2(firstSequence, nSamples, int16Samples);
+}
+
+std::vector<char> TDBuffer::encodeV2(int64_t firstSequence, int nSamples, bool int16Samples) const
+{
+	//channel planes and packet number runs
+	std::vector<float> planes((size_t)m_nChans * nSamples);
+	std::vector<int32_t> runPacketNums, runLengths;
+	std::vector<uint16_t> runTicks, runSamplesAfter;
+	float maxAbs = 0;
+	for (int iSample = 0; iSample < nSamples; iSample++)
+	{
+		int ringIndex = getRingIndex(firstSequence + iSample);
+		for (int iChan = 0; iChan < m_nChans; iChan++)
+		{
+			float value = m_data[(size_t)ringIndex * m_nChans + iChan];
+			planes[(size_t)iChan * nSamples + iSample] = value;
+			maxAbs = std::max(maxAbs, std::fabs(value));
+		}
+
+		int packetNum = m_packetNums[ringIndex];
+		if (!runPacketNums.empty() && runPacketNums.back() == packetNum)
+		{
+			runLengths.back()++;
+		}
+		else
+		{
+			runPacketNums.push_back(packetNum);
+			runLengths.push_back(1);
+			runTicks.push_back((uint16_t)((int64_t)std::lround(m_systemTicks[ringIndex]) & 0xFFFF));
+			runSamplesAfter.push_back(0);
+		}
+	}
+
+	//only the last run can have the rest of its packet after it (when a cursor request is cut short)
+	if (!runPacketNums.empty())
+	{
+		int nAfter = 0;
+		for (int64_t sequence = firstSequence + nSamples; sequence < m_total && nAfter < 0xFFFF; sequence++, nAfter++)
+		{
+			if (m_packetNums[getRingIndex(sequence)] != runPacketNums.back())
+			{
+				break;
+			}
+		}
+		runSamplesAfter.back() = (uint16_t)nAfter;
+	}
+
+	//int16 data is scaled so the largest value in this message uses the full range
+	float int16Scale = maxAbs > 0 ? maxAbs / 32767 : 1;
+	size_t sampleBytes = int16Samples ? sizeof(int16_t) : sizeof(float);
+	size_t runsOffset = TDV2_HEADER_BYTES + planes.size() * sampleBytes;
+	size_t ticksOffset = runsOffset + runPacketNums.size() * 2 * sizeof(int32_t);
+	std::vector<char> message(ticksOffset + runPacketNums.size() * 2 * sizeof(uint16_t));
+
+	//header
+	uint8_t version = 2;
+	uint8_t flags = TDV2_FLAG_RUN_TICKS | (int16Samples ? TDV2_FLAG_INT16 : 0);
+	uint16_t headerBytes = TDV2_HEADER_BYTES;
+	uint16_t nChans = (uint16_t)m_nChans;
+	uint16_t nRuns = (uint16_t)runPacketNums.size();
+	int32_t length = nSamples;
+	int32_t firstPacketNum = nSamples > 0 ? m_packetNums[getRingIndex(firstSequence)] : 0;
+	uint32_t firstSystemTick = nSamples > 0 ? (uint32_t)m_systemTicks[getRingIndex(firstSequence)] : 0;
+	float scale = int16Samples ? int16Scale : 0;
+	uint64_t sequence = (uint64_t)firstSequence;
+	char* data = &message[0];
+	memcpy(data, &version, 1);
+	memcpy(data + 1, &flags, 1);
+	memcpy(data + 2, &headerBytes, 2);
+	memcpy(data + 4, &nChans, 2);
+	memcpy(data + 6, &nRuns, 2);
+	memcpy(data + 8, &length, 4);
+	memcpy(data + 12, &firstPacketNum, 4);
+	memcpy(data + 16, &firstSystemTick, 4);
+	memcpy(data + 20, &scale, 4);
+	memcpy(data + 24, &sequence, 8);
+
+	if (int16Samples)
+	{
+		for (size_t i = 0; i < planes.size(); i++)
+		{
+			int16_t scaled = (int16_t)std::lround(planes[i] / int16Scale);
+			memcpy(data + TDV2_HEADER_BYTES + i * sizeof(int16_t), &scaled, sizeof(int16_t));
+		}
+	}
+	else if (!planes.empty())
+	{
+		memcpy(data + TDV2_HEADER_BYTES, &planes[0], planes.size() * sizeof(float));
+	}
+
+	for (size_t iRun = 0; iRun < runPacketNums.size(); iRun++)
+	{
+		memcpy(data + runsOffset + iRun * 8, &runPacketNums[iRun], 4);
+		memcpy(data + runsOffset + iRun * 8 + 4, &runLengths[iRun], 4);
+		memcpy(data + ticksOffset + iRun * 4, &runTicks[iRun], 2);
+		memcpy(data + ticksOffset + iRun * 4 + 2, &runSamplesAfter[iRun], 2);
+	}
+
+	return message;
+}
@@ -0,0 +1,68 @@
+#ifndef MOCKSIP_TDBUFFER_H_INCLUDED
+#define MOCKSIP_TDBUFFER_H_INCLUDED
+
+#include <cstdint>
+#include <vector>
+
+/**
+
+  The SIP's TD buffer (INSBuffer.cs), cut down to what Open-Ephys sees: the
+  newest bufferSize time points that haven't been flushed, plus a history
+  of older ones that flushing doesn't touch, for "TD since sequence N"
+  requests.
+
+  Serializes to the same wire formats, see INSBuffer.getDataByteArray() for
+  v1 and getDataByteArrayV2() for v2. v2 channel data is never delta
+  bit-packed, the hand-shake tells Open-Ephys so.
+
+*/
+
+class TDBuffer
+{
+public:
+
+	TDBuffer(int nChans, int bufferSize, int historySize);
+
+	/** Adds a CTM packet's time points, data is [time point][channel] */
+	void addPacket(const float* data, int nSamples, int packetNum, double systemTick);
+
+	void flush() { m_flushed = m_total; }
+
+	bool isEmpty() const { return getNumBufferSamples() == 0; }
+	int getNumBufferSamples() const;
+	int getNumChans() const { return m_nChans; }
+	int getBufferSize() const { return m_bufferSize; }
+
+	/** Everything in the buffer in the v1 format (doubles, with a packet number per time point) */
+	std::vector<char> getMessageV1(bool flush);
+
+	/** Everything in the buffer in the v2 format */
+	std::vector<char> getMessageV2(bool flush, bool int16Samples);
+
+	/** Up to maxSamples from the history starting at sequence number cursor, in the v2 format. Starts at the oldest time
+	    point we still have if the cursor is older than that, or newer than anything we've had */
+	std::vector<char> getMessageV2Since(int64_t cursor, int maxSamples, bool int16Samples) const;
+
+	static const int TDV2_HEADER_BYTES = 32;
+	static const uint8_t TDV2_FLAG_INT16 = 0x01;
+	static const uint8_t TDV2_FLAG_RUN_TICKS = 0x04;
+
+private:
+
+	std::vector<char> encodeV2(int64_t firstSequence, int nSamples, bool int16Samples) const;
+	int getRingIndex(int64_t sequence) const { return (int)(sequence % m_capacity); }
+
+	int m_nChans;
+	int m_bufferSize;
+	int m_historySize;
+	int m_capacity; //time points the ring holds, enough for both the buffer and the history
+
+	std::vector<float> m_data; //[ring index][channel]
+	std::vector<int> m_packetNums;
+	std::vector<double> m_systemTicks;
+
+	int64_t m_total; //time points ever added, the sequence number of the next one
+	int64_t m_flushed; //sequence number the buffer starts from after the last flush
+};
+
+#endif  // MOCKSIP_TDBUFFER_H_INCLUDED
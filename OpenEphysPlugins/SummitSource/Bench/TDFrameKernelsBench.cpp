@@ -0,0 +1,215 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2014 Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/*
+
+  Stand-alone microbenchmark for TDFrameKernels::deinterleave(), not part of
+  the plugin. Times the loop SummitSource used before the kernels (convert
+  into a temporary double array per channel, then scale in process())
+  against the scalar, SSE2 and AVX2 kernels at 2, 4 and 16 channels, and
+  checks that every implementation gives bit-identical output. Exits with 1
+  if any doesn't.
+
+  See the README for how to build it.
+
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+#include "TDFrameKernels.h"
+
+namespace
+{
+	const int N_FRAMES = 1003; //a typical TD reply
+	const float SCALE = 1000; //mV to uV, like SummitSource
+	const int N_REPEATS = 7; //best of
+	const double MIN_REPEAT_SECONDS = 0.05;
+
+	typedef void(*DeinterleaveFunction)(const char*, int, int, float, float* const*, int, int*);
+
+	//what SummitSource::deserialize() and process() did before TDFrameKernels
+	void deinterleaveOld(const char* frames, int nFrames, int nChans, float scale, float* const* channelOut, int outOffset,
+		int* packetNumOut)
+	{
+		const double* doubleData = reinterpret_cast<const double*>(frames);
+		double** doubleArray = new double*[nChans];
+		for (int iChan = 0; iChan < nChans; iChan++)
+		{
+			doubleArray[iChan] = new double[nFrames];
+		}
+
+		double packet;
+		for (int iFrame = 0; iFrame < nFrames; iFrame++)
+		{
+			for (int iChan = 0; iChan < nChans; iChan++)
+			{
+				memcpy(&doubleArray[iChan][iFrame], doubleData, 8);
+				channelOut[iChan][outOffset + iFrame] = (float)doubleArray[iChan][iFrame];
+				doubleData++;
+			}
+			memcpy(&packet, doubleData, 8);
+			packetNumOut[outOffset + iFrame] = (int)packet;
+			doubleData++;
+		}
+
+		for (int iChan = 0; iChan < nChans; iChan++)
+		{
+			delete[] doubleArray[iChan];
+		}
+		delete[] doubleArray;
+
+		//the scaling was a separate pass when filling the output buffer
+		for (int iChan = 0; iChan < nChans; iChan++)
+		{
+			for (int iFrame = 0; iFrame < nFrames; iFrame++)
+			{
+				channelOut[iChan][outOffset + iFrame] = channelOut[iChan][outOffset + iFrame] * scale;
+			}
+		}
+	}
+
+	struct Output
+	{
+		std::vector<std::vector<float> > channels;
+		std::vector<float*> planes;
+		std::vector<int> packetNums;
+
+		Output(int nChans) : channels(nChans, std::vector<float>(N_FRAMES)), planes(nChans), packetNums(N_FRAMES)
+		{
+			for (int iChan = 0; iChan < nChans; iChan++)
+			{
+				planes[iChan] = &channels[iChan][0];
+			}
+		}
+
+		bool operator==(const Output& other) const
+		{
+			for (size_t iChan = 0; iChan < channels.size(); iChan++)
+			{
+				if (memcmp(&channels[iChan][0], &other.channels[iChan][0], N_FRAMES * sizeof(float)) != 0)
+				{
+					return false;
+				}
+			}
+			return memcmp(&packetNums[0], &other.packetNums[0], N_FRAMES * sizeof(int)) == 0;
+		}
+	};
+
+	//best time per call in us
+	double timeImplementation(DeinterleaveFunction deinterleave, const char* frames, int nChans, Output* output)
+	{
+		double best = 1e30;
+		for (int iRepeat = 0; iRepeat < N_REPEATS; iRepeat++)
+		{
+			long long nCalls = 0;
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			double seconds;
+			do
+			{
+				for (int iCall = 0; iCall < 100; iCall++)
+				{
+					deinterleave(frames, N_FRAMES, nChans, SCALE, &output->planes[0], 0, &output->packetNums[0]);
+				}
+				nCalls += 100;
+				seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			} while (seconds < MIN_REPEAT_SECONDS);
+			best = std::min(best, seconds * 1e6 / nCalls);
+		}
+		return best;
+	}
+}
+
+int main()
+{
+	std::string best = TDFrameKernels::getImplementationName();
+	struct Implementation
+	{
+		const char* name;
+		DeinterleaveFunction function;
+		bool supported;
+	};
+	const Implementation implementations[] = {
+		{ "old loop", &deinterleaveOld, true },
+		{ "scalar", &TDFrameKernels::deinterleaveScalar, true },
+		{ "SSE2", &TDFrameKernels::deinterleaveSSE2, best == "SSE2" || best == "AVX2" },
+		{ "AVX2", &TDFrameKernels::deinterleaveAVX2, best == "AVX2" }
+	};
+	const int nImplementations = sizeof(implementations) / sizeof(implementations[0]);
+	const int channelCounts[] = { 2, 4, 16 };
+
+	printf("%d frames, best of %d, us per call (deinterleave() picks %s)\n\n", N_FRAMES, N_REPEATS, best.c_str());
+	printf("%8s", "channels");
+	for (int iImpl = 0; iImpl < nImplementations; iImpl++)
+	{
+		printf("%12s", implementations[iImpl].name);
+	}
+	printf("\n");
+
+	std::mt19937 random(1);
+	std::uniform_real_distribution<double> millivolts(-2.0, 2.0);
+	bool allIdentical = true;
+	for (int nChans : channelCounts)
+	{
+		//a reply as the SIP sends it: int32 length, then the frames, so they're only 4-byte aligned
+		std::vector<char> reply(sizeof(int) + (size_t)N_FRAMES * (nChans + 1) * sizeof(double));
+		char* frames = &reply[sizeof(int)];
+		for (int iFrame = 0; iFrame < N_FRAMES; iFrame++)
+		{
+			for (int iChan = 0; iChan <= nChans; iChan++)
+			{
+				double value = iChan < nChans ? millivolts(random) : (double)(iFrame / 10);
+				memcpy(frames + ((size_t)iFrame * (nChans + 1) + iChan) * sizeof(double), &value, sizeof(double));
+			}
+		}
+
+		Output reference(nChans);
+		deinterleaveOld(frames, N_FRAMES, nChans, SCALE, &reference.planes[0], 0, &reference.packetNums[0]);
+
+		printf("%8d", nChans);
+		for (int iImpl = 0; iImpl < nImplementations; iImpl++)
+		{
+			const Implementation& implementation = implementations[iImpl];
+			if (!implementation.supported)
+			{
+				printf("%12s", "n/a");
+				continue;
+			}
+
+			Output output(nChans);
+			double us = timeImplementation(implementation.function, frames, nChans, &output);
+			bool identical = output == reference;
+			allIdentical = allIdentical && identical;
+			printf("%11.2f%s", us, identical ? " " : "!");
+		}
+		printf("\n");
+	}
+
+	printf("\n%s\n", allIdentical ? "All outputs bit-identical to the old loop" : "! marks output that differs from the old loop");
+	return allIdentical ? 0 : 1;
+}
@@ -0,0 +1,157 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2014 Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <algorithm>
+#include <cmath>
+#include "INSClockDrift.h"
+
+const double INSClockDrift::MIN_DRIFT_SPAN_S = 10.0;
+const double INSClockDrift::MIN_GATE_S = 0.002;
+const double INSClockDrift::GATE_SCALES = 3.0;
+const double INSClockDrift::SCALE_SMOOTHING = 0.05;
+
+INSClockDrift::INSClockDrift(int windowPoints)
+	: m_windowPoints(windowPoints), m_x(windowPoints), m_y(windowPoints)
+{
+	reset();
+}
+
+void INSClockDrift::reset()
+{
+	m_next = 0;
+	m_count = 0;
+	m_x0 = 0;
+	m_y0 = 0;
+	m_sumX = m_sumY = m_sumXX = m_sumXY = 0;
+	m_scale = 0;
+	m_consecutiveRejects = 0;
+
+	m_estimate.valid = false;
+	m_estimate.offsetSeconds = 0;
+	m_estimate.rate = 1.0;
+	m_estimate.jitterMs = 0;
+	m_estimate.lastDelayMs = 0;
+	m_estimate.nPoints = 0;
+	m_estimate.nRejected = 0;
+}
+
+bool INSClockDrift::addPoint(double deviceSeconds, double hostSeconds)
+{
+	if (m_count == 0)
+	{
+		m_x0 = deviceSeconds;
+		m_y0 = hostSeconds;
+	}
+	double x = deviceSeconds - m_x0;
+	double y = hostSeconds - m_y0;
+
+	//how late this packet is compared to the quickest ones so far
+	if (m_estimate.valid)
+	{
+		double residual = hostSeconds - m_estimate.deviceToHost(deviceSeconds);
+		m_estimate.lastDelayMs = residual * 1000;
+
+		if (residual > std::max(MIN_GATE_S, GATE_SCALES * m_scale))
+		{
+			m_estimate.nRejected++;
+			if (++m_consecutiveRejects >= MAX_CONSECUTIVE_REJECTS)
+			{
+				reset();
+			}
+			return false;
+		}
+
+		m_scale += SCALE_SMOOTHING * (std::fabs(residual) - m_scale);
+		m_estimate.jitterMs = m_scale * 1000;
+	}
+	m_consecutiveRejects = 0;
+
+	//slide the window, taking the oldest point out of the sums
+	if (m_count == m_windowPoints)
+	{
+		double oldX = m_x[m_next];
+		double oldY = m_y[m_next];
+		m_sumX -= oldX;
+		m_sumY -= oldY;
+		m_sumXX -= oldX * oldX;
+		m_sumXY -= oldX * oldY;
+	}
+	else
+	{
+		m_count++;
+	}
+
+	m_x[m_next] = x;
+	m_y[m_next] = y;
+	m_sumX += x;
+	m_sumY += y;
+	m_sumXX += x * x;
+	m_sumXY += x * y;
+
+	//adding and taking away for hours slowly loses precision, so add the window up again from scratch once per
+	//time around (which keeps it O(1) per point on average)
+	if (++m_next == m_windowPoints)
+	{
+		m_next = 0;
+		recomputeSums();
+	}
+
+	updateFit();
+	return true;
+}
+
+void INSClockDrift::updateFit()
+{
+	if (m_count < MIN_FIT_POINTS)
+	{
+		return;
+	}
+
+	double n = m_count;
+	double meanX = m_sumX / n;
+	double meanY = m_sumY / n;
+	double varX = m_sumXX / n - meanX * meanX;
+	double covXY = m_sumXY / n - meanX * meanY;
+
+	//the points have to cover a while before the rate means anything, until then just fit the offset
+	double oldest = m_x[m_count == m_windowPoints ? m_next : 0];
+	double newest = m_x[(m_next + m_windowPoints - 1) % m_windowPoints];
+	double rate = (newest - oldest >= MIN_DRIFT_SPAN_S && varX > 0) ? covXY / varX : 1.0;
+
+	m_estimate.rate = rate;
+	m_estimate.offsetSeconds = m_y0 + (meanY - rate * meanX) - rate * m_x0;
+	m_estimate.nPoints = m_count;
+	m_estimate.valid = true;
+}
+
+void INSClockDrift::recomputeSums()
+{
+	m_sumX = m_sumY = m_sumXX = m_sumXY = 0;
+	for (int i = 0; i < m_count; i++)
+	{
+		m_sumX += m_x[i];
+		m_sumY += m_y[i];
+		m_sumXX += m_x[i] * m_x[i];
+		m_sumXY += m_x[i] * m_y[i];
+	}
+}
@@ -0,0 +1,108 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2014 Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef INSCLOCKDRIFT_H_INCLUDED
+#define INSCLOCKDRIFT_H_INCLUDED
+
+#include <vector>
+
+/**
+
+  Streaming fit of the INS clock against the host's steady clock.
+
+  Each point is the INS time of a CTM packet (seconds on the sample clock, see
+  INSSampleClock) and the host time we received it. The fit is
+
+      host = offset + rate * device
+
+  by least squares over the last windowPoints accepted points, kept as running
+  sums so each point costs O(1). Transport delays only ever make a packet
+  late, so points far above the line are left out of the fit: the line tracks
+  the packets that got through quickest, the drift (rate - 1) is the clock skew
+  and what's left over on each packet is the variable part of the transport
+  latency. The fixed part of the latency can't be told apart from the clocks'
+  offset without a round trip, so it's in the offset.
+
+  Only used from the SummitSource receiver thread, SummitSource hands out
+  copies of the Estimate.
+
+*/
+
+class INSClockDrift
+{
+public:
+
+	struct Estimate
+	{
+		bool valid; //have enough points for the offset (the drift needs a bit longer, it's 0 until then)
+		double offsetSeconds; //host steady clock time of device time 0
+		double rate; //host seconds per device second
+		double jitterMs; //typical transport delay on top of the quickest packets
+		double lastDelayMs; //how late the last packet was compared to the fit
+		int nPoints; //points in the fit
+		int nRejected; //points left out of the fit since the last reset
+
+		double getDriftPpm() const { return (rate - 1.0) * 1e6; }
+		double deviceToHost(double deviceSeconds) const { return offsetSeconds + rate * deviceSeconds; }
+		double hostToDevice(double hostSeconds) const { return (hostSeconds - offsetSeconds) / rate; }
+	};
+
+	INSClockDrift(int windowPoints);
+
+	/** Forgets all points */
+	void reset();
+
+	/** Adds the INS time of a packet and the host time it arrived, both in seconds. Returns false if it was too late
+	    to go in the fit */
+	bool addPoint(double deviceSeconds, double hostSeconds);
+
+	const Estimate& getEstimate() const { return m_estimate; }
+
+private:
+
+	void updateFit();
+	void recomputeSums();
+
+	//window of accepted points relative to the first one since the reset, so the sums stay small
+	int m_windowPoints;
+	std::vector<double> m_x;
+	std::vector<double> m_y;
+	int m_next; //where the next point goes
+	int m_count;
+	double m_x0;
+	double m_y0;
+	double m_sumX, m_sumY, m_sumXX, m_sumXY;
+
+	double m_scale; //running average of how far accepted points are from the fit, in seconds
+	int m_consecutiveRejects;
+	Estimate m_estimate;
+
+	static const int MIN_FIT_POINTS = 10;
+	static const double MIN_DRIFT_SPAN_S; //don't fit the rate to less than this much device time
+	static const double MIN_GATE_S; //points this close to the fit always go in
+	static const double GATE_SCALES;
+	static const double SCALE_SMOOTHING;
+	static const int MAX_CONSECUTIVE_REJECTS = 100; //after this many the clocks must have jumped, so start over
+};
+
+#endif  // INSCLOCKDRIFT_H_INCLUDED
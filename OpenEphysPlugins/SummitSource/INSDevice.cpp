@@ -0,0 +1,1294 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2014 Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <algorithm>
+#include <cstring>
+#include "INSDevice.h"
+#include "TDFrameKernels.h"
+
+const float INSDevice::DEFAULT_SAMPLE_RATE = 500.0f;
+const float INSDevice::MAX_SIDE_SAMPLE_RATE = 1000.0f;
+const double INSDevice::NO_LATENESS = -1e9;
+const float INSDevice::DATA_SCALE = 1000.0f;
+
+INSDevice::INSDevice(const std::string& name, const std::string& endpoint, const StreamLayout& layout, const Options& options,
+	zmq::context_t& context, std::ostream& receiverLog, std::ostream& processLog, std::ostream* profilingLog,
+	const INSGenerator::Settings* generator)
+	: m_name(name), m_endpoint(endpoint), m_context(context), m_socket(context, ZMQ_REQ), m_pushSocket(context, ZMQ_PULL),
+	m_receiverLog(receiverLog), m_processLog(processLog), m_profilingLog(profilingLog), m_options(options), m_layout(layout),
+	m_receivedLayout(layout), m_layoutChanged(false), m_clockDrift(CLOCK_DRIFT_WINDOW)
+{
+	m_connectionState = STATE_IDLE;
+	m_streamMode = STREAM_POLL;
+	m_tdFormat = TD_FORMAT_V1;
+	m_useCursor = false;
+	m_cursorValid = false;
+	m_cursor = 0;
+	m_replyHasSequence = false;
+	m_replyFirstSequence = 0;
+	m_nChans = 0;
+	m_bufferSize = MAX_INS_BUFFER_SIZE;
+	m_handshakeSent = false;
+	m_waitingForReply = false;
+	m_backoffMs = BACKOFF_INITIAL_MS;
+
+	//allocate memory, big enough for whatever the SIP tells us during the handshake so the receiver never has to reallocate
+	m_nAllocChans = std::min(std::max((int)MAX_TD_CHANS, m_layout.nChans), (int)MAX_CHANS);
+	m_decodeData = new float*[m_nAllocChans];
+	m_receiveData = new float*[m_nAllocChans];
+	m_blockData = new float*[m_nAllocChans];
+	for (int iChan = 0; iChan < m_nAllocChans; iChan++)
+	{
+		m_decodeData[iChan] = new float[MAX_INS_BUFFER_SIZE]();
+		m_receiveData[iChan] = new float[MAX_INS_BUFFER_SIZE]();
+		m_blockData[iChan] = new float[MAX_INS_BUFFER_SIZE]();
+	}
+	m_decodePacketNumbers = new int[MAX_INS_BUFFER_SIZE]();
+	m_receivePacketNumbers = new int[MAX_INS_BUFFER_SIZE]();
+	m_receiveTimestamps = new int64_t[MAX_INS_BUFFER_SIZE]();
+	m_receiveMask = new float[MAX_INS_BUFFER_SIZE]();
+	m_blockPacketNumbers = new int[MAX_INS_BUFFER_SIZE]();
+	m_blockTimestamps = new int64_t[MAX_INS_BUFFER_SIZE]();
+	m_blockMask = new float[MAX_INS_BUFFER_SIZE]();
+	m_decodeRuns.reserve(MAX_INS_BUFFER_SIZE);
+
+	//room for a few SIP buffers worth of data, in case Open Ephys falls behind for a bit. Only as many channels as
+	//we have outputs for (plus the interpolated mask), so we don't copy ones nobody sees
+	m_ringBuffer.reset(new INSRingBuffer(m_layout.nChans + 1, 4 * MAX_INS_BUFFER_SIZE));
+
+	//packets are put back in order and gaps filled before they go in the ring
+	m_gapFiller.reset(new INSGapFiller(m_layout.nChans));
+	m_gapFiller->reset(m_layout.sampleRate, m_layout.packetPeriodMs, m_options.reorderLatencyMs, m_options.fillMode);
+	m_gapFiller->setLog(&m_receiverLog);
+	m_carryOverStart = 0;
+	m_carryOverLength = 0;
+
+	//timestamps start from 0 every acquisition, and stay on the same clock across reconnects to the SIP. The other sense
+	//streams have their own clocks and rings
+	m_sampleClock.reset(m_layout.sampleRate);
+	for (size_t iStream = 0; iStream < m_layout.sideStreams.size(); iStream++)
+	{
+		const SideStreamLayout& sideStream = m_layout.sideStreams[iStream];
+		m_sideStreams.push_back(std::unique_ptr<INSSideStream>(new INSSideStream(sideStream.type, sideStream.nChans, sideStream.sampleRate)));
+	}
+	m_pendingSideStream = -1;
+	m_nextSideStream = 0;
+
+	//the clocks' offset is different every time the INS or the host restarts, so it's fitted again every acquisition
+	m_clockDriftEstimate = m_clockDrift.getEstimate();
+	for (int iSlot = 0; iSlot < 3; iSlot++)
+	{
+		m_clockDriftSlots[iSlot] = m_clockDriftEstimate;
+	}
+	m_clockDriftFront = 0;
+	m_clockDriftMiddle = 1;
+	m_clockDriftBack = 2;
+	m_clockDriftChanged = false;
+	m_processClockDrift = m_clockDriftEstimate;
+
+	m_blockTimestamp = 0;
+	m_nextTimestamp = 0;
+	m_backlog = 0;
+	m_backlogged = false;
+	m_playout.reset(m_layout.sampleRate, m_options.playoutDelayMs, m_options.playoutAdaptive);
+	m_releaseLateness = NO_LATENESS;
+	m_playoutDelayLogged = 0;
+	m_lagFeatures.reset(m_layout.nChans, m_options.featureLags);
+
+	if (generator != nullptr)
+	{
+		m_generator.reset(new INSGenerator(*generator));
+	}
+}
+
+INSDevice::~INSDevice()
+{
+	//deallocate memory
+	for (int iChan = 0; iChan < m_nAllocChans; iChan++)
+	{
+		delete[] m_decodeData[iChan];
+		delete[] m_receiveData[iChan];
+		delete[] m_blockData[iChan];
+	}
+	delete[] m_decodeData;
+	delete[] m_receiveData;
+	delete[] m_blockData;
+	delete[] m_decodePacketNumbers;
+	delete[] m_receivePacketNumbers;
+	delete[] m_receiveTimestamps;
+	delete[] m_receiveMask;
+	delete[] m_blockPacketNumbers;
+	delete[] m_blockTimestamps;
+	delete[] m_blockMask;
+}
+
+INSDevice::StreamLayout INSDevice::getDefaultLayout()
+{
+	StreamLayout layout;
+	layout.nChans = DEFAULT_CHANS;
+	layout.sampleRate = DEFAULT_SAMPLE_RATE;
+	layout.packetPeriodMs = 0;
+	for (int iChan = 0; iChan < DEFAULT_CHANS; iChan++)
+	{
+		layout.labels.push_back("TD" + std::to_string(iChan + 1));
+	}
+	return layout;
+}
+
+//Handshake reply (see handshake() for the first fields), newer SIPs then also send:
+//
+//int sampling rate (Hz)
+//int packet period (ms)
+//int number of bytes of channel labels that follow
+//ASCII channel labels, one per channel separated by '\n'
+//int gap filling (see handshake())
+//int number of other sense streams, then for each one int type (see INSSideStream::Type), int number of channels and
+//    float sampling rate
+//
+//anything an older SIP doesn't send gets a default. Returns false if the channel count isn't something we can take
+bool INSDevice::parseStreamLayout(const zmq::message_t& reply, StreamLayout* layout)
+{
+	const size_t layoutStart = 7 * sizeof(int);
+	int dataBytes[10] = { 0 };
+	memcpy(dataBytes, reply.data(), std::min(reply.size(), sizeof(dataBytes)));
+
+	if (reply.size() < 2 * sizeof(int) || dataBytes[0] < 1 || dataBytes[0] > MAX_TD_CHANS)
+	{
+		return false;
+	}
+
+	layout->nChans = dataBytes[0];
+	layout->sampleRate = (reply.size() >= layoutStart + sizeof(int) && dataBytes[7] > 0) ? (float)dataBytes[7] : DEFAULT_SAMPLE_RATE;
+	layout->packetPeriodMs = (reply.size() >= layoutStart + 2 * sizeof(int) && dataBytes[8] > 0) ? dataBytes[8] : 0;
+
+	layout->labels.clear();
+	const size_t labelsStart = layoutStart + 3 * sizeof(int);
+	if (reply.size() >= labelsStart && dataBytes[9] > 0 && (size_t)dataBytes[9] <= reply.size() - labelsStart)
+	{
+		std::string labels(static_cast<const char*>(reply.data()) + labelsStart, dataBytes[9]);
+		size_t labelStart = 0;
+		while ((int)layout->labels.size() < layout->nChans)
+		{
+			size_t labelEnd = labels.find('\n', labelStart);
+			layout->labels.push_back(labels.substr(labelStart, labelEnd == std::string::npos ? std::string::npos : labelEnd - labelStart));
+			if (labelEnd == std::string::npos)
+			{
+				break;
+			}
+			labelStart = labelEnd + 1;
+		}
+	}
+
+	for (int iChan = (int)layout->labels.size(); iChan < layout->nChans; iChan++)
+	{
+		layout->labels.push_back("TD" + std::to_string(iChan + 1));
+	}
+
+	//the other sense streams come after the labels and the gap filling int. Ones we can't take are left out, we just
+	//never ask for them
+	layout->sideStreams.clear();
+	const size_t sideStreamsStart = labelsStart + std::max(dataBytes[9], 0) + sizeof(int);
+	int nSideStreams = 0;
+	if (reply.size() >= labelsStart && reply.size() >= sideStreamsStart + sizeof(int))
+	{
+		memcpy(&nSideStreams, static_cast<const char*>(reply.data()) + sideStreamsStart, sizeof(int));
+	}
+	const char* sideStream = static_cast<const char*>(reply.data()) + sideStreamsStart + sizeof(int);
+	for (int iStream = 0; iStream < nSideStreams && sideStream + 3 * sizeof(int) <= static_cast<const char*>(reply.data()) + reply.size(); iStream++)
+	{
+		int type;
+		SideStreamLayout sideStreamLayout;
+		memcpy(&type, sideStream, sizeof(int));
+		memcpy(&sideStreamLayout.nChans, sideStream + sizeof(int), sizeof(int));
+		memcpy(&sideStreamLayout.sampleRate, sideStream + 2 * sizeof(int), sizeof(float));
+		sideStreamLayout.type = (INSSideStream::Type)type;
+		sideStream += 3 * sizeof(int);
+
+		if (validSideStream(sideStreamLayout) && layout->sideStreams.size() < MAX_SIDE_STREAMS)
+		{
+			layout->sideStreams.push_back(sideStreamLayout);
+		}
+	}
+
+	return true;
+}
+
+bool INSDevice::validSideStream(const SideStreamLayout& sideStream)
+{
+	return (sideStream.type == INSSideStream::STREAM_FFT || sideStream.type == INSSideStream::STREAM_POWER || sideStream.type == INSSideStream::STREAM_ACCEL)
+		&& sideStream.nChans >= 1 && sideStream.nChans <= INSSideStream::MAX_CHANS && sideStream.sampleRate > 0 && sideStream.sampleRate <= MAX_SIDE_SAMPLE_RATE;
+}
+
+INSDevice::StreamLayout INSDevice::getGeneratorLayout(const INSGenerator::Settings& settings)
+{
+	//the generator shortens the packets if it has to
+	INSGenerator generator(settings);
+	StreamLayout layout;
+	layout.nChans = settings.nChans;
+	layout.sampleRate = settings.sampleRate;
+	layout.packetPeriodMs = generator.getSettings().packetPeriodMs;
+	for (int iChan = 0; iChan < layout.nChans; iChan++)
+	{
+		layout.labels.push_back("TD" + std::to_string(iChan + 1));
+	}
+	return layout;
+}
+
+bool INSDevice::sameLayout(const StreamLayout& a, const StreamLayout& b)
+{
+	return a.nChans == b.nChans && a.sampleRate == b.sampleRate && a.packetPeriodMs == b.packetPeriodMs && a.labels == b.labels
+		&& a.sideStreams == b.sideStreams;
+}
+
+std::ostream& INSDevice::log()
+{
+	if (!m_name.empty())
+	{
+		m_receiverLog << "[" << m_name << "] ";
+	}
+	return m_receiverLog;
+}
+
+void INSDevice::startReceiving()
+{
+	m_backoffMs = BACKOFF_INITIAL_MS;
+	if (!m_generator)
+	{
+		sendHandshake();
+		return;
+	}
+
+	//nothing to handshake with, the generator makes v2 messages like a SIP in push mode
+	m_nChans = m_layout.nChans;
+	m_bufferSize = MAX_INS_BUFFER_SIZE;
+	m_tdFormat = TD_FORMAT_V2;
+	m_streamMode = STREAM_PUSH;
+	m_useCursor = false;
+	const INSGenerator::Settings& settings = m_generator->getSettings();
+	log() << "Generator: " << std::to_string(settings.nChans) << " channels at " << std::to_string(settings.sampleRate) << " Hz, "
+		<< std::to_string(m_generator->getPacketSamples()) << " samples a packet, bursts of " << std::to_string(settings.burstPackets)
+		<< ", " << std::to_string(settings.dropPercent) << "% dropped, up to " << std::to_string(settings.jitterMs) << " ms late" << std::endl;
+	m_generator->start(std::chrono::steady_clock::now());
+	m_lastDataTime = std::chrono::steady_clock::now();
+	setConnectionState(STATE_STREAMING);
+}
+
+void INSDevice::stopReceiving()
+{
+	if (m_connectionState != STATE_IDLE)
+	{
+		setConnectionState(STATE_IDLE);
+	}
+	m_socket.close();
+	m_pushSocket.close();
+}
+
+//Goes handshaking -> streaming, and whenever the SIP stops answering, backs off for a bit and handshakes again with
+//fresh sockets. Nothing here waits, the receiver thread's poll does that for every device at once
+void INSDevice::setConnectionState(ConnectionState state)
+{
+	static const char* stateNames[] = { "idle", "handshaking", "streaming", "backoff" };
+	log() << "Connection state: " << stateNames[m_connectionState] << " -> " << stateNames[state] << std::endl;
+	m_connectionState = state;
+	m_stateTime = std::chrono::steady_clock::now();
+}
+
+void INSDevice::backOff()
+{
+	log() << "Retrying in " << std::to_string(m_backoffMs) << " ms" << std::endl;
+	setConnectionState(STATE_BACKOFF);
+}
+
+//throw away the old sockets (a REQ socket that lost its reply is stuck for good) and make new ones that don't
+//hang around on close. Returns false if the endpoint can't be connected to at all
+bool INSDevice::resetSockets()
+{
+	m_socket = zmq::socket_t(m_context, ZMQ_REQ);
+	applySocketOptions(m_socket);
+
+	m_pushSocket = zmq::socket_t(m_context, ZMQ_PULL);
+	applySocketOptions(m_pushSocket);
+
+	m_handshakeSent = false;
+	m_waitingForReply = false;
+	m_pendingSideStream = -1;
+
+	try
+	{
+		m_socket.connect(m_endpoint);
+	}
+	catch (const zmq::error_t& e)
+	{
+		log() << "Couldn't connect to " << m_endpoint << ": " << e.what() << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+void INSDevice::applySocketOptions(zmq::socket_t& optionSocket)
+{
+	int linger = 0;
+	int immediate = m_options.immediate ? 1 : 0;
+	optionSocket.setsockopt(ZMQ_LINGER, &linger, sizeof(linger));
+	optionSocket.setsockopt(ZMQ_RCVHWM, &m_options.receiveHWM, sizeof(m_options.receiveHWM));
+	optionSocket.setsockopt(ZMQ_IMMEDIATE, &immediate, sizeof(immediate));
+	if (m_options.receiveBufferSize > 0)
+	{
+		optionSocket.setsockopt(ZMQ_RCVBUF, &m_options.receiveBufferSize, sizeof(m_options.receiveBufferSize));
+	}
+}
+
+//where the SIP pushes TD packets: over tcp it's the port it gave us in the handshake on the same host as the
+//request socket, over ipc/inproc there are no ports so it's the request address with "-push" on the end
+std::string INSDevice::getPushEndpoint(int pushPort) const
+{
+	if (m_endpoint.compare(0, 6, "tcp://") != 0)
+	{
+		return m_endpoint + "-push";
+	}
+
+	size_t portStart = m_endpoint.rfind(':');
+	std::string host = portStart <= 5 ? m_endpoint : m_endpoint.substr(0, portStart);
+	return host + ":" + std::to_string(pushPort);
+}
+
+//fresh sockets, "InitTD" goes out as soon as the socket can take it (a fresh socket with ZMQ_IMMEDIATE set can't
+//send anything until its connection is up)
+void INSDevice::sendHandshake()
+{
+	setConnectionState(STATE_HANDSHAKING);
+	if (!resetSockets())
+	{
+		backOff();
+	}
+}
+
+void INSDevice::prepare()
+{
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+	switch (m_connectionState)
+	{
+	case STATE_BACKOFF:
+		if (now - m_stateTime >= std::chrono::milliseconds(m_backoffMs))
+		{
+			m_backoffMs = std::min(2 * m_backoffMs, (int)BACKOFF_MAX_MS);
+			sendHandshake();
+		}
+		break;
+
+	case STATE_STREAMING:
+		//samples from the last reply that didn't fit in the ring go first, and nothing new is taken from the SIP until they're
+		//all in (in push mode ZMQ keeps queueing the packets meanwhile, up to the receive HWM). It's process() that's behind
+		//here, not the SIP, so that doesn't count as the SIP going quiet
+		if (m_carryOverLength > 0)
+		{
+			deliverCarryOver();
+			m_lastDataTime = now;
+			break;
+		}
+
+		//packets the gap filler was holding back go out once they've waited long enough, even if the SIP has nothing new
+		releasePackets();
+
+		//ask for whatever's due (only if we aren't still waiting on the last request, a REQ socket has to alternate)
+		if (!m_generator && !m_waitingForReply && m_carryOverLength == 0 && !sendRequest())
+		{
+			backOff();
+		}
+		break;
+
+	default:
+		break;
+	}
+}
+
+int INSDevice::addPollItems(zmq::pollitem_t* items)
+{
+	int nItems = 0;
+	switch (m_connectionState)
+	{
+	case STATE_HANDSHAKING:
+	{
+		zmq::pollitem_t item = { static_cast<void*>(m_socket), 0, (short)(m_handshakeSent ? ZMQ_POLLIN : ZMQ_POLLOUT), 0 };
+		items[nItems++] = item;
+		break;
+	}
+
+	case STATE_STREAMING:
+	{
+		if (m_generator)
+		{
+			break;
+		}
+
+		//nothing new is read while there are samples carried over, push mode always has a slot so the items line up
+		bool reading = m_carryOverLength == 0;
+		if (m_streamMode == STREAM_PUSH)
+		{
+			zmq::pollitem_t item = { static_cast<void*>(m_pushSocket), 0, (short)(reading ? ZMQ_POLLIN : 0), 0 };
+			items[nItems++] = item;
+		}
+		if (m_waitingForReply)
+		{
+			zmq::pollitem_t item = { static_cast<void*>(m_socket), 0, (short)(reading ? ZMQ_POLLIN : 0), 0 };
+			items[nItems++] = item;
+		}
+		break;
+	}
+
+	default:
+		break;
+	}
+	return nItems;
+}
+
+int INSDevice::getPollTimeoutMs() const
+{
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	std::chrono::steady_clock::time_point wakeUp = now + std::chrono::milliseconds(POLL_TIMEOUT_MS);
+
+	if (m_connectionState == STATE_BACKOFF)
+	{
+		wakeUp = std::min(wakeUp, m_stateTime + std::chrono::milliseconds(m_backoffMs));
+	}
+	else if (m_connectionState == STATE_HANDSHAKING)
+	{
+		wakeUp = std::min(wakeUp, m_stateTime + std::chrono::milliseconds(HANDSHAKE_TIMEOUT_MS));
+	}
+	else if (m_connectionState == STATE_STREAMING && m_carryOverLength > 0)
+	{
+		wakeUp = now + std::chrono::milliseconds(IDLE_WAIT_MS);
+	}
+	else if (m_connectionState == STATE_STREAMING && m_generator)
+	{
+		wakeUp = std::min(wakeUp, m_generator->getNextMessageTime());
+	}
+	else if (m_connectionState == STATE_STREAMING && !m_waitingForReply)
+	{
+		//next time there's something to ask for, in push mode only the other sense streams are asked for
+		if (m_streamMode == STREAM_POLL)
+		{
+			wakeUp = std::min(wakeUp, m_nextRequestTime);
+		}
+		if (!m_sideStreams.empty())
+		{
+			wakeUp = std::min(wakeUp, m_nextSidePoll);
+		}
+	}
+
+	if (wakeUp <= now)
+	{
+		return 0;
+	}
+
+	return (int)std::chrono::duration_cast<std::chrono::milliseconds>(wakeUp - now).count();
+}
+
+void INSDevice::service(const zmq::pollitem_t* items, int loop)
+{
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+	switch (m_connectionState)
+	{
+	case STATE_HANDSHAKING:
+	{
+		if (!m_handshakeSent && (items[0].revents & ZMQ_POLLOUT))
+		{
+			zmq::message_t request(6);
+			memcpy(request.data(), "InitTD", 6);
+			m_handshakeSent = m_socket.send(request, ZMQ_DONTWAIT);
+		}
+		else if (m_handshakeSent && (items[0].revents & ZMQ_POLLIN))
+		{
+			zmq::message_t reply;
+			if (m_socket.recv(&reply, ZMQ_DONTWAIT))
+			{
+				if (handshake(reply))
+				{
+					setConnectionState(STATE_STREAMING);
+					m_backoffMs = BACKOFF_INITIAL_MS;
+				}
+				else
+				{
+					backOff();
+				}
+				break;
+			}
+		}
+
+		if (now - m_stateTime > std::chrono::milliseconds(HANDSHAKE_TIMEOUT_MS))
+		{
+			log() << (m_handshakeSent ? "No handshake reply from the SIP" : "Couldn't send the handshake to the SIP") << std::endl;
+			backOff();
+		}
+		break;
+	}
+
+	case STATE_STREAMING:
+	{
+		int iItem = 0;
+		zmq::message_t reply;
+
+		//messages from the generator take the same way as pushed ones
+		if (m_generator)
+		{
+			if (m_carryOverLength == 0 && m_generator->getMessage(now, &reply))
+			{
+				receiveTD(reply, loop);
+			}
+			break;
+		}
+
+		//TD pushed by the SIP
+		if (m_streamMode == STREAM_PUSH)
+		{
+			if ((items[iItem].revents & ZMQ_POLLIN) && m_pushSocket.recv(&reply, ZMQ_DONTWAIT))
+			{
+				receiveTD(reply, loop);
+			}
+			else if (now - m_lastDataTime > std::chrono::milliseconds(PUSH_SILENCE_TIMEOUT_MS))
+			{
+				log() << "Nothing pushed by the SIP in " << std::to_string(PUSH_SILENCE_TIMEOUT_MS) << " ms" << std::endl;
+				backOff();
+				break;
+			}
+			iItem++;
+		}
+
+		//reply to our last request
+		if (m_waitingForReply)
+		{
+			zmq::message_t requestReply;
+			if ((items[iItem].revents & ZMQ_POLLIN) && m_socket.recv(&requestReply, ZMQ_DONTWAIT))
+			{
+				m_waitingForReply = false;
+				if (m_pendingSideStream >= 0)
+				{
+					receiveSideStream(requestReply);
+					m_lastDataTime = now;
+				}
+				else
+				{
+					receiveTD(requestReply, loop);
+				}
+			}
+			else if (m_carryOverLength == 0 && now - m_requestTime > std::chrono::milliseconds(REPLY_TIMEOUT_MS))
+			{
+				log() << "No reply from the SIP in " << std::to_string(REPLY_TIMEOUT_MS) << " ms" << std::endl;
+				backOff();
+			}
+		}
+		break;
+	}
+
+	default:
+		break;
+	}
+}
+
+//set everything up from the SIP's reply to "InitTD", returns false if it isn't something we can take
+bool INSDevice::handshake(const zmq::message_t& reply)
+{
+	//Message structure on handshake:
+	//
+	//int number of channels
+	//int buffer size
+	//int stream mode (0 for request/reply polling, 1 for SIP pushing), older SIPs don't send this
+	//int port the SIP pushes TD packets on (only used for push mode), older SIPs don't send this
+	//int TD format version (1 or 2), older SIPs don't send this and only send v1
+	//int TD compression (0 for none, 1 for delta bit-packed v2 planes), older SIPs don't send this
+	//int whether the SIP answers "TD since sequence N" requests, older SIPs don't send this
+	//int sampling rate, int packet period, int label bytes and the labels (see parseStreamLayout)
+	//int gap filling (1 if the SIP leaves dropped and out of order packets to us), older SIPs don't send this
+	//
+	if (reply.size() < 8)
+	{
+		log() << "Handshake reply too short: " << std::to_string(reply.size()) << " bytes" << std::endl;
+		return false;
+	}
+
+	int dataBytes[10] = { 0 };
+	memcpy(dataBytes, reply.data(), std::min(reply.size(), sizeof(dataBytes)));
+
+	//we can only hold so much, anything bigger gets cut short (and asked for again if we're using the cursor)
+	if (dataBytes[0] < 1 || dataBytes[0] > MAX_TD_CHANS)
+	{
+		log() << "SIP sends " << std::to_string(dataBytes[0]) << " channels, can only take 1 to " << std::to_string(MAX_TD_CHANS) << std::endl;
+		return false;
+	}
+	m_nChans = dataBytes[0];
+
+	m_bufferSize = dataBytes[1];
+	if (m_bufferSize < 1 || m_bufferSize > MAX_INS_BUFFER_SIZE)
+	{
+		log() << "SIP buffer size " << std::to_string(m_bufferSize) << ", limiting replies to " << std::to_string(MAX_INS_BUFFER_SIZE) << std::endl;
+		m_bufferSize = MAX_INS_BUFFER_SIZE;
+	}
+
+	m_streamMode = STREAM_POLL;
+	if (reply.size() >= 16 && dataBytes[2] == STREAM_PUSH)
+	{
+		try
+		{
+			m_pushSocket.connect(getPushEndpoint(dataBytes[3]));
+		}
+		catch (const zmq::error_t& e)
+		{
+			log() << "Couldn't connect to " << getPushEndpoint(dataBytes[3]) << ": " << e.what() << std::endl;
+			return false;
+		}
+		m_streamMode = STREAM_PUSH;
+	}
+
+	m_tdFormat = (reply.size() >= 20 && dataBytes[4] == TD_FORMAT_V2) ? TD_FORMAT_V2 : TD_FORMAT_V1;
+
+	//each v2 reply also flags its own encoding, so this is just for the record
+	bool tdCompressed = reply.size() >= 24 && dataBytes[5] == 1;
+
+	//cursor requests are only understood with v2 replies (which say where they start) and only make sense when we ask for data.
+	//The cursor is kept across reconnects, so if it's the same SIP we carry on where we left off
+	m_useCursor = reply.size() >= 28 && dataBytes[6] == 1 && m_tdFormat == TD_FORMAT_V2 && m_streamMode == STREAM_POLL;
+
+	//the output channels were built from what the SIP said before we started. If it's changed since (e.g. it was restarted
+	//with other settings), carry on with the channels we have and rebuild them once acquisition stops
+	StreamLayout layout;
+	parseStreamLayout(reply, &layout);
+	m_receivedLayout = layout;
+	m_layoutChanged = !sameLayout(layout, m_layout);
+	if (m_layoutChanged)
+	{
+		log() << "SIP now sends " << std::to_string(layout.nChans) << " channels at " << std::to_string(layout.sampleRate) << " Hz, the outputs were set up for "
+			<< std::to_string(m_layout.nChans) << " at " << std::to_string(m_layout.sampleRate) << " Hz until acquisition restarts" << std::endl;
+	}
+
+	//channels the SIP doesn't send (any more) stay zero
+	for (int iChan = m_nChans; iChan < m_nAllocChans; iChan++)
+	{
+		memset(m_decodeData[iChan], 0, MAX_INS_BUFFER_SIZE * sizeof(float));
+	}
+
+	//after the labels, whether the SIP leaves dropped and out of order packets to us (it always sends what it has,
+	//the gap filler just has nothing to do if the SIP already interpolated)
+	const size_t gapFillStart = 10 * sizeof(int) + (reply.size() >= 10 * sizeof(int) ? std::max(dataBytes[9], 0) : 0);
+	int gapFill = 0;
+	if (reply.size() >= gapFillStart + sizeof(int))
+	{
+		memcpy(&gapFill, static_cast<const char*>(reply.data()) + gapFillStart, sizeof(int));
+	}
+
+	log() << "Handshake: " << std::to_string(m_nChans) << " channels, buffer size " << std::to_string(m_bufferSize) << std::endl;
+	log() << "Sampling rate: " << std::to_string(layout.sampleRate) << " Hz, packet period " << std::to_string(layout.packetPeriodMs) << " ms" << std::endl;
+	log() << "Stream mode: " << (m_streamMode == STREAM_PUSH ? "push" : "poll") << std::endl;
+	log() << "TD format: v" << m_tdFormat << std::endl;
+	log() << "TD compression: " << (tdCompressed ? "delta bit-packed" : "none") << std::endl;
+	log() << "TD cursor requests: " << (m_useCursor ? "yes" : "no") << std::endl;
+	log() << "Dropped packets filled in by: " << (gapFill == 1 ? "us" : "SIP") << std::endl;
+	for (size_t iStream = 0; iStream < layout.sideStreams.size(); iStream++)
+	{
+		log() << "Also offers " << INSSideStream::getTypeName(layout.sideStreams[iStream].type) << ": " << std::to_string(layout.sideStreams[iStream].nChans)
+			<< " channels at " << std::to_string(layout.sideStreams[iStream].sampleRate) << " Hz" << std::endl;
+	}
+
+	m_lastDataTime = std::chrono::steady_clock::now();
+	m_nextRequestTime = m_lastDataTime;
+	m_nextSidePoll = m_lastDataTime;
+	return true;
+}
+
+//ask for whatever's due on the REQ socket: the other sense streams about once a packet period, TD in between (in push
+//mode TD comes by itself). Once we know where the SIP's sequence numbers are, TD is asked for from the last time point
+//we kept. Returns false if the socket wouldn't take the request
+bool INSDevice::sendRequest()
+{
+	int sideStream = nextSideStreamDue();
+	if (sideStream >= 0)
+	{
+		return requestSideStream(sideStream);
+	}
+
+	if (m_streamMode == STREAM_PUSH || std::chrono::steady_clock::now() < m_nextRequestTime)
+	{
+		return true;
+	}
+
+	m_pendingSideStream = -1;
+	zmq::message_t request(m_useCursor && m_cursorValid ? 2 + sizeof(uint64_t) : 2);
+	memcpy(request.data(), "TD", 2);
+	if (m_useCursor && m_cursorValid)
+	{
+		memcpy(static_cast<char*>(request.data()) + 2, &m_cursor, sizeof(uint64_t));
+	}
+	if (!m_socket.send(request, ZMQ_DONTWAIT))
+	{
+		return false;
+	}
+	m_waitingForReply = true;
+	m_requestTime = std::chrono::steady_clock::now();
+	return true;
+}
+
+//the other sense stream that should be asked for next, -1 if none are due. Each round asks for all of them in turn, and
+//rounds are a packet period apart (they never have more than one packet's worth waiting)
+int INSDevice::nextSideStreamDue()
+{
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	if (m_sideStreams.empty() || now < m_nextSidePoll)
+	{
+		return -1;
+	}
+
+	if (m_nextSideStream >= (int)m_sideStreams.size())
+	{
+		m_nextSideStream = 0;
+	}
+	if (m_nextSideStream == (int)m_sideStreams.size() - 1)
+	{
+		m_nextSidePoll = now + std::chrono::milliseconds(std::max(m_layout.packetPeriodMs, (int)SIDE_POLL_MIN_MS));
+	}
+	return m_nextSideStream;
+}
+
+//send the request for one of the other sense streams on the REQ socket, the reply is told apart from a TD one by
+//m_pendingSideStream
+bool INSDevice::requestSideStream(int iStream)
+{
+	const char* command = m_sideStreams[iStream]->getRequest();
+	zmq::message_t request(strlen(command));
+	memcpy(request.data(), command, strlen(command));
+	if (!m_socket.send(request, ZMQ_DONTWAIT))
+	{
+		return false;
+	}
+
+	m_pendingSideStream = iStream;
+	m_nextSideStream = iStream + 1;
+	m_waitingForReply = true;
+	m_requestTime = std::chrono::steady_clock::now();
+	return true;
+}
+
+void INSDevice::receiveSideStream(const zmq::message_t& reply)
+{
+	if (m_pendingSideStream >= 0 && m_pendingSideStream < (int)m_sideStreams.size())
+	{
+		m_sideStreams[m_pendingSideStream]->decode(static_cast<const char*>(reply.data()), reply.size(), m_receiverLog);
+	}
+	m_pendingSideStream = -1;
+}
+
+//hand one TD reply (or pushed packet) on to process()
+void INSDevice::receiveTD(zmq::message_t& reply, int loop)
+{
+	//how long we waited for it, since the request went out or (in push mode) since the last packet
+	std::chrono::steady_clock::time_point waitStart = m_streamMode == STREAM_PUSH ? m_lastDataTime : m_requestTime;
+	m_lastDataTime = std::chrono::steady_clock::now();
+
+	if (m_profilingLog != nullptr)
+	{
+		*m_profilingLog << m_name << (m_name.empty() ? "" : " ") << std::to_string(loop) << " ";
+		*m_profilingLog << std::to_string(std::chrono::duration_cast<std::chrono::microseconds>(m_lastDataTime - waitStart).count()) << " ";
+	}
+
+	//deserialize data from ZMQ socket to data arrays
+	std::chrono::high_resolution_clock::time_point startTime = std::chrono::high_resolution_clock::now();
+
+	int length = deserialize(m_decodeData, m_decodePacketNumbers, 0, &reply);
+
+	std::chrono::high_resolution_clock::time_point endTime = std::chrono::high_resolution_clock::now();
+	if (m_profilingLog != nullptr)
+	{
+		*m_profilingLog << std::to_string(std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime).count()) << " ";
+	}
+
+	//put the packets back in order, fill any gaps and hand whatever's ready over to process()
+	startTime = std::chrono::high_resolution_clock::now();
+
+	for (size_t iRun = 0; iRun < m_decodeRuns.size(); iRun++)
+	{
+		const TDRun& run = m_decodeRuns[iRun];
+		m_gapFiller->addRun(m_decodeData, run.start, run.length, run.packetNum, run.hasTick, run.systemTick, run.samplesAfter, m_lastDataTime);
+	}
+	releasePackets();
+
+	//move the cursor past everything we got, whatever didn't fit in the ring yet is carried over to the next pass
+	if (m_replyHasSequence)
+	{
+		if (m_cursorValid && m_replyFirstSequence > m_cursor)
+		{
+			log() << "Lost " << std::to_string(m_replyFirstSequence - m_cursor) << " samples, SIP no longer had them" << std::endl;
+		}
+		else if (m_cursorValid && m_replyFirstSequence < m_cursor && length > 0)
+		{
+			log() << "SIP sequence went back from " << std::to_string(m_cursor) << " to " << std::to_string(m_replyFirstSequence) << ", was it restarted?" << std::endl;
+		}
+
+		if (length > 0 || !m_cursorValid)
+		{
+			m_cursor = m_replyFirstSequence + length;
+			m_cursorValid = true;
+		}
+	}
+
+	endTime = std::chrono::high_resolution_clock::now();
+	if (m_profilingLog != nullptr)
+	{
+		*m_profilingLog << std::to_string(std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime).count()) << std::endl;
+	}
+
+	//nothing new at the SIP, give it a moment before asking again
+	if (m_streamMode == STREAM_POLL && length == 0)
+	{
+		m_nextRequestTime = m_lastDataTime + std::chrono::milliseconds(IDLE_WAIT_MS);
+	}
+}
+
+//take whatever the gap filler has ready and put as much of it in the ring as fits, the rest is carried over.
+//Returns the number of time points released
+int INSDevice::releasePackets()
+{
+	m_carryOverStart = 0;
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	m_carryOverLength = m_gapFiller->release(m_sampleClock, m_receiveData, m_receivePacketNumbers, m_receiveTimestamps, m_receiveMask,
+		MAX_INS_BUFFER_SIZE, now);
+	int released = m_carryOverLength;
+
+	//one point for the clock drift fit, the newest packet with a SystemTick against when it got here
+	std::chrono::steady_clock::time_point arrival;
+	if (m_gapFiller->getLastTickArrival(&arrival))
+	{
+		m_clockDrift.addPoint(m_sampleClock.getLastPacketSeconds(), std::chrono::duration<double>(arrival.time_since_epoch()).count());
+		publishClockDrift();
+	}
+
+	//how long after the INS took it the oldest sample released got here, process() sizes its playout delay from it
+	const INSClockDrift::Estimate& fit = m_clockDrift.getEstimate();
+	if (released > 0 && fit.valid)
+	{
+		double lateness = std::chrono::duration<double>(now.time_since_epoch()).count() - fit.deviceToHost(m_receiveTimestamps[0] / m_gapFiller->getSampleRate());
+		double peak = m_releaseLateness.load();
+		while (lateness > peak && !m_releaseLateness.compare_exchange_weak(peak, lateness))
+		{
+		}
+	}
+
+	deliverCarryOver();
+	return released;
+}
+
+//move as much of the carried over samples into the ring as fits, returns how many went in
+int INSDevice::deliverCarryOver()
+{
+	//the ring has the interpolated mask as an extra channel after the TD channels
+	int nOutChans = m_gapFiller->getNumChans();
+	float* carryOverData[MAX_CHANS + 1];
+	for (int iChan = 0; iChan < nOutChans; iChan++)
+	{
+		carryOverData[iChan] = m_receiveData[iChan] + m_carryOverStart;
+	}
+	carryOverData[nOutChans] = m_receiveMask + m_carryOverStart;
+
+	int written = m_ringBuffer->write(carryOverData, m_receivePacketNumbers + m_carryOverStart, m_receiveTimestamps + m_carryOverStart, m_carryOverLength);
+	m_carryOverStart += written;
+	m_carryOverLength -= written;
+	return written;
+}
+
+//get ZMQ message as data, writing it starting at sample offset of the data arrays. Returns the number of time points written
+int INSDevice::deserialize(float** data, int* packNums, int offset, zmq::message_t* reply)
+{
+	//Serialization is:
+	//
+	//  int32 number of buffer time points that are in this ZMQ packet
+	//
+	//  double data of channel 1 at time point 1,
+	//  double data of channel 2 at time point 1,
+	//  .
+	//  .
+	//  .
+	//  double data of channel m_nChans, time point 1,
+	//  double CTM packet number of time point 1,
+	//
+	//  double data of channel 1 at time point 2,
+	//  double data of channel 2 at time point 2,
+	//  .
+	//  .
+	//  .
+	//  double data of channel m_nChans at time point 2,
+	//  double CTM packet number of time point 2,
+	//  
+	//  .
+	//  .
+	//  .
+	//  double data of channel m_nChans at time point m_currentBufferInd
+	//  double CTM packet number of time point m_currentBufferInd,
+
+	m_replyHasSequence = false;
+	m_decodeRuns.clear();
+
+	//an empty or truncated message has no data
+	size_t replySize = reply->size();
+	if (replySize < sizeof(int))
+	{
+		return 0;
+	}
+
+	const char* replyData = static_cast<const char*>(reply->data());
+	if (m_tdFormat == TD_FORMAT_V2)
+	{
+		return deserializeV2(data, packNums, offset, replyData, replySize);
+	}
+
+	//get the length (as int) of the incoming data (first 4 bytes)
+	int length;
+	memcpy(&length, replyData, sizeof(int));
+
+	//rest of the serialization is as doubles, make sure the message actually holds that many time points
+	const size_t frameSize = (m_nChans + 1) * sizeof(double);
+	int framesInReply = (int)((replySize - sizeof(int)) / frameSize);
+	if (length < 0 || length > framesInReply)
+	{
+		log() << "Reply says it has " << std::to_string(length) << " samples but only holds " << std::to_string(framesInReply) << std::endl;
+		length = length < 0 ? 0 : framesInReply;
+	}
+
+	//don't write past the end of our arrays (can happen in push mode if a lot of packets queued up)
+	if (offset + length > m_bufferSize)
+	{
+		log() << "Dropping " << std::to_string(offset + length - m_bufferSize) << " samples, more than buffer size" << std::endl;
+		length = m_bufferSize - offset;
+	}
+
+	//decode straight out of the message into the data arrays, scaling to the units Open Ephys displays in.
+	//The doubles start 4 bytes in so they aren't 8-byte aligned, the kernels use unaligned loads
+	TDFrameKernels::deinterleave(replyData + sizeof(int), length, m_nChans, DATA_SCALE, data, offset, packNums);
+
+	//v1 has no runs or SystemTicks, so just split it where the packet number changes
+	for (int iPoint = 0; iPoint < length; iPoint++)
+	{
+		if (iPoint == 0 || packNums[offset + iPoint] != packNums[offset + iPoint - 1])
+		{
+			TDRun run = { offset + iPoint, 0, packNums[offset + iPoint], false, 0, 0 };
+			m_decodeRuns.push_back(run);
+		}
+		m_decodeRuns.back().length++;
+	}
+
+	return length;
+}
+
+//get a "TD v2" ZMQ message as data, writing it starting at sample offset of the data arrays. Returns the number of time points written
+int INSDevice::deserializeV2(float** data, int* packNums, int offset, const char* replyData, size_t replySize)
+{
+	//Serialization is (all little endian):
+	//
+	//  header:
+	//      uint8 format version (2)
+	//      uint8 flags (bit 0 set if the channel data is int16 instead of float32, bit 1 set if it's delta bit-packed, bit 2 set if
+	//          the run SystemTicks follow the runs)
+	//      uint16 headerBytes (newer SIPs may add fields at the end, skip anything we don't know about)
+	//      uint16 number of channels
+	//      uint16 number of packet number runs
+	//      int32 number of buffer time points that are in this ZMQ packet
+	//      int32 CTM packet number of time point 1
+	//      uint32 SystemTick of time point 1 (in 100 us)
+	//      float32 scale of the int16 data (value = int16 * scale), unused for float32 data
+	//      uint64 sequence number of time point 1 (count of all time points the SIP ever buffered before it), older SIPs don't send this
+	//
+	//  channel planes, all time points of channel 1, then all of channel 2, etc. (float32 or int16)
+	//  if flag bit 1 is set each plane is instead delta bit-packed (see TDFrameKernels::decodeDeltaPackedPlane):
+	//      int32 first value (the int16 sample or the float32 bit pattern)
+	//      then for every 32 time points after that:
+	//          uint8 bit width w
+	//          32 zig-zagged deltas from the previous value packed into w bits each (4*w bytes)
+	//
+	//  packet number runs (consecutive time points from the same CTM packet):
+	//      int32 CTM packet number of the run
+	//      int32 number of time points in the run
+	//
+	//  run SystemTicks, if flag bit 2 is set (one per run, older SIPs don't send them):
+	//      uint16 SystemTick of the run's CTM packet, which the INS takes at the packet's last time point (in 100 us, wraps every 6.5536 s)
+	//      uint16 number of time points of the same CTM packet that come after the run (when a packet is split between replies)
+
+	if (replySize < TDV2_MIN_HEADER_BYTES)
+	{
+		log() << "TD v2 reply too short for header: " << std::to_string(replySize) << " bytes" << std::endl;
+		return 0;
+	}
+
+	uint8_t version = static_cast<uint8_t>(replyData[0]);
+	uint8_t flags = static_cast<uint8_t>(replyData[1]);
+	uint16_t headerBytes, replyChans, nRuns;
+	int32_t length;
+	float int16Scale;
+	memcpy(&headerBytes, replyData + 2, sizeof(uint16_t));
+	memcpy(&replyChans, replyData + 4, sizeof(uint16_t));
+	memcpy(&nRuns, replyData + 6, sizeof(uint16_t));
+	memcpy(&length, replyData + 8, sizeof(int32_t));
+	memcpy(&int16Scale, replyData + 20, sizeof(float));
+
+	if (headerBytes >= TDV2_SEQUENCE_HEADER_BYTES && replySize >= TDV2_SEQUENCE_HEADER_BYTES)
+	{
+		memcpy(&m_replyFirstSequence, replyData + 24, sizeof(uint64_t));
+		m_replyHasSequence = true;
+	}
+
+	if (version != TD_FORMAT_V2 || headerBytes < TDV2_MIN_HEADER_BYTES || headerBytes > replySize || replyChans != m_nChans || length < 0)
+	{
+		log() << "Bad TD v2 header: version " << std::to_string(version) << ", " << std::to_string(replyChans)
+			<< " channels, " << std::to_string(length) << " samples" << std::endl;
+		return 0;
+	}
+
+	//samples the SIP no longer had for us are a gap on the sample clock too (receiveTD logs it)
+	if (m_replyHasSequence && m_cursorValid && m_replyFirstSequence > m_cursor)
+	{
+		m_gapFiller->skipSamples((int64_t)(m_replyFirstSequence - m_cursor));
+	}
+
+	bool isInt16 = (flags & TDV2_FLAG_INT16) != 0;
+	bool isDeltaPacked = (flags & TDV2_FLAG_DELTA_PACKED) != 0;
+	float scale = isInt16 ? int16Scale * DATA_SCALE : DATA_SCALE;
+
+	//don't write past the end of our arrays (can happen in push mode if a lot of packets queued up)
+	int nWrite = length;
+	if (offset + nWrite > m_bufferSize)
+	{
+		log() << "Dropping " << std::to_string(offset + nWrite - m_bufferSize) << " samples, more than buffer size" << std::endl;
+		nWrite = m_bufferSize - offset;
+	}
+
+	//channel planes, scaling to the units Open Ephys displays in
+	size_t planeOffset = headerBytes;
+	for (int iChan = 0; iChan < m_nChans && length > 0; iChan++)
+	{
+		size_t planeBytes;
+		if (isDeltaPacked)
+		{
+			planeBytes = TDFrameKernels::decodeDeltaPackedPlane(replyData + planeOffset, replySize - planeOffset, length, isInt16, scale,
+				data[iChan] + offset, nWrite);
+		}
+		else
+		{
+			//make sure the message actually holds everything the header says it does
+			planeBytes = length * (isInt16 ? sizeof(int16_t) : sizeof(float));
+			if (planeOffset + planeBytes > replySize)
+			{
+				planeBytes = 0;
+			}
+			else if (isInt16)
+			{
+				TDFrameKernels::convertInt16Plane(replyData + planeOffset, nWrite, scale, data[iChan] + offset);
+			}
+			else
+			{
+				TDFrameKernels::convertFloat32Plane(replyData + planeOffset, nWrite, scale, data[iChan] + offset);
+			}
+		}
+
+		if (planeBytes == 0)
+		{
+			log() << "TD v2 reply says it has " << std::to_string(length) << " samples but is only " << std::to_string(replySize) << " bytes" << std::endl;
+			return 0;
+		}
+		planeOffset += planeBytes;
+	}
+
+	size_t runsOffset = planeOffset;
+	if (runsOffset + nRuns * 2 * sizeof(int32_t) > replySize)
+	{
+		log() << "TD v2 reply is missing packet number runs" << std::endl;
+		return 0;
+	}
+
+	size_t ticksOffset = runsOffset + nRuns * 2 * sizeof(int32_t);
+	bool hasTicks = (flags & TDV2_FLAG_RUN_TICKS) != 0;
+	if (hasTicks && ticksOffset + nRuns * 2 * sizeof(uint16_t) > replySize)
+	{
+		log() << "TD v2 reply is missing run SystemTicks" << std::endl;
+		hasTicks = false;
+	}
+
+	//expand the packet number runs, keeping them (and their SystemTicks) for the gap filler
+	const char* run = replyData + runsOffset;
+	const char* tick = replyData + ticksOffset;
+	int iPoint = 0;
+	for (int iRun = 0; iRun < nRuns && iPoint < nWrite; iRun++)
+	{
+		int32_t packetNum, runLength;
+		memcpy(&packetNum, run, sizeof(int32_t));
+		memcpy(&runLength, run + sizeof(int32_t), sizeof(int32_t));
+		run += 2 * sizeof(int32_t);
+
+		TDRun decodedRun = { offset + iPoint, std::max(0, std::min((int)runLength, nWrite - iPoint)), packetNum, hasTicks, 0, 0 };
+		if (hasTicks)
+		{
+			uint16_t samplesAfterRun;
+			memcpy(&decodedRun.systemTick, tick, sizeof(uint16_t));
+			memcpy(&samplesAfterRun, tick + sizeof(uint16_t), sizeof(uint16_t));
+			tick += 2 * sizeof(uint16_t);
+
+			//a run we had to cut short is missing the end of its packet too
+			decodedRun.samplesAfter = samplesAfterRun + (runLength - decodedRun.length);
+		}
+		m_decodeRuns.push_back(decodedRun);
+
+		for (int i = 0; i < decodedRun.length; i++)
+		{
+			packNums[offset + iPoint++] = packetNum;
+		}
+	}
+
+	//runs should cover every time point, if they don't just repeat the last packet number
+	if (iPoint < nWrite)
+	{
+		log() << "TD v2 packet number runs only cover " << std::to_string(iPoint) << " of " << std::to_string(nWrite) << " samples" << std::endl;
+		TDRun decodedRun = { offset + iPoint, nWrite - iPoint, iPoint > 0 ? packNums[offset + iPoint - 1] : 0, false, 0, 0 };
+		m_decodeRuns.push_back(decodedRun);
+		for (; iPoint < nWrite; iPoint++)
+		{
+			packNums[offset + iPoint] = decodedRun.packetNum;
+		}
+	}
+
+	return nWrite;
+}
+
+std::ostream& INSDevice::processLog()
+{
+	if (!m_name.empty())
+	{
+		m_processLog << "[" << m_name << "] ";
+	}
+	return m_processLog;
+}
+
+void INSDevice::publishClockDrift()
+{
+	m_clockDriftSlots[m_clockDriftBack] = m_clockDrift.getEstimate();
+	m_clockDriftBack = m_clockDriftMiddle.exchange(m_clockDriftBack | CLOCK_DRIFT_FRESH, std::memory_order_acq_rel) & ~CLOCK_DRIFT_FRESH;
+
+	std::lock_guard<std::mutex> lock(m_clockDriftLock);
+	m_clockDriftEstimate = m_clockDrift.getEstimate();
+}
+
+int INSDevice::readBlock(int maxSamples)
+{
+	//newest clock fit from the receiver thread, for the playout and to pass on as an event. One exchange, whatever the
+	//receiver published last is what we get
+	if (m_clockDriftMiddle.load(std::memory_order_relaxed) & CLOCK_DRIFT_FRESH)
+	{
+		m_clockDriftFront = m_clockDriftMiddle.exchange(m_clockDriftFront, std::memory_order_acq_rel) & ~CLOCK_DRIFT_FRESH;
+		m_processClockDrift = m_clockDriftSlots[m_clockDriftFront];
+		m_clockDriftChanged = true;
+	}
+
+	//only take what's due to be played out (everything there is if playout is off)
+	double lateness = m_releaseLateness.exchange(NO_LATENESS);
+	if (lateness != NO_LATENESS)
+	{
+		m_playout.addLateness(lateness);
+	}
+	int available = m_ringBuffer->getNumReadable();
+	int64_t firstTimestamp = m_nextTimestamp;
+	if (available > 0)
+	{
+		m_ringBuffer->peekTimestamp(&firstTimestamp);
+	}
+	double hostSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	int due = m_playout.getDueSamples(firstTimestamp, available, m_processClockDrift, hostSeconds);
+
+	if (m_playout.isEnabled() && std::abs(m_playout.getDelayMs() - m_playoutDelayLogged) >= PLAYOUT_LOG_STEP_MS)
+	{
+		processLog() << "Playout delay now " << std::to_string((int)m_playout.getDelayMs()) << " ms" << std::endl;
+		m_playoutDelayLogged = m_playout.getDelayMs();
+	}
+
+	//never more than the block Open Ephys gave us room for, the rest waits for the next call
+	//the ring has the interpolated mask as an extra channel after the TD channels
+	float* readPlanes[MAX_CHANS + 1];
+	for (int iChan = 0; iChan < m_layout.nChans; iChan++)
+	{
+		readPlanes[iChan] = m_blockData[iChan];
+	}
+	readPlanes[m_layout.nChans] = m_blockMask;
+	int packetLength = m_ringBuffer->read(readPlanes, m_blockPacketNumbers, m_blockTimestamps, std::min(due, std::min(maxSamples, (int)MAX_INS_BUFFER_SIZE)));
+	m_backlog = due - packetLength + m_carryOverLength;
+
+	//note when we start falling behind and when we've caught up again, not every block in between
+	if (!m_backlogged && m_backlog > maxSamples)
+	{
+		processLog() << "Backlog of " << std::to_string(m_backlog) << " samples (" << std::to_string((int)(1000 * m_backlog / m_layout.sampleRate)) << " ms)" << std::endl;
+		m_backlogged = true;
+	}
+	else if (m_backlogged && m_backlog == 0)
+	{
+		processLog() << "Backlog cleared" << std::endl;
+		m_backlogged = false;
+	}
+
+	//the lag features shouldn't span a jump in the sample clock
+	if (packetLength > 0 && m_blockTimestamps[0] != m_nextTimestamp)
+	{
+		m_lagFeatures.clear();
+	}
+	m_lagFeatures.push(m_blockData, packetLength);
+
+	//the ring only hands out contiguous samples, so the block is stamped with the INS sample clock of its first one
+	m_blockTimestamp = packetLength > 0 ? m_blockTimestamps[0] : m_nextTimestamp;
+	m_nextTimestamp = m_blockTimestamp + packetLength;
+	return packetLength;
+}
+
+bool INSDevice::getNewClockDrift(double* values)
+{
+	if (!m_clockDriftChanged)
+	{
+		return false;
+	}
+	m_clockDriftChanged = false;
+
+	//readBlock() already picked up the newest fit
+	const INSClockDrift::Estimate& estimate = m_processClockDrift;
+	if (!estimate.valid)
+	{
+		return false;
+	}
+
+	double eventValues[CLOCK_DRIFT_EVENT_VALUES] = { estimate.offsetSeconds, estimate.getDriftPpm(), estimate.jitterMs,
+		estimate.lastDelayMs, (double)estimate.nPoints, (double)estimate.nRejected };
+	memcpy(values, eventValues, sizeof(eventValues));
+	return true;
+}
+
+bool INSDevice::getLagFeatures(float* features) const
+{
+	return m_lagFeatures.getFeatures(features);
+}
+
+INSClockDrift::Estimate INSDevice::getClockDriftEstimate() const
+{
+	std::lock_guard<std::mutex> lock(m_clockDriftLock);
+	return m_clockDriftEstimate;
+}
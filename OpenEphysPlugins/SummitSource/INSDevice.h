@@ -0,0 +1,355 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2014 Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef INSDEVICE_H_INCLUDED
+#define INSDEVICE_H_INCLUDED
+
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+
+#include "zmq.hpp"
+#include "INSRingBuffer.h"
+#include "INSSampleClock.h"
+#include "INSClockDrift.h"
+#include "INSGapFiller.h"
+#include "INSPlayout.h"
+#include "INSLagFeatures.h"
+#include "INSSideStream.h"
+#include "INSGenerator.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+
+  Everything SummitSource keeps for one INS, i.e. one SIP: its sockets and
+  connection state, the decode and gap filling state, its sample clock and
+  clock fit, and the ring, playout and lag features process() reads it
+  through.
+
+  The receiver side never blocks. SummitSource's one receiver thread calls
+  prepare(), adds every device's sockets to a single zmq::poll with
+  addPollItems(), then hands the results back to service(), so any number of
+  SIPs are served by one thread on one ZMQ context. A device handshakes,
+  streams, and whenever its SIP stops answering backs off and handshakes
+  again on its own, without holding up the others. A device can also be fed
+  by an INSGenerator instead of a SIP, in which case it has no sockets and
+  its messages go through the same decoding from service().
+
+  The processing side (readBlock() and the block getters) is only used from
+  process(), the layout getters only once the receiver has stopped.
+
+*/
+
+class INSDevice
+{
+public:
+
+	//what the SIP tells us about its other sense streams in the handshake
+	struct SideStreamLayout
+	{
+		INSSideStream::Type type;
+		int nChans;
+		float sampleRate; //Hz
+		bool operator==(const SideStreamLayout& other) const { return type == other.type && nChans == other.nChans && sampleRate == other.sampleRate; }
+	};
+
+	//what the SIP tells us about the TD stream in the handshake, the output channels are built from this
+	struct StreamLayout
+	{
+		int nChans;
+		float sampleRate; //Hz
+		int packetPeriodMs; //0 if the SIP didn't say
+		std::vector<std::string> labels; //one per channel
+		std::vector<SideStreamLayout> sideStreams; //the other sense streams it offers, older SIPs don't send any
+	};
+
+	/** The layout used until we've heard from a SIP */
+	static StreamLayout getDefaultLayout();
+	static bool parseStreamLayout(const zmq::message_t& reply, StreamLayout* layout);
+	static bool sameLayout(const StreamLayout& a, const StreamLayout& b);
+	static bool validSideStream(const SideStreamLayout& sideStream);
+
+	/** The layout an INSGenerator with these settings makes */
+	static StreamLayout getGeneratorLayout(const INSGenerator::Settings& settings);
+
+	/** How the device is set up, from SummitSource's settings */
+	struct Options
+	{
+		int receiveHWM;
+		int receiveBufferSize;
+		bool immediate;
+		int reorderLatencyMs;
+		INSGapFiller::FillMode fillMode;
+		int playoutDelayMs;
+		bool playoutAdaptive;
+		std::vector<int> featureLags;
+	};
+
+	/** name goes in front of every log line (empty for none), the logs are only written from the thread that's using
+	    that side of the device. The context is shared with the other devices. With generator settings, the data comes
+	    from an INSGenerator instead of the SIP at endpoint */
+	INSDevice(const std::string& name, const std::string& endpoint, const StreamLayout& layout, const Options& options,
+		zmq::context_t& context, std::ostream& receiverLog, std::ostream& processLog, std::ostream* profilingLog,
+		const INSGenerator::Settings* generator = nullptr);
+
+	~INSDevice();
+
+	//receiver thread
+
+	/** Starts handshaking */
+	void startReceiving();
+
+	/** Closes the sockets, we don't stay connected to the SIP while we aren't acquiring */
+	void stopReceiving();
+
+	/** Everything that doesn't wait on a socket: backing off, (re)sending the handshake, handing carried over and
+	    gap filled samples to process(), and sending the next request */
+	void prepare();
+
+	/** Adds the sockets we're waiting on to items (at most MAX_POLL_ITEMS), returns how many */
+	int addPollItems(zmq::pollitem_t* items);
+
+	/** Longest the poll should wait for our sake */
+	int getPollTimeoutMs() const;
+
+	/** Handles whatever the poll found on the items we added, and gives up on a SIP that's taken too long */
+	void service(const zmq::pollitem_t* items, int loop);
+
+	static const int MAX_POLL_ITEMS = 2;
+
+	//processing thread
+
+	/** Reads the samples due to be played out (at most maxSamples) into the block, returns how many. The block is
+	    contiguous on the sample clock */
+	int readBlock(int maxSamples);
+
+	const float* getBlockChannel(int iChan) const { return m_blockData[iChan]; }
+	const float* getBlockMask() const { return m_blockMask; }
+	const int* getBlockPacketNumbers() const { return m_blockPacketNumbers; }
+	int64_t getBlockTimestamp() const { return m_blockTimestamp; }
+
+	/** If the clock fit changed since the last call, its values for the event (CLOCK_DRIFT_EVENT_VALUES of them) */
+	bool getNewClockDrift(double* values);
+
+	/** Feature vector of the newest sample of the block (getNumLagFeatures() of them), false if there isn't one */
+	bool getLagFeatures(float* features) const;
+	int getNumLagFeatures() const { return m_lagFeatures.getNumFeatures(); }
+
+	/** How many samples were waiting beyond the last block */
+	int getBacklog() const { return m_backlog; }
+
+	int getNumSideStreams() const { return (int)m_sideStreams.size(); }
+	INSSideStream* getSideStream(int iStream) const { return m_sideStreams[iStream].get(); }
+
+	//any thread
+
+	/** Latest fit of the INS clock against the host's, see SummitSource::getClockDriftEstimate. Takes a lock, so not for process() */
+	INSClockDrift::Estimate getClockDriftEstimate() const;
+
+	//once the receiver has stopped
+
+	/** Whether the SIP sent a different layout from the one we were set up with, and what it was */
+	bool layoutChanged() const { return m_layoutChanged; }
+	const StreamLayout& getReceivedLayout() const { return m_receivedLayout; }
+
+	static const int MAX_TD_CHANS = 4; //the INS has at most 4 TD channels
+	static const int MAX_CHANS = INSGenerator::MAX_CHANS; //an INSGenerator can make more
+	static const int MAX_INS_BUFFER_SIZE = 4096; //most time points we take from one SIP reply
+	static const int DEFAULT_CHANS = 4; //used until we've heard from a SIP, what the plugin always had before
+	static const float DEFAULT_SAMPLE_RATE; //also what older SIPs that don't send it get
+	static const float MAX_SIDE_SAMPLE_RATE;
+	static const int MAX_SIDE_STREAMS = 3;
+	static const int CLOCK_DRIFT_EVENT_VALUES = 6;
+
+private:
+
+	std::ostream& log(); //receiver log with our name in front
+	std::ostream& processLog(); //and the processing one
+
+	//connection to the SIP
+	enum ConnectionState
+	{
+		STATE_IDLE = 0,        //not acquiring
+		STATE_HANDSHAKING = 1, //sent "InitTD" on fresh sockets, waiting for the reply
+		STATE_STREAMING = 2,   //getting TD data
+		STATE_BACKOFF = 3      //SIP stopped answering, waiting a bit before handshaking again
+	};
+	ConnectionState m_connectionState;
+	void setConnectionState(ConnectionState state);
+	void backOff();
+	bool resetSockets();
+	void applySocketOptions(zmq::socket_t& optionSocket);
+	std::string getPushEndpoint(int pushPort) const;
+	void sendHandshake();
+	bool handshake(const zmq::message_t& reply);
+	bool sendRequest();
+	void receiveTD(zmq::message_t& reply, int loop);
+	int releasePackets();
+	int deliverCarryOver();
+	int deserialize(float** data, int* packNums, int offset, zmq::message_t* reply);
+	int deserializeV2(float** data, int* packNums, int offset, const char* replyData, size_t replySize);
+
+	std::string m_name;
+	std::string m_endpoint;
+	zmq::context_t& m_context;
+	zmq::socket_t m_socket; //recreated on every handshake
+	zmq::socket_t m_pushSocket; //only used when the SIP pushes TD packets to us
+	std::ostream& m_receiverLog;
+	std::ostream& m_processLog;
+	std::ostream* m_profilingLog; //nullptr for no profiling
+	Options m_options;
+	StreamLayout m_layout; //what our outputs were built from
+	StreamLayout m_receivedLayout; //what the SIP last said in a handshake
+	std::atomic<bool> m_layoutChanged;
+
+	//time points of a deserialized reply that came from one CTM packet
+	struct TDRun
+	{
+		int start;
+		int length;
+		int packetNum;
+		bool hasTick; //v2 replies from newer SIPs send the SystemTick of the packet
+		uint16_t systemTick;
+		int samplesAfter; //time points of the packet in the next reply
+	};
+	std::vector<TDRun> m_decodeRuns; //runs of the last deserialized reply
+
+	//how the TD data gets from the SIP to us, chosen by the SIP during the InitTD handshake
+	enum StreamMode
+	{
+		STREAM_POLL = 0, //send a "TD" request every block and wait for the reply
+		STREAM_PUSH = 1  //SIP pushes each CTM packet as it arrives, we just drain what is already queued
+	};
+	StreamMode m_streamMode;
+
+	//layout of the TD replies, also chosen by the SIP during the handshake (older SIPs only know v1)
+	enum TDFormat
+	{
+		TD_FORMAT_V1 = 1, //interleaved doubles, one frame of channels + packet number per time point
+		TD_FORMAT_V2 = 2  //versioned header, float32/int16 channel planes and packet number runs
+	};
+	TDFormat m_tdFormat;
+	static const int TDV2_MIN_HEADER_BYTES = 24; //the first SIPs with v2 didn't send the sequence number
+	static const int TDV2_SEQUENCE_HEADER_BYTES = 32;
+	static const unsigned char TDV2_FLAG_INT16 = 0x01;
+	static const unsigned char TDV2_FLAG_DELTA_PACKED = 0x02;
+	static const unsigned char TDV2_FLAG_RUN_TICKS = 0x04;
+
+	//"TD since sequence N" fetching, so a lost reply never loses data (v2 and polling only)
+	bool m_useCursor; //SIP said it can serve requests from a cursor
+	bool m_cursorValid; //we've had a reply telling us where the SIP's sequence numbers are
+	uint64_t m_cursor; //sequence number of the next time point we want
+	bool m_replyHasSequence; //last deserialized reply had a sequence number
+	uint64_t m_replyFirstSequence; //sequence number of its first time point
+
+	int m_nChans; //what the SIP sends
+	int m_nAllocChans; //channels the buffers have room for
+	int m_bufferSize; //most time points the SIP sends at once
+
+	bool m_handshakeSent; //handshaking: "InitTD" went out, waiting for the reply
+	bool m_waitingForReply; //streaming: sent a "TD" (or other sense stream) request and haven't had the reply yet
+	int m_backoffMs;
+	std::chrono::steady_clock::time_point m_stateTime; //when we went into the current state
+	std::chrono::steady_clock::time_point m_requestTime; //when the last request went out
+	std::chrono::steady_clock::time_point m_nextRequestTime; //don't ask again before this (the SIP had nothing new)
+	std::chrono::steady_clock::time_point m_lastDataTime; //last time the SIP gave us anything
+	static const int HANDSHAKE_TIMEOUT_MS = 1000; //how long to wait for the "InitTD" reply
+	static const int REPLY_TIMEOUT_MS = 1000; //how long to wait for a "TD" reply before giving up on the SIP
+	static const int PUSH_SILENCE_TIMEOUT_MS = 5000; //in push mode, how long without data before we check the SIP is still there
+	static const int BACKOFF_INITIAL_MS = 100; //first wait before reconnecting, doubles every failed attempt
+	static const int BACKOFF_MAX_MS = 5000;
+	static const int POLL_TIMEOUT_MS = 100; //longest we ask the poll to wait
+	static const int IDLE_WAIT_MS = 5; //how long to wait before asking again when the SIP had no data
+
+	//receiver side decoding, all allocated in the constructor
+	float** m_decodeData;
+	int* m_decodePacketNumbers;
+	float** m_receiveData; //what the gap filler released, going into the ring
+	int* m_receivePacketNumbers;
+	int64_t* m_receiveTimestamps;
+	float* m_receiveMask;
+	INSSampleClock m_sampleClock; //turns the SIP's SystemTicks into sample timestamps
+	std::unique_ptr<INSGapFiller> m_gapFiller; //puts packets back in order and fills the gaps before the ring
+	std::unique_ptr<INSRingBuffer> m_ringBuffer; //decoded samples to process(), plus the interpolated mask
+	int m_carryOverStart; //decoded time points in m_receiveData that didn't fit in the ring yet start here
+	std::atomic<int> m_carryOverLength; //and there are this many of them (process() reads it for the backlog)
+
+	//the INS's other sense streams, asked for in turn between TD requests
+	std::vector<std::unique_ptr<INSSideStream>> m_sideStreams;
+
+	//stands in for the SIP when load testing, nullptr normally
+	std::unique_ptr<INSGenerator> m_generator;
+	int nextSideStreamDue();
+	bool requestSideStream(int iStream);
+	void receiveSideStream(const zmq::message_t& reply);
+	int m_pendingSideStream; //which one the outstanding request is for, -1 for TD
+	int m_nextSideStream; //next one to ask for
+	std::chrono::steady_clock::time_point m_nextSidePoll; //when to start the next round of asking
+	static const int SIDE_POLL_MIN_MS = 50; //ask at least this far apart even with short packet periods
+
+	//clock drift fit, updated whenever packets with ticks are released. Published to process() through a triple buffer
+	//(the receiver fills the back slot and swaps it with the middle one, readBlock() swaps its front slot with the middle
+	//one when it's marked fresh), so neither side waits for the other. Other threads get a copy under the lock, which
+	//process() never takes
+	void publishClockDrift();
+	INSClockDrift m_clockDrift;
+	INSClockDrift::Estimate m_clockDriftSlots[3];
+	std::atomic<int> m_clockDriftMiddle; //slot index, plus CLOCK_DRIFT_FRESH if process() hasn't taken it yet
+	int m_clockDriftBack; //receiver's slot
+	int m_clockDriftFront; //process() side's slot
+	static const int CLOCK_DRIFT_FRESH = 4;
+	mutable std::mutex m_clockDriftLock;
+	INSClockDrift::Estimate m_clockDriftEstimate;
+	static const int CLOCK_DRIFT_WINDOW = 1200; //a few minutes of packets
+
+	//processing side
+	float** m_blockData;
+	int* m_blockPacketNumbers;
+	int64_t* m_blockTimestamps;
+	float* m_blockMask; //1 for samples filled in for dropped packets
+	int64_t m_blockTimestamp;
+	int64_t m_nextTimestamp; //sample clock of the next block, used to stamp empty ones
+	int m_backlog;
+	bool m_backlogged; //more waiting than fits in one block
+	bool m_clockDriftChanged; //readBlock() took a new fit that getNewClockDrift() hasn't passed on yet
+	INSClockDrift::Estimate m_processClockDrift; //copy of the front slot
+	INSPlayout m_playout;
+	std::atomic<double> m_releaseLateness; //latest released samples have been since process() last looked, seconds
+	double m_playoutDelayLogged; //ms
+	INSLagFeatures m_lagFeatures;
+	static const double NO_LATENESS;
+	static const int PLAYOUT_LOG_STEP_MS = 10; //log the adaptive delay when it's moved this much
+	static const float DATA_SCALE; //TD data comes from the SIP in mV, Open Ephys shows it in uV
+
+	INSDevice(const INSDevice&);
+	INSDevice& operator=(const INSDevice&);
+};
+
+#endif  // INSDEVICE_H_INCLUDED
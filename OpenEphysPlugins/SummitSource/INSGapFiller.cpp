@@ -0,0 +1,298 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2014 Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <cstring>
+#include "INSGapFiller.h"
+#include "TDFrameKernels.h"
+
+INSGapFiller::INSGapFiller(int nChans)
+	: m_nChans(nChans < MAX_CHANS ? nChans : MAX_CHANS), m_log(nullptr)
+{
+	m_data = new float[(size_t)NUM_SLOTS * m_nChans * MAX_PACKET_SAMPLES];
+	reset(1.0f, 0, 0, FILL_LINEAR);
+}
+
+INSGapFiller::~INSGapFiller()
+{
+	delete[] m_data;
+}
+
+void INSGapFiller::reset(float sampleRate, int packetPeriodMs, int latencyBudgetMs, FillMode fillMode)
+{
+	for (int iSlot = 0; iSlot < NUM_SLOTS; iSlot++)
+	{
+		m_slots[iSlot].present = false;
+	}
+	m_numPending = 0;
+	m_started = false;
+	m_nextSequence = 0;
+	m_waiting = false;
+	m_headActive = false;
+	m_fillRemaining = 0;
+	m_hasLast = false;
+	m_knownMissing = 0;
+	m_estimatedMissing = 0;
+	m_packetSamples = (int)(sampleRate * packetPeriodMs / 1000);
+	m_releasedTick = false;
+
+	m_sampleRate = sampleRate;
+	m_latencyBudget = std::chrono::milliseconds(latencyBudgetMs);
+	m_fillMode = fillMode;
+}
+
+bool INSGapFiller::addRun(const float* const* data, int start, int length, int packetNum, bool hasTick, uint16_t systemTick,
+	int samplesAfterRun, std::chrono::steady_clock::time_point arrival)
+{
+	if (length <= 0)
+	{
+		return true;
+	}
+
+	if (!m_started)
+	{
+		m_started = true;
+		m_nextSequence = packetNum & (NUM_SLOTS - 1);
+	}
+
+	//how far ahead of the next packet to release this one is, a little bit behind means it's late
+	int ahead = (packetNum - (int)(m_nextSequence & (NUM_SLOTS - 1))) & (NUM_SLOTS - 1);
+	if (ahead >= NUM_SLOTS - LATE_PACKETS)
+	{
+		ahead -= NUM_SLOTS;
+	}
+	if (ahead < 0 || (ahead == 0 && m_headActive))
+	{
+		if (m_log != nullptr)
+		{
+			*m_log << "Packet " << packetNum << " arrived after we'd moved on without it, dropping it" << std::endl;
+		}
+		return false;
+	}
+
+	int slotIndex = (int)((m_nextSequence + ahead) & (NUM_SLOTS - 1));
+	Slot& slot = m_slots[slotIndex];
+	if (!slot.present)
+	{
+		slot.present = true;
+		slot.sequence = m_nextSequence + ahead;
+		slot.packetNum = packetNum;
+		slot.length = 0;
+		slot.arrival = arrival;
+		m_numPending++;
+
+		if (ahead == 0 && m_waiting && m_log != nullptr)
+		{
+			*m_log << "Packet " << packetNum << " arrived out of order, put it back in place" << std::endl;
+		}
+	}
+
+	//the rest of a packet split between two messages goes on the end of it
+	int nCopy = length < MAX_PACKET_SAMPLES - slot.length ? length : MAX_PACKET_SAMPLES - slot.length;
+	if (nCopy < length && m_log != nullptr)
+	{
+		*m_log << "Packet " << packetNum << " has more than " << MAX_PACKET_SAMPLES << " samples, dropping the rest" << std::endl;
+	}
+	for (int iChan = 0; iChan < m_nChans; iChan++)
+	{
+		memcpy(getSlotData(slotIndex, iChan) + slot.length, data[iChan] + start, nCopy * sizeof(float));
+	}
+	slot.length += nCopy;
+	slot.hasTick = hasTick;
+	slot.systemTick = systemTick;
+	slot.samplesAfter = samplesAfterRun;
+
+	return true;
+}
+
+int INSGapFiller::release(INSSampleClock& clock, float* const* data, int* packNums, int64_t* timestamps, float* mask, int maxOut,
+	std::chrono::steady_clock::time_point now)
+{
+	m_releasedTick = false;
+
+	int nOut = 0;
+	while (nOut < maxOut)
+	{
+		//the gap in front of the packet being released
+		if (m_fillRemaining > 0)
+		{
+			int n = (int)(m_fillRemaining < maxOut - nOut ? m_fillRemaining : maxOut - nOut);
+			for (int iChan = 0; iChan < m_nChans; iChan++)
+			{
+				TDFrameKernels::fillRamp(m_fillFrom[iChan] + m_fillStep[iChan] * (m_fillDone + 1), m_fillStep[iChan], n, data[iChan] + nOut);
+			}
+			TDFrameKernels::fillRamp(1.0f, 0.0f, n, mask + nOut);
+			for (int i = 0; i < n; i++)
+			{
+				packNums[nOut + i] = -1;
+				timestamps[nOut + i] = m_fillTimestamp + m_fillDone + i;
+			}
+
+			m_fillDone += n;
+			m_fillRemaining -= n;
+			nOut += n;
+			continue;
+		}
+
+		//the packet itself
+		if (m_headActive)
+		{
+			Slot& head = m_slots[m_headSlot];
+			int n = head.length - m_headOffset < maxOut - nOut ? head.length - m_headOffset : maxOut - nOut;
+			for (int iChan = 0; iChan < m_nChans; iChan++)
+			{
+				memcpy(data[iChan] + nOut, getSlotData(m_headSlot, iChan) + m_headOffset, n * sizeof(float));
+			}
+			TDFrameKernels::fillRamp(0.0f, 0.0f, n, mask + nOut);
+			for (int i = 0; i < n; i++)
+			{
+				packNums[nOut + i] = head.packetNum;
+				timestamps[nOut + i] = m_headTimestamp + m_headOffset + i;
+			}
+
+			m_headOffset += n;
+			nOut += n;
+
+			if (m_headOffset == head.length)
+			{
+				for (int iChan = 0; iChan < m_nChans; iChan++)
+				{
+					m_lastValues[iChan] = getSlotData(m_headSlot, iChan)[head.length - 1];
+				}
+				m_hasLast = true;
+
+				head.present = false;
+				m_numPending--;
+				m_headActive = false;
+				m_nextSequence++;
+			}
+			continue;
+		}
+
+		if (m_numPending == 0)
+		{
+			break;
+		}
+
+		//next packet's here, release it unless we're still waiting for the end of it
+		int headSlot = (int)(m_nextSequence & (NUM_SLOTS - 1));
+		Slot& head = m_slots[headSlot];
+		if (head.present)
+		{
+			if (head.hasTick && head.samplesAfter > 0 && now - head.arrival < m_latencyBudget)
+			{
+				break;
+			}
+			m_waiting = false;
+			startPacket(clock, headSlot);
+			continue;
+		}
+
+		//it isn't but later ones are, give it the latency budget to turn up before moving on to the next one we have
+		if (!m_waiting)
+		{
+			m_waiting = true;
+			m_waitStart = now;
+		}
+		if (now - m_waitStart < m_latencyBudget)
+		{
+			break;
+		}
+		m_waiting = false;
+
+		int nSkipped = 0;
+		while (!m_slots[m_nextSequence & (NUM_SLOTS - 1)].present)
+		{
+			m_nextSequence++;
+			nSkipped++;
+		}
+		m_estimatedMissing += (int64_t)nSkipped * m_packetSamples;
+
+		if (m_log != nullptr)
+		{
+			*m_log << "Gave up waiting for " << nSkipped << " packet(s) before packet " << m_slots[m_nextSequence & (NUM_SLOTS - 1)].packetNum << std::endl;
+		}
+	}
+
+	return nOut;
+}
+
+//stamp the packet in slotIndex on the sample clock and set up filling any gap in front of it
+void INSGapFiller::startPacket(INSSampleClock& clock, int slotIndex)
+{
+	Slot& slot = m_slots[slotIndex];
+
+	int64_t expected = clock.getNextClock();
+	clock.skipSamples(m_knownMissing);
+	m_knownMissing = 0;
+
+	//SystemTicks say where the packet goes, without them all we have is how many packets we gave up on
+	int64_t first;
+	if (slot.hasTick)
+	{
+		first = clock.stampRun(slot.systemTick, slot.samplesAfter, slot.length);
+		m_releasedTick = true;
+		m_releasedTickArrival = slot.arrival;
+	}
+	else
+	{
+		clock.skipSamples(m_estimatedMissing);
+		first = clock.continueRun(slot.length);
+	}
+	m_estimatedMissing = 0;
+
+	int64_t gap = first - expected;
+	if (gap > 0)
+	{
+		bool fill = m_fillMode != FILL_NONE && m_hasLast && gap <= (int64_t)(MAX_FILL_SECONDS * m_sampleRate);
+		if (fill)
+		{
+			m_fillRemaining = gap;
+			m_fillDone = 0;
+			m_fillTimestamp = expected;
+			for (int iChan = 0; iChan < m_nChans; iChan++)
+			{
+				m_fillFrom[iChan] = m_lastValues[iChan];
+				m_fillStep[iChan] = m_fillMode == FILL_LINEAR ? (getSlotData(slotIndex, iChan)[0] - m_lastValues[iChan]) / (gap + 1) : 0.0f;
+			}
+		}
+
+		if (m_log != nullptr)
+		{
+			*m_log << (fill ? "Filling in " : "Leaving a gap of ") << gap << " samples before packet " << slot.packetNum << std::endl;
+		}
+	}
+
+	m_headActive = true;
+	m_headSlot = slotIndex;
+	m_headOffset = 0;
+	m_headTimestamp = first;
+}
+
+bool INSGapFiller::getLastTickArrival(std::chrono::steady_clock::time_point* arrival) const
+{
+	if (m_releasedTick)
+	{
+		*arrival = m_releasedTickArrival;
+	}
+	return m_releasedTick;
+}
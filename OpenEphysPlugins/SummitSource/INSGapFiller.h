@@ -0,0 +1,164 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2014 Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef INSGAPFILLER_H_INCLUDED
+#define INSGAPFILLER_H_INCLUDED
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include "INSSampleClock.h"
+
+/**
+
+  Puts decoded INS packets back in CTM packet order and fills the gaps left
+  by dropped ones.
+
+  Packets go into one of 256 slots by their 8-bit CTM packet number. Packets
+  that arrive in order are released straight away. When one is missing but
+  later ones have arrived, it gets up to the latency budget to turn up (the
+  CTM sometimes sends packets out of order) before we move on without it, so
+  the budget is the most latency a gap can add. A packet that turns up after
+  that is too late and is dropped.
+
+  Released packets are stamped on the INS sample clock in order, and if that
+  leaves a gap since the previous packet (i.e. packets were lost) it's filled
+  with a straight line between the samples either side of it, or by holding
+  the last sample. Every released time point also gets a mask value, 1 for
+  filled in and 0 for real data.
+
+  Only used from the SummitSource receiver thread, all memory is allocated in
+  the constructor.
+
+*/
+
+class INSGapFiller
+{
+public:
+
+	/** How gaps are filled, the values are also the editor's combo box IDs */
+	enum FillMode
+	{
+		FILL_LINEAR = 1, //straight line from the last sample before the gap to the first one after it
+		FILL_HOLD = 2,   //repeat the last sample before the gap
+		FILL_NONE = 3    //leave the gap, the timestamps jump over it
+	};
+
+	INSGapFiller(int nChans);
+
+	~INSGapFiller();
+
+	/** Forgets all packets. packetPeriodMs is only used to guess how many samples went missing when the
+	    SIP doesn't send SystemTicks, 0 if unknown */
+	void reset(float sampleRate, int packetPeriodMs, int latencyBudgetMs, FillMode fillMode);
+
+	/** Where to log gaps and out of order packets, nullptr for nowhere */
+	void setLog(std::ostream* log) { m_log = log; }
+
+	/** Copies in time points start to start + length - 1 of data, which all came from CTM packet packetNum (see
+	    INSSampleClock::stampRun for the tick arguments). Returns false if the packet was too late and got dropped */
+	bool addRun(const float* const* data, int start, int length, int packetNum, bool hasTick, uint16_t systemTick,
+		int samplesAfterRun, std::chrono::steady_clock::time_point arrival);
+
+	/** We know nSamples time points were lost after the packets added so far (e.g. the SIP no longer had them) */
+	void skipSamples(int64_t nSamples) { m_knownMissing += nSamples; }
+
+	/** Writes whatever is ready, in order and with the gaps filled, to the first getNumChans() planes of data and
+	    to packNums (-1 for filled in time points), timestamps and mask. Returns the number of time points written,
+	    at most maxOut, the rest waits for the next call */
+	int release(INSSampleClock& clock, float* const* data, int* packNums, int64_t* timestamps, float* mask, int maxOut,
+		std::chrono::steady_clock::time_point now);
+
+	/** If the last release() stamped any packets from their SystemTick, gives when the newest of them arrived */
+	bool getLastTickArrival(std::chrono::steady_clock::time_point* arrival) const;
+
+	int getNumChans() const { return m_nChans; }
+	float getSampleRate() const { return m_sampleRate; }
+
+	static const int MAX_PACKET_SAMPLES = 128; //1000 Hz and 100 ms packets is 100
+
+private:
+
+	static const int NUM_SLOTS = 256; //one per CTM packet number
+	static const int LATE_PACKETS = 32; //packet numbers this far behind the next one are late, further back they've wrapped around
+	static const int MAX_CHANS = 64; //a real INS has 4, INSGenerator can make more
+	static const int MAX_FILL_SECONDS = 10; //longer gaps are left as a jump in the timestamps
+
+	struct Slot
+	{
+		bool present;
+		int64_t sequence; //packet number without the wrapping
+		int packetNum;
+		int length;
+		bool hasTick;
+		uint16_t systemTick;
+		int samplesAfter; //time points of the packet that haven't arrived yet
+		std::chrono::steady_clock::time_point arrival;
+	};
+
+	void startPacket(INSSampleClock& clock, int slotIndex);
+	float* getSlotData(int slotIndex, int chan) { return m_data + ((size_t)slotIndex * m_nChans + chan) * MAX_PACKET_SAMPLES; }
+
+	int m_nChans;
+	float* m_data; //[slot][channel][time point]
+	Slot m_slots[NUM_SLOTS];
+	int m_numPending; //slots holding a packet
+
+	bool m_started; //seen a packet since the reset
+	int64_t m_nextSequence; //the packet we release next
+	bool m_waiting; //it's missing but later ones are here
+	std::chrono::steady_clock::time_point m_waitStart;
+
+	//packet being released
+	bool m_headActive;
+	int m_headSlot;
+	int m_headOffset; //time points of it already written
+	int64_t m_headTimestamp;
+
+	//gap being filled before it
+	int64_t m_fillRemaining;
+	int64_t m_fillDone;
+	int64_t m_fillTimestamp; //of the first filled in time point
+	float m_fillFrom[MAX_CHANS];
+	float m_fillStep[MAX_CHANS];
+
+	float m_lastValues[MAX_CHANS]; //last real sample of each channel
+	bool m_hasLast;
+
+	int64_t m_knownMissing; //samples we were told about with skipSamples
+	int64_t m_estimatedMissing; //samples in packets we gave up on, only needed without SystemTicks
+	int m_packetSamples; //our guess at the time points in one packet
+
+	bool m_releasedTick;
+	std::chrono::steady_clock::time_point m_releasedTickArrival;
+
+	float m_sampleRate;
+	std::chrono::milliseconds m_latencyBudget;
+	FillMode m_fillMode;
+	std::ostream* m_log;
+
+	INSGapFiller(const INSGapFiller&);
+	INSGapFiller& operator=(const INSGapFiller&);
+};
+
+#endif  // INSGAPFILLER_H_INCLUDED
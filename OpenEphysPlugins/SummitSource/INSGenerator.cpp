@@ -0,0 +1,261 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2014 Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include "INSGenerator.h"
+#include "INSGapFiller.h"
+
+const float INSGenerator::MAX_SAMPLE_RATE = 10000.0f;
+const double INSGenerator::AMPLITUDE_MV = 0.05;
+const double INSGenerator::TWO_PI = 6.283185307179586;
+
+INSGenerator::Settings INSGenerator::getDefaultSettings()
+{
+	Settings settings;
+	settings.nChans = 4;
+	settings.sampleRate = 500;
+	settings.packetPeriodMs = 50;
+	settings.burstPackets = 1;
+	settings.dropPercent = 0;
+	settings.jitterMs = 0;
+	settings.int16 = false;
+	return settings;
+}
+
+bool INSGenerator::parseSettings(const std::string& text, Settings* settings)
+{
+	Settings parsed = *settings;
+
+	std::istringstream tokens(text);
+	std::string token;
+	while (tokens >> token)
+	{
+		size_t equals = token.find('=');
+		if (equals == std::string::npos || equals == 0 || equals == token.size() - 1)
+		{
+			return false;
+		}
+
+		std::string key = token.substr(0, equals);
+		std::string valueText = token.substr(equals + 1);
+		char* end;
+		double value = strtod(valueText.c_str(), &end);
+		if (*end != '\0' || !(value >= 0))
+		{
+			return false;
+		}
+
+		if (key == "ch" && value >= 1 && value <= MAX_CHANS && value == (int)value)
+		{
+			parsed.nChans = (int)value;
+		}
+		else if (key == "rate" && value >= 1 && value <= MAX_SAMPLE_RATE)
+		{
+			parsed.sampleRate = (float)value;
+		}
+		else if (key == "period" && value >= 1 && value <= 1000 && value == (int)value)
+		{
+			parsed.packetPeriodMs = (int)value;
+		}
+		else if (key == "burst" && value >= 1 && value <= MAX_BURST_PACKETS && value == (int)value)
+		{
+			parsed.burstPackets = (int)value;
+		}
+		else if (key == "drop" && value <= 100)
+		{
+			parsed.dropPercent = (float)value;
+		}
+		else if (key == "jitter" && value <= MAX_JITTER_MS && value == (int)value)
+		{
+			parsed.jitterMs = (int)value;
+		}
+		else if (key == "int16" && (value == 0 || value == 1))
+		{
+			parsed.int16 = value == 1;
+		}
+		else
+		{
+			return false;
+		}
+	}
+
+	*settings = parsed;
+	return true;
+}
+
+INSGenerator::INSGenerator(const Settings& settings)
+	: m_settings(settings), m_random(0x9E3779B9u)
+{
+	//a packet can only hold so many time points, at high rates the packets get shorter instead
+	m_packetSamples = std::max((int)std::lround(m_settings.sampleRate * m_settings.packetPeriodMs / 1000.0), 1);
+	if (m_packetSamples > INSGapFiller::MAX_PACKET_SAMPLES)
+	{
+		m_packetSamples = INSGapFiller::MAX_PACKET_SAMPLES;
+		m_settings.packetPeriodMs = std::max((int)(1000 * m_packetSamples / m_settings.sampleRate), 1);
+	}
+	m_packetSeconds = m_packetSamples / (double)m_settings.sampleRate;
+
+	//spread out below a quarter of the sampling rate, so they're easy to tell apart on a viewer
+	for (int iChan = 0; iChan < m_settings.nChans; iChan++)
+	{
+		m_frequencies.push_back(1.0 + fmod(3.0 * iChan, m_settings.sampleRate / 4.0));
+	}
+
+	start(std::chrono::steady_clock::now());
+}
+
+void INSGenerator::start(std::chrono::steady_clock::time_point now)
+{
+	m_startTime = now;
+	m_nextMessageTime = now;
+	m_nextPacket = 0;
+	m_messagesSent = 0;
+	m_firstPacketNum = nextRandom() % 256;
+	m_firstTick = nextRandom() % 65536;
+	scheduleNextMessage();
+}
+
+bool INSGenerator::getMessage(std::chrono::steady_clock::time_point now, zmq::message_t* message)
+{
+	if (now < m_nextMessageTime)
+	{
+		return false;
+	}
+
+	//every packet the INS has finished by the time this message was due, less the ones the CTM lost
+	int64_t endPacket = (m_messagesSent + 1) * m_settings.burstPackets;
+	std::vector<int64_t> packets;
+	for (int64_t iPacket = m_nextPacket; iPacket < endPacket; iPacket++)
+	{
+		if (nextRandom() % 10000 >= m_settings.dropPercent * 100)
+		{
+			packets.push_back(iPacket);
+		}
+	}
+	m_nextPacket = endPacket;
+	m_messagesSent++;
+	scheduleNextMessage();
+
+	if (packets.empty())
+	{
+		return false;
+	}
+
+	//same layout as a SIP's TD v2 reply, see INSDevice::deserializeV2
+	int nRuns = (int)packets.size();
+	int length = nRuns * m_packetSamples;
+	size_t sampleBytes = m_settings.int16 ? sizeof(int16_t) : sizeof(float);
+	size_t runsOffset = HEADER_BYTES + (size_t)m_settings.nChans * length * sampleBytes;
+	size_t ticksOffset = runsOffset + nRuns * 2 * sizeof(int32_t);
+	*message = zmq::message_t(ticksOffset + nRuns * 2 * sizeof(uint16_t));
+	char* data = static_cast<char*>(message->data());
+
+	float int16Scale = (float)(AMPLITUDE_MV / 1000);
+	uint8_t version = 2;
+	uint8_t flags = (m_settings.int16 ? 0x01 : 0) | 0x04;
+	uint16_t headerBytes = HEADER_BYTES;
+	uint16_t replyChans = (uint16_t)m_settings.nChans;
+	uint16_t replyRuns = (uint16_t)nRuns;
+	int32_t firstPacketNum = (int32_t)((m_firstPacketNum + packets[0]) % 256);
+	uint32_t firstTick = 0;
+	memcpy(data, &version, 1);
+	memcpy(data + 1, &flags, 1);
+	memcpy(data + 2, &headerBytes, sizeof(uint16_t));
+	memcpy(data + 4, &replyChans, sizeof(uint16_t));
+	memcpy(data + 6, &replyRuns, sizeof(uint16_t));
+	memcpy(data + 8, &length, sizeof(int32_t));
+	memcpy(data + 12, &firstPacketNum, sizeof(int32_t));
+	memcpy(data + 16, &firstTick, sizeof(uint32_t));
+	memcpy(data + 20, &int16Scale, sizeof(float));
+
+	//channel planes
+	char* plane = data + HEADER_BYTES;
+	for (int iChan = 0; iChan < m_settings.nChans; iChan++)
+	{
+		double phaseStep = TWO_PI * m_frequencies[iChan] / m_settings.sampleRate;
+		for (int iRun = 0; iRun < nRuns; iRun++)
+		{
+			int64_t firstSample = packets[iRun] * m_packetSamples;
+			for (int iPoint = 0; iPoint < m_packetSamples; iPoint++)
+			{
+				double value = AMPLITUDE_MV * sin(phaseStep * (double)(firstSample + iPoint));
+				if (m_settings.int16)
+				{
+					int16_t sample = (int16_t)std::lround(value / int16Scale);
+					memcpy(plane, &sample, sizeof(int16_t));
+				}
+				else
+				{
+					float sample = (float)value;
+					memcpy(plane, &sample, sizeof(float));
+				}
+				plane += sampleBytes;
+			}
+		}
+	}
+
+	//a run and a SystemTick per packet, the INS takes the tick at the packet's last time point
+	char* run = data + runsOffset;
+	char* tick = data + ticksOffset;
+	for (int iRun = 0; iRun < nRuns; iRun++)
+	{
+		int32_t packetNum = (int32_t)((m_firstPacketNum + packets[iRun]) % 256);
+		int32_t runLength = m_packetSamples;
+		memcpy(run, &packetNum, sizeof(int32_t));
+		memcpy(run + sizeof(int32_t), &runLength, sizeof(int32_t));
+		run += 2 * sizeof(int32_t);
+
+		int64_t lastSample = (packets[iRun] + 1) * m_packetSamples - 1;
+		uint16_t systemTick = (uint16_t)((m_firstTick + std::llround(lastSample * 10000.0 / m_settings.sampleRate)) % 65536);
+		uint16_t samplesAfter = 0;
+		memcpy(tick, &systemTick, sizeof(uint16_t));
+		memcpy(tick + sizeof(uint16_t), &samplesAfter, sizeof(uint16_t));
+		tick += 2 * sizeof(uint16_t);
+	}
+
+	return true;
+}
+
+//the next message goes once its last packet is finished, and up to the jitter later. Never before the one before it,
+//messages stay in order
+void INSGenerator::scheduleNextMessage()
+{
+	double nominalSeconds = (m_messagesSent + 1) * m_settings.burstPackets * m_packetSeconds;
+	double jitterSeconds = m_settings.jitterMs > 0 ? (nextRandom() % (m_settings.jitterMs * 1000 + 1)) / 1e6 : 0;
+	std::chrono::steady_clock::time_point due = m_startTime
+		+ std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(nominalSeconds + jitterSeconds));
+	m_nextMessageTime = std::max(m_nextMessageTime, due);
+}
+
+//xorshift, the same drops every run so results can be compared
+uint32_t INSGenerator::nextRandom()
+{
+	m_random ^= m_random << 13;
+	m_random ^= m_random >> 17;
+	m_random ^= m_random << 5;
+	return m_random;
+}
@@ -0,0 +1,127 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2014 Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef INSGENERATOR_H_INCLUDED
+#define INSGENERATOR_H_INCLUDED
+
+#include "zmq.hpp"
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+
+  Stand-in for a SIP and its INS, for load testing the signal chain without
+  a CTM. Makes TD v2 messages just like a SIP in push mode would, so they go
+  through the same decoding, gap filling, sample clock and playout as real
+  data.
+
+  Every channel is a sine wave (a different frequency on each). Packets are
+  numbered 0 to 255 and wrap like CTM packet numbers, and carry a SystemTick
+  of their last time point that wraps like the INS's. Packets can be dropped
+  at random (the numbers and ticks carry on past them, as if the CTM lost
+  them), held back and sent several at a time like the bursts the CTM sends
+  after a stall, and sent a random bit late.
+
+  Settings are written as space separated key=value pairs, e.g.
+  "ch=16 rate=1000 period=50 burst=4 drop=1 jitter=20 int16=1":
+
+      ch      channels, 1 to MAX_CHANS
+      rate    sampling rate in Hz, up to MAX_SAMPLE_RATE
+      period  packet period in ms (shortened if a packet wouldn't fit in
+              the gap filler)
+      burst   packets sent together in one message
+      drop    percent of packets dropped
+      jitter  most ms a message is sent late
+      int16   1 to send int16 channel planes instead of float32
+
+  Only used from the SummitSource receiver thread.
+
+*/
+
+class INSGenerator
+{
+public:
+
+	struct Settings
+	{
+		int nChans;
+		float sampleRate; //Hz
+		int packetPeriodMs;
+		int burstPackets; //1 for every packet on its own
+		float dropPercent;
+		int jitterMs;
+		bool int16;
+	};
+
+	/** What a generator without any settings given makes, 4 channels at 500 Hz in 50 ms packets like a typical INS */
+	static Settings getDefaultSettings();
+
+	/** Reads settings from text like the above, anything left out keeps its default. Returns false and leaves settings
+	    alone if the text isn't valid */
+	static bool parseSettings(const std::string& text, Settings* settings);
+
+	INSGenerator(const Settings& settings);
+
+	/** Starts making packets from now, starting from a random packet number and SystemTick like a real INS */
+	void start(std::chrono::steady_clock::time_point now);
+
+	/** If a message is due by now, builds it (every packet since the last one) and returns true */
+	bool getMessage(std::chrono::steady_clock::time_point now, zmq::message_t* message);
+
+	/** When the next message is due */
+	std::chrono::steady_clock::time_point getNextMessageTime() const { return m_nextMessageTime; }
+
+	const Settings& getSettings() const { return m_settings; }
+	int getPacketSamples() const { return m_packetSamples; }
+
+	static const int MAX_CHANS = 64;
+	static const float MAX_SAMPLE_RATE; //one sample per SystemTick
+	static const int MAX_BURST_PACKETS = 32;
+	static const int MAX_JITTER_MS = 2000;
+
+private:
+
+	uint32_t nextRandom();
+	void scheduleNextMessage();
+
+	Settings m_settings;
+	int m_packetSamples; //time points in one packet
+	double m_packetSeconds; //how long one packet's time points take, exactly
+	std::vector<double> m_frequencies; //Hz, one per channel
+
+	std::chrono::steady_clock::time_point m_startTime;
+	std::chrono::steady_clock::time_point m_nextMessageTime;
+	int64_t m_nextPacket; //packets made since start(), dropped ones included
+	int64_t m_messagesSent;
+	int m_firstPacketNum; //packet number and SystemTick the INS happened to be at when we started
+	int m_firstTick;
+	uint32_t m_random;
+
+	static const int HEADER_BYTES = 24;
+	static const double AMPLITUDE_MV;
+	static const double TWO_PI;
+};
+
+#endif  // INSGENERATOR_H_INCLUDED
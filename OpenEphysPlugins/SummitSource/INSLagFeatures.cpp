@@ -0,0 +1,184 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2014 Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include "INSLagFeatures.h"
+
+INSLagFeatures::INSLagFeatures()
+	: m_nChans(0), m_history(nullptr), m_capacity(0), m_mask(0), m_count(0)
+{
+}
+
+INSLagFeatures::~INSLagFeatures()
+{
+	freeHistory();
+}
+
+bool INSLagFeatures::parseLags(const std::string& text, std::vector<int>* lags)
+{
+	std::vector<int> parsed;
+
+	//comma separated numbers or first-last ranges, spaces are ignored
+	std::string item;
+	for (size_t iChar = 0; iChar <= text.size(); iChar++)
+	{
+		if (iChar < text.size() && text[iChar] != ',')
+		{
+			if (!isspace((unsigned char)text[iChar]))
+			{
+				item += text[iChar];
+			}
+			continue;
+		}
+
+		if (item.empty())
+		{
+			//only allowed when the whole list is empty
+			if (iChar < text.size() || !parsed.empty())
+			{
+				return false;
+			}
+			continue;
+		}
+
+		size_t dash = item.find('-', 1);
+		std::string firstText = item.substr(0, dash);
+		std::string lastText = dash == std::string::npos ? firstText : item.substr(dash + 1);
+		if (firstText.empty() || lastText.empty() || firstText.find_first_not_of("0123456789") != std::string::npos
+			|| lastText.find_first_not_of("0123456789") != std::string::npos || firstText.size() > 6 || lastText.size() > 6)
+		{
+			return false;
+		}
+
+		int first = atoi(firstText.c_str());
+		int last = atoi(lastText.c_str());
+		if (last < first || last > MAX_LAG)
+		{
+			return false;
+		}
+		for (int lag = first; lag <= last && (int)parsed.size() <= MAX_LAGS; lag++)
+		{
+			parsed.push_back(lag);
+		}
+		item.clear();
+	}
+
+	std::sort(parsed.begin(), parsed.end());
+	parsed.erase(std::unique(parsed.begin(), parsed.end()), parsed.end());
+	if ((int)parsed.size() > MAX_LAGS)
+	{
+		return false;
+	}
+
+	*lags = parsed;
+	return true;
+}
+
+void INSLagFeatures::reset(int nChans, const std::vector<int>& lags)
+{
+	freeHistory();
+
+	m_nChans = nChans;
+	m_lags = lags;
+
+	//round up to a power of two, so indices can be masked
+	int longestLag = m_lags.empty() ? 0 : m_lags.back();
+	m_capacity = 1;
+	while (m_capacity < longestLag + 1)
+	{
+		m_capacity <<= 1;
+	}
+	m_mask = m_capacity - 1;
+
+	m_history = new float*[m_nChans];
+	for (int iChan = 0; iChan < m_nChans; iChan++)
+	{
+		m_history[iChan] = new float[m_capacity]();
+	}
+	m_count = 0;
+}
+
+void INSLagFeatures::clear()
+{
+	m_count = 0;
+}
+
+void INSLagFeatures::push(const float* const* data, int nSamples)
+{
+	if (m_lags.empty())
+	{
+		return;
+	}
+
+	//only the last m_capacity samples can ever be used
+	int skip = std::max(nSamples - m_capacity, 0);
+	m_count += skip;
+	nSamples -= skip;
+
+	//copy in two pieces in case we wrap around the end
+	int start = (int)(m_count & m_mask);
+	int firstPart = std::min(m_capacity - start, nSamples);
+	int secondPart = nSamples - firstPart;
+	for (int iChan = 0; iChan < m_nChans; iChan++)
+	{
+		memcpy(m_history[iChan] + start, data[iChan] + skip, firstPart * sizeof(float));
+		memcpy(m_history[iChan], data[iChan] + skip + firstPart, secondPart * sizeof(float));
+	}
+	m_count += nSamples;
+}
+
+bool INSLagFeatures::getFeatures(float* features) const
+{
+	if (m_lags.empty() || m_count < m_lags.back() + 1)
+	{
+		return false;
+	}
+
+	long long newest = m_count - 1;
+	int iFeature = 0;
+	for (int iChan = 0; iChan < m_nChans; iChan++)
+	{
+		for (size_t iLag = 0; iLag < m_lags.size(); iLag++)
+		{
+			features[iFeature++] = m_history[iChan][(newest - m_lags[iLag]) & m_mask];
+		}
+	}
+	return true;
+}
+
+void INSLagFeatures::freeHistory()
+{
+	if (m_history != nullptr)
+	{
+		for (int iChan = 0; iChan < m_nChans; iChan++)
+		{
+			delete[] m_history[iChan];
+		}
+		delete[] m_history;
+	}
+	m_history = nullptr;
+	m_nChans = 0;
+}
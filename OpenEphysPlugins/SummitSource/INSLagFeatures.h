@@ -0,0 +1,91 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2014 Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef INSLAGFEATURES_H_INCLUDED
+#define INSLAGFEATURES_H_INCLUDED
+
+#include <string>
+#include <vector>
+
+/**
+
+  Lag embedding of the TD channels, for decoders that want the last few
+  samples of every channel as one feature vector.
+
+  Keeps a short history of each channel in its own ring, and after each
+  block gives the value of every channel at every configured lag (0 is the
+  newest sample) counting back from the newest sample:
+
+      [chan 0 lag 0, chan 0 lag 1, ..., chan 1 lag 0, ...]
+
+  All memory is allocated in reset(), push() and getFeatures() never
+  allocate, so they're safe to call from process().
+
+*/
+
+class INSLagFeatures
+{
+public:
+
+	INSLagFeatures();
+
+	~INSLagFeatures();
+
+	/** Parses a list of lags in samples like "0-15" or "0,5,10,20-25" (sorted, without repeats). Returns false and
+	    leaves lags alone if the text isn't valid, an empty text is valid and means no lags */
+	static bool parseLags(const std::string& text, std::vector<int>* lags);
+
+	/** Allocates the history for nChans channels and the given lags, and forgets all samples */
+	void reset(int nChans, const std::vector<int>& lags);
+
+	/** Forgets all samples, e.g. after a jump in the sample clock, so no feature vector spans it */
+	void clear();
+
+	/** Adds nSamples more time points of every channel */
+	void push(const float* const* data, int nSamples);
+
+	/** Writes the feature vector for the newest sample to features (getNumFeatures() values). Returns false without
+	    writing anything until there's enough history for the longest lag */
+	bool getFeatures(float* features) const;
+
+	int getNumFeatures() const { return m_nChans * (int)m_lags.size(); }
+
+	static const int MAX_LAG = 1000;
+	static const int MAX_LAGS = 64;
+
+private:
+
+	void freeHistory();
+
+	int m_nChans;
+	std::vector<int> m_lags;
+	float** m_history; //[channel][time point], a ring
+	int m_capacity; //power of two, more than the longest lag
+	int m_mask;
+	long long m_count; //time points pushed since the last clear
+
+	INSLagFeatures(const INSLagFeatures&);
+	INSLagFeatures& operator=(const INSLagFeatures&);
+};
+
+#endif  // INSLAGFEATURES_H_INCLUDED
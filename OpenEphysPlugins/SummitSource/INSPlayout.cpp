@@ -0,0 +1,96 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2014 Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <algorithm>
+#include <cmath>
+#include "INSPlayout.h"
+
+const double INSPlayout::SAFETY_S = 0.005;
+const double INSPlayout::MAX_GROWTH = 0.1;
+const double INSPlayout::PEAK_DECAY = 0.01;
+const double INSPlayout::INTERVAL_SMOOTHING = 0.05;
+const double INSPlayout::POSITION_PULL = 0.1;
+const double INSPlayout::RESYNC_S = 0.5;
+
+INSPlayout::INSPlayout()
+{
+	reset(1000, 0, false);
+}
+
+void INSPlayout::reset(float sampleRate, int delayMs, bool adaptive)
+{
+	m_sampleRate = sampleRate;
+	m_adaptive = adaptive;
+	m_baseDelay = std::min(std::max(delayMs, 0), MAX_DELAY_MS) / 1000.0;
+	m_delay = m_baseDelay;
+	m_latenessPeak = 0;
+
+	m_playing = false;
+	m_position = 0;
+	m_lastHostSeconds = 0;
+	m_blockInterval = 0;
+}
+
+void INSPlayout::addLateness(double seconds)
+{
+	m_latenessPeak = std::max(m_latenessPeak, seconds);
+}
+
+int INSPlayout::getDueSamples(int64_t firstTimestamp, int available, const INSClockDrift::Estimate& fit, double hostSeconds)
+{
+	//nothing to play out against yet
+	if (!isEnabled() || !fit.valid)
+	{
+		m_playing = false;
+		return available;
+	}
+
+	double elapsed = m_playing ? std::max(hostSeconds - m_lastHostSeconds, 0.0) : 0.0;
+	m_lastHostSeconds = hostSeconds;
+
+	//grow quickly enough to stop samples being late, shrink slowly so one late packet doesn't make us hunt
+	if (m_adaptive)
+	{
+		m_latenessPeak -= PEAK_DECAY * elapsed;
+		double target = std::min(std::max(m_latenessPeak + SAFETY_S, m_baseDelay), MAX_DELAY_MS / 1000.0);
+		m_delay = target > m_delay ? std::min(target, m_delay + MAX_GROWTH * elapsed) : target;
+	}
+
+	//step on by a block's worth of samples and correct a little towards the host clock
+	double target = fit.hostToDevice(hostSeconds - m_delay) * m_sampleRate;
+	if (!m_playing || std::fabs(target - m_position) > RESYNC_S * m_sampleRate)
+	{
+		m_position = target;
+		m_blockInterval = 0;
+		m_playing = true;
+	}
+	else
+	{
+		m_blockInterval = m_blockInterval > 0 ? m_blockInterval + INTERVAL_SMOOTHING * (elapsed - m_blockInterval) : elapsed;
+		double step = m_blockInterval * m_sampleRate / fit.rate;
+		m_position += step + POSITION_PULL * (target - (m_position + step));
+	}
+
+	int64_t due = (int64_t)std::floor(m_position) - firstTimestamp + 1;
+	return (int)std::min(std::max(due, (int64_t)0), (int64_t)available);
+}
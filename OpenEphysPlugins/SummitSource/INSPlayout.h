@@ -0,0 +1,97 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2014 Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef INSPLAYOUT_H_INCLUDED
+#define INSPLAYOUT_H_INCLUDED
+
+#include <cstdint>
+#include "INSClockDrift.h"
+
+/**
+
+  Fixed delay playout of INS samples, so process() hands out a steady number
+  of samples every block instead of nothing for a few blocks and then a whole
+  CTM packet at once.
+
+  Each sample is played out a set delay after the time the clock fit (see
+  INSClockDrift) says the INS took it. The playout position moves on by the
+  average block interval's worth of samples every block and is only pulled
+  gently towards where the host clock says it should be, so block sizes stay
+  within a sample of each other even when process() isn't called quite
+  regularly.
+
+  The delay has to cover the CTM packet period plus the transport jitter (and
+  the reorder wait, see INSGapFiller), otherwise samples turn up after they
+  were due and go out in a burst again. In adaptive mode the delay grows to
+  cover the latest samples seen and slowly comes back down to the set delay
+  once they stop being that late.
+
+  Only used from the Open Ephys processing thread.
+
+*/
+
+class INSPlayout
+{
+public:
+
+	INSPlayout();
+
+	/** Starts over, delayMs of 0 turns playout off and every sample goes out as soon as it's there */
+	void reset(float sampleRate, int delayMs, bool adaptive);
+
+	bool isEnabled() const { return m_baseDelay > 0; }
+
+	/** How long after the INS took them (by the clock fit) the oldest of some samples became available, in seconds */
+	void addLateness(double seconds);
+
+	/** Of the available time points starting with the one stamped firstTimestamp, how many are due by host time
+	    hostSeconds. Everything available is due if playout is off or the clocks haven't been fitted yet */
+	int getDueSamples(int64_t firstTimestamp, int available, const INSClockDrift::Estimate& fit, double hostSeconds);
+
+	/** Current playout delay, in ms */
+	double getDelayMs() const { return 1000 * m_delay; }
+
+	static const int MAX_DELAY_MS = 2000;
+
+private:
+
+	float m_sampleRate;
+	bool m_adaptive;
+	double m_baseDelay; //seconds, what it was set to
+	double m_delay; //seconds, what it is now (only differs when adaptive)
+	double m_latenessPeak; //seconds, latest samples have been recently, decays back down
+
+	bool m_playing;
+	double m_position; //newest sample clock that's due, fractional
+	double m_lastHostSeconds;
+	double m_blockInterval; //average seconds between getDueSamples calls
+
+	static const double SAFETY_S; //adaptive delay margin over the latest samples
+	static const double MAX_GROWTH; //adaptive delay grows by at most this many seconds a second
+	static const double PEAK_DECAY; //and comes back down by this many
+	static const double INTERVAL_SMOOTHING;
+	static const double POSITION_PULL; //fraction of the way to where the host clock says we should be each block
+	static const double RESYNC_S; //further off than this and we just jump there
+};
+
+#endif  // INSPLAYOUT_H_INCLUDED
@@ -0,0 +1,154 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2014 Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <cstring>
+#include "INSRingBuffer.h"
+
+INSRingBuffer::INSRingBuffer(int nChans, int minCapacity)
+	: m_nChans(nChans), m_writeCount(0), m_readCount(0)
+{
+	//round up to a power of two
+	m_capacity = 1;
+	while (m_capacity < minCapacity)
+	{
+		m_capacity <<= 1;
+	}
+	m_mask = m_capacity - 1;
+
+	//allocate memory
+	m_data = new float*[m_nChans];
+	for (int iChan = 0; iChan < m_nChans; iChan++)
+	{
+		m_data[iChan] = new float[m_capacity];
+	}
+	m_packetNumbers = new int[m_capacity];
+	m_timestamps = new int64_t[m_capacity];
+}
+
+INSRingBuffer::~INSRingBuffer()
+{
+	//deallocate memory
+	for (int iChan = 0; iChan < m_nChans; iChan++)
+	{
+		delete[] m_data[iChan];
+	}
+	delete[] m_data;
+	delete[] m_packetNumbers;
+	delete[] m_timestamps;
+}
+
+int INSRingBuffer::write(float* const* data, const int* packNums, const int64_t* timestamps, int nSamples)
+{
+	unsigned int writeCount = m_writeCount.load(std::memory_order_relaxed);
+	unsigned int readCount = m_readCount.load(std::memory_order_acquire);
+
+	int freeSpace = m_capacity - (int)(writeCount - readCount);
+	if (nSamples > freeSpace)
+	{
+		nSamples = freeSpace;
+	}
+
+	//copy in two pieces in case we wrap around the end
+	int start = writeCount & m_mask;
+	int firstPart = m_capacity - start < nSamples ? m_capacity - start : nSamples;
+	int secondPart = nSamples - firstPart;
+
+	for (int iChan = 0; iChan < m_nChans; iChan++)
+	{
+		memcpy(m_data[iChan] + start, data[iChan], firstPart * sizeof(float));
+		memcpy(m_data[iChan], data[iChan] + firstPart, secondPart * sizeof(float));
+	}
+	memcpy(m_packetNumbers + start, packNums, firstPart * sizeof(int));
+	memcpy(m_packetNumbers, packNums + firstPart, secondPart * sizeof(int));
+	memcpy(m_timestamps + start, timestamps, firstPart * sizeof(int64_t));
+	memcpy(m_timestamps, timestamps + firstPart, secondPart * sizeof(int64_t));
+
+	//publish the new samples to the reader
+	m_writeCount.store(writeCount + nSamples, std::memory_order_release);
+
+	return nSamples;
+}
+
+int INSRingBuffer::read(float** data, int* packNums, int64_t* timestamps, int maxSamples)
+{
+	unsigned int readCount = m_readCount.load(std::memory_order_relaxed);
+	unsigned int writeCount = m_writeCount.load(std::memory_order_acquire);
+
+	int nSamples = (int)(writeCount - readCount);
+	if (nSamples > maxSamples)
+	{
+		nSamples = maxSamples;
+	}
+
+	//only up to the first gap in the sample clock
+	for (int iSample = 1; iSample < nSamples; iSample++)
+	{
+		if (m_timestamps[(readCount + iSample) & m_mask] != m_timestamps[(readCount + iSample - 1) & m_mask] + 1)
+		{
+			nSamples = iSample;
+			break;
+		}
+	}
+
+	//copy in two pieces in case we wrap around the end
+	int start = readCount & m_mask;
+	int firstPart = m_capacity - start < nSamples ? m_capacity - start : nSamples;
+	int secondPart = nSamples - firstPart;
+
+	for (int iChan = 0; iChan < m_nChans; iChan++)
+	{
+		memcpy(data[iChan], m_data[iChan] + start, firstPart * sizeof(float));
+		memcpy(data[iChan] + firstPart, m_data[iChan], secondPart * sizeof(float));
+	}
+	memcpy(packNums, m_packetNumbers + start, firstPart * sizeof(int));
+	memcpy(packNums + firstPart, m_packetNumbers, secondPart * sizeof(int));
+	memcpy(timestamps, m_timestamps + start, firstPart * sizeof(int64_t));
+	memcpy(timestamps + firstPart, m_timestamps, secondPart * sizeof(int64_t));
+
+	//give the space back to the writer
+	m_readCount.store(readCount + nSamples, std::memory_order_release);
+
+	return nSamples;
+}
+
+bool INSRingBuffer::peekTimestamp(int64_t* timestamp) const
+{
+	unsigned int readCount = m_readCount.load(std::memory_order_relaxed);
+	if (m_writeCount.load(std::memory_order_acquire) == readCount)
+	{
+		return false;
+	}
+
+	*timestamp = m_timestamps[readCount & m_mask];
+	return true;
+}
+
+int INSRingBuffer::getNumReadable() const
+{
+	return (int)(m_writeCount.load(std::memory_order_acquire) - m_readCount.load(std::memory_order_acquire));
+}
+
+int INSRingBuffer::getFreeSpace() const
+{
+	return m_capacity - getNumReadable();
+}
@@ -0,0 +1,88 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2014 Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef INSRINGBUFFER_H_INCLUDED
+#define INSRINGBUFFER_H_INCLUDED
+
+#include <atomic>
+#include <cstdint>
+
+/**
+
+  Lock-free single-producer/single-consumer ring of decoded INS samples.
+
+  The receiver thread in SummitSource is the only writer and the Open Ephys
+  processing thread is the only reader, so neither side ever takes a lock or
+  allocates: all memory is allocated once in the constructor. Each time point
+  holds one float per channel plus the CTM packet number it came from and its
+  sample clock (see INSSampleClock).
+
+*/
+
+class INSRingBuffer
+{
+public:
+
+	/** Allocates room for at least minCapacity time points (rounded up to a power of two) */
+	INSRingBuffer(int nChans, int minCapacity);
+
+	~INSRingBuffer();
+
+	/** Producer side: copies up to nSamples time points in, returns how many fit */
+	int write(float* const* data, const int* packNums, const int64_t* timestamps, int nSamples);
+
+	/** Consumer side: copies up to maxSamples time points out, returns how many were read. Stops early at a jump in
+	    the sample clock, so everything read in one go is contiguous and the first timestamp stamps the lot */
+	int read(float** data, int* packNums, int64_t* timestamps, int maxSamples);
+
+	/** Consumer side: the sample clock of the next time point read() would hand out, false if there isn't one */
+	bool peekTimestamp(int64_t* timestamp) const;
+
+	/** Number of time points waiting to be read */
+	int getNumReadable() const;
+
+	/** Number of time points that can be written before the ring is full */
+	int getFreeSpace() const;
+
+	int getNumChans() const { return m_nChans; }
+	int getCapacity() const { return m_capacity; }
+
+private:
+
+	int m_nChans;
+	int m_capacity; //always a power of two, so indices can be masked
+	int m_mask;
+
+	float** m_data; //[channel][time point]
+	int* m_packetNumbers;
+	int64_t* m_timestamps;
+
+	//monotonic counters of time points written and read, only the owning side stores to each
+	std::atomic<unsigned int> m_writeCount;
+	std::atomic<unsigned int> m_readCount;
+
+	INSRingBuffer(const INSRingBuffer&);
+	INSRingBuffer& operator=(const INSRingBuffer&);
+};
+
+#endif  // INSRINGBUFFER_H_INCLUDED
@@ -0,0 +1,89 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2014 Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <cmath>
+#include "INSSampleClock.h"
+
+INSSampleClock::INSSampleClock()
+{
+	reset(1.0f);
+}
+
+void INSSampleClock::reset(float sampleRate)
+{
+	m_sampleRate = sampleRate;
+	m_hasTick = false;
+	m_lastTick = 0;
+	m_unwrappedTicks = 0;
+	m_originClock = 0;
+	m_lastPacketEnd = 0;
+	m_nextClock = 0;
+}
+
+int64_t INSSampleClock::stampRun(uint16_t systemTick, int samplesAfterRun, int runLength)
+{
+	//where the end of this packet would be if nothing went missing since the last one
+	int64_t countedEnd = m_nextClock + runLength - 1 + samplesAfterRun;
+
+	if (!m_hasTick)
+	{
+		//first packet, it sits wherever the time points we've already counted put it
+		m_hasTick = true;
+		m_originClock = countedEnd;
+	}
+	else
+	{
+		//the tick only tells us the time modulo one wrap, add however many whole wraps gets closest to what we counted.
+		//That's right unless more than half a wrap of data vanished without anyone telling us (see skipSamples)
+		int64_t delta = (uint16_t)(systemTick - m_lastTick);
+		double countedTicks = (countedEnd - m_lastPacketEnd) * (double)TICKS_PER_SECOND / m_sampleRate;
+		int64_t wraps = (int64_t)std::floor((countedTicks - delta) / TICK_WRAP + 0.5);
+		if (wraps < 0)
+		{
+			wraps = 0;
+		}
+		m_unwrappedTicks += delta + wraps * TICK_WRAP;
+	}
+	m_lastTick = systemTick;
+
+	int64_t packetEnd = m_originClock + (int64_t)std::floor(m_unwrappedTicks * (double)m_sampleRate / TICKS_PER_SECOND + 0.5);
+	m_lastPacketEnd = packetEnd;
+	int64_t first = packetEnd - samplesAfterRun - (runLength - 1);
+
+	//within rounding of where the last time point left off is just the next sample, otherwise trust the ticks going
+	//forward (packets were lost) but never let the clock go backwards
+	if (first - m_nextClock <= SNAP_SAMPLES)
+	{
+		first = m_nextClock;
+	}
+
+	m_nextClock = first + runLength;
+	return first;
+}
+
+int64_t INSSampleClock::continueRun(int runLength)
+{
+	int64_t first = m_nextClock;
+	m_nextClock += runLength;
+	return first;
+}
@@ -0,0 +1,88 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2014 Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef INSSAMPLECLOCK_H_INCLUDED
+#define INSSAMPLECLOCK_H_INCLUDED
+
+#include <cstdint>
+
+/**
+
+  Puts every decoded INS time point on a 64-bit sample clock that follows the
+  device, not the host.
+
+  The INS stamps each CTM packet with a 16-bit SystemTick (100 us units) of
+  its last time point, which wraps every 6.5536 s. Ticks are unwrapped into a
+  monotonic count, using the number of time points since the last packet to
+  work out how many whole wraps went by (the host's arrival times are no use
+  for that, replies can sit in our queues for a while). The sample clock of
+  the first time point we ever see is 0, later ones are placed from their
+  packet's tick, so a dropped packet shows up as a jump in the clock instead
+  of shifting everything after it.
+
+  Only used from the SummitSource receiver thread.
+
+*/
+
+class INSSampleClock
+{
+public:
+
+	INSSampleClock();
+
+	/** Starts over, the next time point stamped gets sample clock 0 */
+	void reset(float sampleRate);
+
+	/** Sample clock of the first time point of a run of runLength time points from one CTM packet with the given
+	    SystemTick, where samplesAfterRun more time points of that packet come after the run. The rest of the run
+	    follows on from it one sample at a time */
+	int64_t stampRun(uint16_t systemTick, int samplesAfterRun, int runLength);
+
+	/** For data without SystemTicks (older SIPs), just carries on counting from the last time point */
+	int64_t continueRun(int runLength);
+
+	/** We know nSamples time points were lost before the next run, so it doesn't take them for a tick wrap */
+	void skipSamples(int64_t nSamples) { m_nextClock += nSamples; }
+
+	/** Sample clock the next time point gets if nothing goes missing before it */
+	int64_t getNextClock() const { return m_nextClock; }
+
+	/** INS time of the end of the last packet stampRun was given, in seconds on the same timeline as the sample clock */
+	double getLastPacketSeconds() const { return m_originClock / (double)m_sampleRate + m_unwrappedTicks / (double)TICKS_PER_SECOND; }
+
+private:
+
+	float m_sampleRate;
+	bool m_hasTick; //we've seen a SystemTick since the last reset
+	uint16_t m_lastTick;
+	int64_t m_unwrappedTicks; //ticks since the first packet, never wraps
+	int64_t m_originClock; //sample clock of the end of the first packet
+	int64_t m_lastPacketEnd; //sample clock the ticks put the end of the last packet at
+	int64_t m_nextClock;
+
+	static const int TICKS_PER_SECOND = 10000;
+	static const int64_t TICK_WRAP = 65536;
+	static const int SNAP_SAMPLES = 2; //ticks only have 100 us resolution and don't sit on sample boundaries, so small differences are just rounding
+};
+
+#endif  // INSSAMPLECLOCK_H_INCLUDED
@@ -0,0 +1,233 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2014 Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include "INSSideStream.h"
+#include "TDFrameKernels.h"
+
+INSSideStream::INSSideStream(Type type, int nChans, float sampleRate)
+	: m_type(type), m_nChans(nChans), m_sampleRate(sampleRate), m_ring(nChans, RING_CAPACITY), m_blockTimestamp(0), m_nextBlockTimestamp(0)
+{
+	m_clock.reset(sampleRate);
+
+	//allocate memory
+	m_decodeData = new float*[m_nChans];
+	m_blockData = new float*[m_nChans];
+	for (int iChan = 0; iChan < m_nChans; iChan++)
+	{
+		m_decodeData[iChan] = new float[MAX_SAMPLES];
+		m_blockData[iChan] = new float[MAX_SAMPLES];
+	}
+	m_decodePacketNumbers = new int[MAX_SAMPLES];
+	m_decodeTimestamps = new int64_t[MAX_SAMPLES];
+	m_blockPacketNumbers = new int[MAX_SAMPLES];
+	m_blockTimestamps = new int64_t[MAX_SAMPLES];
+}
+
+INSSideStream::~INSSideStream()
+{
+	//deallocate memory
+	for (int iChan = 0; iChan < m_nChans; iChan++)
+	{
+		delete[] m_decodeData[iChan];
+		delete[] m_blockData[iChan];
+	}
+	delete[] m_decodeData;
+	delete[] m_blockData;
+	delete[] m_decodePacketNumbers;
+	delete[] m_decodeTimestamps;
+	delete[] m_blockPacketNumbers;
+	delete[] m_blockTimestamps;
+}
+
+const char* INSSideStream::getRequest() const
+{
+	switch (m_type)
+	{
+	case STREAM_FFT:
+		return "FFT";
+	case STREAM_POWER:
+		return "PW";
+	default:
+		return "AC";
+	}
+}
+
+const char* INSSideStream::getTypeName(Type type)
+{
+	switch (type)
+	{
+	case STREAM_FFT:
+		return "FFT";
+	case STREAM_POWER:
+		return "Band power";
+	default:
+		return "Accelerometer";
+	}
+}
+
+int INSSideStream::decode(const char* replyData, size_t replySize, std::ostream& log)
+{
+	//nothing new since we last asked (or the SIP isn't streaming this any more)
+	if (replySize == 0)
+	{
+		return 0;
+	}
+
+	if (replySize < MIN_HEADER_BYTES)
+	{
+		log << getTypeName(m_type) << " reply too short for header: " << std::to_string(replySize) << " bytes" << std::endl;
+		return 0;
+	}
+
+	uint8_t version = static_cast<uint8_t>(replyData[0]);
+	uint8_t flags = static_cast<uint8_t>(replyData[1]);
+	uint16_t headerBytes, replyChans, nRuns;
+	int32_t length;
+	float int16Scale;
+	memcpy(&headerBytes, replyData + 2, sizeof(uint16_t));
+	memcpy(&replyChans, replyData + 4, sizeof(uint16_t));
+	memcpy(&nRuns, replyData + 6, sizeof(uint16_t));
+	memcpy(&length, replyData + 8, sizeof(int32_t));
+	memcpy(&int16Scale, replyData + 20, sizeof(float));
+
+	if (version != 2 || headerBytes < MIN_HEADER_BYTES || headerBytes > replySize || replyChans != m_nChans || length < 0)
+	{
+		log << "Bad " << getTypeName(m_type) << " header: version " << std::to_string(version) << ", " << std::to_string(replyChans)
+			<< " channels, " << std::to_string(length) << " samples" << std::endl;
+		return 0;
+	}
+
+	bool isInt16 = (flags & FLAG_INT16) != 0;
+	float scale = isInt16 ? int16Scale : 1.0f;
+
+	//only happens if we haven't asked for a long time
+	int nWrite = std::min((int)length, MAX_SAMPLES);
+	if (nWrite < length)
+	{
+		log << "Dropping " << std::to_string(length - nWrite) << " " << getTypeName(m_type) << " samples, more than one reply holds" << std::endl;
+	}
+
+	//channel planes
+	size_t planeOffset = headerBytes;
+	for (int iChan = 0; iChan < m_nChans && length > 0; iChan++)
+	{
+		size_t planeBytes;
+		if ((flags & FLAG_DELTA_PACKED) != 0)
+		{
+			planeBytes = TDFrameKernels::decodeDeltaPackedPlane(replyData + planeOffset, replySize - planeOffset, length, isInt16, scale,
+				m_decodeData[iChan], nWrite);
+		}
+		else
+		{
+			planeBytes = length * (isInt16 ? sizeof(int16_t) : sizeof(float));
+			if (planeOffset + planeBytes > replySize)
+			{
+				planeBytes = 0;
+			}
+			else if (isInt16)
+			{
+				TDFrameKernels::convertInt16Plane(replyData + planeOffset, nWrite, scale, m_decodeData[iChan]);
+			}
+			else
+			{
+				TDFrameKernels::convertFloat32Plane(replyData + planeOffset, nWrite, scale, m_decodeData[iChan]);
+			}
+		}
+
+		if (planeBytes == 0)
+		{
+			log << getTypeName(m_type) << " reply says it has " << std::to_string(length) << " samples but is only " << std::to_string(replySize) << " bytes" << std::endl;
+			return 0;
+		}
+		planeOffset += planeBytes;
+	}
+
+	size_t runsOffset = planeOffset;
+	size_t ticksOffset = runsOffset + nRuns * 2 * sizeof(int32_t);
+	if (ticksOffset > replySize)
+	{
+		log << getTypeName(m_type) << " reply is missing packet number runs" << std::endl;
+		return 0;
+	}
+	bool hasTicks = (flags & FLAG_RUN_TICKS) != 0 && ticksOffset + nRuns * 2 * sizeof(uint16_t) <= replySize;
+
+	//put every run on this stream's own sample clock
+	const char* run = replyData + runsOffset;
+	const char* tick = replyData + ticksOffset;
+	int iPoint = 0;
+	for (int iRun = 0; iRun < nRuns && iPoint < nWrite; iRun++)
+	{
+		int32_t packetNum, runLength;
+		memcpy(&packetNum, run, sizeof(int32_t));
+		memcpy(&runLength, run + sizeof(int32_t), sizeof(int32_t));
+		run += 2 * sizeof(int32_t);
+
+		int samplesAfterRun = std::max(0, (int)runLength - (nWrite - iPoint));
+		runLength = std::max(0, std::min((int)runLength, nWrite - iPoint));
+		if (runLength == 0)
+		{
+			continue;
+		}
+
+		int64_t first;
+		if (hasTicks)
+		{
+			uint16_t systemTick, ticksAfterRun;
+			memcpy(&systemTick, tick, sizeof(uint16_t));
+			memcpy(&ticksAfterRun, tick + sizeof(uint16_t), sizeof(uint16_t));
+			tick += 2 * sizeof(uint16_t);
+			first = m_clock.stampRun(systemTick, samplesAfterRun + ticksAfterRun, runLength);
+		}
+		else
+		{
+			first = m_clock.continueRun(runLength);
+		}
+
+		for (int iSample = 0; iSample < runLength; iSample++)
+		{
+			m_decodePacketNumbers[iPoint + iSample] = packetNum;
+			m_decodeTimestamps[iPoint + iSample] = first + iSample;
+		}
+		iPoint += runLength;
+	}
+
+	int nWritten = m_ring.write(m_decodeData, m_decodePacketNumbers, m_decodeTimestamps, iPoint);
+	if (nWritten < iPoint)
+	{
+		log << "Dropping " << std::to_string(iPoint - nWritten) << " " << getTypeName(m_type) << " samples, ring is full" << std::endl;
+	}
+	return nWritten;
+}
+
+int INSSideStream::readBlock(int maxSamples)
+{
+	int nRead = m_ring.read(m_blockData, m_blockPacketNumbers, m_blockTimestamps, std::min(maxSamples, (int)MAX_SAMPLES));
+
+	//an empty block sits where the last one ended
+	m_blockTimestamp = nRead > 0 ? m_blockTimestamps[0] : m_nextBlockTimestamp;
+	m_nextBlockTimestamp = m_blockTimestamp + nRead;
+	return nRead;
+}
@@ -0,0 +1,120 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2014 Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef INSSIDESTREAM_H_INCLUDED
+#define INSSIDESTREAM_H_INCLUDED
+
+#include <cstdint>
+#include <ostream>
+#include "INSRingBuffer.h"
+#include "INSSampleClock.h"
+
+/**
+
+  One of the INS's other sense streams (its embedded FFT, band power or
+  accelerometer), which the SIP sends in the same v2 format as TD when asked
+  with "FFT", "PW" or "AC" (always float32, see deserializeV2() in
+  SummitSource for the format).
+
+  Each stream has its own rate and SystemTicks, so it gets its own sample
+  clock and ring and goes out of SummitSource as its own sub-processor.
+
+  decode() is only called from the receiver thread and readBlock() only from
+  the Open Ephys processing thread. All memory is allocated in the
+  constructor.
+
+*/
+
+class INSSideStream
+{
+public:
+
+	enum Type
+	{
+		STREAM_FFT = 1,
+		STREAM_POWER = 2,
+		STREAM_ACCEL = 3
+	};
+
+	INSSideStream(Type type, int nChans, float sampleRate);
+
+	~INSSideStream();
+
+	Type getType() const { return m_type; }
+	int getNumChans() const { return m_nChans; }
+	float getSampleRate() const { return m_sampleRate; }
+
+	/** What to send the SIP to get this stream's data */
+	const char* getRequest() const;
+
+	/** Name of the stream type, for channel names and the editor */
+	static const char* getTypeName(Type type);
+
+	/** Receiver side: decodes a reply and puts it on the ring. Returns the number of time points added, problems
+	    with the reply are written to log. An empty reply just means the SIP had nothing new */
+	int decode(const char* replyData, size_t replySize, std::ostream& log);
+
+	/** Processing side: reads up to maxSamples contiguous time points into the block, returns how many */
+	int readBlock(int maxSamples);
+
+	/** Data of one channel of the last block read */
+	const float* getBlockChannel(int iChan) const { return m_blockData[iChan]; }
+
+	/** Sample clock of the first time point of the last block read, or where the next one will be if it was empty */
+	int64_t getBlockTimestamp() const { return m_blockTimestamp; }
+
+	static const int MAX_CHANS = 512; //a 1024 point FFT with all its bins
+	static const int MAX_SAMPLES = 256; //per reply, and per block
+
+private:
+
+	Type m_type;
+	int m_nChans;
+	float m_sampleRate;
+
+	INSSampleClock m_clock;
+	INSRingBuffer m_ring;
+
+	//receiver side
+	float** m_decodeData; //[channel][time point]
+	int* m_decodePacketNumbers;
+	int64_t* m_decodeTimestamps;
+
+	//processing side
+	float** m_blockData;
+	int* m_blockPacketNumbers;
+	int64_t* m_blockTimestamps;
+	int64_t m_blockTimestamp;
+	int64_t m_nextBlockTimestamp;
+
+	static const int RING_CAPACITY = 4096;
+	static const int MIN_HEADER_BYTES = 24;
+	static const unsigned char FLAG_INT16 = 0x01;
+	static const unsigned char FLAG_DELTA_PACKED = 0x02;
+	static const unsigned char FLAG_RUN_TICKS = 0x04;
+
+	INSSideStream(const INSSideStream&);
+	INSSideStream& operator=(const INSSideStream&);
+};
+
+#endif  // INSSIDESTREAM_H_INCLUDED
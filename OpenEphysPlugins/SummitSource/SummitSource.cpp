@@ -29,7 +29,7 @@
 #define PRINT_PROFILING
 
 //If the processor uses a custom editor, it needs its header to instantiate it
-//#include "TestSourceEditor.h"
+#include "SummitSourceEditor.h"
 
 SummitSource::SummitSource()
     : GenericProcessor("Summit Source") //, threshold(200.0), state(true)
@@ -40,38 +40,46 @@ SummitSource::SummitSource()
 
 	setProcessorType(PROCESSOR_TYPE_SOURCE);
 
-	nFeatureChans = 15;
-
-	socket.connect("tcp://localhost:5555");
-
 	debugFile.open(debugPath);
 	debugFile << "Starting \n";
 
 #ifdef PRINT_PROFILING
 	m_profilingFile.open("SummitSource_Profiling.txt");
-	m_profilingFile << "Loop WaitingforReply Deserialization WritingToBuffer " << std::endl;
+	m_profilingFile << "Loop ReadingRingBuffer Backlog WritingToBuffer " << std::endl;
+	m_receiverProfilingFile.open("SummitSource_ReceiverProfiling.txt");
+	m_receiverProfilingFile << "Loop WaitingforReply Deserialization WritingToRingBuffer " << std::endl;
 #endif
+	m_receiverDebugFile.open(m_receiverDebugPath);
 
 	m_loop = 0;
-	m_featuresHistory = 15;
+	m_stopReceiver = true;
+
+	m_transport = TRANSPORT_TCP;
+	m_receiveHWM = DEFAULT_RECEIVE_HWM;
+	m_receiveBufferSize = 0;
+	m_immediate = false;
+	m_ioThreads = DEFAULT_IO_THREADS;
+	m_reorderLatencyMs = DEFAULT_REORDER_LATENCY_MS;
+	m_fillMode = INSGapFiller::FILL_LINEAR;
+	m_playoutDelayMs = 0;
+	m_playoutAdaptive = true;
+	setAddress(getDefaultAddress(TRANSPORT_TCP));
 }
 
 
 SummitSource::~SummitSource()
 {
+	stopReceiver();
 
-	debugFile.close();
+	//the devices' sockets have to go before the context they were made on
+	m_devices.clear();
 
-	//deallocate memory
-	for (int iChan = 0; iChan < nChans; iChan++)
-	{
-		delete[] INSData[iChan];
-	}
-	delete[] INSData;
-	delete[] packetNumbers;
+	debugFile.close();
+	m_receiverDebugFile.close();
 
 #ifdef PRINT_PROFILING
 	m_profilingFile.close();
+	m_receiverProfilingFile.close();
 #endif
 
 	//socket.close();
@@ -81,16 +89,393 @@ SummitSource::~SummitSource()
 /**
 	If the processor uses a custom editor, this method must be present.
 */
-/*
-AudioProcessorEditor* TestSource::createEditor()
+AudioProcessorEditor* SummitSource::createEditor()
 {
-	editor = new TestSourceEditor(this, true);
-
-	//std::cout << "Creating editor." << std::endl;
+	editor = new SummitSourceEditor(this, true);
 
 	return editor;
 }
-*/
+
+void SummitSource::setTransport(Transport transport)
+{
+	m_transport = transport;
+}
+
+void SummitSource::setAddress(const String& address)
+{
+	//one address per SIP, empty ones are dropped (and generator settings that don't make sense)
+	StringArray addresses;
+	addresses.addTokens(address, ",", "");
+	addresses.trim();
+	addresses.removeEmptyStrings();
+	for (int iAddress = addresses.size() - 1; iAddress >= 0 && m_transport == TRANSPORT_GENERATOR; iAddress--)
+	{
+		INSGenerator::Settings settings = INSGenerator::getDefaultSettings();
+		if (!INSGenerator::parseSettings(addresses[iAddress].toStdString(), &settings))
+		{
+			addresses.remove(iAddress);
+		}
+	}
+	while (addresses.size() > MAX_DEVICES)
+	{
+		addresses.remove(MAX_DEVICES);
+	}
+	if (addresses.size() == 0)
+	{
+		addresses.add(getDefaultAddress(m_transport));
+	}
+
+	m_address = addresses.joinIntoString(", ");
+	m_addresses.clear();
+	for (int iAddress = 0; iAddress < addresses.size(); iAddress++)
+	{
+		m_addresses.push_back(addresses[iAddress].toStdString());
+	}
+
+	//a new INS starts off with the defaults until it's probed
+	m_layouts.resize(m_addresses.size(), INSDevice::getDefaultLayout());
+	m_layoutFromSIP.resize(m_addresses.size(), false);
+}
+
+void SummitSource::setReceiveHWM(int messages)
+{
+	m_receiveHWM = jmax(messages, 0);
+}
+
+void SummitSource::setReceiveBufferSize(int bytes)
+{
+	m_receiveBufferSize = jmax(bytes, 0);
+}
+
+void SummitSource::setImmediate(bool immediate)
+{
+	m_immediate = immediate;
+}
+
+void SummitSource::setIOThreads(int nThreads)
+{
+	m_ioThreads = jmin(jmax(nThreads, 1), MAX_IO_THREADS);
+}
+
+void SummitSource::setReorderLatency(int milliseconds)
+{
+	m_reorderLatencyMs = jmin(jmax(milliseconds, 0), MAX_REORDER_LATENCY_MS);
+}
+
+void SummitSource::setFillMode(INSGapFiller::FillMode fillMode)
+{
+	m_fillMode = fillMode;
+}
+
+void SummitSource::setPlayoutDelay(int milliseconds)
+{
+	m_playoutDelayMs = jmin(jmax(milliseconds, 0), (int)INSPlayout::MAX_DELAY_MS);
+}
+
+void SummitSource::setPlayoutAdaptive(bool adaptive)
+{
+	m_playoutAdaptive = adaptive;
+}
+
+bool SummitSource::setFeatureLags(const String& lags)
+{
+	if (!INSLagFeatures::parseLags(lags.toStdString(), &m_featureLags))
+	{
+		return false;
+	}
+
+	m_featureLagsText = lags.trim();
+	return true;
+}
+
+String SummitSource::getDefaultAddress(Transport transport)
+{
+	switch (transport)
+	{
+	case TRANSPORT_IPC:
+		return "/tmp/summit-td";
+	case TRANSPORT_INPROC:
+		return "summit-td";
+	case TRANSPORT_GENERATOR:
+		return "ch=4 rate=500 period=50";
+	default:
+		return "localhost:5555";
+	}
+}
+
+
+void SummitSource::saveCustomParametersToXml(XmlElement* parentElement)
+{
+	XmlElement* connectionNode = parentElement->createNewChildElement("CONNECTION");
+	connectionNode->setAttribute("transport", (int)m_transport);
+	connectionNode->setAttribute("address", m_address);
+	connectionNode->setAttribute("receiveHWM", m_receiveHWM);
+	connectionNode->setAttribute("receiveBufferSize", m_receiveBufferSize);
+	connectionNode->setAttribute("immediate", m_immediate ? 1 : 0);
+	connectionNode->setAttribute("ioThreads", m_ioThreads);
+
+	XmlElement* gapFillNode = parentElement->createNewChildElement("GAP_FILL");
+	gapFillNode->setAttribute("reorderLatency", m_reorderLatencyMs);
+	gapFillNode->setAttribute("fillMode", (int)m_fillMode);
+
+	XmlElement* playoutNode = parentElement->createNewChildElement("PLAYOUT");
+	playoutNode->setAttribute("delay", m_playoutDelayMs);
+	playoutNode->setAttribute("adaptive", m_playoutAdaptive ? 1 : 0);
+
+	XmlElement* featuresNode = parentElement->createNewChildElement("FEATURES");
+	featuresNode->setAttribute("lags", m_featureLagsText);
+
+	//last layout we heard from each SIP, in address order, so the channels come back the same even if they aren't
+	//running when we load
+	for (size_t iDevice = 0; iDevice < m_layouts.size(); iDevice++)
+	{
+		const INSDevice::StreamLayout& layout = m_layouts[iDevice];
+		XmlElement* streamNode = parentElement->createNewChildElement("STREAM");
+		streamNode->setAttribute("sampleRate", (double)layout.sampleRate);
+		streamNode->setAttribute("packetPeriod", layout.packetPeriodMs);
+		for (int iChan = 0; iChan < layout.nChans; iChan++)
+		{
+			XmlElement* channelNode = streamNode->createNewChildElement("CHANNEL");
+			channelNode->setAttribute("label", String(layout.labels[iChan]));
+		}
+		for (size_t iStream = 0; iStream < layout.sideStreams.size(); iStream++)
+		{
+			XmlElement* sideStreamNode = streamNode->createNewChildElement("SIDE_STREAM");
+			sideStreamNode->setAttribute("type", (int)layout.sideStreams[iStream].type);
+			sideStreamNode->setAttribute("channels", layout.sideStreams[iStream].nChans);
+			sideStreamNode->setAttribute("sampleRate", (double)layout.sideStreams[iStream].sampleRate);
+		}
+	}
+}
+
+void SummitSource::loadCustomParametersFromXml()
+{
+	if (parametersAsXml == nullptr)
+	{
+		return;
+	}
+
+	size_t iStreamNode = 0;
+	forEachXmlChildElement(*parametersAsXml, connectionNode)
+	{
+		if (connectionNode->hasTagName("CONNECTION"))
+		{
+			int transport = connectionNode->getIntAttribute("transport", TRANSPORT_TCP);
+			setTransport((transport == TRANSPORT_IPC || transport == TRANSPORT_INPROC || transport == TRANSPORT_GENERATOR) ? (Transport)transport : TRANSPORT_TCP);
+			setAddress(connectionNode->getStringAttribute("address", getDefaultAddress(m_transport)));
+			setReceiveHWM(connectionNode->getIntAttribute("receiveHWM", DEFAULT_RECEIVE_HWM));
+			setReceiveBufferSize(connectionNode->getIntAttribute("receiveBufferSize", 0));
+			setImmediate(connectionNode->getIntAttribute("immediate", 0) != 0);
+			setIOThreads(connectionNode->getIntAttribute("ioThreads", DEFAULT_IO_THREADS));
+		}
+
+		if (connectionNode->hasTagName("GAP_FILL"))
+		{
+			setReorderLatency(connectionNode->getIntAttribute("reorderLatency", DEFAULT_REORDER_LATENCY_MS));
+			int fillMode = connectionNode->getIntAttribute("fillMode", INSGapFiller::FILL_LINEAR);
+			setFillMode((fillMode == INSGapFiller::FILL_HOLD || fillMode == INSGapFiller::FILL_NONE) ? (INSGapFiller::FillMode)fillMode : INSGapFiller::FILL_LINEAR);
+		}
+
+		if (connectionNode->hasTagName("PLAYOUT"))
+		{
+			setPlayoutDelay(connectionNode->getIntAttribute("delay", 0));
+			setPlayoutAdaptive(connectionNode->getIntAttribute("adaptive", 1) != 0);
+		}
+
+		if (connectionNode->hasTagName("FEATURES"))
+		{
+			setFeatureLags(connectionNode->getStringAttribute("lags", ""));
+		}
+
+		//one per address in order, what the SIP itself just told us wins over what was saved
+		if (connectionNode->hasTagName("STREAM"))
+		{
+			size_t iDevice = iStreamNode++;
+			if (iDevice >= m_layouts.size() || m_layoutFromSIP[iDevice])
+			{
+				continue;
+			}
+
+			INSDevice::StreamLayout layout;
+			layout.sampleRate = (float)connectionNode->getDoubleAttribute("sampleRate", INSDevice::DEFAULT_SAMPLE_RATE);
+			layout.packetPeriodMs = connectionNode->getIntAttribute("packetPeriod", 0);
+			forEachXmlChildElement(*connectionNode, channelNode)
+			{
+				if (channelNode->hasTagName("CHANNEL") && layout.labels.size() < INSDevice::MAX_CHANS)
+				{
+					layout.labels.push_back(channelNode->getStringAttribute("label", "TD" + String((int)layout.labels.size() + 1)).toStdString());
+				}
+
+				if (channelNode->hasTagName("SIDE_STREAM") && layout.sideStreams.size() < INSDevice::MAX_SIDE_STREAMS)
+				{
+					INSDevice::SideStreamLayout sideStream;
+					sideStream.type = (INSSideStream::Type)channelNode->getIntAttribute("type", 0);
+					sideStream.nChans = channelNode->getIntAttribute("channels", 0);
+					sideStream.sampleRate = (float)channelNode->getDoubleAttribute("sampleRate", 0);
+					if (INSDevice::validSideStream(sideStream))
+					{
+						layout.sideStreams.push_back(sideStream);
+					}
+				}
+			}
+			layout.nChans = (int)layout.labels.size();
+
+			if (layout.nChans > 0 && layout.sampleRate > 0)
+			{
+				m_layouts[iDevice] = layout;
+			}
+		}
+	}
+}
+
+bool SummitSource::probeStreamLayout()
+{
+	//generators make whatever they're set up to, nothing to ask
+	if (m_transport == TRANSPORT_GENERATOR)
+	{
+		for (int iDevice = 0; iDevice < getNumDevices(); iDevice++)
+		{
+			m_layouts[iDevice] = INSDevice::getGeneratorLayout(getGeneratorSettings(iDevice));
+			m_layoutFromSIP[iDevice] = true;
+		}
+		m_devices.clear();
+		debugFile << "Stream layout: " << getStreamDescription().toStdString() << std::endl;
+		return true;
+	}
+
+	//ask every SIP at once and wait for them all together, so more INSs don't make this take any longer
+	OwnedArray<zmq::socket_t> probeSockets;
+	std::vector<zmq::pollitem_t> items;
+	std::vector<int> itemDevices;
+	for (int iDevice = 0; iDevice < getNumDevices(); iDevice++)
+	{
+		zmq::socket_t* probeSocket = probeSockets.add(new zmq::socket_t(context, ZMQ_REQ));
+		int linger = 0;
+		probeSocket->setsockopt(ZMQ_LINGER, &linger, sizeof(linger));
+
+		try
+		{
+			probeSocket->connect(getEndpoint(iDevice));
+		}
+		catch (const zmq::error_t& e)
+		{
+			debugFile << "Couldn't connect to " << getEndpoint(iDevice) << ": " << e.what() << std::endl;
+			continue;
+		}
+
+		zmq::message_t request(6);
+		memcpy(request.data(), "InitTD", 6);
+		probeSocket->send(request, ZMQ_DONTWAIT);
+
+		zmq::pollitem_t item = { static_cast<void*>(*probeSocket), 0, ZMQ_POLLIN, 0 };
+		items.push_back(item);
+		itemDevices.push_back(iDevice);
+	}
+
+	std::vector<bool> answered(items.size(), false);
+	int nAnswered = 0;
+	std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(PROBE_TIMEOUT_MS);
+	while (nAnswered < (int)items.size())
+	{
+		int timeoutMs = (int)std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+		if (timeoutMs <= 0)
+		{
+			break;
+		}
+
+		//answered ones are taken out of the poll
+		for (size_t iItem = 0; iItem < items.size(); iItem++)
+		{
+			items[iItem].events = answered[iItem] ? 0 : ZMQ_POLLIN;
+		}
+		zmq::poll(items.data(), items.size(), timeoutMs);
+
+		for (size_t iItem = 0; iItem < items.size(); iItem++)
+		{
+			zmq::message_t reply;
+			if (answered[iItem] || !(items[iItem].revents & ZMQ_POLLIN) || !probeSockets[itemDevices[iItem]]->recv(&reply, ZMQ_DONTWAIT))
+			{
+				continue;
+			}
+			answered[iItem] = true;
+			nAnswered++;
+
+			int iDevice = itemDevices[iItem];
+			INSDevice::StreamLayout layout;
+			if (INSDevice::parseStreamLayout(reply, &layout))
+			{
+				m_layouts[iDevice] = layout;
+				m_layoutFromSIP[iDevice] = true;
+			}
+		}
+	}
+
+	bool anyLayout = false;
+	for (int iDevice = 0; iDevice < getNumDevices(); iDevice++)
+	{
+		bool probed = false;
+		for (size_t iItem = 0; iItem < items.size(); iItem++)
+		{
+			probed = probed || (itemDevices[iItem] == iDevice && answered[iItem]);
+		}
+
+		if (!probed)
+		{
+			debugFile << "No usable stream layout from " << getEndpoint(iDevice) << ", keeping the one we had" << std::endl;
+		}
+		anyLayout = anyLayout || probed;
+	}
+
+	//devices from the last acquisition have nothing to tell us any more
+	m_devices.clear();
+	debugFile << "Stream layout: " << getStreamDescription().toStdString() << std::endl;
+	return anyLayout;
+}
+
+bool SummitSource::applyLayoutChange()
+{
+	bool changed = false;
+	for (int iDevice = 0; iDevice < m_devices.size() && iDevice < getNumDevices(); iDevice++)
+	{
+		if (m_devices[iDevice]->layoutChanged())
+		{
+			m_layouts[iDevice] = m_devices[iDevice]->getReceivedLayout();
+			m_layoutFromSIP[iDevice] = true;
+			changed = true;
+		}
+	}
+
+	//only pick the change up once
+	m_devices.clear();
+	if (changed)
+	{
+		debugFile << "Stream layout changed while acquiring, now " << getStreamDescription().toStdString() << std::endl;
+	}
+	return changed;
+}
+
+String SummitSource::getStreamDescription() const
+{
+	std::string description;
+	for (int iDevice = 0; iDevice < getNumDevices(); iDevice++)
+	{
+		const INSDevice::StreamLayout& layout = m_layouts[iDevice];
+		if (iDevice > 0)
+		{
+			description += "; ";
+		}
+		description += std::to_string(layout.nChans) + " ch, " + std::to_string((int)layout.sampleRate) + " Hz";
+		if (layout.packetPeriodMs > 0)
+		{
+			description += ", " + std::to_string(layout.packetPeriodMs) + " ms";
+		}
+		for (size_t iStream = 0; iStream < layout.sideStreams.size(); iStream++)
+		{
+			description += std::string(iStream == 0 ? " + " : ", ") + INSSideStream::getTypeName(layout.sideStreams[iStream].type);
+		}
+	}
+	return String(description);
+}
 
 void SummitSource::setParameter(int parameterIndex, float newValue)
 {
@@ -104,20 +489,127 @@ void SummitSource::setParameter(int parameterIndex, float newValue)
     editor->updateParameterButtons(parameterIndex);
 }
 
+
 int SummitSource::getDefaultNumDataOutputs(DataChannel::DataChannelTypes type, int subProcessorIdx) const
 {
-	if (subProcessorIdx == 0)
+	int iDevice;
+	int iSideStream;
+	if (!findSubProcessor(subProcessorIdx, &iDevice, &iSideStream))
+	{
+		return 0;
+	}
+	const INSDevice::StreamLayout& layout = m_layouts[iDevice];
+
+	if (iSideStream < 0)
 	{
 		switch (type)
 		{
 		case DataChannel::HEADSTAGE_CHANNEL:
-			return 4;
+			return layout.nChans;
 		case DataChannel::ADC_CHANNEL:
-			return 0;
+			return 1; //interpolated mask
 		case DataChannel::AUX_CHANNEL:
 			return 0;
 		}
 	}
+
+	//the other sense streams are ADC channels, so they don't get mixed up with anything downstream takes from AUX
+	if (iSideStream >= 0 && type == DataChannel::ADC_CHANNEL)
+	{
+		return layout.sideStreams[iSideStream].nChans;
+	}
+
+	return 0;
+}
+
+void SummitSource::updateSettings()
+{
+	//name the channels after what the SIP is sensing, and which INS it is when there's more than one
+	int iSubChans[MAX_SUBPROCESSORS] = { 0 };
+	for (int iChan = 0; iChan < dataChannelArray.size(); iChan++)
+	{
+		int subProcessor = dataChannelArray[iChan]->getSubProcessorIdx();
+		int iDevice;
+		int iSideStream;
+		if (!findSubProcessor(subProcessor, &iDevice, &iSideStream))
+		{
+			continue;
+		}
+		const INSDevice::StreamLayout& layout = m_layouts[iDevice];
+		String prefix = getNumDevices() > 1 ? String(getDeviceName(iDevice)) + " " : String();
+
+		if (dataChannelArray[iChan]->getChannelType() == DataChannel::HEADSTAGE_CHANNEL && iSubChans[subProcessor] < layout.nChans)
+		{
+			dataChannelArray[iChan]->setName(prefix + String(layout.labels[iSubChans[subProcessor]]));
+			iSubChans[subProcessor]++;
+		}
+		else if (dataChannelArray[iChan]->getChannelType() == DataChannel::ADC_CHANNEL && iSideStream < 0)
+		{
+			dataChannelArray[iChan]->setName(prefix + "Interpolated");
+			dataChannelArray[iChan]->setDescription("1 for samples filled in for dropped packets, 0 for real data");
+		}
+		else if (dataChannelArray[iChan]->getChannelType() == DataChannel::ADC_CHANNEL)
+		{
+			dataChannelArray[iChan]->setName(prefix + String(getSideChannelName(layout, layout.sideStreams[iSideStream].type, iSubChans[subProcessor])));
+			iSubChans[subProcessor]++;
+		}
+	}
+}
+
+std::string SummitSource::getSideChannelName(const INSDevice::StreamLayout& layout, INSSideStream::Type type, int iChan) const
+{
+	switch (type)
+	{
+	case INSSideStream::STREAM_FFT:
+		return "FFT bin " + std::to_string(iChan);
+	case INSSideStream::STREAM_POWER:
+		//both bands of each TD channel in turn
+		return (iChan / 2 < layout.nChans ? layout.labels[iChan / 2] : "TD" + std::to_string(iChan / 2 + 1)) + " band " + std::to_string(iChan % 2 + 1);
+	default:
+		return std::string("Accel ") + (iChan == 0 ? "X" : iChan == 1 ? "Y" : "Z");
+	}
+}
+
+void SummitSource::createEventChannels()
+{
+	m_clockDriftChannels.clear();
+	m_lagFeatureChannels.clear();
+	for (int iDevice = 0; iDevice < getNumDevices(); iDevice++)
+	{
+		const INSDevice::StreamLayout& layout = m_layouts[iDevice];
+		int subProcessor = getFirstSubProcessor(iDevice);
+		String suffix = getNumDevices() > 1 ? " (" + String(getDeviceName(iDevice)) + ")" : String();
+
+		EventChannel* driftChannel = new EventChannel(EventChannel::DOUBLE_ARRAY, 1, INSDevice::CLOCK_DRIFT_EVENT_VALUES, layout.sampleRate, this, subProcessor);
+		driftChannel->setName("INS clock drift" + suffix);
+		driftChannel->setDescription("Fit of the INS clock against the host steady clock: offset s, drift ppm, jitter ms, last packet delay ms, points in fit, points rejected");
+		driftChannel->setIdentifier("summitsource.clockdrift");
+		m_clockDriftChannels.push_back(eventChannelArray.size());
+		eventChannelArray.add(driftChannel);
+
+		//one vector per block instead of a channel per lag
+		int lagFeatureChannel = -1;
+		int nFeatures = layout.nChans * (int)m_featureLags.size();
+		if (nFeatures > 0)
+		{
+			EventChannel* featureChannel = new EventChannel(EventChannel::FLOAT_ARRAY, 1, nFeatures, layout.sampleRate, this, subProcessor);
+			featureChannel->setName("Lag features" + suffix);
+			featureChannel->setDescription("Each TD channel at lags " + m_featureLagsText + " samples before the newest sample of the block, all lags of the first channel then the next");
+			featureChannel->setIdentifier("summitsource.lagfeatures");
+			lagFeatureChannel = eventChannelArray.size();
+			eventChannelArray.add(featureChannel);
+		}
+		m_lagFeatureChannels.push_back(lagFeatureChannel);
+	}
+}
+
+INSClockDrift::Estimate SummitSource::getClockDriftEstimate(int iDevice) const
+{
+	if (iDevice < 0 || iDevice >= m_devices.size())
+	{
+		return INSClockDrift(1).getEstimate();
+	}
+	return m_devices[iDevice]->getClockDriftEstimate();
 }
 
 void SummitSource::process(AudioSampleBuffer& buffer)
@@ -144,41 +636,24 @@ void SummitSource::process(AudioSampleBuffer& buffer)
 	m_profilingFile << std::to_string(m_loop) << " ";
 #endif
 
-	//ask for data with ZMQ
+	//get whatever data the receiver thread has decoded so far from every INS, never blocks. Each INS plays out on
+	//its own clock
 	m_start_time = std::chrono::high_resolution_clock::now();
 
-	zmq::message_t request(2);
-	memcpy(request.data(), "TD", 2);
-	socket.send(request);
-
-	zmq::message_t reply;
-	socket.recv(&reply);
-
-	m_end_time = std::chrono::high_resolution_clock::now();
-	#ifdef PRINT_PROFILING
-	m_elapsed = std::chrono::duration_cast<std::chrono::microseconds>(m_end_time - m_start_time).count();
-	m_profilingFile << std::to_string(m_elapsed) << " ";
-	#endif
-
-
-	//deserialize data from ZMQ socket to data arrays
-	m_start_time = std::chrono::high_resolution_clock::now();
-
-	int packetLength;
-	deserialize(INSData, packetNumbers, packetLength, &reply);
-	if (m_packetNumPrev - packetNumbers[0] > 1)
+	int nDevices = m_devices.size();
+	int packetLengths[MAX_DEVICES] = { 0 };
+	int backlog = 0;
+	for (int iDevice = 0; iDevice < nDevices; iDevice++)
 	{
-	m_sampleCounter += m_packetDropSize*(m_packetNumPrev - packetNumbers[0] - 1);
-	}
-	else
-	{
-	m_sampleCounter += packetLength;
+		packetLengths[iDevice] = m_devices[iDevice]->readBlock(buffer.getNumSamples());
+		backlog += m_devices[iDevice]->getBacklog();
 	}
 
 	m_end_time = std::chrono::high_resolution_clock::now();
 	#ifdef PRINT_PROFILING
 	m_elapsed = std::chrono::duration_cast<std::chrono::microseconds>(m_end_time - m_start_time).count();
 	m_profilingFile << std::to_string(m_elapsed) << " ";
+	m_profilingFile << std::to_string(backlog) << " ";
 	#endif
 
 
@@ -207,24 +682,41 @@ void SummitSource::process(AudioSampleBuffer& buffer)
 
 	//}
 
-	//now fill the channels (raw data for headstage channels, features for aux channels
+	//now fill the channels (raw data for headstage channels, interpolated mask for the ADC channel)
 	m_start_time = std::chrono::high_resolution_clock::now();
 
-	int iHeadstage = 0;
-
-	int iChanHist = 0;
-	int iHist = 0;
-	bool giveZeroes = false;
-
-	if (packetLength != 0)
+	//the other sense streams go out on their own sub-processors, on their own sample clocks. They're much slower than
+	//TD, so there's no playout for them, whatever's arrived goes out
+	int sideLengths[MAX_DEVICES][INSDevice::MAX_SIDE_STREAMS] = { { 0 } };
+	bool anyPackets = false;
+	for (int iDevice = 0; iDevice < nDevices; iDevice++)
 	{
-	debugFile << std::to_string(packetNumbers[0]) << " ";
-	debugFile << std::to_string(m_sampleCounter) << " ";
+		INSDevice* device = m_devices[iDevice];
+		for (int iStream = 0; iStream < device->getNumSideStreams(); iStream++)
+		{
+			sideLengths[iDevice][iStream] = device->getSideStream(iStream)->readBlock(buffer.getNumSamples());
+		}
+
+		if (packetLengths[iDevice] != 0)
+		{
+			debugFile << std::to_string(device->getBlockPacketNumbers()[0]) << " ";
+			debugFile << std::to_string(device->getBlockTimestamp()) << " ";
+			anyPackets = true;
+		}
 	}
 
+	int iSubChans[MAX_SUBPROCESSORS] = { 0 };
 	for (int iChan = 0; iChan < dataChannelArray.size(); iChan++)
 	{
 		float* samplePtr = buffer.getWritePointer(iChan, 0);
+		int subProcessor = dataChannelArray[iChan]->getSubProcessorIdx();
+		int iDevice;
+		int iSideStream;
+		if (!findSubProcessor(subProcessor, &iDevice, &iSideStream) || iDevice >= nDevices)
+		{
+			continue;
+		}
+		INSDevice* device = m_devices[iDevice];
 
 		switch (dataChannelArray[iChan]->getChannelType())
 		{
@@ -232,63 +724,37 @@ void SummitSource::process(AudioSampleBuffer& buffer)
 		case DataChannel::HEADSTAGE_CHANNEL:
 		{
 			//saved all our data channels already
-			if (iHeadstage > nChans - 1)
+			if (iSubChans[subProcessor] > m_layouts[iDevice].nChans - 1)
 			{
 				break;
 			}
 
-			//add next data channel to headstage output channel
-			for (int iSample = 0; iSample < packetLength; iSample++)
-			{
-				*(samplePtr + iSample) = INSData[iChan][iSample] * 1000;
-			}
-			iHeadstage++;
+			//add next data channel to headstage output channel (already scaled when it was decoded)
+			memcpy(samplePtr, device->getBlockChannel(iSubChans[subProcessor]), packetLengths[iDevice] * sizeof(float));
+			iSubChans[subProcessor]++;
 
 			break;
 		}
 
-		case DataChannel::AUX_CHANNEL:
+		case DataChannel::ADC_CHANNEL:
 		{
-			//Theres no more data to use for history, just send what we have
-			if (iHist > packetLength - 1)
-			{
-				for (int iSample = 0; iSample < packetLength; iSample++)
-				{
-					*(samplePtr + iSample) = INSData[iChanHist][packetLength - 1] * 1000;// -chanMeans[iChanToUse]);
-				}
-				break;
-			}
-
-			//We added all the history for one channel, start adding history for next channel
-			if (iHist > m_featuresHistory)
-			{
-				iHist = 0;
-				iChanHist++;
-			}
-
-			//We added all the history for all the channels, we're done
-			if (iChanHist > 0)
+			if (iSideStream < 0)
 			{
-				break;
+				memcpy(samplePtr, device->getBlockMask(), packetLengths[iDevice] * sizeof(float));
 			}
-
-			//Add history
-			for (int iSample = 0; iSample < packetLength; iSample++)
+			else if (iSideStream < device->getNumSideStreams() && iSubChans[subProcessor] < device->getSideStream(iSideStream)->getNumChans())
 			{
-				*(samplePtr + iSample) = INSData[iChanHist][packetLength - 1 - iHist] * 1000;// -chanMeans[iChanToUse]);
+				INSSideStream* sideStream = device->getSideStream(iSideStream);
+				memcpy(samplePtr, sideStream->getBlockChannel(iSubChans[subProcessor]), sideLengths[iDevice][iSideStream] * sizeof(float));
+				iSubChans[subProcessor]++;
 			}
-
-			debugFile << std::to_string(INSData[iChanHist][packetLength - 1 - iHist] * 1000) << " ";
-
-			iHist++;
-
 			break;
 		}
 
 		}
 	}
 
-	if (packetLength != 0)
+	if (anyPackets)
 	{
 		debugFile << std::endl;
 	}
@@ -299,7 +765,45 @@ void SummitSource::process(AudioSampleBuffer& buffer)
 	m_profilingFile << std::to_string(m_elapsed) << std::endl;
 	#endif
 
-	setTimestampAndSamples(getTimestamp(0), packetLength);
+	for (int iDevice = 0; iDevice < nDevices; iDevice++)
+	{
+		INSDevice* device = m_devices[iDevice];
+		int subProcessor = getFirstSubProcessor(iDevice);
+		int64_t blockTimestamp = device->getBlockTimestamp();
+		int packetLength = packetLengths[iDevice];
+
+		setTimestampAndSamples((uint64)blockTimestamp, packetLength, subProcessor);
+		for (int iStream = 0; iStream < device->getNumSideStreams(); iStream++)
+		{
+			setTimestampAndSamples((uint64)device->getSideStream(iStream)->getBlockTimestamp(), sideLengths[iDevice][iStream], subProcessor + 1 + iStream);
+		}
+
+		//pass on the clock drift fit whenever the receiver has a new one
+		double values[INSDevice::CLOCK_DRIFT_EVENT_VALUES];
+		int driftChannel = iDevice < (int)m_clockDriftChannels.size() ? m_clockDriftChannels[iDevice] : -1;
+		if (device->getNewClockDrift(values) && driftChannel >= 0 && driftChannel < eventChannelArray.size())
+		{
+			BinaryEventPtr event = BinaryEvent::createBinaryEvent(eventChannelArray[driftChannel], blockTimestamp, values, sizeof(values));
+			if (event != nullptr)
+			{
+				addEvent(eventChannelArray[driftChannel], event, 0);
+			}
+		}
+
+		//and the lag features of the newest sample
+		int lagFeatureChannel = iDevice < (int)m_lagFeatureChannels.size() ? m_lagFeatureChannels[iDevice] : -1;
+		int nFeatures = device->getNumLagFeatures();
+		if (packetLength > 0 && lagFeatureChannel >= 0 && lagFeatureChannel < eventChannelArray.size()
+			&& nFeatures <= (int)m_lagFeatureValues.size() && device->getLagFeatures(m_lagFeatureValues.data()))
+		{
+			BinaryEventPtr event = BinaryEvent::createBinaryEvent(eventChannelArray[lagFeatureChannel], blockTimestamp + packetLength - 1,
+				m_lagFeatureValues.data(), (int)(nFeatures * sizeof(float)));
+			if (event != nullptr)
+			{
+				addEvent(eventChannelArray[lagFeatureChannel], event, packetLength - 1);
+			}
+		}
+	}
 
 	m_loop++;
 
@@ -307,115 +811,220 @@ void SummitSource::process(AudioSampleBuffer& buffer)
 
 bool SummitSource::enable()
 {
-	//connect to Summit API
-	zmq::message_t request(6);
-	memcpy(request.data(), "InitTD", 6);
-	socket.send(request);
-
-	zmq::message_t reply;
-	socket.recv(&reply);
-
-	int* dataBytes = new int[2];
-	memcpy(dataBytes, reply.data(), 8);
-
-	nChans = dataBytes[0];
-	INSBufferSize = dataBytes[1];
-	
-	//allocate memory
-	INSData = new float*[nChans];
-	for (int iChan = 0; iChan < nChans; iChan++)
+	//make sure a previous acquisition's receiver isn't still running, and its devices go before the context does
+	stopReceiver();
+	m_devices.clear();
+
+	//fresh ZMQ context, the number of I/O threads can only be set before it has any sockets. Every INS's sockets
+	//are made on it (and connected) when it handshakes
+	context = zmq::context_t(m_ioThreads);
+
+	//each INS has its own decode state, clocks and ring, all allocated here so the receiver never has to
+	INSDevice::Options options = getDeviceOptions();
+	size_t nFeatures = 0;
+	for (int iDevice = 0; iDevice < getNumDevices(); iDevice++)
 	{
-		INSData[iChan] = new float[INSBufferSize];
+		std::ostream* profilingLog = nullptr;
+		#ifdef PRINT_PROFILING
+		profilingLog = &m_receiverProfilingFile;
+		#endif
+		INSGenerator::Settings generator = getGeneratorSettings(iDevice);
+		m_devices.add(new INSDevice(getDeviceName(iDevice), getEndpoint(iDevice), m_layouts[iDevice], options, context,
+			m_receiverDebugFile, debugFile, profilingLog, m_transport == TRANSPORT_GENERATOR ? &generator : nullptr));
+		nFeatures = std::max(nFeatures, (size_t)m_devices[iDevice]->getNumLagFeatures());
+		debugFile << "SIP endpoint: " << getEndpoint(iDevice) << std::endl;
 	}
+	m_lagFeatureValues.assign(nFeatures, 0.0f);
+	debugFile << std::to_string(m_ioThreads) << " I/O threads" << std::endl;
 
-	packetNumbers = new int[INSBufferSize];
+	//connect to Summit API and get data in the background, never blocks here even if the SIPs aren't up
+	debugFile << "TD decoder: " << TDFrameKernels::getImplementationName() << std::endl;
+	m_stopReceiver = false;
+	m_receiverThread = std::thread(&SummitSource::receiveLoop, this);
 
-	m_sampleCounter = 0;
-	
-	delete [] dataBytes;
 	return true;
 
 	setAllChannelsToRecord();
 
 }
 
-//get ZMQ message as data
-void SummitSource::deserialize(float** data, int* packNums, int &length, zmq::message_t* reply)
+bool SummitSource::disable()
 {
-	//Serialization is:
-	//
-	//  int32 number of buffer time points that are in this ZMQ packet
-	//
-	//  double data of channel 1 at time point 1,
-	//  double data of channel 2 at time point 1,
-	//  .
-	//  .
-	//  .
-	//  double data of channel m_nChans, time point 1,
-	//  double CTM packet number of time point 1,
-	//
-	//  double data of channel 1 at time point 2,
-	//  double data of channel 2 at time point 2,
-	//  .
-	//  .
-	//  .
-	//  double data of channel m_nChans at time point 2,
-	//  double CTM packet number of time point 2,
-	//  
-	//  .
-	//  .
-	//  .
-	//  double data of channel m_nChans at time point m_currentBufferInd
-	//  double CTM packet number of time point m_currentBufferInd,
+	stopReceiver();
+
+	//the receiver has finished with the sockets, don't stay connected to the SIPs while we aren't acquiring. The
+	//devices themselves stay until the editor has checked their layouts
+	for (int iDevice = 0; iDevice < m_devices.size(); iDevice++)
+	{
+		m_devices[iDevice]->stopReceiving();
+	}
+	return true;
+}
 
-	//get the length (as int) of the incoming data (first 4 bytes)
-	int* intData = static_cast<int*>(reply->data());
-	memcpy(&length, intData, 4);
-	intData++;
+void SummitSource::stopReceiver()
+{
+	m_stopReceiver = true;
+	if (m_receiverThread.joinable())
+	{
+		m_receiverThread.join();
+	}
+}
 
-	//rest of the serialization is as doubles
-	double* doubleData = reinterpret_cast<double*>(intData);
+//Runs on its own thread for the whole acquisition, all socket I/O and deserialization for every INS happens here
+//so that a slow, stalled or missing SIP never blocks process(). Each pass gives every device a turn to do what
+//doesn't need to wait, then waits on all their sockets in one poll, so one SIP going quiet never holds up the others
+void SummitSource::receiveLoop()
+{
+	int loop = 0;
+	int nDevices = m_devices.size();
 
-	//initialize memory	
-	double** doubleArray = new double*[nChans];
-	for (int iChans = 0; iChans < nChans; iChans++)
+	for (int iDevice = 0; iDevice < nDevices; iDevice++)
 	{
-		doubleArray[iChans] = new double[length];
+		m_devices[iDevice]->startReceiving();
 	}
-	double packet;
 
-	//copy data
-	for (int iPoint = 0; iPoint < length; iPoint++)
+	zmq::pollitem_t items[MAX_DEVICES * INSDevice::MAX_POLL_ITEMS];
+	int firstItems[MAX_DEVICES];
+	while (!m_stopReceiver)
 	{
-		//channel data
-		for (int iChans = 0; iChans < nChans; iChans++)
+		int nItems = 0;
+		int timeoutMs = RECEIVER_POLL_TIMEOUT_MS;
+		for (int iDevice = 0; iDevice < nDevices; iDevice++)
+		{
+			INSDevice* device = m_devices[iDevice];
+			device->prepare();
+			firstItems[iDevice] = nItems;
+			nItems += device->addPollItems(items + nItems);
+			timeoutMs = std::min(timeoutMs, device->getPollTimeoutMs());
+		}
+
+		if (nItems > 0)
+		{
+			zmq::poll(items, nItems, timeoutMs);
+		}
+		else if (timeoutMs > 0)
 		{
-			memcpy(&doubleArray[iChans][iPoint], doubleData, 8);
-			data[iChans][iPoint] = (float)doubleArray[iChans][iPoint];
-			doubleData++;
+			std::this_thread::sleep_for(std::chrono::milliseconds(timeoutMs));
 		}
 
-		//INS packet number
-		memcpy(&packet, doubleData, 8);
-		packNums[iPoint] = (int)packet;
-		doubleData++;
+		for (int iDevice = 0; iDevice < nDevices; iDevice++)
+		{
+			m_devices[iDevice]->service(items + firstItems[iDevice], loop);
+		}
+		loop++;
 	}
 
-	//free memory
-	for (int iChans = 0; iChans < nChans; iChans++)
+	for (int iDevice = 0; iDevice < nDevices; iDevice++)
 	{
-		delete[] doubleArray[iChans];
+		m_devices[iDevice]->stopReceiving();
 	}
-	delete[] doubleArray;
 }
 
+std::string SummitSource::getEndpoint(int iDevice) const
+{
+	switch (m_transport)
+	{
+	case TRANSPORT_IPC:
+		return "ipc://" + m_addresses[iDevice];
+	case TRANSPORT_INPROC:
+		return "inproc://" + m_addresses[iDevice];
+	case TRANSPORT_GENERATOR:
+		return "generator " + m_addresses[iDevice];
+	default:
+		return "tcp://" + m_addresses[iDevice];
+	}
+}
+
+INSGenerator::Settings SummitSource::getGeneratorSettings(int iDevice) const
+{
+	//setAddress only keeps settings that parse
+	INSGenerator::Settings settings = INSGenerator::getDefaultSettings();
+	INSGenerator::parseSettings(m_addresses[iDevice], &settings);
+	return settings;
+}
+
+std::string SummitSource::getDeviceName(int iDevice) const
+{
+	return getNumDevices() > 1 ? "INS" + std::to_string(iDevice + 1) : std::string();
+}
+
+INSDevice::Options SummitSource::getDeviceOptions() const
+{
+	INSDevice::Options options;
+	options.receiveHWM = m_receiveHWM;
+	options.receiveBufferSize = m_receiveBufferSize;
+	options.immediate = m_immediate;
+	options.reorderLatencyMs = m_reorderLatencyMs;
+	options.fillMode = m_fillMode;
+	options.playoutDelayMs = m_playoutDelayMs;
+	options.playoutAdaptive = m_playoutAdaptive;
+	options.featureLags = m_featureLags;
+	return options;
+}
+
+int SummitSource::getFirstSubProcessor(int iDevice) const
+{
+	int subProcessor = 0;
+	for (int iPrevious = 0; iPrevious < iDevice && iPrevious < getNumDevices(); iPrevious++)
+	{
+		subProcessor += 1 + (int)m_layouts[iPrevious].sideStreams.size();
+	}
+	return subProcessor;
+}
+
+bool SummitSource::findSubProcessor(int subProcessorIdx, int* iDevice, int* iSideStream) const
+{
+	int first = 0;
+	for (int iLayout = 0; iLayout < getNumDevices(); iLayout++)
+	{
+		int nSubProcessors = 1 + (int)m_layouts[iLayout].sideStreams.size();
+		if (subProcessorIdx >= first && subProcessorIdx < first + nSubProcessors)
+		{
+			*iDevice = iLayout;
+			*iSideStream = subProcessorIdx - first - 1;
+			return true;
+		}
+		first += nSubProcessors;
+	}
+	return false;
+}
+
+int SummitSource::getNumSubProcessors() const
+{
+	return getFirstSubProcessor(getNumDevices());
+}
 
 float SummitSource::getSampleRate(int subProcessorIdx) const
 {
-	return 500.0f;
+	int iDevice;
+	int iSideStream;
+	if (!findSubProcessor(subProcessorIdx, &iDevice, &iSideStream))
+	{
+		return getDefaultSampleRate();
+	}
+	if (iSideStream >= 0)
+	{
+		return m_layouts[iDevice].sideStreams[iSideStream].sampleRate;
+	}
+	return m_layouts[iDevice].sampleRate;
+}
+
+float SummitSource::getDefaultSampleRate() const
+{
+	return m_layouts.empty() ? INSDevice::DEFAULT_SAMPLE_RATE : m_layouts[0].sampleRate;
 }
 
 int SummitSource::getNumOutputs() const
 {
-	return 4;
+	int nOutputs = 0;
+	for (int iDevice = 0; iDevice < getNumDevices(); iDevice++)
+	{
+		const INSDevice::StreamLayout& layout = m_layouts[iDevice];
+		nOutputs += layout.nChans + 1; //and the interpolated mask
+		for (size_t iStream = 0; iStream < layout.sideStreams.size(); iStream++)
+		{
+			nOutputs += layout.sideStreams[iStream].nChans;
+		}
+	}
+	return nOutputs;
 }
@@ -30,8 +30,14 @@
 
 #include <ProcessorHeaders.h>
 #include "zmq.hpp"
+#include "INSDevice.h"
+#include "TDFrameKernels.h"
 #include <fstream>
 #include <chrono>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+#include <vector>
 
 /**
 
@@ -68,13 +74,13 @@ public:
     }
 
 	/** Indicates if the processor has a custom editor. Defaults to false */
-	//bool hasEditor() const
-	//{
-	//	return true;
-	//}
+	bool hasEditor() const
+	{
+		return true;
+	}
 
 	/** If the processor has a custom editor, this method must be defined to instantiate it. */
-	//AudioProcessorEditor* createEditor();
+	AudioProcessorEditor* createEditor() override;
 
 	/** Optional method that informs the GUI if the processor is ready to function. If false acquisition cannot start. Defaults to true */
 	//bool isReady();
@@ -103,13 +109,105 @@ public:
 		information regarding the input and output channels as well as other signal related parameters. Said
 		structure shouldn't be manipulated outside of this method.
 	*/
-	//void updateSettings();
+	void updateSettings() override;
 
+	/** Each INS (one per address, see setAddress) gets a sub-processor for its TD with the interpolated mask, then one
+		for each of the other sense streams its SIP offers (FFT, band power, accelerometer, see INSSideStream) at their
+		own rates. The first INS's TD is sub-processor 0 */
+	int getNumSubProcessors() const override;
 	int getNumOutputs() const override;
 	float getSampleRate(int subProcessorIdx = 0) const override;
+	float getDefaultSampleRate() const override;
 	bool enable() override;
+	bool disable() override;
 	int getDefaultNumDataOutputs(DataChannel::DataChannelTypes type, int subProcessorIdx = 0) const override;
 
+	/** Adds the "INS clock drift" event channel. Whenever the fit changes it gets a double array of
+		{offset s, drift ppm, jitter ms, last packet delay ms, points in fit, points rejected}, see getClockDriftEstimate.
+		With lag features set, also adds the "Lag features" channel, which gets a float array every block that has
+		samples (see INSLagFeatures). With several INSs, each gets its own pair on its TD sub-processor */
+	void createEventChannels() override;
+
+	/** Saves and restores the connection settings with the rest of the signal chain */
+	void saveCustomParametersToXml(XmlElement* parentElement) override;
+	void loadCustomParametersFromXml() override;
+
+	/** How we reach the SIP. The values are also the editor's combo box IDs */
+	enum Transport
+	{
+		TRANSPORT_TCP = 1,   //address is host:port
+		TRANSPORT_IPC = 2,   //address is a socket file path, Linux/macOS only (libzmq 4.0 has no ipc on Windows)
+		TRANSPORT_INPROC = 3, //address is a name bound by something sharing this processor's ZMQ context
+		TRANSPORT_GENERATOR = 4 //no SIP, address is the settings of an INSGenerator making up the data, for load testing
+	};
+
+	/** Connection settings, set from the editor. They're picked up by the next enable(), so the editor
+		only lets them change while we aren't acquiring. The address can be a comma separated list, one per SIP
+		(up to MAX_DEVICES), to stream from several INSs at once */
+	void setTransport(Transport transport);
+	void setAddress(const String& address);
+	void setReceiveHWM(int messages);
+	void setReceiveBufferSize(int bytes);
+	void setImmediate(bool immediate);
+	void setIOThreads(int nThreads);
+
+	/** How long a missing packet gets to turn up out of order before it's filled in, and how it's filled in
+		(see INSGapFiller). Also picked up by the next enable() */
+	void setReorderLatency(int milliseconds);
+	void setFillMode(INSGapFiller::FillMode fillMode);
+
+	/** How far behind the INS process() plays samples out so every block gets the same number of them, 0 for
+		handing them out as soon as they arrive. Adaptive lets the delay grow when samples turn up later than that
+		(see INSPlayout). Also picked up by the next enable() */
+	void setPlayoutDelay(int milliseconds);
+	void setPlayoutAdaptive(bool adaptive);
+
+	/** Lags, in samples, of the feature vector sent every block, e.g. "0-15" (see INSLagFeatures::parseLags). Empty
+		for none. Returns false and keeps the old lags if the text isn't valid. Update the signal chain afterwards,
+		the event channel's size depends on it */
+	bool setFeatureLags(const String& lags);
+
+	Transport getTransport() const { return m_transport; }
+	String getAddress() const { return m_address; }
+	int getReceiveHWM() const { return m_receiveHWM; }
+	int getReceiveBufferSize() const { return m_receiveBufferSize; }
+	bool getImmediate() const { return m_immediate; }
+	int getIOThreads() const { return m_ioThreads; }
+	int getReorderLatency() const { return m_reorderLatencyMs; }
+	INSGapFiller::FillMode getFillMode() const { return m_fillMode; }
+	int getPlayoutDelay() const { return m_playoutDelayMs; }
+	bool getPlayoutAdaptive() const { return m_playoutAdaptive; }
+	String getFeatureLags() const { return m_featureLagsText; }
+
+	/** The address a transport starts off with when it's picked in the editor */
+	static String getDefaultAddress(Transport transport);
+
+	/** Does a quick "InitTD" handshake with every SIP at once (blocking for up to PROBE_TIMEOUT_MS in all) to
+		find out the channel count, sampling rate, labels and packet period the channels are built from. Only
+		call this while not acquiring, and update the signal chain afterwards. Returns false if none of the
+		SIPs answered, any that didn't keep the layout they had */
+	bool probeStreamLayout();
+
+	/** If any SIP sent a different layout during the last acquisition, switches to it and returns true
+		so the signal chain can be updated. Only call this after acquisition has stopped */
+	bool applyLayoutChange();
+
+	/** Short description of the current layout, for the editor */
+	String getStreamDescription() const;
+
+	/** How many INSs we stream from, one per address */
+	int getNumDevices() const { return (int)m_layouts.size(); }
+
+	/** Latest fit of an INS's clock against the host's, safe to call from any thread while acquiring. Device time
+		is a sample timestamp divided by the sample rate, host time is std::chrono::steady_clock in seconds, so e.g.
+		when sample N happens on the host is deviceToHost(N / getSampleRate()). Not valid until the SIP has sent
+		enough SystemTicks (v2 replies only) */
+	INSClockDrift::Estimate getClockDriftEstimate(int iDevice = 0) const;
+
+	static const int MAX_IO_THREADS = 16;
+	static const int MAX_REORDER_LATENCY_MS = 2000;
+	static const int MAX_DEVICES = 8;
+
 private:
 
     // private members and methods go here
@@ -120,25 +218,64 @@ private:
     // bool state;
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SummitSource);
-	zmq::context_t context = zmq::context_t(1);
-	zmq::socket_t socket = zmq::socket_t(context, ZMQ_REQ);
+	zmq::context_t context = zmq::context_t(1); //recreated by enable() with the configured number of I/O threads, shared by every INS's sockets
 	std::ofstream debugFile;
 	std::string debugPath = "SummitSource_debug.txt";
-	void deserialize(float** data, int* packNums, int &length, zmq::message_t* reply);
-
-	int nFeatureChans;
-	int nChans;
-	int INSBufferSize;
 	int m_loop;
-	int m_featuresHistory;
-	int m_sampleCounter;
-	int m_packetNumPrev;
-	int m_packetDropSize;
 
-	float** INSData;
-	int* packetNumbers;
+	//one per SIP, in address order. Made by enable() and kept until the next one, so the layouts the SIPs sent while
+	//we were acquiring can still be picked up afterwards
+	OwnedArray<INSDevice> m_devices;
+	std::vector<std::string> m_addresses; //m_address split up
+	std::string getEndpoint(int iDevice) const;
+	INSGenerator::Settings getGeneratorSettings(int iDevice) const;
+	std::string getDeviceName(int iDevice) const; //empty with only one INS, so nothing changes for the usual setup
+	INSDevice::Options getDeviceOptions() const;
+
+	//sub-processors are each INS's TD then its other sense streams, INS after INS
+	int getFirstSubProcessor(int iDevice) const;
+	bool findSubProcessor(int subProcessorIdx, int* iDevice, int* iSideStream) const; //iSideStream is -1 for TD
+	static const int MAX_SUBPROCESSORS = MAX_DEVICES * (1 + INSDevice::MAX_SIDE_STREAMS);
+
+	//background receiver, one thread serving every SIP, owns the sockets while acquisition is running
+	void receiveLoop();
+	void stopReceiver();
+	std::thread m_receiverThread;
+	std::atomic<bool> m_stopReceiver;
+	static const int RECEIVER_POLL_TIMEOUT_MS = 100; //how often the receiver checks if it should stop
+
+	std::string getSideChannelName(const INSDevice::StreamLayout& layout, INSSideStream::Type type, int iChan) const;
+	std::vector<INSDevice::StreamLayout> m_layouts; //what the signal chain was built from, one per address (message thread only)
+	std::vector<bool> m_layoutFromSIP; //that layout came from a probe rather than the defaults or saved settings
+	static const int PROBE_TIMEOUT_MS = 300;
+
+	//event channels, indices in eventChannelArray per INS (-1 if there are no lags)
+	std::vector<int> m_clockDriftChannels;
+	std::vector<int> m_lagFeatureChannels;
+	std::vector<float> m_lagFeatureValues; //process() only while acquiring, big enough for any INS
+
+	std::ofstream m_receiverDebugFile;
+	std::string m_receiverDebugPath = "SummitSource_ReceiverDebug.txt";
+
+	//connection settings (see the setters above)
+	Transport m_transport;
+	String m_address;
+	int m_receiveHWM; //most TD messages ZMQ queues up for us, 0 for no limit
+	int m_receiveBufferSize; //kernel receive buffer in bytes, 0 for the OS default
+	bool m_immediate; //only queue requests once the connection to the SIP is actually up
+	int m_ioThreads;
+	int m_reorderLatencyMs;
+	INSGapFiller::FillMode m_fillMode;
+	int m_playoutDelayMs;
+	bool m_playoutAdaptive;
+	String m_featureLagsText;
+	std::vector<int> m_featureLags;
+	static const int DEFAULT_RECEIVE_HWM = 1000; //ZMQ's own default
+	static const int DEFAULT_REORDER_LATENCY_MS = 100; //about a packet, out of order packets are usually only one or two behind
+	static const int DEFAULT_IO_THREADS = 1;
 
 	std::ofstream m_profilingFile;
+	std::ofstream m_receiverProfilingFile;
 	long long m_elapsed; //in microseconds
 	std::chrono::high_resolution_clock::time_point m_start_time;
 	std::chrono::high_resolution_clock::time_point m_end_time;
@@ -27,40 +27,247 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 SummitSourceEditor::SummitSourceEditor(GenericProcessor* parentNode, bool useDefaultParameterEditors = true)
 	: GenericEditor(parentNode, useDefaultParameterEditors)
 {
+	m_processor = static_cast<SummitSource*>(parentNode);
+	desiredWidth = 480;
+
+	m_transportCaption = addCaption("Transport", 10, 25);
+	m_transportBox = new ComboBox("Transport");
+	m_transportBox->addItem("tcp", SummitSource::TRANSPORT_TCP);
+#ifndef _WIN32
+	m_transportBox->addItem("ipc", SummitSource::TRANSPORT_IPC);
+#endif
+	m_transportBox->addItem("inproc", SummitSource::TRANSPORT_INPROC);
+	m_transportBox->addItem("generator", SummitSource::TRANSPORT_GENERATOR);
+	m_transportBox->setBounds(90, 25, 150, 16);
+	m_transportBox->addListener(this);
+	m_transportBox->setTooltip("tcp for a SIP on this or another machine, ipc for a local peer without going through the TCP stack, generator for made up data without a SIP");
+	addAndMakeVisible(m_transportBox);
+
+	m_addressCaption = addCaption("Address", 10, 43);
+	m_addressField = addValueField(90, 43, 150);
+	m_addressField->setTooltip("host:port for tcp, a socket file path for ipc, a name for inproc, e.g. ch=16 rate=1000 period=50 burst=4 drop=1 jitter=20 for generator. Separate several with commas to stream from more than one INS");
+
+	m_hwmCaption = addCaption("Rcv HWM", 10, 61);
+	m_hwmField = addValueField(90, 61, 150);
+	m_hwmField->setTooltip("Most TD messages to queue up before ZMQ drops them, 0 for no limit");
+
+	m_bufferCaption = addCaption("Rcv buffer", 10, 79);
+	m_bufferField = addValueField(90, 79, 150);
+	m_bufferField->setTooltip("Kernel receive buffer in bytes, 0 for the OS default");
+
+	m_ioThreadsCaption = addCaption("I/O threads", 10, 97);
+	m_ioThreadsField = addValueField(90, 97, 50);
+	m_ioThreadsField->setTooltip("ZMQ background threads");
+
 	//Most used buttons are UtilityButton, which shows a simple button with text and ElectrodeButton, which is an on-off button which displays a channel.
-	exampleButton = new UtilityButton("Button text", Font("Default", 15, Font::plain));
-	exampleButton->setBounds(10, 10, 100, 100); //Set position and size (X, Y, XSize, YSize)
-	exampleButton->addListener(this); //Specify which class will implement the listener methods, in the case of editors, always make the editor the listener
-	exampleButton->setClickingTogglesState(true); //True for a on-off toggleable button, false for a single-click monostable button
-	exampleButton->setTooltip("Mouseover tooltip text");
-	addAndMakeVisible(exampleButton);
+	m_immediateButton = new UtilityButton("IMMEDIATE", Font("Small Text", 12, Font::plain));
+	m_immediateButton->setBounds(150, 97, 90, 16);
+	m_immediateButton->addListener(this);
+	m_immediateButton->setClickingTogglesState(true);
+	m_immediateButton->setTooltip("Only send requests once the connection to the SIP is up, instead of queueing them");
+	addAndMakeVisible(m_immediateButton);
+
+	//what the SIP is sending, the output channels are built from this
+	m_streamLabel = new Label("Stream", "");
+	m_streamLabel->setFont(Font("Small Text", 12, Font::plain));
+	m_streamLabel->setBounds(10, 115, 150, 16);
+	addAndMakeVisible(m_streamLabel);
+
+	m_refreshButton = new UtilityButton("REFRESH", Font("Small Text", 12, Font::plain));
+	m_refreshButton->setBounds(165, 115, 75, 16);
+	m_refreshButton->addListener(this);
+	m_refreshButton->setTooltip("Ask the SIP for its channels and sampling rate again");
+	addAndMakeVisible(m_refreshButton);
+
+	//dropped and out of order packets, only used if the SIP leaves them to us
+	m_reorderCaption = addCaption("Reorder ms", 250, 25);
+	m_reorderField = addValueField(250, 43, 110);
+	m_reorderField->setTooltip("How long to wait for a late or missing packet before filling it in and moving on");
+
+	m_fillCaption = addCaption("Fill gaps", 250, 61);
+	m_fillBox = new ComboBox("Fill gaps");
+	m_fillBox->addItem("Linear", INSGapFiller::FILL_LINEAR);
+	m_fillBox->addItem("Hold", INSGapFiller::FILL_HOLD);
+	m_fillBox->addItem("None", INSGapFiller::FILL_NONE);
+	m_fillBox->setBounds(250, 79, 110, 16);
+	m_fillBox->addListener(this);
+	m_fillBox->setTooltip("What goes in place of dropped packets, filled samples are flagged on the Interpolated channel");
+	addAndMakeVisible(m_fillBox);
+
+	m_playoutCaption = addCaption("Playout ms", 250, 97);
+	m_playoutField = addValueField(250, 115, 50);
+	m_playoutField->setTooltip("Play samples out this long after the INS took them so every block gets the same number, 0 to pass them on as they arrive");
+
+	m_adaptiveButton = new UtilityButton("ADAPT", Font("Small Text", 12, Font::plain));
+	m_adaptiveButton->setBounds(305, 115, 55, 16);
+	m_adaptiveButton->addListener(this);
+	m_adaptiveButton->setClickingTogglesState(true);
+	m_adaptiveButton->setTooltip("Let the playout delay grow when samples arrive later than it allows for");
+	addAndMakeVisible(m_adaptiveButton);
+
+	m_lagsCaption = addCaption("Feature lags", 370, 25);
+	m_lagsField = addValueField(370, 43, 100);
+	m_lagsField->setTooltip("Lags in samples of the feature vector sent as an event every block, e.g. 0-15 or 0,5,10. Empty for none");
+
+	//the signal chain builds our channels right after this, so get them from the SIP if it's already up
+	m_processor->probeStreamLayout();
+
+	refreshControls();
 }
 
 SummitSourceEditor::~SummitSourceEditor()
 {
 }
 
+Label* SummitSourceEditor::addCaption(const String& text, int x, int y)
+{
+	Label* caption = new Label(text, text);
+	caption->setFont(Font("Small Text", 12, Font::plain));
+	caption->setBounds(x, y, 80, 16);
+	addAndMakeVisible(caption);
+	return caption;
+}
+
+Label* SummitSourceEditor::addValueField(int x, int y, int width)
+{
+	Label* field = new Label();
+	field->setFont(Font("Default", 14, Font::plain));
+	field->setEditable(true);
+	field->setColour(Label::backgroundColourId, Colours::grey);
+	field->setColour(Label::textColourId, Colours::white);
+	field->setBounds(x, y, width, 16);
+	field->addListener(this);
+	addAndMakeVisible(field);
+	return field;
+}
+
+void SummitSourceEditor::refreshControls()
+{
+	m_transportBox->setSelectedId(m_processor->getTransport(), dontSendNotification);
+	m_addressField->setText(m_processor->getAddress(), dontSendNotification);
+	m_hwmField->setText(String(m_processor->getReceiveHWM()), dontSendNotification);
+	m_bufferField->setText(String(m_processor->getReceiveBufferSize()), dontSendNotification);
+	m_ioThreadsField->setText(String(m_processor->getIOThreads()), dontSendNotification);
+	m_immediateButton->setToggleState(m_processor->getImmediate(), dontSendNotification);
+	m_streamLabel->setText(m_processor->getStreamDescription(), dontSendNotification);
+	m_streamLabel->setTooltip(m_processor->getStreamDescription());
+	m_reorderField->setText(String(m_processor->getReorderLatency()), dontSendNotification);
+	m_fillBox->setSelectedId(m_processor->getFillMode(), dontSendNotification);
+	m_playoutField->setText(String(m_processor->getPlayoutDelay()), dontSendNotification);
+	m_adaptiveButton->setToggleState(m_processor->getPlayoutAdaptive(), dontSendNotification);
+	m_lagsField->setText(m_processor->getFeatureLags(), dontSendNotification);
+}
+
+void SummitSourceEditor::refreshStreamLayout()
+{
+	m_processor->probeStreamLayout();
+	CoreServices::updateSignalChain(this);
+}
+
+void SummitSourceEditor::setControlsEnabled(bool enabled)
+{
+	m_transportBox->setEnabled(enabled);
+	m_addressField->setEnabled(enabled);
+	m_hwmField->setEnabled(enabled);
+	m_bufferField->setEnabled(enabled);
+	m_ioThreadsField->setEnabled(enabled);
+	m_immediateButton->setEnabled(enabled);
+	m_refreshButton->setEnabled(enabled);
+	m_reorderField->setEnabled(enabled);
+	m_fillBox->setEnabled(enabled);
+	m_playoutField->setEnabled(enabled);
+	m_adaptiveButton->setEnabled(enabled);
+	m_lagsField->setEnabled(enabled);
+}
 
-/**
-The listener methods that reacts to the button click. The same method is called for all buttons
-on the editor, so the button variable, which cointains a pointer to the button that called the method
-has to be checked to know which function to perform.
-*/
 void SummitSourceEditor::buttonEvent(Button* button)
 {
-	if (button == exampleButton)
+	if (button == m_immediateButton)
+	{
+		m_processor->setImmediate(button->getToggleState());
+	}
+	else if (button == m_adaptiveButton)
 	{
-		//Do Stuff
+		m_processor->setPlayoutAdaptive(button->getToggleState());
+	}
+	else if (button == m_refreshButton)
+	{
+		refreshStreamLayout();
+	}
+}
 
-		//a typical  example:
-		if (button->getToggleState()) //Button is pressed
-		{
-			getProcessor()->setParameter(0, 1);
-		}
-		else
+void SummitSourceEditor::labelTextChanged(Label* label)
+{
+	if (label == m_addressField)
+	{
+		m_processor->setAddress(label->getText());
+		refreshStreamLayout();
+	}
+	else if (label == m_hwmField)
+	{
+		m_processor->setReceiveHWM(label->getText().getIntValue());
+	}
+	else if (label == m_bufferField)
+	{
+		m_processor->setReceiveBufferSize(label->getText().getIntValue());
+	}
+	else if (label == m_ioThreadsField)
+	{
+		m_processor->setIOThreads(label->getText().getIntValue());
+	}
+	else if (label == m_reorderField)
+	{
+		m_processor->setReorderLatency(label->getText().getIntValue());
+	}
+	else if (label == m_playoutField)
+	{
+		m_processor->setPlayoutDelay(label->getText().getIntValue());
+	}
+	else if (label == m_lagsField)
+	{
+		//the feature event channel is sized from the lags
+		if (m_processor->setFeatureLags(label->getText()))
 		{
-			getProcessor()->setParameter(0, 0);
+			CoreServices::updateSignalChain(this);
 		}
 	}
 
+	//the processor clamps whatever it was given, show what it actually took
+	refreshControls();
+}
+
+void SummitSourceEditor::comboBoxChanged(ComboBox* comboBox)
+{
+	if (comboBox == m_transportBox)
+	{
+		SummitSource::Transport transport = (SummitSource::Transport)comboBox->getSelectedId();
+		m_processor->setTransport(transport);
+		m_processor->setAddress(SummitSource::getDefaultAddress(transport));
+		refreshStreamLayout();
+	}
+	else if (comboBox == m_fillBox)
+	{
+		m_processor->setFillMode((INSGapFiller::FillMode)comboBox->getSelectedId());
+	}
+}
+
+void SummitSourceEditor::startAcquisition()
+{
+	setControlsEnabled(false);
+}
+
+void SummitSourceEditor::stopAcquisition()
+{
+	setControlsEnabled(true);
+
+	//the SIP was restarted with other settings while we were acquiring, rebuild the channels to match
+	if (m_processor->applyLayoutChange())
+	{
+		CoreServices::updateSignalChain(this);
+	}
+}
+
+void SummitSourceEditor::updateSettings()
+{
+	refreshControls();
 }
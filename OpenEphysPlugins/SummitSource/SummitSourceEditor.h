@@ -26,21 +26,32 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <EditorHeaders.h>
 
+class SummitSource;
+
 /**
 
-This class serves as a template for creating new editors.
+Connection settings for the Summit Source: which transport and address the
+SIP is reached on, and the ZMQ socket options used for it.
+
+Changes are handed straight to the processor, which uses them the next time
+acquisition starts, so the controls are locked while acquiring.
+
+The second column sets how long dropped or late packets are waited for and
+how the gaps are filled in (see INSGapFiller), and the playout delay that
+evens out the block sizes (see INSPlayout). The third sets the lags of the
+feature vector sent every block (see INSLagFeatures).
 
-If this were a real editor, this comment section would be used to
-describe the editor's structure. In this example, the editor will
-have a single button which will set a parameter in the processor.
+It also shows the channel count, sampling rate and packet period the SIP
+reported, which the output channels are built from. They're asked for again
+whenever the address changes or REFRESH is pressed.
 
 @see GenericEditor
 
 */
 
-class SummitSourceEditor : public GenericEditor	//Generic Editor adds listeners for buttons and sliders.
-											//Other possible JUCE controls can be added and listened by inheriting from the appropiate XXX:Listener class
-											//See JUCE documentation to find other available controls.
+class SummitSourceEditor : public GenericEditor,
+	public Label::Listener,
+	public ComboBox::Listener
 {
 public:
 	
@@ -50,36 +61,61 @@ public:
 	/** The class destructor, used to deallocate memory */
 	~SummitSourceEditor();
 
-	/** 
-	Unlike processors, which have a minimum set of required methods,
-	editor are completely customized. There are still a couple of
-	sometimes useful overloaded methods, which will appear here
-	*/
-
 	/** This method executes whenever a custom button is pressed */
-	void buttonEvent(Button* button);
+	void buttonEvent(Button* button) override;
+
+	/** Called when one of the text fields has been edited */
+	void labelTextChanged(Label* label) override;
+
+	/** Called when a different transport or fill mode is picked */
+	void comboBoxChanged(ComboBox* comboBox) override;
 
 	/** Called to inform the editor that acquisition is about to start*/
-	//void startAcquisition();
+	void startAcquisition() override;
 
 	/** Called to inform the editor that acquisition has just stopped*/
-	//void stopAcquisition();
+	void stopAcquisition() override;
 
 	/** Called whenever there is a change in the signal chain or it refreshes.
 		It's called after the processors' same named method.
 	*/
-	//void updateSettings();
+	void updateSettings() override;
 
 
 private:
 
-	/**
-	Here would be all the required internal variables.
-	In this case, we have a single button.
-	*/
+	//show what the processor currently has (e.g. after loading settings or rejecting an edit)
+	void refreshControls();
+	void setControlsEnabled(bool enabled);
+	void refreshStreamLayout();
+	Label* addCaption(const String& text, int x, int y);
+	Label* addValueField(int x, int y, int width);
+
+	SummitSource* m_processor;
 
 	//Always use JUCE RAII classes instead of pure pointers.
-	ScopedPointer<Button> exampleButton;
+	ScopedPointer<Label> m_transportCaption;
+	ScopedPointer<ComboBox> m_transportBox;
+	ScopedPointer<Label> m_addressCaption;
+	ScopedPointer<Label> m_addressField;
+	ScopedPointer<Label> m_hwmCaption;
+	ScopedPointer<Label> m_hwmField;
+	ScopedPointer<Label> m_bufferCaption;
+	ScopedPointer<Label> m_bufferField;
+	ScopedPointer<Label> m_ioThreadsCaption;
+	ScopedPointer<Label> m_ioThreadsField;
+	ScopedPointer<UtilityButton> m_immediateButton;
+	ScopedPointer<Label> m_streamLabel;
+	ScopedPointer<UtilityButton> m_refreshButton;
+	ScopedPointer<Label> m_reorderCaption;
+	ScopedPointer<Label> m_reorderField;
+	ScopedPointer<Label> m_fillCaption;
+	ScopedPointer<ComboBox> m_fillBox;
+	ScopedPointer<Label> m_playoutCaption;
+	ScopedPointer<Label> m_playoutField;
+	ScopedPointer<UtilityButton> m_adaptiveButton;
+	ScopedPointer<Label> m_lagsCaption;
+	ScopedPointer<Label> m_lagsField;
 
 	JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SummitSourceEditor);
 };
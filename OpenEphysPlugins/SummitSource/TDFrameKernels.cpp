@@ -0,0 +1,350 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2014 Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <cstring>
+#include <cstdint>
+#include "TDFrameKernels.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define TD_KERNELS_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TD_TARGET_SSE2
+#define TD_TARGET_AVX2
+#else
+#define TD_TARGET_SSE2 __attribute__((target("sse2")))
+#define TD_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+typedef void(*DeinterleaveFunction)(const char*, int, int, float, float* const*, int, int*);
+
+//pick the best implementation the CPU (and OS) supports
+static DeinterleaveFunction pickImplementation(const char** name)
+{
+#ifdef TD_KERNELS_X86
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	int maxLeaf = info[0];
+
+	__cpuid(info, 1);
+	bool hasSSE2 = (info[3] & (1 << 26)) != 0;
+	bool osSavesAVX = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 && (_xgetbv(0) & 6) == 6;
+
+	bool hasAVX2 = false;
+	if (maxLeaf >= 7 && osSavesAVX)
+	{
+		__cpuidex(info, 7, 0);
+		hasAVX2 = (info[1] & (1 << 5)) != 0;
+	}
+#else
+	__builtin_cpu_init();
+	bool hasSSE2 = __builtin_cpu_supports("sse2") != 0;
+	bool hasAVX2 = __builtin_cpu_supports("avx2") != 0;
+#endif
+
+	if (hasAVX2)
+	{
+		*name = "AVX2";
+		return &TDFrameKernels::deinterleaveAVX2;
+	}
+	if (hasSSE2)
+	{
+		*name = "SSE2";
+		return &TDFrameKernels::deinterleaveSSE2;
+	}
+#endif
+
+	*name = "scalar";
+	return &TDFrameKernels::deinterleaveScalar;
+}
+
+static const char* s_implementationName = "";
+static DeinterleaveFunction s_deinterleave = pickImplementation(&s_implementationName);
+
+void TDFrameKernels::deinterleave(const char* frames, int nFrames, int nChans, float scale,
+	float* const* channelOut, int outOffset, int* packetNumOut)
+{
+	s_deinterleave(frames, nFrames, nChans, scale, channelOut, outOffset, packetNumOut);
+}
+
+const char* TDFrameKernels::getImplementationName()
+{
+	return s_implementationName;
+}
+
+void TDFrameKernels::deinterleaveScalar(const char* frames, int nFrames, int nChans, float scale,
+	float* const* channelOut, int outOffset, int* packetNumOut)
+{
+	const size_t frameSize = (nChans + 1) * sizeof(double);
+	double value;
+
+	for (int iFrame = 0; iFrame < nFrames; iFrame++)
+	{
+		//channel data (memcpy since the frames don't have to be 8-byte aligned)
+		for (int iChan = 0; iChan < nChans; iChan++)
+		{
+			memcpy(&value, frames + iChan * sizeof(double), sizeof(double));
+			channelOut[iChan][outOffset + iFrame] = (float)value * scale;
+		}
+
+		//INS packet number
+		memcpy(&value, frames + nChans * sizeof(double), sizeof(double));
+		packetNumOut[outOffset + iFrame] = (int)value;
+
+		frames += frameSize;
+	}
+}
+
+void TDFrameKernels::convertFloat32Plane(const char* plane, int n, float scale, float* out)
+{
+	memcpy(out, plane, n * sizeof(float));
+	for (int i = 0; i < n; i++)
+	{
+		out[i] *= scale;
+	}
+}
+
+void TDFrameKernels::convertInt16Plane(const char* plane, int n, float scale, float* out)
+{
+	int16_t value;
+	for (int i = 0; i < n; i++)
+	{
+		memcpy(&value, plane + i * sizeof(int16_t), sizeof(int16_t));
+		out[i] = value * scale;
+	}
+}
+
+void TDFrameKernels::fillRamp(float start, float step, int n, float* out)
+{
+	//computed from the index rather than accumulated, so there's no dependency between iterations
+	for (int i = 0; i < n; i++)
+	{
+		out[i] = start + i * step;
+	}
+}
+
+size_t TDFrameKernels::decodeDeltaPackedPlane(const char* plane, size_t available, int n, bool isInt16, float scale,
+	float* out, int nOut)
+{
+	if (n == 0)
+	{
+		return 0;
+	}
+	if (available < sizeof(int32_t))
+	{
+		return 0;
+	}
+
+	//first value is sent as is, the rest are deltas from the value before
+	uint32_t value;
+	memcpy(&value, plane, sizeof(int32_t));
+	size_t used = sizeof(int32_t);
+
+	//the raw values are either int16 samples or float32 bit patterns
+	float sample;
+	if (isInt16)
+	{
+		sample = (int16_t)value * scale;
+	}
+	else
+	{
+		memcpy(&sample, &value, sizeof(float));
+		sample *= scale;
+	}
+	if (nOut > 0)
+	{
+		out[0] = sample;
+	}
+
+	unsigned char block[DELTA_BLOCK_SIZE * sizeof(uint32_t) + sizeof(uint64_t)];
+	uint32_t values[DELTA_BLOCK_SIZE];
+
+	for (int iBlock = 1; iBlock < n; iBlock += DELTA_BLOCK_SIZE)
+	{
+		if (used + 1 > available)
+		{
+			return 0;
+		}
+		int width = static_cast<unsigned char>(plane[used]);
+		size_t blockBytes = width * DELTA_BLOCK_SIZE / 8;
+		if (width > 32 || used + 1 + blockBytes > available)
+		{
+			return 0;
+		}
+
+		int inBlock = n - iBlock < DELTA_BLOCK_SIZE ? n - iBlock : DELTA_BLOCK_SIZE;
+		int outInBlock = nOut - iBlock < inBlock ? nOut - iBlock : inBlock;
+
+		//past what we are keeping, just skip over it
+		if (outInBlock <= 0)
+		{
+			used += 1 + blockBytes;
+			continue;
+		}
+
+		//near the end of the message copy to the scratch block so the 8 byte reads below never go past it
+		const unsigned char* packed = reinterpret_cast<const unsigned char*>(plane + used + 1);
+		if (used + 1 + blockBytes + sizeof(uint64_t) > available)
+		{
+			memcpy(block, packed, blockBytes);
+			memset(block + blockBytes, 0, sizeof(block) - blockBytes);
+			packed = block;
+		}
+		used += 1 + blockBytes;
+
+		//unpack fixed-width fields, undo the zig-zag and do the running sum back to values (wrapping, same as
+		//the SIP's subtraction). The raw values are int16 samples or float32 bit patterns
+		const uint64_t mask = (width == 0) ? 0 : (~0ULL >> (64 - width));
+		for (int i = 0; i < DELTA_BLOCK_SIZE; i++)
+		{
+			size_t bit = (size_t)i * width;
+			uint64_t word;
+			memcpy(&word, packed + (bit >> 3), sizeof(uint64_t));
+			uint32_t zigzag = (uint32_t)((word >> (bit & 7)) & mask);
+			value += (zigzag >> 1) ^ (0u - (zigzag & 1));
+			values[i] = value;
+		}
+		value = values[inBlock - 1];
+
+		if (isInt16)
+		{
+			for (int i = 0; i < outInBlock; i++)
+			{
+				out[iBlock + i] = (int16_t)values[i] * scale;
+			}
+		}
+		else
+		{
+			float blockSamples[DELTA_BLOCK_SIZE];
+			memcpy(blockSamples, values, outInBlock * sizeof(float));
+			for (int i = 0; i < outInBlock; i++)
+			{
+				out[iBlock + i] = blockSamples[i] * scale;
+			}
+		}
+	}
+
+	return used;
+}
+
+#ifdef TD_KERNELS_X86
+
+//Four frames at a time: each double is loaded into its own lane (the frames are strided so
+//there's no way to get two of the same channel in one load), then converted and scaled as a vector
+TD_TARGET_SSE2 void TDFrameKernels::deinterleaveSSE2(const char* frames, int nFrames, int nChans, float scale,
+	float* const* channelOut, int outOffset, int* packetNumOut)
+{
+	const int stride = nChans + 1;
+	const double* frameData = reinterpret_cast<const double*>(frames);
+	const __m128 scaleVec = _mm_set1_ps(scale);
+
+	int iFrame = 0;
+	for (; iFrame + 4 <= nFrames; iFrame += 4)
+	{
+		const double* f0 = frameData + iFrame * stride;
+		const double* f2 = f0 + 2 * stride;
+
+		for (int iChan = 0; iChan <= nChans; iChan++)
+		{
+			__m128d lo = _mm_loadh_pd(_mm_load_sd(f0 + iChan), f0 + stride + iChan);
+			__m128d hi = _mm_loadh_pd(_mm_load_sd(f2 + iChan), f2 + stride + iChan);
+
+			if (iChan < nChans)
+			{
+				__m128 values = _mm_movelh_ps(_mm_cvtpd_ps(lo), _mm_cvtpd_ps(hi));
+				_mm_storeu_ps(channelOut[iChan] + outOffset + iFrame, _mm_mul_ps(values, scaleVec));
+			}
+			else
+			{
+				__m128i packets = _mm_unpacklo_epi64(_mm_cvttpd_epi32(lo), _mm_cvttpd_epi32(hi));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(packetNumOut + outOffset + iFrame), packets);
+			}
+		}
+	}
+
+	//leftover frames
+	deinterleaveScalar(frames + iFrame * stride * sizeof(double), nFrames - iFrame, nChans, scale,
+		channelOut, outOffset + iFrame, packetNumOut);
+}
+
+//Eight frames at a time. Strided gathers turn out slower than separate loads on a lot of CPUs, so the
+//lanes are filled the same way as SSE2 and the wider registers just halve the convert/scale/store work
+TD_TARGET_AVX2 void TDFrameKernels::deinterleaveAVX2(const char* frames, int nFrames, int nChans, float scale,
+	float* const* channelOut, int outOffset, int* packetNumOut)
+{
+	const int stride = nChans + 1;
+	const double* frameData = reinterpret_cast<const double*>(frames);
+	const __m256 scaleVec = _mm256_set1_ps(scale);
+
+	int iFrame = 0;
+	for (; iFrame + 8 <= nFrames; iFrame += 8)
+	{
+		const double* f0 = frameData + iFrame * stride;
+		const double* f2 = f0 + 2 * stride;
+		const double* f4 = f0 + 4 * stride;
+		const double* f6 = f0 + 6 * stride;
+
+		for (int iChan = 0; iChan <= nChans; iChan++)
+		{
+			__m256d lo = _mm256_insertf128_pd(_mm256_castpd128_pd256(_mm_loadh_pd(_mm_load_sd(f0 + iChan), f0 + stride + iChan)),
+				_mm_loadh_pd(_mm_load_sd(f2 + iChan), f2 + stride + iChan), 1);
+			__m256d hi = _mm256_insertf128_pd(_mm256_castpd128_pd256(_mm_loadh_pd(_mm_load_sd(f4 + iChan), f4 + stride + iChan)),
+				_mm_loadh_pd(_mm_load_sd(f6 + iChan), f6 + stride + iChan), 1);
+
+			if (iChan < nChans)
+			{
+				__m256 values = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm256_cvtpd_ps(lo)), _mm256_cvtpd_ps(hi), 1);
+				_mm256_storeu_ps(channelOut[iChan] + outOffset + iFrame, _mm256_mul_ps(values, scaleVec));
+			}
+			else
+			{
+				__m256i packets = _mm256_insertf128_si256(_mm256_castsi128_si256(_mm256_cvttpd_epi32(lo)), _mm256_cvttpd_epi32(hi), 1);
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(packetNumOut + outOffset + iFrame), packets);
+			}
+		}
+	}
+
+	//leftover frames
+	deinterleaveSSE2(frames + iFrame * stride * sizeof(double), nFrames - iFrame, nChans, scale,
+		channelOut, outOffset + iFrame, packetNumOut);
+}
+
+#else
+
+//no x86 SIMD on this platform, these are never picked but keep the interface the same
+void TDFrameKernels::deinterleaveSSE2(const char* frames, int nFrames, int nChans, float scale,
+	float* const* channelOut, int outOffset, int* packetNumOut)
+{
+	deinterleaveScalar(frames, nFrames, nChans, scale, channelOut, outOffset, packetNumOut);
+}
+
+void TDFrameKernels::deinterleaveAVX2(const char* frames, int nFrames, int nChans, float scale,
+	float* const* channelOut, int outOffset, int* packetNumOut)
+{
+	deinterleaveScalar(frames, nFrames, nChans, scale, channelOut, outOffset, packetNumOut);
+}
+
+#endif
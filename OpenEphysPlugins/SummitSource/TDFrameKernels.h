@@ -0,0 +1,88 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2014 Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef TDFRAMEKERNELS_H_INCLUDED
+#define TDFRAMEKERNELS_H_INCLUDED
+
+#include <cstddef>
+
+/**
+
+  Vectorized kernels for decoding the Summit time-domain frame layout.
+
+  A TD reply from the SIP is a run of interleaved double frames,
+  [ch0, ch1, ..., chN-1, packetNum], i.e. a stride of nChans+1 doubles.
+  deinterleave() splits those into one scaled float plane per channel and
+  pulls the packet number lane out into ints, all in one pass. The
+  implementation (AVX2, SSE2 or plain scalar) is picked once at load time
+  from what the CPU supports.
+
+  The v2 format already sends contiguous channel planes, so those only need
+  a convert/scale pass which the compiler vectorizes on its own. Its
+  optional delta bit-packed planes are unpacked a block at a time with
+  fixed-width shifts so there's no per-value branching. Gap filling is a
+  plain ramp, also left to the compiler.
+
+*/
+
+class TDFrameKernels
+{
+public:
+
+	/** Decodes nFrames frames starting at frames (no alignment needed) into
+		channelOut[iChan][outOffset...] scaled by scale, and packetNumOut[outOffset...] */
+	static void deinterleave(const char* frames, int nFrames, int nChans, float scale,
+		float* const* channelOut, int outOffset, int* packetNumOut);
+
+	/** Decodes one v2 channel plane of n little endian float32 or int16 values (no alignment
+		needed) into out, multiplying each by scale */
+	static void convertFloat32Plane(const char* plane, int n, float scale, float* out);
+	static void convertInt16Plane(const char* plane, int n, float scale, float* out);
+
+	/** Decodes one delta bit-packed v2 channel plane of n values, writing the first nOut of them
+		(converted like the planes above) to out. The plane is the first value as int32, then blocks of
+		DELTA_BLOCK_SIZE zig-zagged deltas each packed at a fixed bit width given by a leading byte.
+		Never reads more than available bytes, returns the number of bytes the plane took up or 0 if
+		it was malformed (so n has to be at least 1) */
+	static size_t decodeDeltaPackedPlane(const char* plane, size_t available, int n, bool isInt16, float scale,
+		float* out, int nOut);
+
+	/** Writes out[i] = start + i * step for n values, for filling in samples of dropped packets (a step
+		of 0 holds the value) */
+	static void fillRamp(float start, float step, int n, float* out);
+
+	static const int DELTA_BLOCK_SIZE = 32;
+
+	/** Name of the implementation that was picked, for logging */
+	static const char* getImplementationName();
+
+	/** The individual implementations, public so they can be compared against each other */
+	static void deinterleaveScalar(const char* frames, int nFrames, int nChans, float scale,
+		float* const* channelOut, int outOffset, int* packetNumOut);
+	static void deinterleaveSSE2(const char* frames, int nFrames, int nChans, float scale,
+		float* const* channelOut, int outOffset, int* packetNumOut);
+	static void deinterleaveAVX2(const char* frames, int nFrames, int nChans, float scale,
+		float* const* channelOut, int outOffset, int* packetNumOut);
+};
+
+#endif  // TDFRAMEKERNELS_H_INCLUDED
@@ -0,0 +1,247 @@
+
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2014 Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include "StimClassReducer.h"
+
+StimClassReducer::StimClassReducer()
+	: m_mode(MODE_LATEST), m_threshold(0.5f)
+{
+}
+
+void StimClassReducer::configure(Mode mode, float threshold)
+{
+	m_mode = mode;
+	m_threshold = threshold;
+}
+
+int StimClassReducer::reduce(const float* const* inputs, int nInputs, int nSamples) const
+{
+	int last = nSamples - 1;
+	switch (m_mode)
+	{
+	case MODE_MAJORITY:
+		return vote(inputs, nInputs, nSamples);
+
+	case MODE_MEAN:
+		return mean(inputs, nInputs, nSamples) >= m_threshold ? 1 : 0;
+
+	case MODE_ANY:
+		for (int iInput = 0; iInput < nInputs; iInput++)
+		{
+			int stimClass = toClass(inputs[iInput][last]);
+			if (stimClass != 0)
+			{
+				return stimClass;
+			}
+		}
+		return 0;
+
+	case MODE_ALL:
+		for (int iInput = 0; iInput < nInputs; iInput++)
+		{
+			if (toClass(inputs[iInput][last]) == 0)
+			{
+				return 0;
+			}
+		}
+		return toClass(inputs[0][last]);
+
+	default:
+		return toClass(inputs[0][last]);
+	}
+}
+
+int StimClassReducer::vote(const float* const* inputs, int nInputs, int nSamples) const
+{
+	//casting NaN or anything out of int range is undefined, so those blocks aren't a vote
+	int nInvalid = 0;
+	for (int iInput = 0; iInput < nInputs; iInput++)
+	{
+		nInvalid += countInvalid(inputs[iInput], nSamples);
+	}
+	if (nInvalid > 0)
+	{
+		return toClass(inputs[0][nSamples - 1]);
+	}
+
+	//one pass to find each class that's actually there and one to count it, rather than a histogram the compiler can't vectorize
+	int stimClass = NO_CLASS_BELOW;
+	int winner = 0;
+	int winnerVotes = -1;
+	for (int nClasses = 0; ; nClasses++)
+	{
+		int next = NO_CLASS_ABOVE;
+		for (int iInput = 0; iInput < nInputs; iInput++)
+		{
+			next = std::min(next, findNextClass(inputs[iInput], nSamples, stimClass));
+		}
+		if (next == NO_CLASS_ABOVE)
+		{
+			break;
+		}
+		if (nClasses == MAX_VOTE_CLASSES)
+		{
+			return toClass(inputs[0][nSamples - 1]);
+		}
+		stimClass = next;
+
+		int votes = 0;
+		for (int iInput = 0; iInput < nInputs; iInput++)
+		{
+			votes += count(inputs[iInput], nSamples, stimClass);
+		}
+		if (votes > winnerVotes || (votes == winnerVotes && std::abs(stimClass) < std::abs(winner)))
+		{
+			winner = stimClass;
+			winnerVotes = votes;
+		}
+	}
+	return winner;
+}
+
+float StimClassReducer::mean(const float* const* inputs, int nInputs, int nSamples) const
+{
+	float total = 0;
+	for (int iInput = 0; iInput < nInputs; iInput++)
+	{
+		total += sum(inputs[iInput], nSamples);
+	}
+	return total / ((float)nInputs * nSamples);
+}
+
+float StimClassReducer::sum(const float* values, int n)
+{
+	float lanes[LANES] = {};
+	int i = 0;
+	for (; i + LANES <= n; i += LANES)
+	{
+		for (int iLane = 0; iLane < LANES; iLane++)
+		{
+			lanes[iLane] += values[i + iLane];
+		}
+	}
+
+	float total = 0;
+	for (; i < n; i++)
+	{
+		total += values[i];
+	}
+	for (int iLane = 0; iLane < LANES; iLane++)
+	{
+		total += lanes[iLane];
+	}
+	return total;
+}
+
+int StimClassReducer::findNextClass(const float* values, int n, int after)
+{
+	//smallest class above after, or NO_CLASS_ABOVE if there's none. Only for values countInvalid() passed. Kept in ints, as the
+	//compiler won't vectorize float selects on the converted values
+	int lanes[LANES];
+	std::fill(lanes, lanes + LANES, (int)NO_CLASS_ABOVE);
+	int i = 0;
+	for (; i + LANES <= n; i += LANES)
+	{
+		for (int iLane = 0; iLane < LANES; iLane++)
+		{
+			int stimClass = (int)values[i + iLane];
+			stimClass = stimClass > after ? stimClass : NO_CLASS_ABOVE;
+			lanes[iLane] = stimClass < lanes[iLane] ? stimClass : lanes[iLane];
+		}
+	}
+
+	int next = NO_CLASS_ABOVE;
+	for (; i < n; i++)
+	{
+		int stimClass = (int)values[i];
+		stimClass = stimClass > after ? stimClass : NO_CLASS_ABOVE;
+		next = stimClass < next ? stimClass : next;
+	}
+	for (int iLane = 0; iLane < LANES; iLane++)
+	{
+		next = std::min(next, lanes[iLane]);
+	}
+	return next;
+}
+
+int StimClassReducer::count(const float* values, int n, int stimClass)
+{
+	//whole numbers only, so a class is everything that truncates to it. Only for values countInvalid() passed
+	int lanes[LANES] = {};
+	int i = 0;
+	for (; i + LANES <= n; i += LANES)
+	{
+		for (int iLane = 0; iLane < LANES; iLane++)
+		{
+			lanes[iLane] += (int)values[i + iLane] == stimClass ? 1 : 0;
+		}
+	}
+
+	int total = 0;
+	for (; i < n; i++)
+	{
+		total += (int)values[i] == stimClass ? 1 : 0;
+	}
+	for (int iLane = 0; iLane < LANES; iLane++)
+	{
+		total += lanes[iLane];
+	}
+	return total;
+}
+
+int StimClassReducer::countInvalid(const float* values, int n)
+{
+	//NaN fails the comparison too
+	int lanes[LANES] = {};
+	int i = 0;
+	for (; i + LANES <= n; i += LANES)
+	{
+		for (int iLane = 0; iLane < LANES; iLane++)
+		{
+			lanes[iLane] += std::fabs(values[i + iLane]) <= MAX_CLASS ? 0 : 1;
+		}
+	}
+
+	int total = 0;
+	for (; i < n; i++)
+	{
+		total += std::fabs(values[i]) <= MAX_CLASS ? 0 : 1;
+	}
+	for (int iLane = 0; iLane < LANES; iLane++)
+	{
+		total += lanes[iLane];
+	}
+	return total;
+}
+
+int StimClassReducer::toClass(float value)
+{
+	//clamped first, as casting NaN or anything out of int range is undefined. NaN comes out of the clamp as -MAX_CLASS, so it needs its own check
+	float clamped = value > -MAX_CLASS ? value : -MAX_CLASS;
+	clamped = clamped < MAX_CLASS ? clamped : MAX_CLASS;
+	clamped = value == value ? clamped : 0.0f;
+	return (int)clamped;
+}
@@ -0,0 +1,99 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2014 Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef STIMCLASSREDUCER_H_INCLUDED
+#define STIMCLASSREDUCER_H_INCLUDED
+
+/**
+
+  Turns a block of decoder output on one or more AUX channels into the one
+  stim class to act on, as of the block's last sample:
+
+  - latest: the last sample of the first input, the freshest decision
+  - majority: the class most samples vote for, over the whole block and
+    all inputs. Ties go to the class nearest 0 so stim stays off when it's
+    a toss-up. A block with more than MAX_VOTE_CLASSES different classes,
+    or with NaN or classes beyond +-MAX_CLASS in it, isn't a vote, so it
+    falls back to latest
+  - mean: 1 if the mean over the whole block and all inputs reaches the
+    threshold, otherwise 0, for decoders that output a score
+  - any of: the class of the first input whose last sample isn't 0
+  - all of: the first input's class if no input's last sample is 0,
+    otherwise 0
+
+  Classes come in as whole numbers and are truncated like before, after
+  clamping to +-MAX_CLASS. NaN counts as class 0. The passes over the
+  block are branch-free and written with independent lanes so the
+  compiler vectorizes them without needing fast math, and majority only
+  makes passes for the classes that are in the block. Nothing is
+  allocated.
+
+*/
+
+class StimClassReducer
+{
+public:
+
+	/** The values are also the editor's combo box IDs */
+	enum Mode
+	{
+		MODE_LATEST = 1,
+		MODE_MAJORITY = 2,
+		MODE_MEAN = 3,
+		MODE_ANY = 4,
+		MODE_ALL = 5
+	};
+
+	static const int MAX_CLASS = 1000000000; //a float that converts to int exactly
+	static const int MAX_VOTE_CLASSES = 16;
+
+	StimClassReducer();
+
+	void configure(Mode mode, float threshold);
+
+	/** Reduces nSamples samples of each of nInputs channels (nInputs and nSamples at least 1) to one class */
+	int reduce(const float* const* inputs, int nInputs, int nSamples) const;
+
+	Mode getMode() const { return m_mode; }
+	float getThreshold() const { return m_threshold; }
+
+private:
+
+	int vote(const float* const* inputs, int nInputs, int nSamples) const;
+	float mean(const float* const* inputs, int nInputs, int nSamples) const;
+
+	static float sum(const float* values, int n);
+	static int findNextClass(const float* values, int n, int after);
+	static int count(const float* values, int n, int stimClass);
+	static int countInvalid(const float* values, int n);
+	static int toClass(float value);
+
+	static const int LANES = 8; //independent accumulators, enough for an AVX register of floats
+	static const int NO_CLASS_BELOW = -MAX_CLASS - 1;
+	static const int NO_CLASS_ABOVE = MAX_CLASS + 1;
+
+	Mode m_mode;
+	float m_threshold;
+};
+
+#endif  // STIMCLASSREDUCER_H_INCLUDED
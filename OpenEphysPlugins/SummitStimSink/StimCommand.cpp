@@ -0,0 +1,105 @@
+
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2014 Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#include <chrono>
+#include <cstring>
+#include "StimCommand.h"
+
+StimCommand::StimCommand()
+	: type(TYPE_CLASS), sequence(0), sourceTimestamp(0), hostSendTimeUs(0), group(-1), program(-1), parameter(PARAMETER_NONE),
+	flags(0), stimClass(0), value(0)
+{
+}
+
+void StimCommand::write(char* buffer) const
+{
+	uint8_t version = VERSION;
+	uint8_t typeByte = (uint8_t)type;
+	uint16_t messageBytes = MESSAGE_BYTES;
+	uint8_t parameterByte = (uint8_t)parameter;
+
+	memcpy(buffer, &version, 1);
+	memcpy(buffer + 1, &typeByte, 1);
+	memcpy(buffer + 2, &messageBytes, 2);
+	memcpy(buffer + 4, &sequence, 4);
+	memcpy(buffer + 8, &sourceTimestamp, 8);
+	memcpy(buffer + 16, &hostSendTimeUs, 8);
+	memcpy(buffer + 24, &group, 1);
+	memcpy(buffer + 25, &program, 1);
+	memcpy(buffer + 26, &parameterByte, 1);
+	memcpy(buffer + 27, &flags, 1);
+	if (type == TYPE_PARAMETER)
+	{
+		memcpy(buffer + 28, &value, 4);
+	}
+	else
+	{
+		memcpy(buffer + 28, &stimClass, 4);
+	}
+}
+
+bool StimCommand::read(const void* data, size_t size, StimCommand* command)
+{
+	const char* bytes = static_cast<const char*>(data);
+	uint8_t version, typeByte, parameterByte;
+	uint16_t messageBytes;
+	if (size < (size_t)MESSAGE_BYTES)
+	{
+		return false;
+	}
+	memcpy(&version, bytes, 1);
+	memcpy(&typeByte, bytes + 1, 1);
+	memcpy(&messageBytes, bytes + 2, 2);
+	if (version != VERSION || messageBytes < MESSAGE_BYTES || messageBytes > size
+		|| (typeByte != TYPE_CLASS && typeByte != TYPE_PARAMETER))
+	{
+		return false;
+	}
+
+	command->type = (Type)typeByte;
+	memcpy(&command->sequence, bytes + 4, 4);
+	memcpy(&command->sourceTimestamp, bytes + 8, 8);
+	memcpy(&command->hostSendTimeUs, bytes + 16, 8);
+	memcpy(&command->group, bytes + 24, 1);
+	memcpy(&command->program, bytes + 25, 1);
+	memcpy(&parameterByte, bytes + 26, 1);
+	command->parameter = (Parameter)parameterByte;
+	memcpy(&command->flags, bytes + 27, 1);
+	command->stimClass = 0;
+	command->value = 0;
+	if (command->type == TYPE_PARAMETER)
+	{
+		memcpy(&command->value, bytes + 28, 4);
+	}
+	else
+	{
+		memcpy(&command->stimClass, bytes + 28, 4);
+	}
+	return true;
+}
+
+int64_t StimCommand::getHostTimeUs()
+{
+	//the system clock, so a SIP in another process (or C#, with DateTime.UtcNow) can compare against it
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
@@ -0,0 +1,106 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2014 Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef STIMCOMMAND_H_INCLUDED
+#define STIMCOMMAND_H_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+
+  One stim command from the Summit Stim Sink to the SIP, sent as a single
+  ZMQ message of MESSAGE_BYTES in a fixed layout (all little endian):
+
+      uint8   version (VERSION)
+      uint8   type (TYPE_CLASS or TYPE_PARAMETER)
+      uint16  message bytes (newer versions may add fields at the end, a
+              reader skips anything it doesn't know about)
+      uint32  sequence number, one more for every command since
+              acquisition started (also ones that couldn't be sent), so
+              the SIP can spot lost ones
+      int64   Open-Ephys timestamp (sample number) of the sample the
+              command was decoded from
+      int64   host time it was sent, in us since the Unix epoch
+      int8    stim group (-1 for the SIP's closed-loop group)
+      int8    stim program (-1 for the one the class picks)
+      uint8   parameter (PARAMETER_NONE for classes)
+      uint8   flags (FLAG_HEARTBEAT if it repeats the current state rather
+              than changing it, e.g. for a SIP that just (re)connected)
+      int32   stim class, or float32 parameter value
+
+  write() and read() only copy bytes, nothing is formatted or allocated,
+  so building a command is cheap enough to do in every process() call.
+
+*/
+
+class StimCommand
+{
+public:
+
+	enum Type
+	{
+		TYPE_CLASS = 1,    //closed-loop stim class from a decoder, the SIP picks what stim goes with it
+		TYPE_PARAMETER = 2 //set one stim parameter of the group/program to value
+	};
+
+	enum Parameter
+	{
+		PARAMETER_NONE = 0,
+		PARAMETER_AMPLITUDE = 1,   //mA
+		PARAMETER_PULSE_WIDTH = 2, //us
+		PARAMETER_FREQUENCY = 3    //Hz
+	};
+
+	StimCommand();
+
+	enum Flags
+	{
+		FLAG_HEARTBEAT = 0x01
+	};
+
+	/** Writes the command into buffer, which has to have room for MESSAGE_BYTES */
+	void write(char* buffer) const;
+
+	/** Reads a command. Returns false and leaves command alone if data is too short or from an unknown version */
+	static bool read(const void* data, size_t size, StimCommand* command);
+
+	/** Now, for hostSendTimeUs */
+	static int64_t getHostTimeUs();
+
+	Type type;
+	uint32_t sequence;
+	int64_t sourceTimestamp;
+	int64_t hostSendTimeUs;
+	int8_t group;
+	int8_t program;
+	Parameter parameter;
+	uint8_t flags;
+	int32_t stimClass; //for TYPE_CLASS
+	float value; //for TYPE_PARAMETER
+
+	static const uint8_t VERSION = 1;
+	static const int MESSAGE_BYTES = 32;
+};
+
+#endif  // STIMCOMMAND_H_INCLUDED
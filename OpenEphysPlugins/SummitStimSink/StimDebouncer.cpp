@@ -0,0 +1,89 @@
+
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2014 Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#include <algorithm>
+#include <cmath>
+#include "StimDebouncer.h"
+
+StimDebouncer::StimDebouncer()
+	: m_onDwell(0), m_offDwell(0), m_switchDwell(0), m_minOn(0), m_minOff(0), m_refractory(0)
+{
+	reset();
+}
+
+void StimDebouncer::configure(const Settings& settings, double sampleRate)
+{
+	//no sample rate, no way to tell time: pass everything straight through
+	double samplesPerMs = std::max(sampleRate, 0.0) / 1000;
+	m_onDwell = (int64_t)std::ceil(settings.onDwellMs * samplesPerMs);
+	m_offDwell = (int64_t)std::ceil(settings.offDwellMs * samplesPerMs);
+	m_switchDwell = (int64_t)std::ceil(settings.switchDwellMs * samplesPerMs);
+	m_minOn = (int64_t)std::ceil(settings.minOnMs * samplesPerMs);
+	m_minOff = (int64_t)std::ceil(settings.minOffMs * samplesPerMs);
+	m_refractory = (int64_t)std::ceil(settings.refractoryMs * samplesPerMs);
+	reset();
+}
+
+void StimDebouncer::reset()
+{
+	m_started = false;
+	m_held = false;
+	m_class = OFF_CLASS;
+	m_classSince = 0;
+	m_candidate = OFF_CLASS;
+	m_candidateSince = 0;
+	m_lastSample = 0;
+}
+
+int StimDebouncer::update(int rawClass, int64_t sampleNumber)
+{
+	if (!m_started || sampleNumber < m_lastSample)
+	{
+		m_started = true;
+		m_held = false;
+		m_classSince = sampleNumber;
+		m_candidate = rawClass;
+		m_candidateSince = sampleNumber;
+	}
+	m_lastSample = sampleNumber;
+
+	if (rawClass != m_candidate)
+	{
+		m_candidate = rawClass;
+		m_candidateSince = sampleNumber;
+	}
+
+	if (m_candidate != m_class)
+	{
+		int64_t dwell = m_class == OFF_CLASS ? m_onDwell : (m_candidate == OFF_CLASS ? m_offDwell : m_switchDwell);
+		int64_t hold = m_held ? std::max(m_refractory, m_class == OFF_CLASS ? m_minOff : m_minOn) : 0;
+		if (sampleNumber - m_candidateSince >= dwell && sampleNumber - m_classSince >= hold)
+		{
+			m_class = m_candidate;
+			m_classSince = sampleNumber;
+			m_held = true;
+		}
+	}
+
+	return m_class;
+}
@@ -0,0 +1,92 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2014 Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef STIMDEBOUNCER_H_INCLUDED
+#define STIMDEBOUNCER_H_INCLUDED
+
+#include <cstdint>
+
+/**
+
+  Debounces the decoded stim class before it goes to the SIP, on the sample
+  clock rather than on Open-Ephys blocks, so the timing is the same whatever
+  block size the GUI runs with.
+
+  A new class has to be seen for a dwell time before we switch to it, with
+  separate dwell times for turning stim on (from OFF_CLASS), turning it off
+  (to OFF_CLASS) and switching between two stim classes. Once switched, the
+  class is held for at least the refractory period, and for at least the
+  minimum on or off duration. Anything that flickers back before then is
+  ignored. The class we start with isn't held, it wasn't a decision.
+
+  update() is O(1) per call, it only keeps the current class, the class
+  the input last changed to and the sample numbers both started at.
+
+*/
+
+class StimDebouncer
+{
+public:
+
+	/** All in milliseconds, 0 for none */
+	struct Settings
+	{
+		int onDwellMs;     //how long a stim class has to be seen before stim goes on
+		int offDwellMs;    //how long OFF_CLASS has to be seen before stim goes off
+		int switchDwellMs; //how long another stim class has to be seen before switching to it
+		int minOnMs;       //shortest time stim stays on
+		int minOffMs;      //shortest time stim stays off
+		int refractoryMs;  //shortest time between any two switches
+	};
+
+	static const int OFF_CLASS = 0;
+
+	StimDebouncer();
+
+	/** Takes new settings for a sample clock running at sampleRate Hz, and starts over at OFF_CLASS */
+	void configure(const Settings& settings, double sampleRate);
+
+	/** Starts over at OFF_CLASS, e.g. when acquisition restarts */
+	void reset();
+
+	/** Takes the decoded class at sampleNumber and returns the class to send. Sample numbers going backwards mean the
+	    source started over, so the dwell times and holds start over too (but not the class) */
+	int update(int rawClass, int64_t sampleNumber);
+
+	int getClass() const { return m_class; }
+
+private:
+
+	int64_t m_onDwell, m_offDwell, m_switchDwell; //in samples
+	int64_t m_minOn, m_minOff, m_refractory;
+
+	bool m_started; //seen a sample since the reset
+	bool m_held; //the class was switched to, so the holds apply
+	int m_class;
+	int64_t m_classSince; //sample number we switched to m_class at
+	int m_candidate; //class the input last changed to
+	int64_t m_candidateSince;
+	int64_t m_lastSample;
+};
+
+#endif  // STIMDEBOUNCER_H_INCLUDED
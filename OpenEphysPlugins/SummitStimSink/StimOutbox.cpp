@@ -0,0 +1,290 @@
+
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2014 Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+#include <algorithm>
+#include <climits>
+#include <thread>
+#include "StimCommand.h"
+#include "StimOutbox.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#elif defined(__APPLE__)
+#include <dispatch/dispatch.h>
+#else
+#include <cerrno>
+#include <ctime>
+#include <semaphore.h>
+#endif
+
+//counting semaphore, posting it doesn't take a lock (C++11 doesn't have one)
+class StimOutbox::Semaphore
+{
+public:
+
+#ifdef _WIN32
+	Semaphore() { m_handle = CreateSemaphore(NULL, 0, LONG_MAX, NULL); }
+	~Semaphore() { CloseHandle(m_handle); }
+	void post() { ReleaseSemaphore(m_handle, 1, NULL); }
+	bool wait(std::chrono::milliseconds timeout) { return WaitForSingleObject(m_handle, (DWORD)timeout.count()) == WAIT_OBJECT_0; }
+
+private:
+	HANDLE m_handle;
+#elif defined(__APPLE__)
+	Semaphore() { m_semaphore = dispatch_semaphore_create(0); }
+	~Semaphore() { dispatch_release(m_semaphore); }
+	void post() { dispatch_semaphore_signal(m_semaphore); }
+	bool wait(std::chrono::milliseconds timeout)
+	{
+		return dispatch_semaphore_wait(m_semaphore, dispatch_time(DISPATCH_TIME_NOW, (int64_t)timeout.count() * 1000000)) == 0;
+	}
+
+private:
+	dispatch_semaphore_t m_semaphore;
+#else
+	Semaphore() { sem_init(&m_semaphore, 0, 0); }
+	~Semaphore() { sem_destroy(&m_semaphore); }
+	void post() { sem_post(&m_semaphore); }
+	bool wait(std::chrono::milliseconds timeout)
+	{
+		//sem_timedwait wants an absolute CLOCK_REALTIME deadline
+		timespec deadline;
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		long long nanoseconds = deadline.tv_nsec + (long long)timeout.count() * 1000000;
+		deadline.tv_sec += (time_t)(nanoseconds / 1000000000);
+		deadline.tv_nsec = (long)(nanoseconds % 1000000000);
+		int result;
+		while ((result = sem_timedwait(&m_semaphore, &deadline)) != 0 && errno == EINTR)
+		{
+		}
+		return result == 0;
+	}
+
+private:
+	sem_t m_semaphore;
+#endif
+};
+
+StimOutbox::StimOutbox(int minCapacity, FullPolicy policy, int blockTimeoutUs)
+	: m_pushPosition(0), m_popPosition(0), m_policy(policy), m_blockTimeout((std::min)((std::max)(blockTimeoutUs, 0), (int)MAX_BLOCK_US)),
+	m_wake(new Semaphore()), m_consumerWaiting(false),
+	m_nQueued(0), m_nSent(0), m_nSendFailed(0), m_nDroppedOldest(0), m_nConflated(0), m_nTimedOut(0),
+	m_totalQueueUs(0), m_maxQueueUs(0), m_totalSendUs(0), m_maxSendUs(0)
+{
+	size_t capacity = 2;
+	while (capacity < (size_t)minCapacity)
+	{
+		capacity *= 2;
+	}
+	m_mask = capacity - 1;
+
+	m_slots = new Slot[capacity];
+	for (size_t iSlot = 0; iSlot < capacity; iSlot++)
+	{
+		m_slots[iSlot].turn.store(iSlot, std::memory_order_relaxed);
+	}
+}
+
+StimOutbox::~StimOutbox()
+{
+	delete[] m_slots;
+}
+
+bool StimOutbox::tryPush(const Entry& entry)
+{
+	size_t position = m_pushPosition.load(std::memory_order_relaxed);
+	Slot* slot;
+	while (true)
+	{
+		slot = &m_slots[position & m_mask];
+		intptr_t ahead = (intptr_t)slot->turn.load(std::memory_order_acquire) - (intptr_t)position;
+		if (ahead == 0)
+		{
+			//the slot's free for this position, claim it
+			if (m_pushPosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+			{
+				break;
+			}
+		}
+		else if (ahead < 0)
+		{
+			//the slot still has the entry from a lap ago, full
+			return false;
+		}
+		else
+		{
+			//another producer got there first
+			position = m_pushPosition.load(std::memory_order_relaxed);
+		}
+	}
+
+	slot->entry = entry;
+	slot->turn.store(position + 1, std::memory_order_release);
+	return true;
+}
+
+bool StimOutbox::pop(Entry* entry)
+{
+	size_t position = m_popPosition.load(std::memory_order_relaxed);
+	Slot* slot;
+	while (true)
+	{
+		slot = &m_slots[position & m_mask];
+		intptr_t ahead = (intptr_t)slot->turn.load(std::memory_order_acquire) - (intptr_t)(position + 1);
+		if (ahead == 0)
+		{
+			if (m_popPosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+			{
+				break;
+			}
+		}
+		else if (ahead < 0)
+		{
+			return false;
+		}
+		else
+		{
+			//a producer dropping old entries got there first
+			position = m_popPosition.load(std::memory_order_relaxed);
+		}
+	}
+
+	*entry = slot->entry;
+	slot->turn.store(position + m_mask + 1, std::memory_order_release);
+	entry->dequeuedUs = StimCommand::getHostTimeUs();
+	return true;
+}
+
+bool StimOutbox::isEmpty() const
+{
+	size_t position = m_popPosition.load(std::memory_order_relaxed);
+	return m_slots[position & m_mask].turn.load(std::memory_order_acquire) != position + 1;
+}
+
+bool StimOutbox::push(const Entry& entry)
+{
+	Entry queued = entry;
+	queued.enqueuedUs = StimCommand::getHostTimeUs();
+	queued.dequeuedUs = 0;
+	queued.sentUs = 0;
+
+	//the full policy gets one go at making room. That can fail for a moment when the sender has claimed the oldest slot but
+	//not freed it yet, so after that every policy waits for the sender until the deadline, rather than dropping everything
+	//queued one by one or spinning for as long as the sender is descheduled
+	std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + m_blockTimeout;
+	bool triedDropping = m_policy == FULL_BLOCK;
+	Entry dropped;
+	while (!tryPush(queued))
+	{
+		if (!triedDropping)
+		{
+			triedDropping = true;
+			if (m_policy == FULL_DROP_OLDEST)
+			{
+				if (pop(&dropped))
+				{
+					m_nDroppedOldest++;
+				}
+			}
+			else
+			{
+				while (pop(&dropped))
+				{
+					m_nConflated++;
+				}
+			}
+		}
+		else if (std::chrono::steady_clock::now() < deadline)
+		{
+			std::this_thread::yield();
+		}
+		else
+		{
+			m_nTimedOut++;
+			return false;
+		}
+	}
+	m_nQueued++;
+
+	//if the consumer is about to sleep, it either sees this entry or is woken up by us. The fences make sure at least one of
+	//us sees the other's store
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	wake();
+	return true;
+}
+
+bool StimOutbox::waitForEntry(std::chrono::milliseconds timeout)
+{
+	m_consumerWaiting.store(true, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	bool posted = isEmpty() && m_wake->wait(timeout);
+
+	//if someone else cleared the flag they post (or have posted) the semaphore, take that post so they don't build up
+	if (!posted && !m_consumerWaiting.exchange(false))
+	{
+		m_wake->wait(std::chrono::milliseconds(INT_MAX));
+	}
+	return !isEmpty();
+}
+
+void StimOutbox::wake()
+{
+	//only one post per sleep, and no syscall at all while the sender is busy
+	if (m_consumerWaiting.load(std::memory_order_relaxed) && m_consumerWaiting.exchange(false))
+	{
+		m_wake->post();
+	}
+}
+
+void StimOutbox::recordSend(const Entry& entry, bool sent)
+{
+	(sent ? m_nSent : m_nSendFailed)++;
+	int64_t queueUs = entry.dequeuedUs - entry.enqueuedUs;
+	int64_t sendUs = entry.sentUs - entry.dequeuedUs;
+	m_totalQueueUs.store(m_totalQueueUs.load(std::memory_order_relaxed) + queueUs, std::memory_order_relaxed);
+	m_totalSendUs.store(m_totalSendUs.load(std::memory_order_relaxed) + sendUs, std::memory_order_relaxed);
+	if (queueUs > m_maxQueueUs.load(std::memory_order_relaxed))
+	{
+		m_maxQueueUs.store(queueUs, std::memory_order_relaxed);
+	}
+	if (sendUs > m_maxSendUs.load(std::memory_order_relaxed))
+	{
+		m_maxSendUs.store(sendUs, std::memory_order_relaxed);
+	}
+}
+
+StimOutbox::Stats StimOutbox::getStats() const
+{
+	Stats stats;
+	stats.nQueued = m_nQueued;
+	stats.nSent = m_nSent;
+	stats.nSendFailed = m_nSendFailed;
+	stats.nDroppedOldest = m_nDroppedOldest;
+	stats.nConflated = m_nConflated;
+	stats.nTimedOut = m_nTimedOut;
+	stats.totalQueueUs = m_totalQueueUs.load(std::memory_order_relaxed);
+	stats.maxQueueUs = m_maxQueueUs.load(std::memory_order_relaxed);
+	stats.totalSendUs = m_totalSendUs.load(std::memory_order_relaxed);
+	stats.maxSendUs = m_maxSendUs.load(std::memory_order_relaxed);
+	return stats;
+}
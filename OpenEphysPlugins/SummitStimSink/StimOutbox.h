@@ -0,0 +1,162 @@
+/*
+    ------------------------------------------------------------------
+
+    This file is part of the Open Ephys GUI
+    Copyright (C) 2014 Open Ephys
+
+    ------------------------------------------------------------------
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef STIMOUTBOX_H_INCLUDED
+#define STIMOUTBOX_H_INCLUDED
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+
+/**
+
+  Bounded lock-free queue of stim classes waiting to go to the SIP, so the
+  Open Ephys processing thread never waits for ZMQ. Any number of threads
+  can push(), one sender thread pops and sends. All memory is allocated in
+  the constructor.
+
+  push() never takes a lock. When the queue is full it either drops the
+  oldest queued entry, drops everything queued (the newest class
+  supersedes them all), or waits for the sender to make room. Whatever
+  the policy, push() gives up and drops the new entry after the block
+  timeout, at most MAX_BLOCK_US, e.g. when dropping can't make room yet
+  because the sender is halfway through taking an entry. That cap is a
+  small fraction of any Open Ephys block, so no policy can make process()
+  miss its deadline.
+
+  The sender sleeps on a semaphore while the queue is empty. A producer
+  only posts it when it's the one that clears the consumer's "waiting"
+  flag, so there's at most one post per sleep and no mutex on either side.
+
+  Each entry is stamped when it's queued, when the sender takes it and
+  when ZMQ has taken it, all in host us since the Unix epoch like
+  StimCommand::hostSendTimeUs, so queueing time and time on the wire (the
+  SIP sees hostSendTimeUs) can be told apart.
+
+  The slots are Dmitry Vyukov's bounded MPMC queue: each has a sequence
+  number saying whose turn it is, so producers and the consumer only ever
+  compare-and-swap a position counter. Dropping from the producer side is
+  just another pop, which that queue allows.
+
+*/
+
+class StimOutbox
+{
+public:
+
+	/** What push() does when the queue is full. The values are also the editor's combo box IDs */
+	enum FullPolicy
+	{
+		FULL_DROP_OLDEST = 1, //drop the oldest queued entry to make room
+		FULL_CONFLATE = 2,    //drop everything queued, only the newest class matters
+		FULL_BLOCK = 3        //wait for room, then drop the new entry
+	};
+
+	struct Entry
+	{
+		int32_t stimClass;
+		uint32_t sequence;
+		int64_t sourceTimestamp; //Open-Ephys sample number the class was decoded from
+		uint8_t flags; //StimCommand flags
+
+		int64_t enqueuedUs; //set by push()
+		int64_t dequeuedUs; //set by pop()
+		int64_t sentUs; //set by the sender once ZMQ has taken it
+	};
+
+	/** Counts since the outbox was made, and how long entries spent queued and being handed to ZMQ */
+	struct Stats
+	{
+		uint64_t nQueued;
+		uint64_t nSent;
+		uint64_t nSendFailed; //ZMQ wouldn't take it
+		uint64_t nDroppedOldest;
+		uint64_t nConflated;
+		uint64_t nTimedOut; //push() gave up waiting for room
+		int64_t totalQueueUs, maxQueueUs;
+		int64_t totalSendUs, maxSendUs;
+	};
+
+	static const int MAX_BLOCK_US = 200;
+
+	/** Room for at least minCapacity entries (rounded up to a power of two). blockTimeoutUs is how long push() keeps trying
+	    under any policy, clamped to MAX_BLOCK_US */
+	StimOutbox(int minCapacity, FullPolicy policy, int blockTimeoutUs);
+
+	~StimOutbox();
+
+	/** Producer side, from any thread, never takes a lock: queues the entry following the full policy. Returns false if it
+	    was dropped */
+	bool push(const Entry& entry);
+
+	/** Consumer side: takes the oldest entry, false if there's none */
+	bool pop(Entry* entry);
+
+	/** Consumer side: sleeps until there's something to pop or timeout has passed. Returns whether there is */
+	bool waitForEntry(std::chrono::milliseconds timeout);
+
+	/** Wakes the consumer up from waitForEntry() if it's asleep, e.g. to stop it */
+	void wake();
+
+	/** Consumer side: adds a popped entry to the stats once it's been handed to ZMQ (or not) */
+	void recordSend(const Entry& entry, bool sent);
+
+	Stats getStats() const;
+
+	int getCapacity() const { return (int)m_mask + 1; }
+
+private:
+
+	class Semaphore;
+
+	struct Slot
+	{
+		std::atomic<size_t> turn; //position + 1 once written, position + capacity once read
+		Entry entry;
+	};
+
+	bool tryPush(const Entry& entry);
+	bool isEmpty() const;
+
+	Slot* m_slots;
+	size_t m_mask; //capacity is a power of two, so positions can be masked
+
+	//monotonic positions of the next push and pop
+	std::atomic<size_t> m_pushPosition;
+	std::atomic<size_t> m_popPosition;
+	FullPolicy m_policy;
+	std::chrono::microseconds m_blockTimeout;
+
+	//the consumer sleeps on this, whoever clears m_consumerWaiting posts it
+	std::unique_ptr<Semaphore> m_wake;
+	std::atomic<bool> m_consumerWaiting;
+
+	std::atomic<uint64_t> m_nQueued, m_nSent, m_nSendFailed, m_nDroppedOldest, m_nConflated, m_nTimedOut;
+	std::atomic<int64_t> m_totalQueueUs, m_maxQueueUs, m_totalSendUs, m_maxSendUs; //only the consumer stores to these
+
+	StimOutbox(const StimOutbox&);
+	StimOutbox& operator=(const StimOutbox&);
+};
+
+#endif  // STIMOUTBOX_H_INCLUDED
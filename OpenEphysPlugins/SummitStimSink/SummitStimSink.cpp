@@ -29,7 +29,7 @@
 #define PRINT_PROFILING
 
 //If the processor uses a custom editor, it needs its header to instantiate it
-//#include "TestSourceEditor.h"
+#include "SummitStimSinkEditor.h"
 
 SummitStimSink::SummitStimSink()
     : GenericProcessor("Summit Stim Sink") //, threshold(200.0), state(true)
@@ -43,15 +43,51 @@ SummitStimSink::SummitStimSink()
 	//context = zmq_ctx_new();
 	//socket(context, ZMQ_SUB);
 	m_inputChan = 0;
+	m_nInputs = 1;
+	m_reduceMode = StimClassReducer::MODE_LATEST;
+	m_reduceThreshold = 0.5f;
+	m_nActiveInputs = 0;
 	m_loop = 0;
-	m_socket.connect("tcp://localhost:12345");
+
+	m_transport = TRANSPORT_TCP;
+	m_address = getDefaultAddress(TRANSPORT_TCP);
+	m_sendHWM = DEFAULT_SEND_HWM;
+	m_sendBufferSize = 0;
+	m_immediate = false;
+	m_ioThreads = DEFAULT_IO_THREADS;
+	m_conflate = false;
+
+	m_publishMode = PUBLISH_EVERY_BLOCK;
+	m_heartbeatMs = DEFAULT_HEARTBEAT_MS;
+	m_haveSent = false;
+	m_sentClass = 0;
+
+	m_debounceSettings.onDwellMs = 0;
+	m_debounceSettings.offDwellMs = 0;
+	m_debounceSettings.switchDwellMs = 0;
+	m_debounceSettings.minOnMs = 0;
+	m_debounceSettings.minOffMs = 0;
+	m_debounceSettings.refractoryMs = DEFAULT_REFRACTORY_MS;
+
+	m_outboxDepth = DEFAULT_OUTBOX_DEPTH;
+	m_outboxFullPolicy = StimOutbox::FULL_DROP_OLDEST;
+	m_outboxBlockTimeoutUs = DEFAULT_OUTBOX_BLOCK_US;
+	m_nextSequence = 0;
+	m_stopSender = true;
+
+	m_commandFormat = FORMAT_BINARY;
+	m_stimGroup = -1;
+	m_stimProgram = -1;
 
 	m_debugFile.open(m_debugPath);
 	m_debugFile << "Starting \n";
+	m_senderDebugFile.open(m_senderDebugPath);
 
 #ifdef PRINT_PROFILING
 	m_profilingFile.open("SummitSink_Profiling.txt");
 	m_profilingFile << "Loop GettingClass SendToSummit" << std::endl;
+	m_senderProfilingFile.open("SummitSink_Sender_Profiling.txt");
+	m_senderProfilingFile << "Sequence Class EnqueuedUs DequeuedUs SentUs Sent" << std::endl;
 #endif
 
 }
@@ -59,10 +95,13 @@ SummitStimSink::SummitStimSink()
 
 SummitStimSink::~SummitStimSink()
 {
+	stopSender();
 	m_debugFile.close();
+	m_senderDebugFile.close();
 
 #ifdef PRINT_PROFILING
 	m_profilingFile.close();
+	m_senderProfilingFile.close();
 #endif
 
 	//socket.close();
@@ -72,16 +111,240 @@ SummitStimSink::~SummitStimSink()
 /**
 	If the processor uses a custom editor, this method must be present.
 */
-/*
-AudioProcessorEditor* TestSource::createEditor()
+AudioProcessorEditor* SummitStimSink::createEditor()
 {
-	editor = new TestSourceEditor(this, true);
-
-	//std::cout << "Creating editor." << std::endl;
+	editor = new SummitStimSinkEditor(this, true);
 
 	return editor;
 }
-*/
+
+void SummitStimSink::setTransport(Transport transport)
+{
+	m_transport = transport;
+}
+
+void SummitStimSink::setAddress(const String& address)
+{
+	m_address = address.trim();
+}
+
+void SummitStimSink::setSendHWM(int messages)
+{
+	m_sendHWM = jmax(messages, 0);
+}
+
+void SummitStimSink::setSendBufferSize(int bytes)
+{
+	m_sendBufferSize = jmax(bytes, 0);
+}
+
+void SummitStimSink::setImmediate(bool immediate)
+{
+	m_immediate = immediate;
+}
+
+void SummitStimSink::setIOThreads(int nThreads)
+{
+	m_ioThreads = jmin(jmax(nThreads, 1), MAX_IO_THREADS);
+}
+
+void SummitStimSink::setConflate(bool conflate)
+{
+	m_conflate = conflate;
+}
+
+void SummitStimSink::setPublishMode(PublishMode mode)
+{
+	m_publishMode = mode;
+}
+
+void SummitStimSink::setHeartbeatMs(int milliseconds)
+{
+	m_heartbeatMs = jmin(jmax(milliseconds, 0), MAX_HEARTBEAT_MS);
+}
+
+void SummitStimSink::setFirstInput(int firstInput)
+{
+	m_inputChan = jmin(jmax(firstInput, 0), MAX_INPUTS - 1);
+}
+
+void SummitStimSink::setNumInputs(int nInputs)
+{
+	m_nInputs = jmin(jmax(nInputs, 1), MAX_INPUTS);
+}
+
+void SummitStimSink::setReduceMode(StimClassReducer::Mode mode)
+{
+	m_reduceMode = mode;
+}
+
+void SummitStimSink::setReduceThreshold(float threshold)
+{
+	m_reduceThreshold = threshold;
+}
+
+void SummitStimSink::setDebounceSettings(const StimDebouncer::Settings& settings)
+{
+	m_debounceSettings.onDwellMs = jmin(jmax(settings.onDwellMs, 0), MAX_DEBOUNCE_MS);
+	m_debounceSettings.offDwellMs = jmin(jmax(settings.offDwellMs, 0), MAX_DEBOUNCE_MS);
+	m_debounceSettings.switchDwellMs = jmin(jmax(settings.switchDwellMs, 0), MAX_DEBOUNCE_MS);
+	m_debounceSettings.minOnMs = jmin(jmax(settings.minOnMs, 0), MAX_DEBOUNCE_MS);
+	m_debounceSettings.minOffMs = jmin(jmax(settings.minOffMs, 0), MAX_DEBOUNCE_MS);
+	m_debounceSettings.refractoryMs = jmin(jmax(settings.refractoryMs, 0), MAX_DEBOUNCE_MS);
+}
+
+void SummitStimSink::setOutboxDepth(int depth)
+{
+	m_outboxDepth = jmin(jmax(depth, 1), MAX_OUTBOX_DEPTH);
+}
+
+void SummitStimSink::setOutboxFullPolicy(StimOutbox::FullPolicy policy)
+{
+	m_outboxFullPolicy = policy;
+}
+
+void SummitStimSink::setOutboxBlockTimeoutUs(int microseconds)
+{
+	m_outboxBlockTimeoutUs = jmin(jmax(microseconds, 0), MAX_OUTBOX_BLOCK_US);
+}
+
+void SummitStimSink::setCommandFormat(CommandFormat format)
+{
+	m_commandFormat = format;
+}
+
+void SummitStimSink::setStimGroup(int group)
+{
+	m_stimGroup = jmin(jmax(group, -1), MAX_STIM_GROUP);
+}
+
+void SummitStimSink::setStimProgram(int program)
+{
+	m_stimProgram = jmin(jmax(program, -1), MAX_STIM_PROGRAM);
+}
+
+String SummitStimSink::getDefaultAddress(Transport transport)
+{
+	switch (transport)
+	{
+	case TRANSPORT_IPC:
+		return "/tmp/summit-stim";
+	case TRANSPORT_INPROC:
+		return "summit-stim";
+	default:
+		return "localhost:12345";
+	}
+}
+
+std::string SummitStimSink::getEndpoint() const
+{
+	switch (m_transport)
+	{
+	case TRANSPORT_IPC:
+		return "ipc://" + m_address.toStdString();
+	case TRANSPORT_INPROC:
+		return "inproc://" + m_address.toStdString();
+	default:
+		return "tcp://" + m_address.toStdString();
+	}
+}
+
+void SummitStimSink::saveCustomParametersToXml(XmlElement* parentElement)
+{
+	XmlElement* connectionNode = parentElement->createNewChildElement("CONNECTION");
+	connectionNode->setAttribute("transport", (int)m_transport);
+	connectionNode->setAttribute("address", m_address);
+	connectionNode->setAttribute("sendHWM", m_sendHWM);
+	connectionNode->setAttribute("sendBufferSize", m_sendBufferSize);
+	connectionNode->setAttribute("immediate", m_immediate ? 1 : 0);
+	connectionNode->setAttribute("ioThreads", m_ioThreads);
+	connectionNode->setAttribute("conflate", m_conflate ? 1 : 0);
+
+	XmlElement* commandNode = parentElement->createNewChildElement("COMMAND");
+	commandNode->setAttribute("format", (int)m_commandFormat);
+	commandNode->setAttribute("group", m_stimGroup);
+	commandNode->setAttribute("program", m_stimProgram);
+	commandNode->setAttribute("publish", (int)m_publishMode);
+	commandNode->setAttribute("heartbeatMs", m_heartbeatMs);
+
+	XmlElement* inputsNode = parentElement->createNewChildElement("INPUTS");
+	inputsNode->setAttribute("first", m_inputChan);
+	inputsNode->setAttribute("count", m_nInputs);
+	inputsNode->setAttribute("reduce", (int)m_reduceMode);
+	inputsNode->setAttribute("threshold", (double)m_reduceThreshold);
+
+	XmlElement* debounceNode = parentElement->createNewChildElement("DEBOUNCE");
+	debounceNode->setAttribute("onDwellMs", m_debounceSettings.onDwellMs);
+	debounceNode->setAttribute("offDwellMs", m_debounceSettings.offDwellMs);
+	debounceNode->setAttribute("switchDwellMs", m_debounceSettings.switchDwellMs);
+	debounceNode->setAttribute("minOnMs", m_debounceSettings.minOnMs);
+	debounceNode->setAttribute("minOffMs", m_debounceSettings.minOffMs);
+	debounceNode->setAttribute("refractoryMs", m_debounceSettings.refractoryMs);
+
+	XmlElement* outboxNode = parentElement->createNewChildElement("OUTBOX");
+	outboxNode->setAttribute("depth", m_outboxDepth);
+	outboxNode->setAttribute("whenFull", (int)m_outboxFullPolicy);
+	outboxNode->setAttribute("blockTimeoutUs", m_outboxBlockTimeoutUs);
+}
+
+void SummitStimSink::loadCustomParametersFromXml()
+{
+	if (parametersAsXml == nullptr)
+	{
+		return;
+	}
+
+	forEachXmlChildElement(*parametersAsXml, connectionNode)
+	{
+		if (connectionNode->hasTagName("CONNECTION"))
+		{
+			int transport = connectionNode->getIntAttribute("transport", TRANSPORT_TCP);
+			setTransport((transport == TRANSPORT_IPC || transport == TRANSPORT_INPROC) ? (Transport)transport : TRANSPORT_TCP);
+			setAddress(connectionNode->getStringAttribute("address", getDefaultAddress(m_transport)));
+			setSendHWM(connectionNode->getIntAttribute("sendHWM", DEFAULT_SEND_HWM));
+			setSendBufferSize(connectionNode->getIntAttribute("sendBufferSize", 0));
+			setImmediate(connectionNode->getIntAttribute("immediate", 0) != 0);
+			setIOThreads(connectionNode->getIntAttribute("ioThreads", DEFAULT_IO_THREADS));
+			setConflate(connectionNode->getIntAttribute("conflate", 0) != 0);
+		}
+		else if (connectionNode->hasTagName("COMMAND"))
+		{
+			setCommandFormat(connectionNode->getIntAttribute("format", FORMAT_BINARY) == FORMAT_TEXT ? FORMAT_TEXT : FORMAT_BINARY);
+			setStimGroup(connectionNode->getIntAttribute("group", -1));
+			setStimProgram(connectionNode->getIntAttribute("program", -1));
+			setPublishMode(connectionNode->getIntAttribute("publish", PUBLISH_EVERY_BLOCK) == PUBLISH_ON_CHANGE ? PUBLISH_ON_CHANGE : PUBLISH_EVERY_BLOCK);
+			setHeartbeatMs(connectionNode->getIntAttribute("heartbeatMs", DEFAULT_HEARTBEAT_MS));
+		}
+		else if (connectionNode->hasTagName("INPUTS"))
+		{
+			int mode = connectionNode->getIntAttribute("reduce", StimClassReducer::MODE_LATEST);
+			setFirstInput(connectionNode->getIntAttribute("first", 0));
+			setNumInputs(connectionNode->getIntAttribute("count", 1));
+			setReduceMode(mode >= StimClassReducer::MODE_LATEST && mode <= StimClassReducer::MODE_ALL ? (StimClassReducer::Mode)mode
+				: StimClassReducer::MODE_LATEST);
+			setReduceThreshold((float)connectionNode->getDoubleAttribute("threshold", 0.5));
+		}
+		else if (connectionNode->hasTagName("DEBOUNCE"))
+		{
+			StimDebouncer::Settings settings;
+			settings.onDwellMs = connectionNode->getIntAttribute("onDwellMs", 0);
+			settings.offDwellMs = connectionNode->getIntAttribute("offDwellMs", 0);
+			settings.switchDwellMs = connectionNode->getIntAttribute("switchDwellMs", 0);
+			settings.minOnMs = connectionNode->getIntAttribute("minOnMs", 0);
+			settings.minOffMs = connectionNode->getIntAttribute("minOffMs", 0);
+			settings.refractoryMs = connectionNode->getIntAttribute("refractoryMs", DEFAULT_REFRACTORY_MS);
+			setDebounceSettings(settings);
+		}
+		else if (connectionNode->hasTagName("OUTBOX"))
+		{
+			int policy = connectionNode->getIntAttribute("whenFull", StimOutbox::FULL_DROP_OLDEST);
+			setOutboxDepth(connectionNode->getIntAttribute("depth", DEFAULT_OUTBOX_DEPTH));
+			setOutboxFullPolicy(policy == StimOutbox::FULL_CONFLATE || policy == StimOutbox::FULL_BLOCK ? (StimOutbox::FullPolicy)policy
+				: StimOutbox::FULL_DROP_OLDEST);
+			setOutboxBlockTimeoutUs(connectionNode->getIntAttribute("blockTimeoutUs", DEFAULT_OUTBOX_BLOCK_US));
+		}
+	}
+}
 
 void SummitStimSink::setParameter(int parameterIndex, float newValue)
 {
@@ -122,6 +385,12 @@ void SummitStimSink::process(AudioSampleBuffer& buffer)
 	//Get decoded class from AUX channel
 	m_start_time = std::chrono::high_resolution_clock::now();
 
+	//no AUX channel to read from
+	if (m_nActiveInputs == 0)
+	{
+		return;
+	}
+
 	//EEG Test
 	int iChan = m_AUXChannels[m_inputChan];
 	int nSamples = getNumSamples(iChan);
@@ -131,9 +400,15 @@ void SummitStimSink::process(AudioSampleBuffer& buffer)
 	{
 		return;
 	}
-	
-	const float* readPtr = buffer.getReadPointer(iChan);
-	m_class = *readPtr;
+
+	//one class for the whole block from all the inputs (they come from the same source, so have the same number of samples),
+	//as of the last sample
+	for (int iInput = 0; iInput < m_nActiveInputs; iInput++)
+	{
+		m_inputPointers[iInput] = buffer.getReadPointer(m_AUXChannels[m_inputChan + iInput]);
+	}
+	int rawClass = m_reducer.reduce(m_inputPointers.data(), m_nActiveInputs, nSamples);
+	int64 sampleNumber = getTimestamp(iChan) + nSamples - 1;
 
 	////EEG Test
 	//if (m_class != 0)
@@ -151,27 +426,34 @@ void SummitStimSink::process(AudioSampleBuffer& buffer)
 	//Send to Summit system
 	m_start_time = std::chrono::high_resolution_clock::now();
 
-	zmq::message_t message(1);
 	//assert(m_class == 0 || m_class == 1 || m_class == 2);
 
-	if (m_loop < 11)
-	{
-		m_class = m_prevClass;
-		m_loop++;
-	}
-	
-	if (m_prevClass != m_class)
+	//debounced on the sample clock, so it doesn't matter how many blocks the time is split into
+	m_class = m_debouncer.update(rawClass, sampleNumber);
+
+	//in on-change mode, only send a new class, or the current one again when a heartbeat is due so a SIP that's just
+	//connected (PUB drops everything sent before a subscriber joins) catches up
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	bool changed = !m_haveSent || m_class != m_sentClass;
+	bool heartbeat = !changed && m_heartbeatMs > 0 && now - m_sentTime >= std::chrono::milliseconds(m_heartbeatMs);
+	if (m_publishMode == PUBLISH_EVERY_BLOCK || changed || heartbeat)
 	{
-		m_loop = 0;
-		m_prevClass = m_class;
+		//queued for the sender thread, so ZMQ never holds up the processing thread. The sequence number goes up even if the
+		//class is dropped on the way, so the SIP can tell some were
+		StimOutbox::Entry entry;
+		entry.stimClass = m_class;
+		entry.sequence = m_nextSequence++;
+		entry.sourceTimestamp = sampleNumber;
+		entry.flags = heartbeat && m_publishMode == PUBLISH_ON_CHANGE ? StimCommand::FLAG_HEARTBEAT : 0;
+		m_outbox->push(entry);
+
+		//a class that was dropped still counts as sent, the next heartbeat will have it. The outbox counts the drops, and
+		//disable() logs them, rather than writing to the debug file from here
+		m_haveSent = true;
+		m_sentClass = m_class;
+		m_sentTime = now;
 	}
 
-	m_prevClass = m_class;
-
-
-	memcpy(message.data(), std::to_string(m_class).c_str(), 1);
-	m_socket.send(message);
-
 	m_end_time = std::chrono::high_resolution_clock::now();
 #ifdef PRINT_PROFILING
 	m_elapsed = std::chrono::duration_cast<std::chrono::microseconds>(m_end_time - m_start_time).count();
@@ -204,9 +486,76 @@ void SummitStimSink::process(AudioSampleBuffer& buffer)
 	m_loop++;
 }
 
+void SummitStimSink::sendLoop()
+{
+	StimOutbox::Entry entry;
+	while (true)
+	{
+		if (!m_outbox->pop(&entry))
+		{
+			//anything queued before the stop still goes out, so the SIP gets the last class
+			if (m_stopSender)
+			{
+				break;
+			}
+			m_outbox->waitForEntry(std::chrono::milliseconds(SENDER_IDLE_MS));
+			continue;
+		}
+
+		bool sent = sendEntry(&entry);
+		m_outbox->recordSend(entry, sent);
+		if (!sent)
+		{
+			m_senderDebugFile << "Couldn't send stim class " << std::to_string(entry.stimClass) << ", SIP not keeping up" << std::endl;
+		}
+
+#ifdef PRINT_PROFILING
+		m_senderProfilingFile << entry.sequence << " " << entry.stimClass << " " << entry.enqueuedUs << " " << entry.dequeuedUs << " "
+			<< entry.sentUs << " " << (sent ? 1 : 0) << std::endl;
+#endif
+	}
+}
+
+void SummitStimSink::stopSender()
+{
+	m_stopSender = true;
+	if (m_senderThread.joinable())
+	{
+		m_outbox->wake();
+		m_senderThread.join();
+	}
+}
+
+bool SummitStimSink::sendEntry(StimOutbox::Entry* entry)
+{
+	bool sent;
+	if (m_commandFormat == FORMAT_TEXT)
+	{
+		std::string text = std::to_string(entry->stimClass);
+		sent = m_socket.send(text.data(), text.size(), ZMQ_DONTWAIT) > 0;
+	}
+	else
+	{
+		m_command.sequence = entry->sequence;
+		m_command.stimClass = entry->stimClass;
+		m_command.sourceTimestamp = entry->sourceTimestamp;
+		m_command.flags = entry->flags;
+		m_command.hostSendTimeUs = StimCommand::getHostTimeUs();
+		m_command.write(m_commandBuffer);
+		sent = m_socket.send(m_commandBuffer, StimCommand::MESSAGE_BYTES, ZMQ_DONTWAIT) > 0;
+	}
+	entry->sentUs = StimCommand::getHostTimeUs();
+	return sent;
+}
+
 bool SummitStimSink::enable()
 {
+	//in case we're enabled again without being disabled, the sender has to be done with the command and socket
+	stopSender();
+
 	//before start closed loop, set the input channels and output channel
+	m_AUXChannels.clear();
+	m_HEADChannels.clear();
 	int nAUXInputs = 0;
 	int nHEADInputs = 0;
 	for (int iChan = 0; iChan < dataChannelArray.size(); iChan++)
@@ -226,8 +575,93 @@ bool SummitStimSink::enable()
 
 	m_nAUXInputs = nAUXInputs;
 	m_nHEADInputs = nHEADInputs;
+
+	//numbering starts over with every acquisition
+	m_command = StimCommand();
+	m_command.type = StimCommand::TYPE_CLASS;
+	m_command.group = (int8_t)m_stimGroup;
+	m_command.program = (int8_t)m_stimProgram;
+	m_haveSent = false;
+	m_nextSequence = 0;
+
+	//as many of the inputs as there are
+	m_nActiveInputs = jmax(jmin(m_nInputs, m_nAUXInputs - m_inputChan), 0);
+	m_inputPointers.assign(jmax(m_nActiveInputs, 1), nullptr);
+	m_reducer.configure(m_reduceMode, m_reduceThreshold);
+	if (m_nActiveInputs < m_nInputs)
+	{
+		m_debugFile << "Only " << m_nActiveInputs << " of the " << m_nInputs << " stim class inputs from AUX " << m_inputChan + 1
+			<< " are there" << std::endl;
+	}
+
+	//durations are counted in samples of the channel the classes come in on
+	double sampleRate = m_nActiveInputs > 0 ? dataChannelArray[m_AUXChannels[m_inputChan]]->getSampleRate() : 0;
+	if (sampleRate <= 0)
+	{
+		m_debugFile << "No sample rate for the stim class channel, classes won't be debounced" << std::endl;
+	}
+	m_debouncer.configure(m_debounceSettings, sampleRate);
+
+	//fresh context and socket with the current settings (the number of I/O threads can only be set before the context has
+	//any sockets). The SIP might not be up yet or might go away: PUB never waits for it, ZMQ keeps retrying the connection
+	//in the background with a growing interval, only a few messages queue up while it's gone (old stim classes are no use
+	//anyway), and nothing that's still queued holds up closing the socket
+	m_socket.close();
+	m_context = zmq::context_t(m_ioThreads);
+	m_socket = zmq::socket_t(m_context, ZMQ_PUB);
+
+	int linger = 0;
+	int immediate = m_immediate ? 1 : 0;
+	int reconnectIvl = RECONNECT_INITIAL_MS;
+	int reconnectIvlMax = RECONNECT_MAX_MS;
+	int conflate = m_conflate ? 1 : 0;
+	m_socket.setsockopt(ZMQ_LINGER, &linger, sizeof(linger));
+	m_socket.setsockopt(ZMQ_SNDHWM, &m_sendHWM, sizeof(m_sendHWM));
+	m_socket.setsockopt(ZMQ_IMMEDIATE, &immediate, sizeof(immediate));
+	m_socket.setsockopt(ZMQ_RECONNECT_IVL, &reconnectIvl, sizeof(reconnectIvl));
+	m_socket.setsockopt(ZMQ_RECONNECT_IVL_MAX, &reconnectIvlMax, sizeof(reconnectIvlMax));
+	m_socket.setsockopt(ZMQ_CONFLATE, &conflate, sizeof(conflate));
+	if (m_sendBufferSize > 0)
+	{
+		m_socket.setsockopt(ZMQ_SNDBUF, &m_sendBufferSize, sizeof(m_sendBufferSize));
+	}
+
+	try
+	{
+		m_socket.connect(getEndpoint());
+		m_debugFile << "Sending stim classes to " << getEndpoint() << (m_commandFormat == FORMAT_BINARY ? " as binary commands" : " as text")
+			<< std::endl;
+	}
+	catch (const zmq::error_t& e)
+	{
+		//carry on with an unconnected socket, sends on it just go nowhere
+		m_debugFile << "Couldn't connect to " << getEndpoint() << ": " << e.what() << std::endl;
+		CoreServices::sendStatusMessage("Summit Stim Sink: couldn't connect to " + String(getEndpoint()));
+	}
+
+	//from here on only the sender thread touches the socket
+	m_outbox.reset(new StimOutbox(m_outboxDepth, m_outboxFullPolicy, m_outboxBlockTimeoutUs));
+	m_stopSender = false;
+	m_senderThread = std::thread(&SummitStimSink::sendLoop, this);
 	
 	return true;
 
 	setAllChannelsToRecord();
+}
+
+bool SummitStimSink::disable()
+{
+	stopSender();
+	if (m_outbox != nullptr)
+	{
+		StimOutbox::Stats stats = m_outbox->getStats();
+		uint64_t nHandled = jmax(stats.nSent + stats.nSendFailed, (uint64_t)1);
+		m_debugFile << "Outbox: " << stats.nQueued << " queued, " << stats.nSent << " sent, " << stats.nSendFailed << " not taken by ZMQ, "
+			<< stats.nDroppedOldest << " dropped for newer, " << stats.nConflated << " conflated, " << stats.nTimedOut << " timed out. "
+			<< "Queued for " << stats.totalQueueUs / (int64_t)nHandled << " us on average (max " << stats.maxQueueUs << "), handed to ZMQ in "
+			<< stats.totalSendUs / (int64_t)nHandled << " us (max " << stats.maxSendUs << ")" << std::endl;
+	}
+
+	m_socket.close();
+	return true;
 }
\ No newline at end of file
@@ -30,8 +30,14 @@
 
 #include <ProcessorHeaders.h>
 #include "zmq.hpp"
+#include "StimClassReducer.h"
+#include "StimCommand.h"
+#include "StimDebouncer.h"
+#include "StimOutbox.h"
 #include <fstream>
 #include <chrono>
+#include <memory>
+#include <thread>
 
 /**
 
@@ -68,13 +74,13 @@ public:
     }
 
 	/** Indicates if the processor has a custom editor. Defaults to false */
-	//bool hasEditor() const
-	//{
-	//	return true;
-	//}
+	bool hasEditor() const
+	{
+		return true;
+	}
 
 	/** If the processor has a custom editor, this method must be defined to instantiate it. */
-	//AudioProcessorEditor* createEditor();
+	AudioProcessorEditor* createEditor() override;
 
 	/** Optional method that informs the GUI if the processor is ready to function. If false acquisition cannot start. Defaults to true */
 	//bool isReady();
@@ -106,7 +112,107 @@ public:
 	//void updateSettings();
 
 	bool enable() override;
+	bool disable() override;
+
+	/** Saves and restores the connection settings with the rest of the signal chain */
+	void saveCustomParametersToXml(XmlElement* parentElement) override;
+	void loadCustomParametersFromXml() override;
+
+	/** How we reach the SIP. The values are also the editor's combo box IDs */
+	enum Transport
+	{
+		TRANSPORT_TCP = 1,   //address is host:port
+		TRANSPORT_IPC = 2,   //address is a socket file path, Linux/macOS only (libzmq 4.0 has no ipc on Windows)
+		TRANSPORT_INPROC = 3 //address is a name bound by something sharing this processor's ZMQ context
+	};
+
+	/** Connection settings, set from the editor. They're picked up by the next enable(), so the editor
+		only lets them change while we aren't acquiring */
+	void setTransport(Transport transport);
+	void setAddress(const String& address);
+	void setSendHWM(int messages);
+	void setSendBufferSize(int bytes);
+	void setImmediate(bool immediate);
+	void setIOThreads(int nThreads);
+
+	Transport getTransport() const { return m_transport; }
+	String getAddress() const { return m_address; }
+	int getSendHWM() const { return m_sendHWM; }
+	int getSendBufferSize() const { return m_sendBufferSize; }
+	bool getImmediate() const { return m_immediate; }
+	int getIOThreads() const { return m_ioThreads; }
+
+	/** The address a transport starts off with when it's picked in the editor */
+	static String getDefaultAddress(Transport transport);
+
+	/** What the stim classes are sent as. The values are also the editor's combo box IDs */
+	enum CommandFormat
+	{
+		FORMAT_BINARY = 1, //a StimCommand
+		FORMAT_TEXT = 2    //the class as decimal text, for SIPs that only know the old protocol
+	};
+
+	/** Command settings, set from the editor and picked up by the next enable() like the connection settings.
+		The group and program go in every binary command, -1 leaves it to the SIP's closed-loop setup */
+	void setCommandFormat(CommandFormat format);
+	void setStimGroup(int group);
+	void setStimProgram(int program);
+
+	/** When stim classes are sent. The values are also the editor's combo box IDs */
+	enum PublishMode
+	{
+		PUBLISH_EVERY_BLOCK = 1, //one command per process() call
+		PUBLISH_ON_CHANGE = 2    //only when the class changes, plus a heartbeat with the current class every heartbeat interval
+	};
 
+	/** Publish settings, picked up by the next enable(). A heartbeat interval of 0 turns heartbeats off. With conflate, ZMQ only
+		keeps the newest command queued for the SIP (ZMQ_CONFLATE), so a backlog never holds up the latest class */
+	void setPublishMode(PublishMode mode);
+	void setHeartbeatMs(int milliseconds);
+	void setConflate(bool conflate);
+
+	PublishMode getPublishMode() const { return m_publishMode; }
+	int getHeartbeatMs() const { return m_heartbeatMs; }
+	bool getConflate() const { return m_conflate; }
+
+	/** Input settings, picked up by the next enable(). Stim classes are read from nInputs AUX channels starting at firstInput
+		(counting from 0), as many of them as there are, and reduced to one class per block */
+	void setFirstInput(int firstInput);
+	void setNumInputs(int nInputs);
+	void setReduceMode(StimClassReducer::Mode mode);
+	void setReduceThreshold(float threshold);
+
+	int getFirstInput() const { return m_inputChan; }
+	int getNumInputs() const { return m_nInputs; }
+	StimClassReducer::Mode getReduceMode() const { return m_reduceMode; }
+	float getReduceThreshold() const { return m_reduceThreshold; }
+
+	/** Debounce settings, picked up by the next enable(). Each duration is clamped to 0..MAX_DEBOUNCE_MS */
+	void setDebounceSettings(const StimDebouncer::Settings& settings);
+	const StimDebouncer::Settings& getDebounceSettings() const { return m_debounceSettings; }
+
+	/** Outbox settings, picked up by the next enable(). process() queues stim classes in an outbox of up to depth entries
+		and a sender thread hands them to ZMQ, the full policy says what happens when the sender doesn't keep up */
+	void setOutboxDepth(int depth);
+	void setOutboxFullPolicy(StimOutbox::FullPolicy policy);
+	void setOutboxBlockTimeoutUs(int microseconds);
+
+	int getOutboxDepth() const { return m_outboxDepth; }
+	StimOutbox::FullPolicy getOutboxFullPolicy() const { return m_outboxFullPolicy; }
+	int getOutboxBlockTimeoutUs() const { return m_outboxBlockTimeoutUs; }
+
+	CommandFormat getCommandFormat() const { return m_commandFormat; }
+	int getStimGroup() const { return m_stimGroup; }
+	int getStimProgram() const { return m_stimProgram; }
+
+	static const int MAX_IO_THREADS = 16;
+	static const int MAX_STIM_GROUP = 3; //groups A to D
+	static const int MAX_STIM_PROGRAM = 3;
+	static const int MAX_HEARTBEAT_MS = 60000;
+	static const int MAX_DEBOUNCE_MS = 60000;
+	static const int MAX_INPUTS = 16;
+	static const int MAX_OUTBOX_DEPTH = 1024;
+	static const int MAX_OUTBOX_BLOCK_US = StimOutbox::MAX_BLOCK_US; //process() never waits any longer than this
 
 private:
 
@@ -118,21 +224,90 @@ private:
     // bool state;
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SummitStimSink);
-	zmq::context_t m_context = zmq::context_t(2);
-	zmq::socket_t m_socket = zmq::socket_t(m_context, ZMQ_PUB);
+	static const int DEFAULT_SEND_HWM = 10; //most stim classes to queue up for the SIP
+	static const int DEFAULT_IO_THREADS = 2;
+	static const int DEFAULT_HEARTBEAT_MS = 1000;
+	static const int DEFAULT_REFRACTORY_MS = 100; //about what the old lockout of a few blocks came to
+	static const int DEFAULT_OUTBOX_DEPTH = 16;
+	static const int DEFAULT_OUTBOX_BLOCK_US = 50;
+	static const int SENDER_IDLE_MS = 100; //how often the sender checks whether it should stop when there's nothing to send
+	zmq::context_t m_context = zmq::context_t(DEFAULT_IO_THREADS); //recreated by enable() with the configured number of I/O threads
+	zmq::socket_t m_socket = zmq::socket_t(m_context, ZMQ_PUB); //connected in enable(), only used by the sender thread, closed in disable()
+	std::string getEndpoint() const;
+
+	/** Sender thread: hands whatever process() queued in the outbox to ZMQ until stopSender() */
+	void sendLoop();
+	void stopSender();
+
+	/** Publishes one stim class (never blocks), returns false if ZMQ couldn't take it. Sender thread only */
+	bool sendEntry(StimOutbox::Entry* entry);
+	static const int RECONNECT_INITIAL_MS = 100; //first wait before ZMQ tries to reconnect to the SIP, doubles up to RECONNECT_MAX_MS
+	static const int RECONNECT_MAX_MS = 5000;
 	std::ofstream m_debugFile;
 	std::string m_debugPath = "SummitSink_debug.txt";
+	std::ofstream m_senderDebugFile; //the sender thread's, so it never writes to the same file as process()
+	std::string m_senderDebugPath = "SummitSink_sender_debug.txt";
+
+	//connection settings (see the setters above)
+	Transport m_transport;
+	String m_address;
+	int m_sendHWM; //most stim classes ZMQ queues up for the SIP, 0 for no limit
+	int m_sendBufferSize; //kernel send buffer in bytes, 0 for the OS default
+	bool m_immediate; //drop stim classes while the SIP isn't connected instead of queueing them for when it is
+	int m_ioThreads;
+	bool m_conflate; //only keep the newest command queued
+
+	//publish settings (see the setters above)
+	PublishMode m_publishMode;
+	int m_heartbeatMs;
+
+	//what the SIP was last sent, for publishing on changes
+	bool m_haveSent;
+	int m_sentClass;
+	std::chrono::steady_clock::time_point m_sentTime;
+
+	//input settings (see the setters above), and what enable() made of them
+	int m_nInputs;
+	StimClassReducer::Mode m_reduceMode;
+	float m_reduceThreshold;
+	StimClassReducer m_reducer;
+	int m_nActiveInputs; //inputs that are actually there
+	std::vector<const float*> m_inputPointers; //filled in by process(), sized by enable()
+
+	//debounce settings (see the setter above), and the debouncer they're loaded into by enable()
+	StimDebouncer::Settings m_debounceSettings;
+	StimDebouncer m_debouncer;
+
+	//outbox settings (see the setters above)
+	int m_outboxDepth;
+	StimOutbox::FullPolicy m_outboxFullPolicy;
+	int m_outboxBlockTimeoutUs;
+
+	//stim classes from process() to the sender thread, made by enable()
+	std::unique_ptr<StimOutbox> m_outbox;
+	uint32_t m_nextSequence; //of the next class queued, process() is the only producer
+	std::thread m_senderThread;
+	std::atomic<bool> m_stopSender;
+
+	//command settings (see the setters above)
+	CommandFormat m_commandFormat;
+	int m_stimGroup;
+	int m_stimProgram;
+
+	//the next binary command, and where it's written to before sending so the sender doesn't allocate or format anything
+	StimCommand m_command;
+	char m_commandBuffer[StimCommand::MESSAGE_BYTES];
 
 	std::vector<int> m_AUXChannels;
 	std::vector<int> m_HEADChannels;
 	int m_nAUXInputs;
 	int m_nHEADInputs;
-	int m_inputChan;
+	int m_inputChan; //first AUX channel stim classes are read from
 	int m_class;
-	int m_loop;
-	int m_prevClass;
+	int m_loop; //process() calls since the plugin was created, for the profiling file
 
 	std::ofstream m_profilingFile;
+	std::ofstream m_senderProfilingFile; //when each class was queued, taken by the sender and handed to ZMQ
 	long long m_elapsed; //in microseconds
 	std::chrono::high_resolution_clock::time_point m_start_time;
 	std::chrono::high_resolution_clock::time_point m_end_time;
@@ -27,40 +27,380 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 SummitStimSinkEditor::SummitStimSinkEditor(GenericProcessor* parentNode, bool useDefaultParameterEditors = true)
 	: GenericEditor(parentNode, useDefaultParameterEditors)
 {
+	m_processor = static_cast<SummitStimSink*>(parentNode);
+	desiredWidth = 850;
+
+	m_transportCaption = addCaption("Transport", 10, 30);
+	m_transportBox = new ComboBox("Transport");
+	m_transportBox->addItem("tcp", SummitStimSink::TRANSPORT_TCP);
+#ifndef _WIN32
+	m_transportBox->addItem("ipc", SummitStimSink::TRANSPORT_IPC);
+#endif
+	m_transportBox->addItem("inproc", SummitStimSink::TRANSPORT_INPROC);
+	m_transportBox->setBounds(90, 30, 150, 18);
+	m_transportBox->addListener(this);
+	m_transportBox->setTooltip("tcp for a SIP on this or another machine, ipc for a local peer without going through the TCP stack");
+	addAndMakeVisible(m_transportBox);
+
+	m_addressCaption = addCaption("Address", 10, 50);
+	m_addressField = addValueField(90, 50, 150);
+	m_addressField->setTooltip("host:port for tcp, a socket file path for ipc, a name for inproc");
+
+	m_hwmCaption = addCaption("Snd HWM", 10, 70);
+	m_hwmField = addValueField(90, 70, 150);
+	m_hwmField->setTooltip("Most stim classes to queue up for the SIP before ZMQ drops them, 0 for no limit");
+
+	m_bufferCaption = addCaption("Snd buffer", 10, 90);
+	m_bufferField = addValueField(90, 90, 50);
+	m_bufferField->setTooltip("Kernel send buffer in bytes, 0 for the OS default");
+
+	m_conflateButton = new UtilityButton("CONFLATE", Font("Small Text", 12, Font::plain));
+	m_conflateButton->setBounds(150, 90, 90, 18);
+	m_conflateButton->addListener(this);
+	m_conflateButton->setClickingTogglesState(true);
+	m_conflateButton->setTooltip("Only keep the newest stim class queued for the SIP, so a backlog never holds it up (Snd HWM doesn't apply)");
+	addAndMakeVisible(m_conflateButton);
+
+	m_ioThreadsCaption = addCaption("I/O threads", 10, 110);
+	m_ioThreadsField = addValueField(90, 110, 50);
+	m_ioThreadsField->setTooltip("ZMQ background threads");
+
 	//Most used buttons are UtilityButton, which shows a simple button with text and ElectrodeButton, which is an on-off button which displays a channel.
-	exampleButton = new UtilityButton("Button text", Font("Default", 15, Font::plain));
-	exampleButton->setBounds(10, 10, 100, 100); //Set position and size (X, Y, XSize, YSize)
-	exampleButton->addListener(this); //Specify which class will implement the listener methods, in the case of editors, always make the editor the listener
-	exampleButton->setClickingTogglesState(true); //True for a on-off toggleable button, false for a single-click monostable button
-	exampleButton->setTooltip("Mouseover tooltip text");
-	addAndMakeVisible(exampleButton);
+	m_immediateButton = new UtilityButton("IMMEDIATE", Font("Small Text", 12, Font::plain));
+	m_immediateButton->setBounds(150, 110, 90, 18);
+	m_immediateButton->addListener(this);
+	m_immediateButton->setClickingTogglesState(true);
+	m_immediateButton->setTooltip("Drop stim classes while the SIP isn't connected, instead of queueing them for when it is");
+	addAndMakeVisible(m_immediateButton);
+
+	m_formatCaption = addCaption("Format", 250, 30);
+	m_formatBox = new ComboBox("Format");
+	m_formatBox->addItem("binary", SummitStimSink::FORMAT_BINARY);
+	m_formatBox->addItem("text", SummitStimSink::FORMAT_TEXT);
+	m_formatBox->setBounds(310, 30, 80, 18);
+	m_formatBox->addListener(this);
+	m_formatBox->setTooltip("binary sends each class as a command with a sequence number and timestamps, text sends just the class for older SIPs");
+	addAndMakeVisible(m_formatBox);
+
+	m_groupCaption = addCaption("Group", 250, 50);
+	m_groupField = addValueField(310, 50, 80);
+	m_groupField->setTooltip("Stim group the classes are for, 0 to 3 (A to D), -1 for the SIP's closed-loop group");
+
+	m_programCaption = addCaption("Program", 250, 70);
+	m_programField = addValueField(310, 70, 80);
+	m_programField->setTooltip("Stim program the classes are for, 0 to 3, -1 to leave it to the class");
+
+	m_publishCaption = addCaption("Publish", 250, 90);
+	m_publishBox = new ComboBox("Publish");
+	m_publishBox->addItem("every block", SummitStimSink::PUBLISH_EVERY_BLOCK);
+	m_publishBox->addItem("on change", SummitStimSink::PUBLISH_ON_CHANGE);
+	m_publishBox->setBounds(310, 90, 80, 18);
+	m_publishBox->addListener(this);
+	m_publishBox->setTooltip("on change only sends a class when it's different from the last one, plus a heartbeat with the current class");
+	addAndMakeVisible(m_publishBox);
+
+	m_heartbeatCaption = addCaption("Heartbeat", 250, 110);
+	m_heartbeatField = addValueField(310, 110, 80);
+	m_heartbeatField->setTooltip("ms between repeats of the current class when nothing changes, so a SIP that (re)connects catches up. 0 for none");
+
+	m_onDwellField = addDebounceField("On dwell", 400, 30, "ms a stim class has to be seen before stim goes on");
+	m_offDwellField = addDebounceField("Off dwell", 400, 50, "ms class 0 has to be seen before stim goes off");
+	m_switchDwellField = addDebounceField("Switch dwell", 400, 70, "ms another stim class has to be seen before switching to it");
+	m_minOnField = addDebounceField("Min on", 530, 30, "Shortest ms stim stays on");
+	m_minOffField = addDebounceField("Min off", 530, 50, "Shortest ms stim stays off");
+	m_refractoryField = addDebounceField("Refractory", 530, 70, "Shortest ms between any two class changes");
+
+	m_outboxDepthCaption = addCaption("Queue", 400, 90);
+	m_outboxDepthField = addValueField(470, 90, 50);
+	m_outboxDepthField->setTooltip("Most stim classes waiting for the sender thread to hand them to ZMQ");
+
+	m_blockTimeoutCaption = addCaption("Block us", 530, 90);
+	m_blockTimeoutField = addValueField(600, 90, 50);
+	m_blockTimeoutField->setTooltip("Longest the processing thread waits (us, at most 200) for room in a full queue, whatever the policy, before dropping the new class");
+
+	m_fullPolicyCaption = addCaption("When full", 400, 110);
+	m_fullPolicyBox = new ComboBox("When full");
+	m_fullPolicyBox->addItem("drop oldest", StimOutbox::FULL_DROP_OLDEST);
+	m_fullPolicyBox->addItem("keep newest only", StimOutbox::FULL_CONFLATE);
+	m_fullPolicyBox->addItem("block", StimOutbox::FULL_BLOCK);
+	m_fullPolicyBox->setBounds(470, 110, 180, 18);
+	m_fullPolicyBox->addListener(this);
+	m_fullPolicyBox->setTooltip("What happens to stim classes when the sender falls behind and the queue is full");
+	addAndMakeVisible(m_fullPolicyBox);
+
+	m_firstInputCaption = addCaption("First AUX", 660, 30);
+	m_firstInputField = addValueField(730, 30, 50);
+	m_firstInputField->setTooltip("AUX channel the (first) decoder's stim classes come in on, counting from 1");
+
+	m_nInputsCaption = addCaption("AUX inputs", 660, 50);
+	m_nInputsField = addValueField(730, 50, 50);
+	m_nInputsField->setTooltip("How many AUX channels from the first one carry decoder outputs to combine");
+
+	m_reduceCaption = addCaption("Reduce", 660, 70);
+	m_reduceBox = new ComboBox("Reduce");
+	m_reduceBox->addItem("latest", StimClassReducer::MODE_LATEST);
+	m_reduceBox->addItem("majority", StimClassReducer::MODE_MAJORITY);
+	m_reduceBox->addItem("mean", StimClassReducer::MODE_MEAN);
+	m_reduceBox->addItem("any of", StimClassReducer::MODE_ANY);
+	m_reduceBox->addItem("all of", StimClassReducer::MODE_ALL);
+	m_reduceBox->setBounds(730, 70, 110, 18);
+	m_reduceBox->addListener(this);
+	m_reduceBox->setTooltip("latest: the first input's last sample. majority/mean: over the whole block and all inputs. "
+		"any of/all of: stim if any/all inputs' last samples say so");
+	addAndMakeVisible(m_reduceBox);
+
+	m_thresholdCaption = addCaption("Threshold", 660, 90);
+	m_thresholdField = addValueField(730, 90, 50);
+	m_thresholdField->setTooltip("Mean the inputs have to reach for class 1");
+
+	refreshControls();
 }
 
 SummitStimSinkEditor::~SummitStimSinkEditor()
 {
 }
 
+Label* SummitStimSinkEditor::addCaption(const String& text, int x, int y)
+{
+	Label* caption = new Label(text, text);
+	caption->setFont(Font("Small Text", 12, Font::plain));
+	caption->setBounds(x, y, 80, 18);
+	addAndMakeVisible(caption);
+	return caption;
+}
+
+Label* SummitStimSinkEditor::addValueField(int x, int y, int width)
+{
+	Label* field = new Label();
+	field->setFont(Font("Default", 14, Font::plain));
+	field->setEditable(true);
+	field->setColour(Label::backgroundColourId, Colours::grey);
+	field->setColour(Label::textColourId, Colours::white);
+	field->setBounds(x, y, width, 18);
+	field->addListener(this);
+	addAndMakeVisible(field);
+	return field;
+}
+
+Label* SummitStimSinkEditor::addDebounceField(const String& caption, int x, int y, const String& tooltip)
+{
+	m_debounceCaptions.add(addCaption(caption, x, y));
+	Label* field = addValueField(x + 70, y, 50);
+	field->setTooltip(tooltip);
+	return field;
+}
+
+void SummitStimSinkEditor::refreshControls()
+{
+	m_transportBox->setSelectedId(m_processor->getTransport(), dontSendNotification);
+	m_addressField->setText(m_processor->getAddress(), dontSendNotification);
+	m_hwmField->setText(String(m_processor->getSendHWM()), dontSendNotification);
+	m_bufferField->setText(String(m_processor->getSendBufferSize()), dontSendNotification);
+	m_ioThreadsField->setText(String(m_processor->getIOThreads()), dontSendNotification);
+	m_immediateButton->setToggleState(m_processor->getImmediate(), dontSendNotification);
+	m_conflateButton->setToggleState(m_processor->getConflate(), dontSendNotification);
+	m_formatBox->setSelectedId(m_processor->getCommandFormat(), dontSendNotification);
+	m_groupField->setText(String(m_processor->getStimGroup()), dontSendNotification);
+	m_programField->setText(String(m_processor->getStimProgram()), dontSendNotification);
+	m_publishBox->setSelectedId(m_processor->getPublishMode(), dontSendNotification);
+	m_heartbeatField->setText(String(m_processor->getHeartbeatMs()), dontSendNotification);
+
+	const StimDebouncer::Settings& debounce = m_processor->getDebounceSettings();
+	m_onDwellField->setText(String(debounce.onDwellMs), dontSendNotification);
+	m_offDwellField->setText(String(debounce.offDwellMs), dontSendNotification);
+	m_switchDwellField->setText(String(debounce.switchDwellMs), dontSendNotification);
+	m_minOnField->setText(String(debounce.minOnMs), dontSendNotification);
+	m_minOffField->setText(String(debounce.minOffMs), dontSendNotification);
+	m_refractoryField->setText(String(debounce.refractoryMs), dontSendNotification);
+
+	m_outboxDepthField->setText(String(m_processor->getOutboxDepth()), dontSendNotification);
+	m_blockTimeoutField->setText(String(m_processor->getOutboxBlockTimeoutUs()), dontSendNotification);
+	m_fullPolicyBox->setSelectedId(m_processor->getOutboxFullPolicy(), dontSendNotification);
+
+	m_firstInputField->setText(String(m_processor->getFirstInput() + 1), dontSendNotification);
+	m_nInputsField->setText(String(m_processor->getNumInputs()), dontSendNotification);
+	m_reduceBox->setSelectedId(m_processor->getReduceMode(), dontSendNotification);
+	m_thresholdField->setText(String(m_processor->getReduceThreshold()), dontSendNotification);
+
+	//text commands only carry the class
+	m_groupField->setEnabled(m_formatBox->isEnabled() && m_processor->getCommandFormat() == SummitStimSink::FORMAT_BINARY);
+	m_programField->setEnabled(m_groupField->isEnabled());
+
+	//every block is a heartbeat already
+	m_heartbeatField->setEnabled(m_publishBox->isEnabled() && m_processor->getPublishMode() == SummitStimSink::PUBLISH_ON_CHANGE);
+
+	//only the mean has a threshold
+	m_thresholdField->setEnabled(m_reduceBox->isEnabled() && m_processor->getReduceMode() == StimClassReducer::MODE_MEAN);
+}
+
+void SummitStimSinkEditor::setControlsEnabled(bool enabled)
+{
+	m_transportBox->setEnabled(enabled);
+	m_addressField->setEnabled(enabled);
+	m_hwmField->setEnabled(enabled);
+	m_bufferField->setEnabled(enabled);
+	m_ioThreadsField->setEnabled(enabled);
+	m_immediateButton->setEnabled(enabled);
+	m_conflateButton->setEnabled(enabled);
+	m_formatBox->setEnabled(enabled);
+	m_groupField->setEnabled(enabled && m_processor->getCommandFormat() == SummitStimSink::FORMAT_BINARY);
+	m_programField->setEnabled(m_groupField->isEnabled());
+	m_publishBox->setEnabled(enabled);
+	m_heartbeatField->setEnabled(enabled && m_processor->getPublishMode() == SummitStimSink::PUBLISH_ON_CHANGE);
+	m_onDwellField->setEnabled(enabled);
+	m_offDwellField->setEnabled(enabled);
+	m_switchDwellField->setEnabled(enabled);
+	m_minOnField->setEnabled(enabled);
+	m_minOffField->setEnabled(enabled);
+	m_refractoryField->setEnabled(enabled);
+	m_outboxDepthField->setEnabled(enabled);
+	m_fullPolicyBox->setEnabled(enabled);
+	m_blockTimeoutField->setEnabled(enabled);
+	m_firstInputField->setEnabled(enabled);
+	m_nInputsField->setEnabled(enabled);
+	m_reduceBox->setEnabled(enabled);
+	m_thresholdField->setEnabled(enabled && m_processor->getReduceMode() == StimClassReducer::MODE_MEAN);
+}
 
-/**
-The listener methods that reacts to the button click. The same method is called for all buttons
-on the editor, so the button variable, which cointains a pointer to the button that called the method
-has to be checked to know which function to perform.
-*/
 void SummitStimSinkEditor::buttonEvent(Button* button)
 {
-	if (button == exampleButton)
+	if (button == m_immediateButton)
 	{
-		//Do Stuff
+		m_processor->setImmediate(button->getToggleState());
+	}
+	else if (button == m_conflateButton)
+	{
+		m_processor->setConflate(button->getToggleState());
+	}
+}
 
-		//a typical  example:
-		if (button->getToggleState()) //Button is pressed
+void SummitStimSinkEditor::labelTextChanged(Label* label)
+{
+	if (label == m_addressField)
+	{
+		m_processor->setAddress(label->getText());
+	}
+	else if (label == m_hwmField)
+	{
+		m_processor->setSendHWM(label->getText().getIntValue());
+	}
+	else if (label == m_bufferField)
+	{
+		m_processor->setSendBufferSize(label->getText().getIntValue());
+	}
+	else if (label == m_ioThreadsField)
+	{
+		m_processor->setIOThreads(label->getText().getIntValue());
+	}
+	else if (label == m_groupField)
+	{
+		m_processor->setStimGroup(label->getText().getIntValue());
+	}
+	else if (label == m_programField)
+	{
+		m_processor->setStimProgram(label->getText().getIntValue());
+	}
+	else if (label == m_heartbeatField)
+	{
+		m_processor->setHeartbeatMs(label->getText().getIntValue());
+	}
+	else if (label == m_outboxDepthField)
+	{
+		m_processor->setOutboxDepth(label->getText().getIntValue());
+	}
+	else if (label == m_blockTimeoutField)
+	{
+		m_processor->setOutboxBlockTimeoutUs(label->getText().getIntValue());
+	}
+	else if (label == m_firstInputField)
+	{
+		m_processor->setFirstInput(label->getText().getIntValue() - 1);
+	}
+	else if (label == m_nInputsField)
+	{
+		m_processor->setNumInputs(label->getText().getIntValue());
+	}
+	else if (label == m_thresholdField)
+	{
+		m_processor->setReduceThreshold(label->getText().getFloatValue());
+	}
+	else
+	{
+		StimDebouncer::Settings debounce = m_processor->getDebounceSettings();
+		int milliseconds = label->getText().getIntValue();
+		if (label == m_onDwellField)
+		{
+			debounce.onDwellMs = milliseconds;
+		}
+		else if (label == m_offDwellField)
 		{
-			getProcessor()->setParameter(0, 1);
+			debounce.offDwellMs = milliseconds;
 		}
-		else
+		else if (label == m_switchDwellField)
 		{
-			getProcessor()->setParameter(0, 0);
+			debounce.switchDwellMs = milliseconds;
 		}
+		else if (label == m_minOnField)
+		{
+			debounce.minOnMs = milliseconds;
+		}
+		else if (label == m_minOffField)
+		{
+			debounce.minOffMs = milliseconds;
+		}
+		else if (label == m_refractoryField)
+		{
+			debounce.refractoryMs = milliseconds;
+		}
+		m_processor->setDebounceSettings(debounce);
 	}
 
+	//the processor clamps whatever it was given, show what it actually took
+	refreshControls();
+}
+
+void SummitStimSinkEditor::comboBoxChanged(ComboBox* comboBox)
+{
+	if (comboBox == m_transportBox)
+	{
+		SummitStimSink::Transport transport = (SummitStimSink::Transport)comboBox->getSelectedId();
+		m_processor->setTransport(transport);
+		m_processor->setAddress(SummitStimSink::getDefaultAddress(transport));
+		refreshControls();
+	}
+	else if (comboBox == m_formatBox)
+	{
+		m_processor->setCommandFormat((SummitStimSink::CommandFormat)comboBox->getSelectedId());
+		refreshControls();
+	}
+	else if (comboBox == m_publishBox)
+	{
+		m_processor->setPublishMode((SummitStimSink::PublishMode)comboBox->getSelectedId());
+		refreshControls();
+	}
+	else if (comboBox == m_fullPolicyBox)
+	{
+		m_processor->setOutboxFullPolicy((StimOutbox::FullPolicy)comboBox->getSelectedId());
+		refreshControls();
+	}
+	else if (comboBox == m_reduceBox)
+	{
+		m_processor->setReduceMode((StimClassReducer::Mode)comboBox->getSelectedId());
+		refreshControls();
+	}
+}
+
+void SummitStimSinkEditor::startAcquisition()
+{
+	setControlsEnabled(false);
+}
+
+void SummitStimSinkEditor::stopAcquisition()
+{
+	setControlsEnabled(true);
+}
+
+void SummitStimSinkEditor::updateSettings()
+{
+	refreshControls();
 }
@@ -26,21 +26,28 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <EditorHeaders.h>
 
+class SummitStimSink;
+
 /**
 
-This class serves as a template for creating new editors.
+Connection settings for the Summit Stim Sink: which transport and address
+stim classes are published on, and the ZMQ socket options used for it. Also
+what the stim classes are sent as, and which stim group and program they're
+for, whether they're sent every block or only when they change, how they're
+debounced, and how many can queue up for the sender thread. Also which AUX
+channels the classes are read from and how a block of them is reduced to
+one class.
 
-If this were a real editor, this comment section would be used to
-describe the editor's structure. In this example, the editor will
-have a single button which will set a parameter in the processor.
+Changes are handed straight to the processor, which uses them the next time
+acquisition starts, so the controls are locked while acquiring.
 
 @see GenericEditor
 
 */
 
-class SummitStimSinkEditor : public GenericEditor	//Generic Editor adds listeners for buttons and sliders.
-											//Other possible JUCE controls can be added and listened by inheriting from the appropiate XXX:Listener class
-											//See JUCE documentation to find other available controls.
+class SummitStimSinkEditor : public GenericEditor,
+	public Label::Listener,
+	public ComboBox::Listener
 {
 public:
 	
@@ -50,36 +57,86 @@ public:
 	/** The class destructor, used to deallocate memory */
 	~SummitStimSinkEditor();
 
-	/** 
-	Unlike processors, which have a minimum set of required methods,
-	editor are completely customized. There are still a couple of
-	sometimes useful overloaded methods, which will appear here
-	*/
-
 	/** This method executes whenever a custom button is pressed */
-	void buttonEvent(Button* button);
+	void buttonEvent(Button* button) override;
+
+	/** Called when one of the text fields has been edited */
+	void labelTextChanged(Label* label) override;
+
+	/** Called when a different transport, command format, publish mode, outbox policy or reduction is picked */
+	void comboBoxChanged(ComboBox* comboBox) override;
 
 	/** Called to inform the editor that acquisition is about to start*/
-	//void startAcquisition();
+	void startAcquisition() override;
 
 	/** Called to inform the editor that acquisition has just stopped*/
-	//void stopAcquisition();
+	void stopAcquisition() override;
 
 	/** Called whenever there is a change in the signal chain or it refreshes.
 		It's called after the processors' same named method.
 	*/
-	//void updateSettings();
+	void updateSettings() override;
 
 
 private:
 
-	/**
-	Here would be all the required internal variables.
-	In this case, we have a single button.
-	*/
+	//show what the processor currently has (e.g. after loading settings or rejecting an edit)
+	void refreshControls();
+	void setControlsEnabled(bool enabled);
+	Label* addCaption(const String& text, int x, int y);
+	Label* addValueField(int x, int y, int width);
+	Label* addDebounceField(const String& caption, int x, int y, const String& tooltip);
+
+	SummitStimSink* m_processor;
 
 	//Always use JUCE RAII classes instead of pure pointers.
-	ScopedPointer<Button> exampleButton;
+	ScopedPointer<Label> m_transportCaption;
+	ScopedPointer<ComboBox> m_transportBox;
+	ScopedPointer<Label> m_addressCaption;
+	ScopedPointer<Label> m_addressField;
+	ScopedPointer<Label> m_hwmCaption;
+	ScopedPointer<Label> m_hwmField;
+	ScopedPointer<Label> m_bufferCaption;
+	ScopedPointer<Label> m_bufferField;
+	ScopedPointer<Label> m_ioThreadsCaption;
+	ScopedPointer<Label> m_ioThreadsField;
+	ScopedPointer<UtilityButton> m_immediateButton;
+	ScopedPointer<UtilityButton> m_conflateButton;
+	ScopedPointer<Label> m_formatCaption;
+	ScopedPointer<ComboBox> m_formatBox;
+	ScopedPointer<Label> m_groupCaption;
+	ScopedPointer<Label> m_groupField;
+	ScopedPointer<Label> m_programCaption;
+	ScopedPointer<Label> m_programField;
+	ScopedPointer<Label> m_publishCaption;
+	ScopedPointer<ComboBox> m_publishBox;
+	ScopedPointer<Label> m_heartbeatCaption;
+	ScopedPointer<Label> m_heartbeatField;
+
+	//debounce durations in ms, with their captions
+	OwnedArray<Label> m_debounceCaptions;
+	ScopedPointer<Label> m_onDwellField;
+	ScopedPointer<Label> m_offDwellField;
+	ScopedPointer<Label> m_switchDwellField;
+	ScopedPointer<Label> m_minOnField;
+	ScopedPointer<Label> m_minOffField;
+	ScopedPointer<Label> m_refractoryField;
+
+	ScopedPointer<Label> m_outboxDepthCaption;
+	ScopedPointer<Label> m_outboxDepthField;
+	ScopedPointer<Label> m_blockTimeoutCaption;
+	ScopedPointer<Label> m_blockTimeoutField;
+	ScopedPointer<Label> m_fullPolicyCaption;
+	ScopedPointer<ComboBox> m_fullPolicyBox;
+
+	ScopedPointer<Label> m_firstInputCaption;
+	ScopedPointer<Label> m_firstInputField;
+	ScopedPointer<Label> m_nInputsCaption;
+	ScopedPointer<Label> m_nInputsField;
+	ScopedPointer<Label> m_reduceCaption;
+	ScopedPointer<ComboBox> m_reduceBox;
+	ScopedPointer<Label> m_thresholdCaption;
+	ScopedPointer<Label> m_thresholdField;
 
 	JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SummitStimSinkEditor);
 };
@@ -24,9 +24,15 @@ namespace Summit_Interface
         private int[] m_stimClass; //vector indicating what stim protocol the decoder said to use (putting this in the this buffer right now for testing and saving purposes)
         private int m_nextStimClass; //because stim events are comining in async, one might come in when the buffer is empty, in which case I will just add it to the next timepoint that gets added to the buffer (and indicate the delay by adding 100)
         private ReaderWriterLockSlim RWLock; //lock for thread-safety
-
-        //constructor
-        public INSBuffer(int nChans, int bufferSize)
+        private AutoResetEvent m_dataAdded; //signaled whenever new data is added, so a thread can wait on new data instead of polling
+        private long m_totalSamples; //number of time points ever added, i.e. the sequence number the next time point will get
+        private int m_historySize; //size of the history ring (0 if there isn't one)
+        private double[,] m_historyData; //copy of the last m_historySize time points, indexed by sequence number, flushing doesn't touch it
+        private double[] m_historyPacketNums;
+        private double[] m_historyTimestamps;
+
+        //constructor, historySize is how many time points to keep around for getDataByteArraySince() (0 if not needed)
+        public INSBuffer(int nChans, int bufferSize, int historySize = 0)
         {
             m_nChans = nChans;
             m_bufferSize = bufferSize;
@@ -40,6 +46,12 @@ namespace Summit_Interface
             m_isFull = false;
             m_isEmpty = true;
             RWLock = new ReaderWriterLockSlim(LockRecursionPolicy.SupportsRecursion);
+            m_dataAdded = new AutoResetEvent(false);
+            m_totalSamples = 0;
+            m_historySize = historySize;
+            m_historyData = new double[m_nChans, m_historySize];
+            m_historyPacketNums = new double[m_historySize];
+            m_historyTimestamps = new double[m_historySize];
         }
 
         //see if buffer is empty
@@ -66,6 +78,12 @@ namespace Summit_Interface
             return m_bufferSize;
         }
 
+        //history size accessor
+        public int getHistorySize()
+        {
+            return m_historySize;
+        }
+
         //Get how many samples are currently in the buffer
         public int getNumBufferSamples()
         {
@@ -109,6 +127,13 @@ namespace Summit_Interface
         }
 
 
+        //block until data has been added to the buffer (since the last wait), or until the timeout. Returns true if data was added
+        public bool waitForData(int timeoutMilliseconds)
+        {
+            return m_dataAdded.WaitOne(timeoutMilliseconds);
+        }
+
+
         //set the stim class at the current time point
         public void setStim(int stimClass)
         {
@@ -192,6 +217,19 @@ namespace Summit_Interface
 
                 //add dropped packet indicator
                 m_isDropped[m_currentBufferInd] = isDroppedPacket;
+
+                //add to history
+                if (m_historySize > 0)
+                {
+                    int historyInd = (int)(m_totalSamples % m_historySize);
+                    for (int iChan = 0; iChan < m_nChans; iChan++)
+                    {
+                        m_historyData[iChan, historyInd] = data[iChan, iSample];
+                    }
+                    m_historyPacketNums[historyInd] = CTMNum;
+                    m_historyTimestamps[historyInd] = timestamp;
+                }
+                m_totalSamples++;
             }
 
             if (!manualLock)
@@ -199,6 +237,9 @@ namespace Summit_Interface
                 RWLock.ExitWriteLock(); //Critical section stop----------
             }
 
+            //let anyone waiting know there's new data
+            m_dataAdded.Set();
+
             return success;
         }
 
@@ -435,6 +476,320 @@ namespace Summit_Interface
         }
 
 
+        //serialize buffer data into the compact "TD v2" byte array (all little endian)
+        //
+        //Serialization is:
+        //
+        //  header (TDV2_HEADER_BYTES long, older readers can skip anything past the fields they know by using headerBytes):
+        //      uint8 format version (2)
+        //      uint8 flags (bit 0 set if the channel data is int16 instead of float32, bit 1 set if it's delta bit-packed, bit 2 set if
+        //          the run SystemTicks follow the runs)
+        //      uint16 headerBytes
+        //      uint16 number of channels
+        //      uint16 number of packet number runs
+        //      int32 number of buffer time points that are in this ZMQ packet
+        //      int32 CTM packet number of time point 1
+        //      uint32 SystemTick of time point 1 (in 100 us)
+        //      float32 scale of the int16 data (value = int16 * scale), unused for float32 data
+        //      uint64 sequence number of time point 1 (count of all time points ever added to the buffer before it)
+        //
+        //  channel planes, all time points of channel 1, then all of channel 2, etc.
+        //      float32 or int16 data of channel 1 at time points 1 to n
+        //      .
+        //      .
+        //      .
+        //      float32 or int16 data of channel m_nChans at time points 1 to n
+        //
+        //  or, if delta bit-packed, for each channel:
+        //      int32 first value (the int16 sample or the float32 bit pattern)
+        //      then for every TDV2_DELTA_BLOCK_SIZE time points after that:
+        //          uint8 bit width w
+        //          TDV2_DELTA_BLOCK_SIZE zig-zagged deltas from the previous value packed into w bits each (padded with zeros)
+        //
+        //  packet number runs (consecutive time points from the same CTM packet)
+        //      int32 CTM packet number of the run
+        //      int32 number of time points in the run
+        //      .
+        //      .
+        //      .
+        //
+        //  run SystemTicks (one per run, in the same order), so the reader can put every time point on the INS clock. The INS stamps
+        //  a CTM packet with the SystemTick of its last time point, a run can be missing the end of its packet when the packet is split
+        //  between two messages:
+        //      uint16 SystemTick of the run's CTM packet (in 100 us, wraps every 6.5536 s)
+        //      uint16 number of time points of the same CTM packet that come after the run (0 if the run ends the packet)
+        //      .
+        //      .
+        //      .
+        public const int TDV2_HEADER_BYTES = 32;
+        public const byte TDV2_FLAG_INT16 = 0x01;
+        public const byte TDV2_FLAG_DELTA_PACKED = 0x02;
+        public const byte TDV2_FLAG_RUN_TICKS = 0x04;
+        public const int TDV2_DELTA_BLOCK_SIZE = 32;
+
+        public byte[] getDataByteArrayV2(bool flush, bool int16Samples, bool deltaPacked = false)
+        {
+            RWLock.EnterReadLock(); //Critical section start---------
+
+            int nSamples = getNumBufferSamples();
+            int readInd = m_isFull ? (m_currentBufferInd + 1) % m_bufferSize : 0; //if buffer is full, start ind is 1 point in front of current ind
+            long firstSequence = m_totalSamples - nSamples;
+
+            float[] planes;
+            List<int> runPacketNums, runLengths;
+            List<ushort> runTicks, runSamplesAfter;
+            float maxAbs;
+            int firstPacketNum;
+            uint firstSystemTick;
+            gatherV2(m_bufferData, m_CTMPacketNums, m_CTMTimestamps, m_bufferSize, readInd, nSamples, 0,
+                out planes, out runPacketNums, out runLengths, out runTicks, out runSamplesAfter, out maxAbs, out firstPacketNum, out firstSystemTick);
+
+            RWLock.ExitReadLock(); //Critical section stop----------
+
+            //flush the buffer
+            if (flush)
+            {
+                FlushBuffer(); //has crtical section
+            }
+
+            return encodeV2(planes, nSamples, runPacketNums, runLengths, runTicks, runSamplesAfter, maxAbs, firstPacketNum, firstSystemTick,
+                firstSequence, int16Samples, deltaPacked);
+        }
+
+
+        //serialize data from the history (which flushing doesn't touch) into a "TD v2" byte array, starting at the sample with sequence
+        //number cursor and sending at most maxSamples. If the cursor is older than the history the reply starts at the oldest sample we
+        //still have, if it's newer than anything we've had (e.g. we were restarted) it starts at the oldest sample too. The reader can tell
+        //which happened from the first sequence number in the header
+        public byte[] getDataByteArraySince(long cursor, int maxSamples, bool int16Samples, bool deltaPacked = false)
+        {
+            RWLock.EnterReadLock(); //Critical section start---------
+
+            long oldestSequence = Math.Max(0, m_totalSamples - m_historySize);
+            long firstSequence = (cursor < oldestSequence || cursor > m_totalSamples) ? oldestSequence : cursor;
+            int nSamples = (int)Math.Min(m_totalSamples - firstSequence, maxSamples);
+
+            float[] planes;
+            List<int> runPacketNums, runLengths;
+            List<ushort> runTicks, runSamplesAfter;
+            float maxAbs;
+            int firstPacketNum;
+            uint firstSystemTick;
+            gatherV2(m_historyData, m_historyPacketNums, m_historyTimestamps, m_historySize, (int)(firstSequence % Math.Max(m_historySize, 1)), nSamples,
+                (int)(m_totalSamples - firstSequence - nSamples), out planes, out runPacketNums, out runLengths, out runTicks, out runSamplesAfter,
+                out maxAbs, out firstPacketNum, out firstSystemTick);
+
+            RWLock.ExitReadLock(); //Critical section stop----------
+
+            return encodeV2(planes, nSamples, runPacketNums, runLengths, runTicks, runSamplesAfter, maxAbs, firstPacketNum, firstSystemTick,
+                firstSequence, int16Samples, deltaPacked);
+        }
+
+
+        //pull nSamples time points out of a ring (starting at readInd) into channel planes and count the packet number runs, call with the read lock held.
+        //nSamplesAfter is how many valid time points the ring has after the gathered ones, so a packet cut off at the end can be spotted
+        private void gatherV2(double[,] data, double[] packetNums, double[] timestamps, int ringSize, int readInd, int nSamples, int nSamplesAfter,
+            out float[] planes, out List<int> runPacketNums, out List<int> runLengths, out List<ushort> runTicks, out List<ushort> runSamplesAfter,
+            out float maxAbs, out int firstPacketNum, out uint firstSystemTick)
+        {
+            planes = new float[m_nChans * nSamples];
+            runPacketNums = new List<int>();
+            runLengths = new List<int>();
+            runTicks = new List<ushort>();
+            runSamplesAfter = new List<ushort>();
+            maxAbs = 0;
+            firstPacketNum = nSamples > 0 ? (int)packetNums[readInd] : 0;
+            firstSystemTick = nSamples > 0 ? (uint)timestamps[readInd] : 0;
+
+            for (int iSample = 0; iSample < nSamples; iSample++)
+            {
+                for (int iChan = 0; iChan < m_nChans; iChan++)
+                {
+                    float value = (float)data[iChan, readInd];
+                    planes[iChan * nSamples + iSample] = value;
+                    maxAbs = Math.Max(maxAbs, Math.Abs(value));
+                }
+
+                int packetNum = (int)packetNums[readInd];
+                if (runPacketNums.Count > 0 && runPacketNums[runPacketNums.Count - 1] == packetNum)
+                {
+                    runLengths[runLengths.Count - 1]++;
+                }
+                else
+                {
+                    runPacketNums.Add(packetNum);
+                    runLengths.Add(1);
+                    runTicks.Add((ushort)((long)Math.Round(timestamps[readInd]) & 0xFFFF)); //interpolated packets can have fractional ticks
+                    runSamplesAfter.Add(0);
+                }
+
+                readInd = (readInd + 1) % ringSize;
+            }
+
+            //only the last run can have the rest of its packet still in the ring
+            if (runPacketNums.Count > 0)
+            {
+                int lastPacketNum = runPacketNums[runPacketNums.Count - 1];
+                int nAfter = 0;
+                while (nAfter < nSamplesAfter && nAfter < ushort.MaxValue && (int)packetNums[readInd] == lastPacketNum)
+                {
+                    nAfter++;
+                    readInd = (readInd + 1) % ringSize;
+                }
+                runSamplesAfter[runSamplesAfter.Count - 1] = (ushort)nAfter;
+            }
+        }
+
+
+        //build the "TD v2" byte array from gathered planes and runs
+        private byte[] encodeV2(float[] planes, int nSamples, List<int> runPacketNums, List<int> runLengths, List<ushort> runTicks,
+            List<ushort> runSamplesAfter, float maxAbs, int firstPacketNum, uint firstSystemTick, long firstSequence, bool int16Samples, bool deltaPacked)
+        {
+            byte[] byteArray;
+
+            //int16 data is scaled so the largest value in this message uses the full range
+            float int16Scale = maxAbs > 0 ? maxAbs / short.MaxValue : 1;
+
+            //channel planes
+            byte[] planeBytes;
+            if (int16Samples)
+            {
+                short[] scaled = new short[planes.Length];
+                for (int i = 0; i < planes.Length; i++)
+                {
+                    scaled[i] = (short)Math.Round(planes[i] / int16Scale);
+                }
+
+                if (deltaPacked)
+                {
+                    int[] values = new int[scaled.Length];
+                    for (int i = 0; i < scaled.Length; i++)
+                    {
+                        values[i] = scaled[i];
+                    }
+                    planeBytes = deltaPackPlanes(values, nSamples);
+                }
+                else
+                {
+                    planeBytes = new byte[scaled.Length * sizeof(short)];
+                    Buffer.BlockCopy(scaled, 0, planeBytes, 0, planeBytes.Length);
+                }
+            }
+            else
+            {
+                if (deltaPacked)
+                {
+                    //delta the float bit patterns, which stays lossless
+                    int[] values = new int[planes.Length];
+                    Buffer.BlockCopy(planes, 0, values, 0, planes.Length * sizeof(float));
+                    planeBytes = deltaPackPlanes(values, nSamples);
+                }
+                else
+                {
+                    planeBytes = new byte[planes.Length * sizeof(float)];
+                    Buffer.BlockCopy(planes, 0, planeBytes, 0, planeBytes.Length);
+                }
+            }
+
+            int runsOffset = TDV2_HEADER_BYTES + planeBytes.Length;
+            int ticksOffset = runsOffset + runPacketNums.Count * 2 * sizeof(int);
+            byteArray = new byte[ticksOffset + runPacketNums.Count * 2 * sizeof(ushort)];
+
+            //header
+            byte flags = TDV2_FLAG_RUN_TICKS;
+            if (int16Samples)
+            {
+                flags |= TDV2_FLAG_INT16;
+            }
+            if (deltaPacked)
+            {
+                flags |= TDV2_FLAG_DELTA_PACKED;
+            }
+            byteArray[0] = 2;
+            byteArray[1] = flags;
+            Buffer.BlockCopy(BitConverter.GetBytes((ushort)TDV2_HEADER_BYTES), 0, byteArray, 2, 2);
+            Buffer.BlockCopy(BitConverter.GetBytes((ushort)m_nChans), 0, byteArray, 4, 2);
+            Buffer.BlockCopy(BitConverter.GetBytes((ushort)runPacketNums.Count), 0, byteArray, 6, 2);
+            Buffer.BlockCopy(BitConverter.GetBytes(nSamples), 0, byteArray, 8, 4);
+            Buffer.BlockCopy(BitConverter.GetBytes(firstPacketNum), 0, byteArray, 12, 4);
+            Buffer.BlockCopy(BitConverter.GetBytes(firstSystemTick), 0, byteArray, 16, 4);
+            Buffer.BlockCopy(BitConverter.GetBytes(int16Samples ? int16Scale : 0), 0, byteArray, 20, 4);
+            Buffer.BlockCopy(BitConverter.GetBytes(firstSequence), 0, byteArray, 24, 8);
+            Buffer.BlockCopy(planeBytes, 0, byteArray, TDV2_HEADER_BYTES, planeBytes.Length);
+
+            //packet number runs
+            for (int iRun = 0; iRun < runPacketNums.Count; iRun++)
+            {
+                Buffer.BlockCopy(BitConverter.GetBytes(runPacketNums[iRun]), 0, byteArray, runsOffset + iRun * 8, 4);
+                Buffer.BlockCopy(BitConverter.GetBytes(runLengths[iRun]), 0, byteArray, runsOffset + iRun * 8 + 4, 4);
+            }
+
+            //run SystemTicks
+            for (int iRun = 0; iRun < runPacketNums.Count; iRun++)
+            {
+                Buffer.BlockCopy(BitConverter.GetBytes(runTicks[iRun]), 0, byteArray, ticksOffset + iRun * 4, 2);
+                Buffer.BlockCopy(BitConverter.GetBytes(runSamplesAfter[iRun]), 0, byteArray, ticksOffset + iRun * 4 + 2, 2);
+            }
+
+            return byteArray;
+        }
+
+
+        //delta bit-pack each channel's plane of nSamples values (see getDataByteArrayV2 for the layout)
+        private byte[] deltaPackPlanes(int[] values, int nSamples)
+        {
+            List<byte> packed = new List<byte>();
+            uint[] zigzags = new uint[TDV2_DELTA_BLOCK_SIZE];
+
+            for (int iChan = 0; iChan < m_nChans && nSamples > 0; iChan++)
+            {
+                int planeStart = iChan * nSamples;
+                packed.AddRange(BitConverter.GetBytes(values[planeStart]));
+
+                for (int iBlock = 1; iBlock < nSamples; iBlock += TDV2_DELTA_BLOCK_SIZE)
+                {
+                    //zig-zag the deltas so small negative ones are small too, and find how many bits they need
+                    uint maxZigzag = 0;
+                    for (int i = 0; i < TDV2_DELTA_BLOCK_SIZE; i++)
+                    {
+                        int iSample = iBlock + i;
+                        zigzags[i] = 0;
+                        if (iSample < nSamples)
+                        {
+                            int delta = unchecked(values[planeStart + iSample] - values[planeStart + iSample - 1]);
+                            zigzags[i] = unchecked((uint)((delta << 1) ^ (delta >> 31)));
+                            maxZigzag |= zigzags[i];
+                        }
+                    }
+
+                    int width = 0;
+                    while (width < 32 && (maxZigzag >> width) != 0)
+                    {
+                        width++;
+                    }
+                    packed.Add((byte)width);
+
+                    //pack them LSB first
+                    ulong bitBuffer = 0;
+                    int bitCount = 0;
+                    for (int i = 0; i < TDV2_DELTA_BLOCK_SIZE; i++)
+                    {
+                        bitBuffer |= (ulong)zigzags[i] << bitCount;
+                        bitCount += width;
+                        while (bitCount >= 8)
+                        {
+                            packed.Add((byte)bitBuffer);
+                            bitBuffer >>= 8;
+                            bitCount -= 8;
+                        }
+                    }
+                }
+            }
+
+            return packed.ToArray();
+        }
+
+
         //helper function for concatenating byte arrays
         public byte[] Concatenate(byte[] first, byte[] second)
         {
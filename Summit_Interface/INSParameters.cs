@@ -58,10 +58,11 @@ namespace Summit_Interface
                 m_parameters = (JObject)JToken.ReadFrom(new JsonTextReader(reader));
             }
 
-            //list of all the field names (v0.3)
+            //list of all the field names (v0.4)
             // v0.1 initial def
             // v0.2 added stim config button to read all group and program pairs
             // v0.3 added option to hide console and option for software testing only (no device so won't try connecting)
+            // v0.4 added Open-Ephys streaming options
 
             //                      Field Name                          Value type          Parent                      grandParent  has Children?  Array?  sepcific values         [lowerbound upperbound] relative array size         absolute array size
             m_allFields = new parameterField[]{
@@ -100,6 +101,16 @@ namespace Summit_Interface
                 new parameterField("StreamSizeBins",                    typeof(long),       "FFT",                      "Sense",            false,  false,  null,                   null,                   null,                       null),
                 new parameterField("StreamOffsetBins",                  typeof(long),       "FFT",                      "Sense",            false,  false,  null,                   null,                   null,                       null),
 
+                new parameterField("OpenEphysStream",                   null,               "Sense",                    null,               true,   false,  null,                   null,                   null,                       null),
+                new parameterField("Mode",                              typeof(string),     "OpenEphysStream",          "Sense",            false,  false,  "streamModes",          null,                   null,                       null),
+                new parameterField("Format",                            typeof(string),     "OpenEphysStream",          "Sense",            false,  false,  "streamFormats",        null,                   null,                       null),
+                new parameterField("SampleEncoding",                    typeof(string),     "OpenEphysStream",          "Sense",            false,  false,  "sampleEncodings",      null,                   null,                       null),
+                new parameterField("Compression",                       typeof(string),     "OpenEphysStream",          "Sense",            false,  false,  "streamCompressions",   null,                   null,                       null),
+                new parameterField("GapFill",                           typeof(string),     "OpenEphysStream",          "Sense",            false,  false,  "gapFillModes",         null,                   null,                       null),
+                new parameterField("StreamFFT",                         typeof(bool),       "OpenEphysStream",          "Sense",            false,  false,  null,                   null,                   null,                       null),
+                new parameterField("StreamPower",                       typeof(bool),       "OpenEphysStream",          "Sense",            false,  false,  null,                   null,                   null,                       null),
+                new parameterField("StreamAccel",                       typeof(bool),       "OpenEphysStream",          "Sense",            false,  false,  null,                   null,                   null,                       null),
+
                 new parameterField("BandPower",                         null,               "Sense",                    null,               true,   false,  null,                   null,                   null,                       null),
                 new parameterField("FirstBandEnabled",                  typeof(bool),       "BandPower",                "Sense",            false,  true,   null,                   null,                   "Sense.nChans",             null),
                 new parameterField("SecondBandEnabled",                 typeof(bool),       "BandPower",                "Sense",            false,  true,   null,                   null,                   "Sense.nChans",             null),
@@ -122,6 +133,11 @@ namespace Summit_Interface
             m_fieldSpecificValues.Add("senseChannels", new specificValuesGeneric<long>(new List<long>() {       0, 1, 2, 3 }));
             m_fieldSpecificValues.Add("FFTSizes", new specificValuesGeneric<long>(new List<long>() {            64, 256, 1024 }));
             m_fieldSpecificValues.Add("windowLoads", new specificValuesGeneric<long>(new List<long>() {         25, 50, 100 }));
+            m_fieldSpecificValues.Add("streamModes", new specificValuesGeneric<string>(new List<string>(){      "Poll", "Push" }));
+            m_fieldSpecificValues.Add("streamFormats", new specificValuesGeneric<string>(new List<string>(){    "v1", "v2" }));
+            m_fieldSpecificValues.Add("sampleEncodings", new specificValuesGeneric<string>(new List<string>(){  "Float32", "Int16" }));
+            m_fieldSpecificValues.Add("streamCompressions", new specificValuesGeneric<string>(new List<string>(){ "None", "DeltaBitPack" }));
+            m_fieldSpecificValues.Add("gapFillModes", new specificValuesGeneric<string>(new List<string>(){       "SIP", "OpenEphys" }));
             m_fieldSpecificValues.Add("rampingTypes", new specificValuesGeneric<string>(new List<string>(){     "None", "UpEnabled", "DownEnabled", "RepeatRampUp" }));
 
             //now do checking of all the loaded JSON fields to make sure everything is conforming to the JSON structure definition defined by m_allFields and m_fieldSpecificValues
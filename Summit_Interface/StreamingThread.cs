@@ -34,6 +34,7 @@ namespace Summit_Interface
         public INSBuffer TDbuffer { get; set; } //thread-safe buffer holding time-domain data
         public INSBuffer FFTBuffer { get; set; } //thread-safe buffer holding FFT data
         public INSBuffer PWBuffer { get; set; } //thread-safe buffer holding power band data
+        public INSBuffer ACBuffer { get; set; } //thread-safe buffer holding accelerometer data
         public INSBuffer savingBuffer { get; set; } //thread-safe buffer holding data that will be saved to disk
         public SummitSystemWrapper summitWrapper { get; set; } //summit object for making API calls (put in a wrapper to make it nullable)
         public SummitManager summitManager { get; set; } //summit manager object for reconnecting to the INS
@@ -86,6 +87,10 @@ namespace Summit_Interface
         private Thread m_thread; //thread object
         private bool m_stopped { get; set; } //for stopping the thread
         public ThreadType m_type; //thread function
+        private bool m_sendTDV2; //whether to send TD data to Open-Ephys in the compact v2 format
+        private bool m_sendTDInt16; //whether v2 channel data is sent as int16 instead of float32
+        private bool m_sendTDDeltaPacked; //whether v2 channel data is delta bit-packed
+        private const int PUSH_WAIT_MS = 50; //in push mode, how long to wait for new data (or for a push to go through) before checking for requests
 
         //constructor
         public StreamingThread(ThreadType threadtype)
@@ -136,21 +141,49 @@ namespace Summit_Interface
             //display on console?
             bool dispPackets = resources.parameters.GetParam("NotifyOpenEphysPacketsReceived", typeof(bool));
 
+            //TD wire format that was agreed on with Open-Ephys during the handshake
+            m_sendTDV2 = resources.parameters.GetParam("Sense.OpenEphysStream.Format", typeof(string)) == "v2";
+            m_sendTDInt16 = resources.parameters.GetParam("Sense.OpenEphysStream.SampleEncoding", typeof(string)) == "Int16";
+            m_sendTDDeltaPacked = resources.parameters.GetParam("Sense.OpenEphysStream.Compression", typeof(string)) == "DeltaBitPack";
+
+            //in push mode, don't wait for requests, just send packets as they come in (still answer requests so Open-Ephys can re-do the handshake)
+            bool pushMode = resources.parameters.GetParam("Sense.OpenEphysStream.Mode", typeof(string)) == "Push";
+            int zmqPort = resources.parameters.GetParam("Sense.ZMQPort", typeof(int));
+
             using (ResponseSocket senseSocket = new ResponseSocket())
+            using (PushSocket pushSocket = pushMode ? new PushSocket() : null)
             {
-                senseSocket.Bind("tcp://localhost:5555");
+                //don't hold on to unsent messages when closing, Open-Ephys might be gone
+                senseSocket.Options.Linger = TimeSpan.Zero;
+                senseSocket.Bind("tcp://localhost:" + zmqPort);
+
+                if (pushMode)
+                {
+                    pushSocket.Options.Linger = TimeSpan.Zero;
+                    pushSocket.Bind("tcp://localhost:" + (zmqPort + 1));
+                }
 
                 //Wait for data request from Open-Ephys
-                string gotMessage;
+                byte[] gotMessage;
                 byte[] sendMessage;
 
                 while (true)
                 {
                     if (m_stopped == true) { Thread.Sleep(500); break; }
 
-                    //listening for messages is blocking for 1000 ms, after which it will check if it should exit thread, and if not, listen again (have this so that this thread isn't infinitely blocking when trying to join)
-                    senseSocket.TryReceiveFrameString(TimeSpan.FromMilliseconds(1000), out gotMessage);
-                    if (gotMessage == null)//not actual message received, just the timeout being hit
+                    TimeSpan requestTimeout = TimeSpan.FromMilliseconds(1000);
+                    if (pushMode)
+                    {
+                        //waiting for data is blocking for a bit, then we check for requests without waiting
+                        if (resources.TDbuffer.waitForData(PUSH_WAIT_MS) && !resources.TDbuffer.isEmpty())
+                        {
+                            pushTD(resources, pushSocket, dispPackets);
+                        }
+                        requestTimeout = TimeSpan.Zero;
+                    }
+
+                    //listening for messages is blocking for 1000 ms (in poll mode), after which it will check if it should exit thread, and if not, listen again (have this so that this thread isn't infinitely blocking when trying to join)
+                    if (!senseSocket.TryReceiveFrameBytes(requestTimeout, out gotMessage))//not actual message received, just the timeout being hit
                     {
                         continue;
                     }
@@ -165,24 +198,220 @@ namespace Summit_Interface
                         Console.WriteLine("OpenEphys Packet requested, time Event Called:" + DateTime.Now.Ticks.ToString());
                     }
 
-                    switch (gotMessage)
+                    //requests are a 2 character command (or "InitTD" or "FFT"), "TD" can also be followed by the int64 sequence number of the next time point Open-Ephys wants
+                    string command = Encoding.ASCII.GetString(gotMessage);
+                    if (command != "InitTD" && command != "FFT")
                     {
+                        command = Encoding.ASCII.GetString(gotMessage, 0, Math.Min(gotMessage.Length, 2));
+                    }
+
+                    switch (command)
+                    {
+                        case "InitTD":
+                            //Open-Ephys reconnecting (e.g. it was restarted, or lost us for a bit), same handshake as at startup
+                            senseSocket.SendFrame(getHandshakeMessage(resources.parameters, resources.TDbuffer));
+                            Console.WriteLine("Connection with Open-Ephys re-established");
+                            break;
                         case "TD":
                             //requested time domain data
-                            sendMessage = resources.TDbuffer.getDataByteArray(true);
+                            if (gotMessage.Length >= 2 + sizeof(long) && m_sendTDV2)
+                            {
+                                //from a cursor, served from the history without flushing so a lost reply can just be asked for again
+                                long cursor = BitConverter.ToInt64(gotMessage, 2);
+                                sendMessage = resources.TDbuffer.getDataByteArraySince(cursor, resources.TDbuffer.getBufferSize(), m_sendTDInt16, m_sendTDDeltaPacked);
+                            }
+                            else
+                            {
+                                sendMessage = getTDMessage(resources);
+                            }
                             senseSocket.SendFrame(sendMessage, false);
                             break;
+                        case "FFT":
+                            //requested one of the other sense streams, always v2 (float32) and flushed, empty if it isn't being streamed
+                            senseSocket.SendFrame(getSideStreamMessage(resources.FFTBuffer, resources.parameters, "StreamFFT"), false);
+                            break;
+                        case "PW":
+                            senseSocket.SendFrame(getSideStreamMessage(resources.PWBuffer, resources.parameters, "StreamPower"), false);
+                            break;
+                        case "AC":
+                            senseSocket.SendFrame(getSideStreamMessage(resources.ACBuffer, resources.parameters, "StreamAccel"), false);
+                            break;
                         case "FB":
                             //Told us to flush the buffer
                             resources.TDbuffer.FlushBuffer();
                             sendMessage = new byte[0];
                             senseSocket.SendFrame(sendMessage);
                             break;
+                        default:
+                            //have to answer every request or the socket gets stuck
+                            Console.WriteLine("Unknown request from Open-Ephys: " + command);
+                            senseSocket.SendFrame(new byte[0]);
+                            break;
                     }
                 }
             }
         }
 
+        //Push everything in the TD buffer to Open-Ephys (push mode)
+        private void pushTD(ThreadResources resources, PushSocket pushSocket, bool dispPackets)
+        {
+            byte[] sendMessage = getTDMessage(resources);
+
+            //log time sent to timing file
+            string timestamp = DateTime.Now.Ticks.ToString();
+            resources.timingLogFile.WriteLine("1 " + timestamp);
+
+            //don't block for long if Open-Ephys isn't connected, we still need to answer requests
+            if (!pushSocket.TrySendFrame(TimeSpan.FromMilliseconds(PUSH_WAIT_MS), sendMessage))
+            {
+                Console.WriteLine("Unable to push TD packet to Open-Ephys, dropping it");
+                return;
+            }
+
+            //announce that an openEphys packet was sent
+            if (dispPackets)
+            {
+                Console.WriteLine("OpenEphys Packet pushed, time Event Called:" + DateTime.Now.Ticks.ToString());
+            }
+        }
+
+        //Reply to Open-Ephys' "InitTD" handshake
+        //
+        //Message structure on handshake:
+        //
+        //int number of channels
+        //int buffer size
+        //int stream mode (0 for Open-Ephys polling with "TD" requests, 1 for us pushing each CTM packet)
+        //int port we push TD packets on (only used in push mode)
+        //int TD wire format version (1 for every value as a double, 2 for the compact format)
+        //int TD compression (0 for none, 1 for delta bit-packed v2 channel data)
+        //int whether we answer "TD since sequence N" requests (1), Open-Ephys only uses them with the v2 format and polling
+        //int sampling rate (Hz)
+        //int packet period (ms)
+        //int number of bytes of channel labels that follow
+        //ASCII channel labels, one per channel separated by '\n'
+        //int who fills in dropped packets (0 for us, see Sense.InterpolateMissingPackets, 1 for Open-Ephys)
+        //int number of other sense streams Open-Ephys can ask for, then for each one:
+        //    int stream type (1 for FFT, 2 for band power, 3 for accelerometer, asked for with "FFT", "PW" and "AC")
+        //    int number of channels (FFT bins, bands or axes)
+        //    float sampling rate (Hz)
+        //
+        public static byte[] getHandshakeMessage(INSParameters parameters, INSBuffer TDBuffer)
+        {
+            int zmqPort = parameters.GetParam("Sense.ZMQPort", typeof(int));
+            string streamMode = parameters.GetParam("Sense.OpenEphysStream.Mode", typeof(string));
+            int tdFormat = parameters.GetParam("Sense.OpenEphysStream.Format", typeof(string)) == "v2" ? 2 : 1;
+            int tdCompression = tdFormat == 2 && parameters.GetParam("Sense.OpenEphysStream.Compression", typeof(string)) == "DeltaBitPack" ? 1 : 0;
+            int gapFill = parameters.GetParam("Sense.OpenEphysStream.GapFill", typeof(string)) == "OpenEphys" ? 1 : 0;
+
+            byte[] outMessage = BitConverter.GetBytes(TDBuffer.getNumChans());
+            outMessage = TDBuffer.Concatenate(outMessage, BitConverter.GetBytes(TDBuffer.getBufferSize()));
+            outMessage = TDBuffer.Concatenate(outMessage, BitConverter.GetBytes(streamMode == "Push" ? 1 : 0));
+            outMessage = TDBuffer.Concatenate(outMessage, BitConverter.GetBytes(zmqPort + 1));
+            outMessage = TDBuffer.Concatenate(outMessage, BitConverter.GetBytes(tdFormat));
+            outMessage = TDBuffer.Concatenate(outMessage, BitConverter.GetBytes(tdCompression));
+            outMessage = TDBuffer.Concatenate(outMessage, BitConverter.GetBytes(1));
+
+            //what Open-Ephys builds its channels from
+            byte[] labels = Encoding.ASCII.GetBytes(String.Join("\n", getChannelLabels(parameters)));
+            outMessage = TDBuffer.Concatenate(outMessage, BitConverter.GetBytes((int)parameters.GetParam("Sense.SamplingRate", typeof(int))));
+            outMessage = TDBuffer.Concatenate(outMessage, BitConverter.GetBytes((int)parameters.GetParam("Sense.PacketPeriod", typeof(int))));
+            outMessage = TDBuffer.Concatenate(outMessage, BitConverter.GetBytes(labels.Length));
+            outMessage = TDBuffer.Concatenate(outMessage, labels);
+            outMessage = TDBuffer.Concatenate(outMessage, BitConverter.GetBytes(gapFill));
+
+            //FFT and band power come once per FFT interval, the accelerometer is always set to 32 Hz (see SummitProgram)
+            float fftRate = 1000f / Math.Max((int)parameters.GetParam("Sense.FFT.FFTInterval", typeof(int)), 1);
+            List<byte[]> sideStreams = new List<byte[]>();
+            if (parameters.GetParam("Sense.OpenEphysStream.StreamFFT", typeof(bool)))
+            {
+                sideStreams.Add(getSideStreamLayout(1, getNumFFTBins(parameters), fftRate));
+            }
+            if (parameters.GetParam("Sense.OpenEphysStream.StreamPower", typeof(bool)))
+            {
+                sideStreams.Add(getSideStreamLayout(2, (int)parameters.GetParam("Sense.nChans", typeof(int)) * 2, fftRate));
+            }
+            if (parameters.GetParam("Sense.OpenEphysStream.StreamAccel", typeof(bool)))
+            {
+                sideStreams.Add(getSideStreamLayout(3, 3, 32));
+            }
+            outMessage = TDBuffer.Concatenate(outMessage, BitConverter.GetBytes(sideStreams.Count));
+            foreach (byte[] layout in sideStreams)
+            {
+                outMessage = TDBuffer.Concatenate(outMessage, layout);
+            }
+            return outMessage;
+        }
+
+        private static byte[] getSideStreamLayout(int type, int nChans, float samplingRate)
+        {
+            return BitConverter.GetBytes(type).Concat(BitConverter.GetBytes(nChans)).Concat(BitConverter.GetBytes(samplingRate)).ToArray();
+        }
+
+        //Number of FFT bins the INS streams, all of the (one-sided) spectrum if Sense.FFT.StreamSizeBins is 0
+        public static int getNumFFTBins(INSParameters parameters)
+        {
+            int binSize = parameters.GetParam("Sense.FFT.StreamSizeBins", typeof(int));
+            return binSize > 0 ? binSize : (int)parameters.GetParam("Sense.FFT.FFTSize", typeof(int)) / 2;
+        }
+
+        //Serialize (and flush) one of the other sense streams, if it's being streamed
+        private static byte[] getSideStreamMessage(INSBuffer buffer, INSParameters parameters, string streamParam)
+        {
+            if (!parameters.GetParam("Sense.OpenEphysStream." + streamParam, typeof(bool)))
+            {
+                return new byte[0];
+            }
+            return buffer.getDataByteArrayV2(true, false);
+        }
+
+        //Names of the TD channels in the order they're streamed, after their anode-cathode pair. The INS puts the channels
+        //on the first bore (electrodes 0-7) before the ones on the second (8-15), see SummitUtils.ConfigureTimeDomain()
+        private static List<string> getChannelLabels(INSParameters parameters)
+        {
+            var allAnodes = parameters.GetParam("Sense.Anode", typeof(int));
+            var allCathodes = parameters.GetParam("Sense.Cathode", typeof(int));
+
+            List<string> bore1Labels = new List<string>();
+            List<string> bore2Labels = new List<string>();
+            for (int iChan = 0; iChan < allAnodes.Count; iChan++)
+            {
+                int anode = allAnodes[iChan];
+                int cathode = allCathodes[iChan];
+                string label = electrodeName(anode) + "-" + electrodeName(cathode);
+
+                //a floating anode goes on the cathode's bore
+                int boreElectrode = anode == 16 ? cathode : anode;
+                if (boreElectrode <= 7)
+                {
+                    bore1Labels.Add(label);
+                }
+                else
+                {
+                    bore2Labels.Add(label);
+                }
+            }
+
+            bore1Labels.AddRange(bore2Labels);
+            return bore1Labels;
+        }
+
+        private static string electrodeName(int electrode)
+        {
+            return electrode == 16 ? "Case" : "E" + electrode;
+        }
+
+        //Serialize (and flush) the TD buffer in the format Open-Ephys is expecting
+        private byte[] getTDMessage(ThreadResources resources)
+        {
+            if (m_sendTDV2)
+            {
+                return resources.TDbuffer.getDataByteArrayV2(true, m_sendTDInt16, m_sendTDDeltaPacked);
+            }
+
+            return resources.TDbuffer.getDataByteArray(true);
+        }
+
         //Code for the the thread saving data to disk
         private void SaveData(object input)
         {
@@ -40,7 +40,9 @@ namespace Summit_Interface
         static INSBuffer m_TDBuffer; //time domain voltages
         static INSBuffer m_FFTBuffer; //Frequency domain
         static INSBuffer m_BPBuffer; //Band power
+        static INSBuffer m_ACBuffer; //Accelerometer
         static INSBuffer m_dataSavingBuffer; //saving to file buffer
+        const int TD_HISTORY_BUFFERS = 4; //how many buffers worth of TD data to keep for resending to Open-Ephys
 
         //Summit API object
         static SummitSystem m_summit;
@@ -53,6 +55,8 @@ namespace Summit_Interface
         static bool notifyCTM;
         static bool notifyOpenEphys;
         static bool interp;
+        static bool gapFillInOpenEphys;
+        static int m_nFFTBins = 0;
         //initialization variables for packet handling threads
         static int m_nTDChans = 0;
         static int m_TDPacketCount = 0;
@@ -163,9 +167,11 @@ namespace Summit_Interface
                 // set up buffers
                 int numSenseChans = parameters.GetParam("Sense.nChans", typeof(int));
                 int bufferSize = parameters.GetParam("Sense.BufferSize", typeof(int)); // Make sure this is not larger than the AudioSampleBuffer buffer that Open-Ephys uses! (1024 last time I checked)
-                m_TDBuffer = new INSBuffer(numSenseChans, bufferSize);
-                m_FFTBuffer = new INSBuffer(1, bufferSize);
+                m_TDBuffer = new INSBuffer(numSenseChans, bufferSize, TD_HISTORY_BUFFERS * bufferSize); //keep some history so Open-Ephys can re-request data it didn't get
+                m_nFFTBins = StreamingThread.getNumFFTBins(parameters);
+                m_FFTBuffer = new INSBuffer(m_nFFTBins, bufferSize);
                 m_BPBuffer = new INSBuffer(numSenseChans * 2, bufferSize);
+                m_ACBuffer = new INSBuffer(3, bufferSize);
                 m_dataSavingBuffer = new INSBuffer(numSenseChans, bufferSize);
                 m_summitWrapper = new SummitSystemWrapper();
 
@@ -180,6 +186,9 @@ namespace Summit_Interface
 
                 ThreadResources sharedResources = new ThreadResources();
                 sharedResources.TDbuffer = m_TDBuffer;
+                sharedResources.FFTBuffer = m_FFTBuffer;
+                sharedResources.PWBuffer = m_BPBuffer;
+                sharedResources.ACBuffer = m_ACBuffer;
                 sharedResources.savingBuffer = m_dataSavingBuffer;
                 sharedResources.summitWrapper = m_summitWrapper;
                 sharedResources.summitManager = theSummitManager;
@@ -392,6 +401,7 @@ namespace Summit_Interface
 
                     notifyCTM = parameters.GetParam("NotifyCTMPacketsReceived", typeof(bool));
                     interp = parameters.GetParam("Sense.InterpolateMissingPackets", typeof(bool));
+                    gapFillInOpenEphys = parameters.GetParam("Sense.OpenEphysStream.GapFill", typeof(string)) == "OpenEphys";
 
                     ////Initialize closed-loop threads===============================================
 
@@ -408,11 +418,7 @@ namespace Summit_Interface
                         Console.WriteLine();
                         //first, perform hand-shake
 
-                        //Message structure on handshake:
-                        //
-                        //int number of channels
-                        //int buffer size
-                        //
+                        //(see StreamingThread.getHandshakeMessage() for the message structure)
                         Console.WriteLine("Attempting to connect to Open-Ephys...");
 
                         int zmqPort = parameters.GetParam("Sense.ZMQPort", typeof(int));
@@ -426,8 +432,7 @@ namespace Summit_Interface
 
                             if (inMessage == "InitTD")
                             {
-                                outMessage = BitConverter.GetBytes(m_TDBuffer.getNumChans());
-                                outMessage = m_TDBuffer.Concatenate(outMessage, BitConverter.GetBytes(m_TDBuffer.getBufferSize()));
+                                outMessage = StreamingThread.getHandshakeMessage(parameters, m_TDBuffer);
                                 senseSocket.SendFrame(outMessage);
                                 Console.WriteLine("Connection with Open-Ephys Established");
                             }
@@ -457,10 +462,18 @@ namespace Summit_Interface
 
                     //finally register the listeners to start getting data from the INS
                     m_summit.DataReceivedTDHandler += SummitTimeDomainPacketReceived;
-                    //TODO: Add frequency domain streams
-                    //theSummit.dataReceivedPower += theSummit_DataReceived_Power;
-                    //theSummit.dataReceivedFFT += theSummit_DataReceived_FFT;
-                    //theSummit.dataReceivedAccel += theSummit_DataReceived_Accel;
+                    if (streamToOpenEphys && parameters.GetParam("Sense.OpenEphysStream.StreamFFT", typeof(bool)))
+                    {
+                        m_summit.DataReceivedFFTHandler += theSummit_DataReceived_FFT;
+                    }
+                    if (streamToOpenEphys && parameters.GetParam("Sense.OpenEphysStream.StreamPower", typeof(bool)))
+                    {
+                        m_summit.DataReceivedPowerHandler += theSummit_DataReceived_Power;
+                    }
+                    if (streamToOpenEphys && parameters.GetParam("Sense.OpenEphysStream.StreamAccel", typeof(bool)))
+                    {
+                        m_summit.DataReceivedAccelHandler += theSummit_DataReceived_Accel;
+                    }
                     m_summit.UnexpectedLinkStatusHandler += SummitLinkStatusReceived;
 
                 }
@@ -609,55 +622,63 @@ namespace Summit_Interface
 
             // check if we dropped a packet
             int nDroppedPackets;
-            if (!SummitUtils.CheckDroppedPackets(TdSenseEvent.Header.DataTypeSequence, m_prevPacketNum, out nDroppedPackets))
+            bool inOrder = SummitUtils.CheckDroppedPackets(TdSenseEvent.Header.DataTypeSequence, m_prevPacketNum, out nDroppedPackets);
+            if (!inOrder && !gapFillInOpenEphys)
             {
                 return;
             }
 
-            //update packet numbers, times, samples
-            SummitUtils.InterpolationParameters interpParams;
+            //when Open-Ephys fills in dropped packets itself it also puts late ones back in order, so those get passed on
+            //as they are (without touching the previous packet state). It needs the packets with their gaps, so we don't
+            //interpolate here then
 
-            interpParams.prevPacketNum = m_prevPacketNum;
-            m_prevPacketNum = TdSenseEvent.Header.DataTypeSequence;
-
-            //long packetTime = TdSenseEvent.GenerationTimeEstimate.Ticks; //ticks in 100 ns
-            ushort packetTime = TdSenseEvent.Header.SystemTick; //ticks in 100 us
-            interpParams.prevPacketTime = m_prevPacketTime;
-            m_prevPacketTime = packetTime;
-
-            interpParams.prevPacketNSamples = m_prevPacketNSamples;
-            m_prevPacketNSamples = nSamples;
-
-            //estimate number of times SystemTick looped (since it's an uint16, 65535 max value, so can loop if more than 6.5 s)
-            //get estimate timestamp of current packet
-            long packetEstTime = TdSenseEvent.GenerationTimeEstimate.Ticks; //ticks in 100 ns
-            //save difference between current and previous packet
-            interpParams.prevPacketEstTimeDiff = packetEstTime - m_prevPacketEstTime;
-            //one loop is 65536 values
-            int nloops = (int)Math.Floor((double)(packetEstTime - m_prevPacketEstTime) / 65536000);
-            m_prevPacketEstTime = packetEstTime;
-
-            //number of loops should never be negative
-            if (nloops < 0)
+            if (inOrder)
             {
-                Console.WriteLine("Previous packet INS time estimate is greater than current!");
-                nloops = 0;
-            }
+                //update packet numbers, times, samples
+                SummitUtils.InterpolationParameters interpParams;
+
+                interpParams.prevPacketNum = m_prevPacketNum;
+                m_prevPacketNum = TdSenseEvent.Header.DataTypeSequence;
+
+                //long packetTime = TdSenseEvent.GenerationTimeEstimate.Ticks; //ticks in 100 ns
+                ushort packetTime = TdSenseEvent.Header.SystemTick; //ticks in 100 us
+                interpParams.prevPacketTime = m_prevPacketTime;
+                m_prevPacketTime = packetTime;
+
+                interpParams.prevPacketNSamples = m_prevPacketNSamples;
+                m_prevPacketNSamples = nSamples;
+
+                //estimate number of times SystemTick looped (since it's an uint16, 65535 max value, so can loop if more than 6.5 s)
+                //get estimate timestamp of current packet
+                long packetEstTime = TdSenseEvent.GenerationTimeEstimate.Ticks; //ticks in 100 ns
+                //save difference between current and previous packet
+                interpParams.prevPacketEstTimeDiff = packetEstTime - m_prevPacketEstTime;
+                //one loop is 65536 values
+                int nloops = (int)Math.Floor((double)(packetEstTime - m_prevPacketEstTime) / 65536000);
+                m_prevPacketEstTime = packetEstTime;
+
+                //number of loops should never be negative
+                if (nloops < 0)
+                {
+                    Console.WriteLine("Previous packet INS time estimate is greater than current!");
+                    nloops = 0;
+                }
 
-            //now do the interpolation
-            if (!m_firstPacket && nDroppedPackets != 0 && interp)
-            {
-                interpParams.nChans = m_nTDChans;
-                interpParams.timestampDiff = packetTime - interpParams.prevPacketTime;
-                interpParams.secondsToTimeStamp = 10000; //since using SystemTick which is in 100us
-                interpParams.nDroppedPackets = nDroppedPackets;
-                interpParams.samplingRate = m_samplingRate;
-                interpParams.prevValues = m_prevLastValues;
-
-                SummitUtils.InterpolateDroppedSamples(m_TDBuffer, m_dataSavingBuffer, TdSenseEvent, interpParams);
-            }
+                //now do the interpolation
+                if (!m_firstPacket && nDroppedPackets != 0 && interp && !gapFillInOpenEphys)
+                {
+                    interpParams.nChans = m_nTDChans;
+                    interpParams.timestampDiff = packetTime - interpParams.prevPacketTime;
+                    interpParams.secondsToTimeStamp = 10000; //since using SystemTick which is in 100us
+                    interpParams.nDroppedPackets = nDroppedPackets;
+                    interpParams.samplingRate = m_samplingRate;
+                    interpParams.prevValues = m_prevLastValues;
+
+                    SummitUtils.InterpolateDroppedSamples(m_TDBuffer, m_dataSavingBuffer, TdSenseEvent, interpParams);
+                }
 
-            m_firstPacket = false;
+                m_firstPacket = false;
+            }
 
             //get data from packet and add to buffers
             double[,] chanData = new double[m_nTDChans, nSamples];
@@ -692,36 +713,67 @@ namespace Summit_Interface
         }
 
 
+        //The INS's own FFT, band power and accelerometer streams only go to Open-Ephys (as their own sub-processors, see
+        //StreamingThread.getHandshakeMessage()), they aren't saved to the data file. They're passed on as they come, with the
+        //same packet number and SystemTick stamping as TD, Open-Ephys puts them on their own sample clocks
+
         private static void theSummit_DataReceived_FFT(object sender, SensingEventFFT e)
         {
-            // Log the received packet out to file
-            //theSummit.LogCustomJSON("FFT Received", e.theFftPacket.Header.GlobalSequence.ToString());
-
             // Annouce to console that packet was received by handler
-            Console.WriteLine("FFT Packet Received, Global SeqNum:" + e.Header.GlobalSequence.ToString()
-                + "; Time Generated:" + e.GenerationTimeEstimate.Ticks.ToString() + "; Time Event Called:" + DateTime.Now.Ticks.ToString());
+            if (notifyCTM)
+            {
+                Console.WriteLine("FFT Packet Received, Global SeqNum:" + e.Header.GlobalSequence.ToString()
+                    + "; Time Generated:" + e.Header.SystemTick.ToString() + "; Time Event Called:" + DateTime.Now.Ticks.ToString());
+            }
+
+            //one time point per packet, the bins are the channels (zeros if the INS sent fewer than configured)
+            double[,] binData = new double[m_nFFTBins, 1];
+            for (int iBin = 0; iBin < Math.Min(m_nFFTBins, e.FftOutput.Count); iBin++)
+            {
+                binData[iBin, 0] = e.FftOutput[iBin];
+            }
+            m_FFTBuffer.addData(binData, e.Header.DataTypeSequence, (double)e.Header.SystemTick, 0);
         }
 
 
         private static void theSummit_DataReceived_Power(object sender, SensingEventPower e)
         {
-            // Log the received packet out to file
-            //theSummit.LogCustomJSON("Power Received", e.thePowerPacket.Header.GlobalSequence.ToString());
-
             // Annouce to console that packet was received by handler
-            Console.WriteLine("Power Packet Received, Global SeqNum:" + e.Header.GlobalSequence.ToString()
-                + "; Time Generated:" + e.GenerationTimeEstimate.Ticks.ToString() + "; Time Event Called:" + DateTime.Now.Ticks.ToString());
+            if (notifyCTM)
+            {
+                Console.WriteLine("Power Packet Received, Global SeqNum:" + e.Header.GlobalSequence.ToString()
+                    + "; Time Generated:" + e.Header.SystemTick.ToString() + "; Time Event Called:" + DateTime.Now.Ticks.ToString());
+            }
+
+            //one time point per packet, both bands of each sense channel in turn
+            int nBands = m_BPBuffer.getNumChans();
+            double[,] bandData = new double[nBands, 1];
+            for (int iBand = 0; iBand < Math.Min(nBands, e.Bands.Count); iBand++)
+            {
+                bandData[iBand, 0] = e.Bands[iBand];
+            }
+            m_BPBuffer.addData(bandData, e.Header.DataTypeSequence, (double)e.Header.SystemTick, 0);
         }
 
 
         private static void theSummit_DataReceived_Accel(object sender, SensingEventAccel e)
         {
-            // Log the received packet out to file
-            //theSummit.LogCustomJSON("Accel Received", e.theAccelPacket.Header.GlobalSequence.ToString());
-
             // Annouce to console that packet was received by handler
-            Console.WriteLine("AccelPacket Received, Global SeqNum:" + e.Header.GlobalSequence.ToString()
-                + "; Time Generated:" + e.GenerationTimeEstimate.Ticks.ToString() + "; Time Event Called:" + DateTime.Now.Ticks.ToString());
+            if (notifyCTM)
+            {
+                Console.WriteLine("AccelPacket Received, Global SeqNum:" + e.Header.GlobalSequence.ToString()
+                    + "; Time Generated:" + e.Header.SystemTick.ToString() + "; Time Event Called:" + DateTime.Now.Ticks.ToString());
+            }
+
+            int nSamples = Math.Min(e.XSamples.Count, Math.Min(e.YSamples.Count, e.ZSamples.Count));
+            double[,] accelData = new double[3, nSamples];
+            for (int iSample = 0; iSample < nSamples; iSample++)
+            {
+                accelData[0, iSample] = e.XSamples[iSample];
+                accelData[1, iSample] = e.YSamples[iSample];
+                accelData[2, iSample] = e.ZSamples[iSample];
+            }
+            m_ACBuffer.addData(accelData, e.Header.DataTypeSequence, (double)e.Header.SystemTick, 0);
         }
 
 